@@ -0,0 +1,266 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Compares the CPU cost of reading V4L2 capture buffers with the memory types supported by
+// the external camera HAL (see <V4l2Memory> in external_camera_config.xml):
+//   mmap:    driver buffers mmap'ed/munmap'ed for every frame
+//   userptr: HAL allocated buffers, mapped once
+//   dmabuf:  driver buffers exported with VIDIOC_EXPBUF, mapped once
+// Streams are set up, dequeued and returned by ExternalCameraDeviceSession itself, so the
+// numbers cover the HAL's V4L2Frame mapping and DMABUF cache syncs.
+//
+// Usage: camera.device@3.4-external-capture-benchmark [-d /dev/videoN] [-w width]
+//        [-h height] [-f fourcc] [-n frames] [-b buffers] [-m mmap,userptr,dmabuf]
+
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <linux/videodev2.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "ExternalCameraDeviceSession.h"
+
+namespace {
+
+using ::android::Mutex;
+using ::android::sp;
+using ::android::base::unique_fd;
+using ::android::hardware::camera::common::V1_0::helper::CameraMetadata;
+using ::android::hardware::camera::device::V3_4::implementation::CroppingType;
+using ::android::hardware::camera::device::V3_4::implementation::ExternalCameraDeviceSession;
+using ::android::hardware::camera::device::V3_4::implementation::SupportedV4L2Format;
+using ::android::hardware::camera::device::V3_4::implementation::V4L2Frame;
+using ::android::hardware::camera::external::common::ExternalCameraConfig;
+using ::android::hardware::camera::external::common::V4L2MemoryType;
+
+constexpr double kStreamingFps = 30.0;
+
+struct Options {
+    std::string device = "/dev/video0";
+    uint32_t width = 1280;
+    uint32_t height = 720;
+    uint32_t fourcc = V4L2_PIX_FMT_MJPEG;
+    uint32_t numFrames = 300;
+    uint32_t numBuffers = 4;
+    std::vector<V4L2MemoryType> memoryTypes = {V4L2MemoryType::MMAP, V4L2MemoryType::USERPTR,
+                                               V4L2MemoryType::DMABUF};
+};
+
+struct Result {
+    uint32_t frames = 0;
+    uint64_t bytes = 0;
+    int64_t cpuNs = 0; // dequeue + map + read + unmap + enqueue, excluding waits for the device
+    int64_t wallNs = 0;
+};
+
+const char* memoryTypeName(V4L2MemoryType type) {
+    switch (type) {
+        case V4L2MemoryType::MMAP:
+            return "mmap";
+        case V4L2MemoryType::USERPTR:
+            return "userptr";
+        case V4L2MemoryType::DMABUF:
+            return "dmabuf";
+    }
+    return "unknown";
+}
+
+int64_t nowNs(clockid_t clock) {
+    timespec ts;
+    clock_gettime(clock, &ts);
+    return static_cast<int64_t>(ts.tv_sec) * 1000000000LL + ts.tv_nsec;
+}
+
+// Reads every byte of the frame, as a decoder or format converter would
+uint64_t consume(const uint8_t* data, size_t size) {
+    uint64_t sum = 0;
+    size_t words = size / sizeof(uint64_t);
+    const uint64_t* p = reinterpret_cast<const uint64_t*>(data);
+    for (size_t i = 0; i < words; i++) {
+        sum += p[i];
+    }
+    for (size_t i = words * sizeof(uint64_t); i < size; i++) {
+        sum += data[i];
+    }
+    return sum;
+}
+
+// Exposes the V4L2 streaming paths of the HAL session without a camera framework client
+class BenchmarkSession : public ExternalCameraDeviceSession {
+  public:
+    BenchmarkSession(const ExternalCameraConfig& cfg, const SupportedV4L2Format& fmt,
+                     unique_fd v4l2Fd)
+        : ExternalCameraDeviceSession(nullptr, cfg, {fmt}, CroppingType::VERTICAL,
+                                      CameraMetadata(), "benchmark", std::move(v4l2Fd)) {}
+
+    ~BenchmarkSession() override { close(); }
+
+    int startStreaming(const SupportedV4L2Format& fmt) {
+        Mutex::Autolock _l(mLock);
+        return configureV4l2StreamLocked(fmt, kStreamingFps);
+    }
+
+    sp<V4L2Frame> dequeueFrame() {
+        Mutex::Autolock _l(mLock);
+        nsecs_t shutterTs;
+        return dequeueV4l2FrameLocked(&shutterTs);
+    }
+
+    void enqueueFrame(const sp<V4L2Frame>& frame) { enqueueV4l2Frame(frame); }
+};
+
+bool run(const Options& opts, V4L2MemoryType type, Result* result) {
+    unique_fd fd(TEMP_FAILURE_RETRY(open(opts.device.c_str(), O_RDWR)));
+    if (fd.get() < 0) {
+        fprintf(stderr, "open %s failed: %s\n", opts.device.c_str(), strerror(errno));
+        return false;
+    }
+
+    ExternalCameraConfig cfg = ExternalCameraConfig::loadFromCfg();
+    cfg.v4l2MemoryType = type;
+    cfg.numVideoBuffers = opts.numBuffers;
+    cfg.numStillBuffers = opts.numBuffers;
+    SupportedV4L2Format fmt{};
+    fmt.width = opts.width;
+    fmt.height = opts.height;
+    fmt.fourcc = opts.fourcc;
+
+    sp<BenchmarkSession> session = new BenchmarkSession(cfg, fmt, std::move(fd));
+    int ret = session->startStreaming(fmt);
+    if (ret != 0) {
+        fprintf(stderr, "%s: configuring V4L2 stream failed: %s\n", memoryTypeName(type),
+                strerror(-ret));
+        return false;
+    }
+
+    uint64_t checksum = 0;
+    int64_t startNs = nowNs(CLOCK_MONOTONIC);
+    int64_t startCpuNs = nowNs(CLOCK_THREAD_CPUTIME_ID);
+    for (uint32_t n = 0; n < opts.numFrames; n++) {
+        sp<V4L2Frame> frame = session->dequeueFrame();
+        if (frame == nullptr) {
+            fprintf(stderr, "%s: dequeuing frame %u failed\n", memoryTypeName(type), n);
+            return false;
+        }
+
+        uint8_t* data;
+        size_t dataSize;
+        if (frame->getData(&data, &dataSize) != 0) {
+            fprintf(stderr, "%s: mapping frame %u failed\n", memoryTypeName(type), n);
+            session->enqueueFrame(frame);
+            return false;
+        }
+        checksum += consume(data, dataSize);
+        session->enqueueFrame(frame);
+        result->bytes += dataSize;
+        result->frames++;
+    }
+    result->cpuNs = nowNs(CLOCK_THREAD_CPUTIME_ID) - startCpuNs;
+    result->wallNs = nowNs(CLOCK_MONOTONIC) - startNs;
+
+    // Keep the reads from being optimized out
+    fprintf(stderr, "%s checksum %" PRIx64 "\n", memoryTypeName(type), checksum);
+    return true;
+}
+
+bool parseMemoryTypes(const char* arg, std::vector<V4L2MemoryType>* out) {
+    out->clear();
+    std::stringstream ss(arg);
+    std::string name;
+    while (std::getline(ss, name, ',')) {
+        if (name == "mmap") {
+            out->push_back(V4L2MemoryType::MMAP);
+        } else if (name == "userptr") {
+            out->push_back(V4L2MemoryType::USERPTR);
+        } else if (name == "dmabuf") {
+            out->push_back(V4L2MemoryType::DMABUF);
+        } else {
+            fprintf(stderr, "unknown memory type %s\n", name.c_str());
+            return false;
+        }
+    }
+    return !out->empty();
+}
+
+}  // anonymous namespace
+
+int main(int argc, char** argv) {
+    Options opts;
+    int opt;
+    while ((opt = getopt(argc, argv, "d:w:h:f:n:b:m:")) != -1) {
+        switch (opt) {
+            case 'd':
+                opts.device = optarg;
+                break;
+            case 'w':
+                opts.width = atoi(optarg);
+                break;
+            case 'h':
+                opts.height = atoi(optarg);
+                break;
+            case 'f':
+                if (strlen(optarg) != 4) {
+                    fprintf(stderr, "fourcc must be 4 characters\n");
+                    return 1;
+                }
+                opts.fourcc = v4l2_fourcc(optarg[0], optarg[1], optarg[2], optarg[3]);
+                break;
+            case 'n':
+                opts.numFrames = atoi(optarg);
+                break;
+            case 'b':
+                opts.numBuffers = atoi(optarg);
+                break;
+            case 'm':
+                if (!parseMemoryTypes(optarg, &opts.memoryTypes)) {
+                    return 1;
+                }
+                break;
+            default:
+                fprintf(stderr,
+                        "Usage: %s [-d /dev/videoN] [-w width] [-h height] [-f fourcc]"
+                        " [-n frames] [-b buffers] [-m mmap,userptr,dmabuf]\n",
+                        argv[0]);
+                return 1;
+        }
+    }
+
+    printf("%-8s %8s %12s %14s %14s %10s\n", "memory", "frames", "bytes/frame", "cpu us/frame",
+           "cpu MB/s", "fps");
+    bool ok = true;
+    for (V4L2MemoryType type : opts.memoryTypes) {
+        Result result;
+        if (!run(opts, type, &result) || result.frames == 0) {
+            printf("%-8s failed\n", memoryTypeName(type));
+            ok = false;
+            continue;
+        }
+        double cpuUs = result.cpuNs / 1000.0 / result.frames;
+        double mbPerSec = result.cpuNs == 0 ? 0.0 : result.bytes * 1000.0 / result.cpuNs;
+        double fps = result.wallNs == 0 ? 0.0 : result.frames * 1e9 / result.wallNs;
+        printf("%-8s %8u %12" PRIu64 " %14.1f %14.1f %10.1f\n", memoryTypeName(type),
+               result.frames, result.bytes / result.frames, cpuUs, mbPerSec, fps);
+    }
+    return ok ? 0 : 1;
+}
@@ -24,8 +24,12 @@
 #include "android-base/macros.h"
 #include <utils/Timers.h>
 #include <utils/Trace.h>
+#include <fcntl.h>
+#include <linux/dma-buf.h>
 #include <linux/videodev2.h>
 #include <sync/sync.h>
+#include <sys/mman.h>
+#include <thread>
 
 #define HAVE_JPEG // required for libyuv.h to export MJPEG decode APIs
 #include <libyuv.h>
@@ -55,6 +59,9 @@ constexpr int IOCTL_RETRY_SLEEP_US = 33000; // 33ms * MAX_RETRY = 0.5 seconds
 static constexpr int kDumpLockRetries = 50;
 static constexpr int kDumpLockSleep = 60000;
 
+const char* kPipelineStageNames[] = {"queue", "decode", "convert", "deliver", "jpeg",
+        "shot-to-shot"};
+
 bool tryLock(Mutex& mutex)
 {
     bool locked = false;
@@ -146,6 +153,8 @@ bool ExternalCameraDeviceSession::initialize() {
         return true;
     }
     mOutputThread->setExifMakeModel(mExifMake, mExifModel);
+    mOutputThread->setDecodePipeline(mCfg.numDecodeThreads, mCfg.numPipelineFrames);
+    mOutputThread->setJpegEncodeStrips(mCfg.numJpegEncodeStrips);
 
     status_t status = initDefaultRequests();
     if (status != OK) {
@@ -286,6 +295,15 @@ void ExternalCameraDeviceSession::dumpState(const native_handle_t* handle) {
                 v4L2BufferCount, numDequeuedV4l2Buffers);
     }
 
+    {
+        std::lock_guard<std::mutex> lk(mV4l2BufferLock);
+        static const char* kMemoryTypeNames[] = {"mmap", "userptr", "dmabuf"};
+        dprintf(fd, "V4L2 memory %s, %" PRIu64 " frames dequeued, %" PRIu64 " bytes/frame\n",
+                kMemoryTypeNames[static_cast<int>(mCfg.v4l2MemoryType)],
+                mNumV4l2FramesDequeued,
+                mNumV4l2FramesDequeued == 0 ? 0 : mV4l2BytesDequeued / mNumV4l2FramesDequeued);
+    }
+
     dprintf(fd, "In-flight frames (not sorted):");
     for (const auto& frameNumber : inflightFrames) {
         dprintf(fd, "%d, ", frameNumber);
@@ -923,7 +941,9 @@ ExternalCameraDeviceSession::OutputThread::OutputThread(
         const common::V1_0::helper::CameraMetadata& chars) :
         mParent(parent), mCroppingType(ct), mCameraCharacteristics(chars) {}
 
-ExternalCameraDeviceSession::OutputThread::~OutputThread() {}
+ExternalCameraDeviceSession::OutputThread::~OutputThread() {
+    stopDecodeThreads();
+}
 
 void ExternalCameraDeviceSession::OutputThread::setExifMakeModel(
         const std::string& make, const std::string& model) {
@@ -931,6 +951,284 @@ void ExternalCameraDeviceSession::OutputThread::setExifMakeModel(
     mExifModel = model;
 }
 
+void ExternalCameraDeviceSession::OutputThread::setJpegEncodeStrips(uint32_t numStrips) {
+    mJpegEncoder.setNumStrips(numStrips);
+}
+
+void ExternalCameraDeviceSession::OutputThread::setDecodePipeline(
+        uint32_t numDecodeThreads, uint32_t numPipelineFrames) {
+    if (!mDecodeThreads.empty()) {
+        ALOGE("%s: decode pipeline already started", __FUNCTION__);
+        return;
+    }
+
+    if (numDecodeThreads != 0 && numPipelineFrames == 0) {
+        ALOGW("%s: %u decode threads without pipeline frames, disable decode pipeline",
+                __FUNCTION__, numDecodeThreads);
+        numDecodeThreads = 0;
+    }
+
+    mNumDecodeThreads = numDecodeThreads;
+    mNumPipelineFrames = numPipelineFrames;
+    for (uint32_t i = 0; i < mNumDecodeThreads; i++) {
+        sp<DecodeThread> thread = new DecodeThread(this);
+        std::string name = "ExtCamDec" + std::to_string(i);
+        thread->run(name.c_str(), PRIORITY_DISPLAY);
+        mDecodeThreads.push_back(thread);
+    }
+    ALOGV("%s: %u decode threads, %u pipeline frames", __FUNCTION__,
+            mNumDecodeThreads, mNumPipelineFrames);
+}
+
+void ExternalCameraDeviceSession::OutputThread::stopDecodeThreads() {
+    {
+        std::lock_guard<std::mutex> lk(mPipelineLock);
+        mDecodeExiting = true;
+    }
+    mDecodeCond.notify_all();
+    mDecodeDoneCond.notify_all();
+    for (auto& thread : mDecodeThreads) {
+        thread->requestExit();
+        thread->join();
+    }
+    mDecodeThreads.clear();
+}
+
+bool ExternalCameraDeviceSession::OutputThread::DecodeThread::threadLoop() {
+    return mParent->decodeOnce();
+}
+
+bool ExternalCameraDeviceSession::OutputThread::decodeOnce() {
+    std::shared_ptr<DecodeSlot> slot;
+    std::unique_lock<std::mutex> lk(mPipelineLock);
+    while (slot == nullptr) {
+        if (mDecodeExiting) {
+            return false;
+        }
+        // Decode the oldest pending request first so the output thread is never starved
+        if (!mFreeFrames.empty()) {
+            for (const auto& s : mDecodeSlots) {
+                if (s->state == DecodeSlot::PENDING) {
+                    slot = s;
+                    break;
+                }
+            }
+        }
+        if (slot == nullptr) {
+            mDecodeCond.wait(lk);
+        }
+    }
+    slot->state = DecodeSlot::DECODING;
+    slot->frame = mFreeFrames.back();
+    mFreeFrames.pop_back();
+    lk.unlock();
+
+    nsecs_t startTs = systemTime(SYSTEM_TIME_MONOTONIC);
+    uint8_t* inData;
+    size_t inDataSize;
+    int res = slot->req->frameIn->getData(&inData, &inDataSize);
+    if (res != 0) {
+        ALOGE("%s: V4L2 buffer map failed", __FUNCTION__);
+    } else {
+        res = slot->frame->getLayout(&slot->layout);
+    }
+    if (res == 0) {
+        ATRACE_BEGIN("MJPGtoI420");
+        res = libyuv::MJPGToI420(
+                inData, inDataSize, static_cast<uint8_t*>(slot->layout.y),
+                slot->layout.yStride, static_cast<uint8_t*>(slot->layout.cb),
+                slot->layout.cStride, static_cast<uint8_t*>(slot->layout.cr),
+                slot->layout.cStride, slot->frame->mWidth, slot->frame->mHeight,
+                slot->frame->mWidth, slot->frame->mHeight);
+        ATRACE_END();
+    }
+    recordStageLatency(kStageDecode, systemTime(SYSTEM_TIME_MONOTONIC) - startTs);
+
+    lk.lock();
+    slot->result = res;
+    slot->state = DecodeSlot::DONE;
+    if (slot->cancelled) {
+        releaseFrameLocked(slot->frame);
+        slot->frame.clear();
+    }
+    lk.unlock();
+    mDecodeDoneCond.notify_all();
+    mDecodeCond.notify_all();
+    return true;
+}
+
+void ExternalCameraDeviceSession::OutputThread::queueDecodeSlot(
+        const std::shared_ptr<HalRequest>& req) {
+    auto slot = std::make_shared<DecodeSlot>();
+    slot->req = req;
+    slot->submitTs = systemTime(SYSTEM_TIME_MONOTONIC);
+    {
+        std::lock_guard<std::mutex> lk(mPipelineLock);
+        mDecodeSlots.push_back(slot);
+    }
+    mDecodeCond.notify_one();
+}
+
+std::shared_ptr<ExternalCameraDeviceSession::OutputThread::DecodeSlot>
+ExternalCameraDeviceSession::OutputThread::waitForDecodedSlot(
+        const std::shared_ptr<HalRequest>& req) {
+    std::unique_lock<std::mutex> lk(mPipelineLock);
+    auto it = mDecodeSlots.begin();
+    while (it != mDecodeSlots.end() && (*it)->req != req) {
+        it++;
+    }
+    if (it == mDecodeSlots.end()) {
+        // The slot was cancelled by a flush racing with submitRequest
+        return nullptr;
+    }
+    recordStageLatencyLocked(kStageQueue, systemTime(SYSTEM_TIME_MONOTONIC) - (*it)->submitTs);
+
+    // Slots ahead of req belong to requests that were already returned with an error
+    std::vector<std::shared_ptr<DecodeSlot>> staleDecodes;
+    while (mDecodeSlots.front()->req != req) {
+        auto stale = mDecodeSlots.front();
+        mDecodeSlots.pop_front();
+        stale->cancelled = true;
+        if (stale->state != DecodeSlot::DECODING) {
+            releaseFrameLocked(stale->frame);
+            stale->frame.clear();
+        } else {
+            staleDecodes.push_back(stale);
+        }
+    }
+    // Their V4L2 buffers may be re-queued as soon as this returns, so wait for the decodes
+    // still reading them to finish, as in cancelPendingDecodes
+    mDecodeDoneCond.wait(lk, [&] {
+        for (const auto& stale : staleDecodes) {
+            if (stale->state == DecodeSlot::DECODING) {
+                return mDecodeExiting;
+            }
+        }
+        return true;
+    });
+
+    std::shared_ptr<DecodeSlot> slot = mDecodeSlots.front();
+    mDecodeDoneCond.wait(lk, [&] {
+        return slot->state == DecodeSlot::DONE || slot->cancelled || mDecodeExiting;
+    });
+    if (slot->state != DecodeSlot::DONE || slot->cancelled) {
+        // Cancelled by a concurrent flush, decode on the output thread instead
+        return nullptr;
+    }
+    mDecodeSlots.pop_front();
+    lk.unlock();
+    mDecodeCond.notify_all();
+    return slot;
+}
+
+void ExternalCameraDeviceSession::OutputThread::releaseDecodeSlot(
+        const std::shared_ptr<DecodeSlot>& slot) {
+    {
+        std::lock_guard<std::mutex> lk(mPipelineLock);
+        releaseFrameLocked(slot->frame);
+        slot->frame.clear();
+    }
+    mDecodeCond.notify_one();
+}
+
+void ExternalCameraDeviceSession::OutputThread::releaseFrameLocked(
+        const sp<AllocatedFrame>& frame) {
+    // Frames of a previous stream configuration are not returned to the pool
+    if (frame != nullptr && frame->mWidth == mFramePoolSize.width &&
+            frame->mHeight == mFramePoolSize.height) {
+        mFreeFrames.push_back(frame);
+    }
+}
+
+void ExternalCameraDeviceSession::OutputThread::cancelPendingDecodes() {
+    {
+        std::unique_lock<std::mutex> lk(mPipelineLock);
+        // The cancelled requests are about to be returned, which re-queues (and unmaps) their
+        // V4L2 buffers, so wait for the decodes still reading them to finish first
+        mDecodeDoneCond.wait(lk, [&] {
+            for (const auto& slot : mDecodeSlots) {
+                if (slot->state == DecodeSlot::DECODING) {
+                    return mDecodeExiting;
+                }
+            }
+            return true;
+        });
+        for (const auto& slot : mDecodeSlots) {
+            slot->cancelled = true;
+            if (slot->state != DecodeSlot::DECODING) {
+                releaseFrameLocked(slot->frame);
+                slot->frame.clear();
+            }
+        }
+        mDecodeSlots.clear();
+    }
+    mDecodeCond.notify_all();
+    mDecodeDoneCond.notify_all();
+}
+
+Status ExternalCameraDeviceSession::OutputThread::allocateFramePool(const Size& v4lSize) {
+    std::lock_guard<std::mutex> lk(mPipelineLock);
+    if (mFramePoolSize == v4lSize && mFreeFrames.size() == mNumPipelineFrames) {
+        return Status::OK;
+    }
+
+    mFreeFrames.clear();
+    mFramePoolSize = v4lSize;
+    for (uint32_t i = 0; i < mNumPipelineFrames; i++) {
+        sp<AllocatedFrame> frame = new AllocatedFrame(v4lSize.width, v4lSize.height);
+        int ret = frame->allocate();
+        if (ret != 0) {
+            ALOGE("%s: allocating pipeline YU12 frame %dx%d failed!",
+                    __FUNCTION__, v4lSize.width, v4lSize.height);
+            mFreeFrames.clear();
+            mFramePoolSize = {0, 0};
+            return Status::INTERNAL_ERROR;
+        }
+        mFreeFrames.push_back(frame);
+    }
+    return Status::OK;
+}
+
+void ExternalCameraDeviceSession::OutputThread::recordStageLatency(
+        PipelineStage stage, nsecs_t latencyNs) {
+    std::lock_guard<std::mutex> lk(mPipelineLock);
+    recordStageLatencyLocked(stage, latencyNs);
+}
+
+void ExternalCameraDeviceSession::OutputThread::recordStageLatencyLocked(
+        PipelineStage stage, nsecs_t latencyNs) {
+    StageStats& stats = mStageStats[stage];
+    stats.count++;
+    stats.totalNs += latencyNs;
+    stats.maxNs = std::max(stats.maxNs, latencyNs);
+}
+
+void ExternalCameraDeviceSession::OutputThread::updateMuteStateLocked(
+        const common::V1_0::helper::CameraMetadata& settings) {
+    auto testPatternMode = settings.find(ANDROID_SENSOR_TEST_PATTERN_MODE);
+    if (testPatternMode.count == 1) {
+        if (mCameraMuted != (testPatternMode.data.u8[0] != ANDROID_SENSOR_TEST_PATTERN_MODE_OFF)) {
+            mCameraMuted = !mCameraMuted;
+            // Get solid color for test pattern, if any was set
+            if (testPatternMode.data.u8[0] == ANDROID_SENSOR_TEST_PATTERN_MODE_SOLID_COLOR) {
+                auto entry = settings.find(ANDROID_SENSOR_TEST_PATTERN_DATA);
+                if (entry.count == 4) {
+                    // Update the mute frame if the pattern color has changed
+                    if (memcmp(entry.data.i32, mTestPatternData, sizeof(mTestPatternData)) != 0) {
+                        memcpy(mTestPatternData, entry.data.i32, sizeof(mTestPatternData));
+                        // Fill the mute frame with the solid color, use only 8 MSB of RGGB as RGB
+                        for (int i = 0; i < mMuteTestPatternFrame.size(); i += 3) {
+                            mMuteTestPatternFrame[i] = entry.data.i32[0] >> 24;
+                            mMuteTestPatternFrame[i + 1] = entry.data.i32[1] >> 24;
+                            mMuteTestPatternFrame[i + 2] = entry.data.i32[3] >> 24;
+                        }
+                    }
+                }
+            }
+        }
+    }
+}
+
 int ExternalCameraDeviceSession::OutputThread::cropAndScaleLocked(
         sp<AllocatedFrame>& in, const Size& outSz, YCbCrLayout* out) {
     Size inSz = {in->mWidth, in->mHeight};
@@ -969,19 +1267,24 @@ int ExternalCameraDeviceSession::OutputThread::cropAndScaleLocked(
         return 0;
     }
 
+    // Streams of the same size share the frame already scaled for this request
     auto it = mScaledYu12Frames.find(outSz);
-    sp<AllocatedFrame> scaledYu12Buf;
     if (it != mScaledYu12Frames.end()) {
-        scaledYu12Buf = it->second;
-    } else {
-        it = mIntermediateBuffers.find(outSz);
-        if (it == mIntermediateBuffers.end()) {
-            ALOGE("%s: failed to find intermediate buffer size %dx%d",
-                    __FUNCTION__, outSz.width, outSz.height);
-            return -1;
+        ret = it->second->getLayout(out);
+        if (ret != 0) {
+            ALOGE("%s: failed to get scaled buffer layout", __FUNCTION__);
         }
-        scaledYu12Buf = it->second;
+        return ret;
     }
+
+    it = mIntermediateBuffers.find(outSz);
+    if (it == mIntermediateBuffers.end()) {
+        ALOGE("%s: failed to find intermediate buffer size %dx%d",
+                __FUNCTION__, outSz.width, outSz.height);
+        return -1;
+    }
+    sp<AllocatedFrame> scaledYu12Buf = it->second;
+
     // Scale
     YCbCrLayout outLayout;
     ret = scaledYu12Buf->getLayout(&outLayout);
@@ -1321,52 +1624,71 @@ int ExternalCameraDeviceSession::OutputThread::createJpegLocked(
     /* Temporary thumbnail code buffer */
     std::vector<uint8_t> thumbCode(outputThumbnail ? maxThumbCodeSize : 0);
 
-    YCbCrLayout yu12Thumb;
-    if (outputThumbnail) {
-        ret = cropAndScaleThumbLocked(mYu12Frame, thumbSize, &yu12Thumb);
+    nsecs_t startTs = systemTime(SYSTEM_TIME_MONOTONIC);
 
-        if (ret != 0) {
-            return lfail(
-                "%s: crop and scale thumbnail failed!", __FUNCTION__);
+    /* The thumbnail and the EXIF APP1 segment only depend on mYu12Frame and
+     * the request settings, so they are produced on a helper thread while the
+     * main image is scaled and compressed on this one */
+    std::unique_ptr<ExifUtils> utils(ExifUtils::create());
+    int thumbRet = 0;
+    auto thumbTask = [&]() {
+        YCbCrLayout yu12Thumb;
+        if (outputThumbnail) {
+            thumbRet = cropAndScaleThumbLocked(mYu12Frame, thumbSize, &yu12Thumb);
+
+            if (thumbRet != 0) {
+                ALOGE("%s: crop and scale thumbnail failed!", __FUNCTION__);
+                return;
+            }
+
+            /* Encode the thumbnail image */
+            thumbRet = mThumbEncoder.encode(thumbSize, yu12Thumb,
+                    thumbQuality, 0, 0,
+                    &thumbCode[0], maxThumbCodeSize, thumbCodeSize);
+
+            if (thumbRet != 0) {
+                ALOGE("%s: thumbnail encode failed with %d", __FUNCTION__, thumbRet);
+                return;
+            }
         }
-    }
 
-    /* Scale and crop main jpeg */
-    ret = cropAndScaleLocked(mYu12Frame, jpegSize, &yu12Main);
+        /* Combine camera characteristics with request settings to form EXIF
+         * metadata */
+        common::V1_0::helper::CameraMetadata meta(mCameraCharacteristics);
+        meta.append(setting);
 
-    if (ret != 0) {
-        return lfail("%s: crop and scale main failed!", __FUNCTION__);
-    }
+        /* Generate EXIF object */
+        /* Make sure it's initialized */
+        utils->initialize();
+
+        utils->setFromMetadata(meta, jpegSize.width, jpegSize.height);
+        utils->setMake(mExifMake);
+        utils->setModel(mExifModel);
 
-    /* Encode the thumbnail image */
-    if (outputThumbnail) {
-        ret = encodeJpegYU12(thumbSize, yu12Thumb,
-                thumbQuality, 0, 0,
-                &thumbCode[0], maxThumbCodeSize, thumbCodeSize);
+        if (!utils->generateApp1(outputThumbnail ? &thumbCode[0] : 0, thumbCodeSize)) {
+            ALOGE("%s: generating APP1 failed", __FUNCTION__);
+            thumbRet = -1;
+        }
+    };
+    mJpegHelper.reserve(1);
+    mJpegHelper.post(thumbTask);
 
+    /* Scale and crop main jpeg, then compress it into the encoder's scratch
+     * buffers. APP1 is inserted once the helper thread is done. */
+    ret = cropAndScaleLocked(mYu12Frame, jpegSize, &yu12Main);
+    if (ret != 0) {
+        ALOGE("%s: crop and scale main failed!", __FUNCTION__);
+    } else {
+        ret = mJpegEncoder.compress(jpegSize, yu12Main, jpegQuality, maxJpegCodeSize);
         if (ret != 0) {
-            return lfail("%s: thumbnail encodeJpegYU12 failed with %d",__FUNCTION__, ret);
+            ALOGE("%s: main image compress failed with %d", __FUNCTION__, ret);
         }
     }
 
-    /* Combine camera characteristics with request settings to form EXIF
-     * metadata */
-    common::V1_0::helper::CameraMetadata meta(mCameraCharacteristics);
-    meta.append(setting);
-
-    /* Generate EXIF object */
-    std::unique_ptr<ExifUtils> utils(ExifUtils::create());
-    /* Make sure it's initialized */
-    utils->initialize();
-
-    utils->setFromMetadata(meta, jpegSize.width, jpegSize.height);
-    utils->setMake(mExifMake);
-    utils->setModel(mExifModel);
-
-    ret = utils->generateApp1(outputThumbnail ? &thumbCode[0] : 0, thumbCodeSize);
+    mJpegHelper.wait();
 
-    if (!ret) {
-        return lfail("%s: generating APP1 failed", __FUNCTION__);
+    if (ret != 0 || thumbRet != 0) {
+        return 1;
     }
 
     /* Get internal buffer */
@@ -1381,10 +1703,9 @@ int ExternalCameraDeviceSession::OutputThread::createJpegLocked(
         return lfail("%s: could not lock %zu bytes", __FUNCTION__, maxJpegCodeSize);
     }
 
-    /* Encode the main jpeg image */
-    ret = encodeJpegYU12(jpegSize, yu12Main,
-            jpegQuality, exifData, exifDataSize,
-            bufPtr, maxJpegCodeSize, jpegCodeSize);
+    /* Write the main jpeg image along with the APP1 segment */
+    ret = mJpegEncoder.write(exifData, exifDataSize,
+            bufPtr, maxJpegCodeSize - sizeof(CameraBlob), jpegCodeSize);
 
     /* TODO: Not sure this belongs here, maybe better to pass jpegCodeSize out
      * and do this when returning buffer to parent */
@@ -1404,15 +1725,30 @@ int ExternalCameraDeviceSession::OutputThread::createJpegLocked(
     /* Check if our JPEG actually succeeded */
     if (ret != 0) {
         return lfail(
-            "%s: encodeJpegYU12 failed with %d",__FUNCTION__, ret);
+            "%s: writing JPEG failed with %d",__FUNCTION__, ret);
     }
 
     ALOGV("%s: encoded JPEG (ret:%d) with Q:%d max size: %zu",
           __FUNCTION__, ret, jpegQuality, maxJpegCodeSize);
 
+    nsecs_t doneTs = systemTime(SYSTEM_TIME_MONOTONIC);
+    recordStageLatency(kStageJpeg, doneTs - startTs);
+    if (mLastJpegDoneTs != 0) {
+        recordStageLatency(kStageShotToShot, doneTs - mLastJpegDoneTs);
+    }
+    mLastJpegDoneTs = doneTs;
+
     return 0;
 }
 
+bool ExternalCameraDeviceSession::OutputThread::canDecodeToOutputLocked(
+        const HalRequest& req) const {
+    if (mYu12Frame == nullptr) {
+        return false;
+    }
+    return canDecodeMjpegToOutput(req.buffers, {mYu12Frame->mWidth, mYu12Frame->mHeight});
+}
+
 bool ExternalCameraDeviceSession::OutputThread::threadLoop() {
     std::shared_ptr<HalRequest> req;
     auto parent = mParent.promote();
@@ -1452,44 +1788,70 @@ bool ExternalCameraDeviceSession::OutputThread::threadLoop() {
         return onDeviceError("%s: failed to send buffer request!", __FUNCTION__);
     }
 
+    std::shared_ptr<DecodeSlot> slot;
     std::unique_lock<std::mutex> lk(mBufferLock);
+    // Swap the pipeline decoded frame back out of mYu12Frame and return it to the frame pool
+    // before releasing mBufferLock
+    auto unlockBuffers = [&]() {
+        mScaledYu12Frames.clear();
+        if (slot != nullptr) {
+            std::swap(mYu12Frame, slot->frame);
+            std::swap(mYu12FrameLayout, slot->layout);
+            releaseDecodeSlot(slot);
+            slot.reset();
+        }
+        lk.unlock();
+    };
+    // For some webcam, the first few V4L2 frames might be malformed...
+    // Return the request with an error and move on to the next one.
+    auto onDecodeError = [&](int res) {
+        ALOGE("%s: Convert V4L2 frame to YU12 failed! res %d", __FUNCTION__, res);
+        {
+            std::lock_guard<std::mutex> pipelineLock(mPipelineLock);
+            mNumDroppedFrames++;
+        }
+        unlockBuffers();
+        Status st = parent->processCaptureRequestError(req);
+        if (st != Status::OK) {
+            return onDeviceError("%s: failed to process capture request error!", __FUNCTION__);
+        }
+        signalRequestDone();
+        return true;
+    };
     // Convert input V4L2 frame to YU12 of the same size
     // TODO: see if we can save some computation by converting to YV12 here
     uint8_t* inData;
     size_t inDataSize;
     if (req->frameIn->getData(&inData, &inDataSize) != 0) {
-        lk.unlock();
+        unlockBuffers();
         return onDeviceError("%s: V4L2 buffer map failed", __FUNCTION__);
     }
 
     // Process camera mute state
-    auto testPatternMode = req->setting.find(ANDROID_SENSOR_TEST_PATTERN_MODE);
-    if (testPatternMode.count == 1) {
-        if (mCameraMuted != (testPatternMode.data.u8[0] != ANDROID_SENSOR_TEST_PATTERN_MODE_OFF)) {
-            mCameraMuted = !mCameraMuted;
-            // Get solid color for test pattern, if any was set
-            if (testPatternMode.data.u8[0] == ANDROID_SENSOR_TEST_PATTERN_MODE_SOLID_COLOR) {
-                auto entry = req->setting.find(ANDROID_SENSOR_TEST_PATTERN_DATA);
-                if (entry.count == 4) {
-                    // Update the mute frame if the pattern color has changed
-                    if (memcmp(entry.data.i32, mTestPatternData, sizeof(mTestPatternData)) != 0) {
-                        memcpy(mTestPatternData, entry.data.i32, sizeof(mTestPatternData));
-                        // Fill the mute frame with the solid color, use only 8 MSB of RGGB as RGB
-                        for (int i = 0; i < mMuteTestPatternFrame.size(); i += 3) {
-                            mMuteTestPatternFrame[i] = entry.data.i32[0] >> 24;
-                            mMuteTestPatternFrame[i + 1] = entry.data.i32[1] >> 24;
-                            mMuteTestPatternFrame[i + 2] = entry.data.i32[3] >> 24;
-                        }
-                    }
-                }
-            }
-        }
-    }
+    updateMuteStateLocked(req->setting);
 
-    // TODO: in some special case maybe we can decode jpg directly to gralloc output?
+    bool decodeToOutput = false;
     if (req->frameIn->mFourcc == V4L2_PIX_FMT_MJPEG) {
-        ATRACE_BEGIN("MJPGtoI420");
+        if (isDecodePipelineEnabled()) {
+            ATRACE_BEGIN("waitForDecodedSlot");
+            slot = waitForDecodedSlot(req);
+            ATRACE_END();
+        }
+
         int res = 0;
+        if (slot != nullptr) {
+            // Process the pipeline decoded frame through mYu12Frame, the same way as a frame
+            // decoded on this thread. Swapped back in unlockBuffers.
+            std::swap(mYu12Frame, slot->frame);
+            std::swap(mYu12FrameLayout, slot->layout);
+            res = slot->result;
+        } else if (!mCameraMuted) {
+            // Skip mYu12Frame and decode into the output buffer once it is locked below
+            decodeToOutput = canDecodeToOutputLocked(*req);
+        }
+
+        ATRACE_BEGIN("MJPGtoI420");
+        nsecs_t decodeStartTs = systemTime(SYSTEM_TIME_MONOTONIC);
         if (mCameraMuted) {
             res = libyuv::ConvertToI420(
                     mMuteTestPatternFrame.data(), mMuteTestPatternFrame.size(),
@@ -1498,26 +1860,19 @@ bool ExternalCameraDeviceSession::OutputThread::threadLoop() {
                     static_cast<uint8_t*>(mYu12FrameLayout.cr), mYu12FrameLayout.cStride, 0, 0,
                     mYu12Frame->mWidth, mYu12Frame->mHeight, mYu12Frame->mWidth,
                     mYu12Frame->mHeight, libyuv::kRotate0, libyuv::FOURCC_RAW);
-        } else {
+        } else if (slot == nullptr && !decodeToOutput) {
             res = libyuv::MJPGToI420(
                     inData, inDataSize, static_cast<uint8_t*>(mYu12FrameLayout.y),
                     mYu12FrameLayout.yStride, static_cast<uint8_t*>(mYu12FrameLayout.cb),
                     mYu12FrameLayout.cStride, static_cast<uint8_t*>(mYu12FrameLayout.cr),
                     mYu12FrameLayout.cStride, mYu12Frame->mWidth, mYu12Frame->mHeight,
                     mYu12Frame->mWidth, mYu12Frame->mHeight);
+            recordStageLatency(kStageDecode, systemTime(SYSTEM_TIME_MONOTONIC) - decodeStartTs);
         }
         ATRACE_END();
 
         if (res != 0) {
-            // For some webcam, the first few V4L2 frames might be malformed...
-            ALOGE("%s: Convert V4L2 frame to YU12 failed! res %d", __FUNCTION__, res);
-            lk.unlock();
-            Status st = parent->processCaptureRequestError(req);
-            if (st != Status::OK) {
-                return onDeviceError("%s: failed to process capture request error!", __FUNCTION__);
-            }
-            signalRequestDone();
-            return true;
+            return onDecodeError(res);
         }
     }
 
@@ -1527,11 +1882,14 @@ bool ExternalCameraDeviceSession::OutputThread::threadLoop() {
 
     if (res != 0) {
         ALOGE("%s: wait for BufferRequest done failed! res %d", __FUNCTION__, res);
-        lk.unlock();
+        unlockBuffers();
         return onDeviceError("%s: failed to process buffer request error!", __FUNCTION__);
     }
 
     ALOGV("%s processing new request", __FUNCTION__);
+    nsecs_t convertStartTs = systemTime(SYSTEM_TIME_MONOTONIC);
+    // Time spent in the decode and JPEG stages below, which is not part of kStageConvert
+    nsecs_t otherStagesNs = 0;
     const int kSyncWaitTimeoutMs = 500;
     for (auto& halBuf : req->buffers) {
         if (*(halBuf.bufPtr) == nullptr) {
@@ -1554,10 +1912,12 @@ bool ExternalCameraDeviceSession::OutputThread::threadLoop() {
         // Gralloc lockYCbCr the buffer
         switch (halBuf.format) {
             case PixelFormat::BLOB: {
+                nsecs_t jpegStartTs = systemTime(SYSTEM_TIME_MONOTONIC);
                 int ret = createJpegLocked(halBuf, req->setting);
+                otherStagesNs += systemTime(SYSTEM_TIME_MONOTONIC) - jpegStartTs;
 
                 if(ret != 0) {
-                    lk.unlock();
+                    unlockBuffers();
                     return onDeviceError("%s: createJpegLocked failed with %d",
                           __FUNCTION__, ret);
                 }
@@ -1591,25 +1951,60 @@ bool ExternalCameraDeviceSession::OutputThread::threadLoop() {
                         (outputFourcc >> 16) & 0xFF,
                         (outputFourcc >> 24) & 0xFF);
 
-                YCbCrLayout cropAndScaled;
-                ATRACE_BEGIN("cropAndScaleLocked");
-                int ret = cropAndScaleLocked(
-                        mYu12Frame,
-                        Size { halBuf.width, halBuf.height },
-                        &cropAndScaled);
-                ATRACE_END();
-                if (ret != 0) {
-                    lk.unlock();
-                    return onDeviceError("%s: crop and scale failed!", __FUNCTION__);
+                Size sz {halBuf.width, halBuf.height};
+                int ret = 0;
+                if (decodeToOutput && outputFourcc == FLEX_YUV_GENERIC) {
+                    // Layout can't be decoded into directly, go through mYu12Frame instead
+                    decodeToOutput = false;
+                    ATRACE_BEGIN("MJPGtoI420");
+                    nsecs_t decodeStartTs = systemTime(SYSTEM_TIME_MONOTONIC);
+                    ret = decodeMjpeg(inData, inDataSize, mYu12FrameLayout, sz,
+                            V4L2_PIX_FMT_YUV420);
+                    nsecs_t decodeNs = systemTime(SYSTEM_TIME_MONOTONIC) - decodeStartTs;
+                    recordStageLatency(kStageDecode, decodeNs);
+                    otherStagesNs += decodeNs;
+                    ATRACE_END();
+                    if (ret != 0) {
+                        int relFence = sHandleImporter.unlock(*(halBuf.bufPtr));
+                        if (relFence >= 0) {
+                            halBuf.acquireFence = relFence;
+                        }
+                        return onDecodeError(ret);
+                    }
                 }
 
-                Size sz {halBuf.width, halBuf.height};
-                ATRACE_BEGIN("formatConvert");
-                ret = formatConvert(cropAndScaled, outLayout, sz, outputFourcc);
-                ATRACE_END();
-                if (ret != 0) {
-                    lk.unlock();
-                    return onDeviceError("%s: format coversion failed!", __FUNCTION__);
+                if (decodeToOutput) {
+                    ATRACE_BEGIN("MJPGtoOutput");
+                    nsecs_t decodeStartTs = systemTime(SYSTEM_TIME_MONOTONIC);
+                    ret = decodeMjpeg(inData, inDataSize, outLayout, sz, outputFourcc);
+                    nsecs_t decodeNs = systemTime(SYSTEM_TIME_MONOTONIC) - decodeStartTs;
+                    recordStageLatency(kStageDecode, decodeNs);
+                    otherStagesNs += decodeNs;
+                    ATRACE_END();
+                    if (ret != 0) {
+                        int relFence = sHandleImporter.unlock(*(halBuf.bufPtr));
+                        if (relFence >= 0) {
+                            halBuf.acquireFence = relFence;
+                        }
+                        return onDecodeError(ret);
+                    }
+                } else {
+                    YCbCrLayout cropAndScaled;
+                    ATRACE_BEGIN("cropAndScaleLocked");
+                    ret = cropAndScaleLocked(mYu12Frame, sz, &cropAndScaled);
+                    ATRACE_END();
+                    if (ret != 0) {
+                        unlockBuffers();
+                        return onDeviceError("%s: crop and scale failed!", __FUNCTION__);
+                    }
+
+                    ATRACE_BEGIN("formatConvert");
+                    ret = formatConvert(cropAndScaled, outLayout, sz, outputFourcc);
+                    ATRACE_END();
+                    if (ret != 0) {
+                        unlockBuffers();
+                        return onDeviceError("%s: format coversion failed!", __FUNCTION__);
+                    }
                 }
                 int relFence = sHandleImporter.unlock(*(halBuf.bufPtr));
                 if (relFence >= 0) {
@@ -1617,18 +2012,21 @@ bool ExternalCameraDeviceSession::OutputThread::threadLoop() {
                 }
             } break;
             default:
-                lk.unlock();
+                unlockBuffers();
                 return onDeviceError("%s: unknown output format %x", __FUNCTION__, halBuf.format);
         }
     } // for each buffer
-    mScaledYu12Frames.clear();
+    recordStageLatency(kStageConvert,
+            systemTime(SYSTEM_TIME_MONOTONIC) - convertStartTs - otherStagesNs);
 
     // Don't hold the lock while calling back to parent
-    lk.unlock();
+    unlockBuffers();
+    nsecs_t deliverStartTs = systemTime(SYSTEM_TIME_MONOTONIC);
     Status st = parent->processCaptureResult(req);
     if (st != Status::OK) {
         return onDeviceError("%s: failed to process capture result!", __FUNCTION__);
     }
+    recordStageLatency(kStageDeliver, systemTime(SYSTEM_TIME_MONOTONIC) - deliverStartTs);
     signalRequestDone();
     return true;
 }
@@ -1709,6 +2107,14 @@ Status ExternalCameraDeviceSession::OutputThread::allocateIntermediateBuffers(
     // Allocate mute test pattern frame
     mMuteTestPatternFrame.resize(mYu12Frame->mWidth * mYu12Frame->mHeight * 3);
 
+    // Allocating decode pipeline frames
+    if (isDecodePipelineEnabled()) {
+        Status st = allocateFramePool(v4lSize);
+        if (st != Status::OK) {
+            return st;
+        }
+    }
+
     mBlobBufferSize = blobBufferSize;
     return Status::OK;
 }
@@ -1720,10 +2126,20 @@ void ExternalCameraDeviceSession::OutputThread::clearIntermediateBuffers() {
     mIntermediateBuffers.clear();
     mMuteTestPatternFrame.clear();
     mBlobBufferSize = 0;
+
+    std::lock_guard<std::mutex> pipelineLock(mPipelineLock);
+    mFreeFrames.clear();
+    mFramePoolSize = {0, 0};
 }
 
 Status ExternalCameraDeviceSession::OutputThread::submitRequest(
         const std::shared_ptr<HalRequest>& req) {
+    // Queue the decode before the request so the output thread never waits on a request
+    // whose decode has not been queued yet
+    if (isDecodePipelineEnabled() && req->frameIn->mFourcc == V4L2_PIX_FMT_MJPEG) {
+        queueDecodeSlot(req);
+    }
+
     std::unique_lock<std::mutex> lk(mRequestListLock);
     mRequestList.push_back(req);
     lk.unlock();
@@ -1752,6 +2168,11 @@ void ExternalCameraDeviceSession::OutputThread::flush() {
 
     ALOGV("%s: flusing inflight requests", __FUNCTION__);
     lk.unlock();
+    cancelPendingDecodes();
+    {
+        std::lock_guard<std::mutex> pipelineLock(mPipelineLock);
+        mNumDroppedFrames += reqs.size();
+    }
     for (const auto& req : reqs) {
         parent->processCaptureRequestError(req);
     }
@@ -1778,6 +2199,7 @@ ExternalCameraDeviceSession::OutputThread::switchToOffline() {
         }
     }
     lk.unlock();
+    cancelPendingDecodes();
     clearIntermediateBuffers();
     ALOGV("%s: returning %zu request for offline processing", __FUNCTION__, reqs.size());
     return reqs;
@@ -1822,17 +2244,44 @@ void ExternalCameraDeviceSession::OutputThread::signalRequestDone() {
 }
 
 void ExternalCameraDeviceSession::OutputThread::dump(int fd) {
-    std::lock_guard<std::mutex> lk(mRequestListLock);
-    if (mProcessingRequest) {
-        dprintf(fd, "OutputThread processing frame %d\n", mProcessingFrameNumer);
+    {
+        std::lock_guard<std::mutex> lk(mRequestListLock);
+        if (mProcessingRequest) {
+            dprintf(fd, "OutputThread processing frame %d\n", mProcessingFrameNumer);
+        } else {
+            dprintf(fd, "OutputThread not processing any frames\n");
+        }
+        dprintf(fd, "OutputThread request list contains frame: ");
+        for (const auto& req : mRequestList) {
+            dprintf(fd, "%d, ", req->frameNumber);
+        }
+        dprintf(fd, "\n");
+    }
+
+    std::lock_guard<std::mutex> lk(mPipelineLock);
+    if (isDecodePipelineEnabled()) {
+        size_t numDecoding = 0;
+        for (const auto& slot : mDecodeSlots) {
+            if (slot->state == DecodeSlot::DECODING) {
+                numDecoding++;
+            }
+        }
+        dprintf(fd, "OutputThread decode pipeline: %u threads, %zu/%u free frames,"
+                " %zu queued, %zu decoding\n",
+                mNumDecodeThreads, mFreeFrames.size(), mNumPipelineFrames,
+                mDecodeSlots.size(), numDecoding);
     } else {
-        dprintf(fd, "OutputThread not processing any frames\n");
+        dprintf(fd, "OutputThread decode pipeline disabled\n");
     }
-    dprintf(fd, "OutputThread request list contains frame: ");
-    for (const auto& req : mRequestList) {
-        dprintf(fd, "%d, ", req->frameNumber);
+    dprintf(fd, "OutputThread dropped frames: %" PRIu64 "\n", mNumDroppedFrames);
+    for (int i = 0; i < kNumPipelineStages; i++) {
+        const StageStats& stats = mStageStats[i];
+        dprintf(fd, "OutputThread %s latency: count %" PRIu64 ", avg %" PRId64 "us,"
+                " max %" PRId64 "us\n",
+                kPipelineStageNames[i], stats.count,
+                stats.count == 0 ? 0 : static_cast<int64_t>(stats.totalNs / stats.count / 1000),
+                static_cast<int64_t>(stats.maxNs / 1000));
     }
-    dprintf(fd, "\n");
 }
 
 void ExternalCameraDeviceSession::cleanupBuffersLocked(int id) {
@@ -1947,17 +2396,111 @@ int ExternalCameraDeviceSession::v4l2StreamOffLocked() {
     // VIDIOC_REQBUFS: clear buffers
     v4l2_requestbuffers req_buffers{};
     req_buffers.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-    req_buffers.memory = V4L2_MEMORY_MMAP;
+    req_buffers.memory = getV4l2Memory();
     req_buffers.count = 0;
     if (TEMP_FAILURE_RETRY(ioctl(mV4l2Fd.get(), VIDIOC_REQBUFS, &req_buffers)) < 0) {
         ALOGE("%s: REQBUFS failed: %s", __FUNCTION__, strerror(errno));
         return -errno;
     }
+    // The driver no longer references the buffers
+    freeV4l2BuffersLocked();
 
     mV4l2Streaming = false;
     return OK;
 }
 
+void ExternalCameraDeviceSession::releaseV4l2BuffersLocked() {
+    // Undo a partial configureV4l2StreamLocked. STREAMOFF also dequeues the buffers if the
+    // stream never started.
+    mV4L2BufferCount = 0;
+    v4l2_buf_type capture_type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    if (TEMP_FAILURE_RETRY(ioctl(mV4l2Fd.get(), VIDIOC_STREAMOFF, &capture_type)) < 0) {
+        ALOGE("%s: STREAMOFF failed: %s", __FUNCTION__, strerror(errno));
+    }
+
+    v4l2_requestbuffers req_buffers{};
+    req_buffers.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    req_buffers.memory = getV4l2Memory();
+    req_buffers.count = 0;
+    if (TEMP_FAILURE_RETRY(ioctl(mV4l2Fd.get(), VIDIOC_REQBUFS, &req_buffers)) < 0) {
+        // The driver may still reference the user pointers, keep them mapped
+        ALOGE("%s: REQBUFS failed: %s", __FUNCTION__, strerror(errno));
+        return;
+    }
+    freeV4l2BuffersLocked();
+}
+
+uint32_t ExternalCameraDeviceSession::getV4l2Memory() const {
+    return (mCfg.v4l2MemoryType == V4L2MemoryType::USERPTR) ?
+            V4L2_MEMORY_USERPTR : V4L2_MEMORY_MMAP;
+}
+
+void ExternalCameraDeviceSession::setV4l2BufferMemory(v4l2_buffer* buffer) const {
+    buffer->memory = getV4l2Memory();
+    if (buffer->memory == V4L2_MEMORY_USERPTR && buffer->index < mV4L2Buffers.size()) {
+        const V4L2Buffer& v4l2Buf = mV4L2Buffers[buffer->index];
+        buffer->m.userptr = reinterpret_cast<unsigned long>(v4l2Buf.data);
+        buffer->length = v4l2Buf.length;
+    }
+}
+
+int ExternalCameraDeviceSession::allocateV4l2UserPtrBuffersLocked(
+        uint32_t count, uint32_t bufferSize) {
+    freeV4l2BuffersLocked();
+    size_t pageSize = getpagesize();
+    size_t length = (bufferSize + pageSize - 1) & ~(pageSize - 1);
+    mV4L2Buffers.resize(count);
+    for (auto& v4l2Buf : mV4L2Buffers) {
+        void* addr = mmap(nullptr, length, PROT_READ | PROT_WRITE,
+                MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (addr == MAP_FAILED) {
+            ALOGE("%s: allocating %zu bytes V4L2 buffer failed: %s",
+                    __FUNCTION__, length, strerror(errno));
+            freeV4l2BuffersLocked();
+            return -ENOMEM;
+        }
+        v4l2Buf.data = static_cast<uint8_t*>(addr);
+        v4l2Buf.length = length;
+    }
+    return OK;
+}
+
+int ExternalCameraDeviceSession::exportV4l2BufferLocked(uint32_t index, uint32_t length) {
+    if (index == 0) {
+        freeV4l2BuffersLocked();
+        mV4L2Buffers.resize(mV4L2BufferCount);
+    }
+
+    v4l2_exportbuffer expbuf{};
+    expbuf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    expbuf.index = index;
+    expbuf.flags = O_RDONLY | O_CLOEXEC;
+    if (TEMP_FAILURE_RETRY(ioctl(mV4l2Fd.get(), VIDIOC_EXPBUF, &expbuf)) < 0) {
+        ALOGE("%s: EXPBUF %d failed: %s", __FUNCTION__, index, strerror(errno));
+        return -errno;
+    }
+
+    V4L2Buffer& v4l2Buf = mV4L2Buffers[index];
+    v4l2Buf.dmaBufFd.reset(expbuf.fd);
+    void* addr = mmap(nullptr, length, PROT_READ, MAP_SHARED, expbuf.fd, 0);
+    if (addr == MAP_FAILED) {
+        ALOGE("%s: mapping DMABUF %d failed: %s", __FUNCTION__, index, strerror(errno));
+        return -errno;
+    }
+    v4l2Buf.data = static_cast<uint8_t*>(addr);
+    v4l2Buf.length = length;
+    return OK;
+}
+
+void ExternalCameraDeviceSession::freeV4l2BuffersLocked() {
+    for (auto& v4l2Buf : mV4L2Buffers) {
+        if (v4l2Buf.data != nullptr && munmap(v4l2Buf.data, v4l2Buf.length) != 0) {
+            ALOGE("%s: unmapping V4L2 buffer failed: %s", __FUNCTION__, strerror(errno));
+        }
+    }
+    mV4L2Buffers.clear();
+}
+
 int ExternalCameraDeviceSession::setV4l2FpsLocked(double fps) {
     // VIDIOC_G_PARM/VIDIOC_S_PARM: set fps
     v4l2_streamparm streamparm = { .type = V4L2_BUF_TYPE_VIDEO_CAPTURE };
@@ -2086,7 +2629,7 @@ int ExternalCameraDeviceSession::configureV4l2StreamLocked(
     // VIDIOC_REQBUFS: create buffers
     v4l2_requestbuffers req_buffers{};
     req_buffers.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-    req_buffers.memory = V4L2_MEMORY_MMAP;
+    req_buffers.memory = getV4l2Memory();
     req_buffers.count = v4lBufferCount;
     if (TEMP_FAILURE_RETRY(ioctl(mV4l2Fd.get(), VIDIOC_REQBUFS, &req_buffers)) < 0) {
         ALOGE("%s: VIDIOC_REQBUFS failed: %s", __FUNCTION__, strerror(errno));
@@ -2097,24 +2640,47 @@ int ExternalCameraDeviceSession::configureV4l2StreamLocked(
     if (req_buffers.count < v4lBufferCount) {
         ALOGE("%s: VIDIOC_REQBUFS expected %d buffers, got %d instead",
                 __FUNCTION__, v4lBufferCount, req_buffers.count);
+        releaseV4l2BuffersLocked();
         return NO_MEMORY;
     }
 
+    mV4L2BufferCount = req_buffers.count;
+    if (mCfg.v4l2MemoryType == V4L2MemoryType::USERPTR) {
+        ret = allocateV4l2UserPtrBuffersLocked(req_buffers.count, bufferSize);
+        if (ret != 0) {
+            releaseV4l2BuffersLocked();
+            return ret;
+        }
+    }
+
     // VIDIOC_QUERYBUF:  get buffer offset in the V4L2 fd
+    // VIDIOC_EXPBUF: export the buffer as a DMABUF (DMABUF memory type only)
     // VIDIOC_QBUF: send buffer to driver
-    mV4L2BufferCount = req_buffers.count;
     for (uint32_t i = 0; i < req_buffers.count; i++) {
         v4l2_buffer buffer = {
-                .index = i, .type = V4L2_BUF_TYPE_VIDEO_CAPTURE, .memory = V4L2_MEMORY_MMAP};
+                .index = i, .type = V4L2_BUF_TYPE_VIDEO_CAPTURE, .memory = getV4l2Memory()};
 
         if (TEMP_FAILURE_RETRY(ioctl(mV4l2Fd.get(), VIDIOC_QUERYBUF, &buffer)) < 0) {
             ALOGE("%s: QUERYBUF %d failed: %s", __FUNCTION__, i,  strerror(errno));
-            return -errno;
+            ret = -errno;
+            releaseV4l2BuffersLocked();
+            return ret;
+        }
+
+        if (mCfg.v4l2MemoryType == V4L2MemoryType::DMABUF) {
+            ret = exportV4l2BufferLocked(i, buffer.length);
+            if (ret != 0) {
+                releaseV4l2BuffersLocked();
+                return ret;
+            }
         }
 
+        setV4l2BufferMemory(&buffer);
         if (TEMP_FAILURE_RETRY(ioctl(mV4l2Fd.get(), VIDIOC_QBUF, &buffer)) < 0) {
             ALOGE("%s: QBUF %d failed: %s", __FUNCTION__, i,  strerror(errno));
-            return -errno;
+            ret = -errno;
+            releaseV4l2BuffersLocked();
+            return ret;
         }
     }
 
@@ -2134,7 +2700,9 @@ int ExternalCameraDeviceSession::configureV4l2StreamLocked(
         }
         if (ret < 0) {
             ALOGE("%s: VIDIOC_STREAMON ioctl failed: %s", __FUNCTION__, strerror(errno));
-            return -errno;
+            ret = -errno;
+            releaseV4l2BuffersLocked();
+            return ret;
         }
     }
 
@@ -2142,15 +2710,20 @@ int ExternalCameraDeviceSession::configureV4l2StreamLocked(
     for (int i = 0; i < kBadFramesAfterStreamOn; i++) {
         v4l2_buffer buffer{};
         buffer.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-        buffer.memory = V4L2_MEMORY_MMAP;
+        buffer.memory = getV4l2Memory();
         if (TEMP_FAILURE_RETRY(ioctl(mV4l2Fd.get(), VIDIOC_DQBUF, &buffer)) < 0) {
             ALOGE("%s: DQBUF fails: %s", __FUNCTION__, strerror(errno));
-            return -errno;
+            ret = -errno;
+            releaseV4l2BuffersLocked();
+            return ret;
         }
 
+        setV4l2BufferMemory(&buffer);
         if (TEMP_FAILURE_RETRY(ioctl(mV4l2Fd.get(), VIDIOC_QBUF, &buffer)) < 0) {
             ALOGE("%s: QBUF index %d fails: %s", __FUNCTION__, buffer.index, strerror(errno));
-            return -errno;
+            ret = -errno;
+            releaseV4l2BuffersLocked();
+            return ret;
         }
     }
 
@@ -2183,7 +2756,7 @@ sp<V4L2Frame> ExternalCameraDeviceSession::dequeueV4l2FrameLocked(/*out*/nsecs_t
     ATRACE_BEGIN("VIDIOC_DQBUF");
     v4l2_buffer buffer{};
     buffer.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-    buffer.memory = V4L2_MEMORY_MMAP;
+    buffer.memory = getV4l2Memory();
     if (TEMP_FAILURE_RETRY(ioctl(mV4l2Fd.get(), VIDIOC_DQBUF, &buffer)) < 0) {
         ALOGE("%s: DQBUF fails: %s", __FUNCTION__, strerror(errno));
         return ret;
@@ -2218,20 +2791,48 @@ sp<V4L2Frame> ExternalCameraDeviceSession::dequeueV4l2FrameLocked(/*out*/nsecs_t
     {
         std::lock_guard<std::mutex> lk(mV4l2BufferLock);
         mNumDequeuedV4l2Buffers++;
+        mNumV4l2FramesDequeued++;
+        mV4l2BytesDequeued += buffer.bytesused;
+    }
+
+    if (mCfg.v4l2MemoryType == V4L2MemoryType::MMAP) {
+        return new V4L2Frame(
+                mV4l2StreamingFmt.width, mV4l2StreamingFmt.height, mV4l2StreamingFmt.fourcc,
+                buffer.index, mV4l2Fd.get(), buffer.bytesused, buffer.m.offset);
+    }
+
+    const V4L2Buffer& v4l2Buf = mV4L2Buffers[buffer.index];
+    if (v4l2Buf.dmaBufFd.get() >= 0) {
+        // Make the frame written by the device visible to the CPU
+        dma_buf_sync sync = {.flags = DMA_BUF_SYNC_START | DMA_BUF_SYNC_READ};
+        if (TEMP_FAILURE_RETRY(ioctl(v4l2Buf.dmaBufFd.get(), DMA_BUF_IOCTL_SYNC, &sync)) < 0) {
+            ALOGW("%s: DMA_BUF_IOCTL_SYNC start failed: %s", __FUNCTION__, strerror(errno));
+        }
     }
     return new V4L2Frame(
             mV4l2StreamingFmt.width, mV4l2StreamingFmt.height, mV4l2StreamingFmt.fourcc,
-            buffer.index, mV4l2Fd.get(), buffer.bytesused, buffer.m.offset);
+            buffer.index, v4l2Buf.data, buffer.bytesused);
 }
 
 void ExternalCameraDeviceSession::enqueueV4l2Frame(const sp<V4L2Frame>& frame) {
     ATRACE_CALL();
     frame->unmap();
+    if (frame->mBufferIndex >= 0 &&
+            static_cast<size_t>(frame->mBufferIndex) < mV4L2Buffers.size()) {
+        const V4L2Buffer& v4l2Buf = mV4L2Buffers[frame->mBufferIndex];
+        if (v4l2Buf.dmaBufFd.get() >= 0) {
+            dma_buf_sync sync = {.flags = DMA_BUF_SYNC_END | DMA_BUF_SYNC_READ};
+            if (TEMP_FAILURE_RETRY(
+                    ioctl(v4l2Buf.dmaBufFd.get(), DMA_BUF_IOCTL_SYNC, &sync)) < 0) {
+                ALOGW("%s: DMA_BUF_IOCTL_SYNC end failed: %s", __FUNCTION__, strerror(errno));
+            }
+        }
+    }
     ATRACE_BEGIN("VIDIOC_QBUF");
     v4l2_buffer buffer{};
     buffer.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-    buffer.memory = V4L2_MEMORY_MMAP;
     buffer.index = frame->mBufferIndex;
+    setV4l2BufferMemory(&buffer);
     if (TEMP_FAILURE_RETRY(ioctl(mV4l2Fd.get(), VIDIOC_QBUF, &buffer)) < 0) {
         ALOGE("%s: QBUF index %d fails: %s", __FUNCTION__,
                 frame->mBufferIndex, strerror(errno));
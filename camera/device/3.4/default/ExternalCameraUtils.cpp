@@ -19,6 +19,7 @@
 
 #include <cmath>
 #include <cstring>
+#include <thread>
 #include <sys/mman.h>
 #include <linux/videodev2.h>
 
@@ -51,6 +52,13 @@ V4L2Frame::V4L2Frame(
         Frame(w, h, fourcc),
         mBufferIndex(bufIdx), mFd(fd), mDataSize(dataSize), mOffset(offset) {}
 
+V4L2Frame::V4L2Frame(
+        uint32_t w, uint32_t h, uint32_t fourcc,
+        int bufIdx, uint8_t* data, uint32_t dataSize) :
+        Frame(w, h, fourcc),
+        mBufferIndex(bufIdx), mFd(-1), mDataSize(dataSize), mOffset(0),
+        mData(data), mMapped(true), mOwnsMapping(false) {}
+
 int V4L2Frame::map(uint8_t** data, size_t* dataSize) {
     if (data == nullptr || dataSize == nullptr) {
         ALOGI("%s: V4L2 buffer map bad argument: data %p, dataSize %p",
@@ -76,7 +84,7 @@ int V4L2Frame::map(uint8_t** data, size_t* dataSize) {
 
 int V4L2Frame::unmap() {
     std::lock_guard<std::mutex> lk(mLock);
-    if (mMapped) {
+    if (mMapped && mOwnsMapping) {
         ALOGV("%s: V4L unmap data %p size %zu", __FUNCTION__, mData, mDataSize);
         if (munmap(mData, mDataSize) != 0) {
             ALOGE("%s: V4L2 buffer unmap failed: %s", __FUNCTION__, strerror(errno));
@@ -382,26 +390,93 @@ int formatConvert(
     return 0;
 }
 
-int encodeJpegYU12(
-        const Size & inSz, const YCbCrLayout& inLayout,
-        int jpegQuality, const void *app1Buffer, size_t app1Size,
-        void *out, const size_t maxOutSize, size_t &actualCodeSize)
-{
-    /* libjpeg is a C library so we use C-style "inheritance" by
-     * putting libjpeg's jpeg_destination_mgr first in our custom
-     * struct. This allows us to cast jpeg_destination_mgr* to
-     * CustomJpegDestMgr* when we get it passed to us in a callback */
-    struct CustomJpegDestMgr {
-        struct jpeg_destination_mgr mgr;
-        JOCTET *mBuffer;
-        size_t mBufferSize;
-        size_t mEncodedSize;
-        bool mSuccess;
-    } dmgr;
+int decodeMjpeg(const uint8_t* in, size_t inSize, const YCbCrLayout& out, Size sz,
+        uint32_t format) {
+    int ret = 0;
+    switch (format) {
+        case V4L2_PIX_FMT_NV21:
+            ret = libyuv::MJPGToNV21(
+                    in, inSize,
+                    static_cast<uint8_t*>(out.y), out.yStride,
+                    static_cast<uint8_t*>(out.cr), out.cStride,
+                    sz.width, sz.height, sz.width, sz.height);
+            break;
+        case V4L2_PIX_FMT_NV12:
+            ret = libyuv::MJPGToNV12(
+                    in, inSize,
+                    static_cast<uint8_t*>(out.y), out.yStride,
+                    static_cast<uint8_t*>(out.cb), out.cStride,
+                    sz.width, sz.height, sz.width, sz.height);
+            break;
+        case V4L2_PIX_FMT_YVU420: // YV12
+        case V4L2_PIX_FMT_YUV420: // YU12
+            // Plane order is carried by the cb/cr pointers of the layout
+            ret = libyuv::MJPGToI420(
+                    in, inSize,
+                    static_cast<uint8_t*>(out.y), out.yStride,
+                    static_cast<uint8_t*>(out.cb), out.cStride,
+                    static_cast<uint8_t*>(out.cr), out.cStride,
+                    sz.width, sz.height, sz.width, sz.height);
+            break;
+        default:
+            return -EINVAL;
+    }
+    if (ret != 0) {
+        ALOGE("%s: decode MJPEG to %c%c%c%c %dx%d failed! ret %d", __FUNCTION__,
+                format & 0xFF, (format >> 8) & 0xFF, (format >> 16) & 0xFF, (format >> 24) & 0xFF,
+                sz.width, sz.height, ret);
+    }
+    return ret;
+}
 
+bool canDecodeMjpegToOutput(const std::vector<HalStreamBuffer>& buffers, Size frameSize) {
+    if (buffers.size() != 1) {
+        return false;
+    }
+    using ::android::hardware::graphics::common::V1_0::PixelFormat;
+    const HalStreamBuffer& halBuf = buffers[0];
+    if (halBuf.format != PixelFormat::YCBCR_420_888 && halBuf.format != PixelFormat::YV12) {
+        return false;
+    }
+    // No cropping or scaling allowed
+    return halBuf.width == frameSize.width && halBuf.height == frameSize.height;
+}
+
+/* libjpeg is a C library so we use C-style "inheritance" by
+ * putting libjpeg's jpeg_destination_mgr first in our custom
+ * struct. This allows us to cast jpeg_destination_mgr* to
+ * CustomJpegDestMgr* when we get it passed to us in a callback */
+struct CustomJpegDestMgr {
+    struct jpeg_destination_mgr mgr;
+    JOCTET *mBuffer;
+    size_t mBufferSize;
+    size_t mEncodedSize;
+    bool mSuccess;
+    bool mOverflow; // ran out of output buffer
+};
+
+/* One libjpeg compressor plus the row pointer arrays it is fed with. The
+ * compressor object is created once and reused for every image, libjpeg
+ * allows that as long as each image is either finished or aborted. */
+struct JpegEncoder::Compressor {
+    CustomJpegDestMgr dmgr;
     jpeg_compress_struct cinfo = {};
     jpeg_error_mgr jerr;
+    std::vector<JSAMPROW> yLines;
+    std::vector<JSAMPROW> cbLines;
+    std::vector<JSAMPROW> crLines;
+
+    Compressor();
+    ~Compressor();
 
+    // Compress rows [firstRow, firstRow + numRows) of the inSz image
+    int compress(const Size& inSz, const YCbCrLayout& inLayout,
+            uint32_t firstRow, uint32_t numRows, int jpegQuality,
+            const void *app1Buffer, size_t app1Size,
+            void *out, size_t maxOutSize, size_t &actualCodeSize);
+};
+
+JpegEncoder::Compressor::Compressor() {
     /* Initialize error handling with standard callbacks, but
      * then override output_message (to print to ALOG) and
      * error_exit to set a flag and print a message instead
@@ -426,11 +501,6 @@ int encodeJpegYU12(
     /* Now that we initialized some callbacks, let's create our compressor */
     jpeg_create_compress(&cinfo);
 
-    /* Initialize our destination manager */
-    dmgr.mBuffer = static_cast<JOCTET*>(out);
-    dmgr.mBufferSize = maxOutSize;
-    dmgr.mEncodedSize = 0;
-    dmgr.mSuccess = true;
     cinfo.client_data = static_cast<void*>(&dmgr);
 
     /* These lambdas become C-style function pointers and as per C++11 spec
@@ -443,8 +513,10 @@ int encodeJpegYU12(
               __FUNCTION__, __LINE__, dmgr.mBuffer, dmgr.mBufferSize);
     };
 
-    dmgr.mgr.empty_output_buffer = [](j_compress_ptr cinfo __unused) {
+    dmgr.mgr.empty_output_buffer = [](j_compress_ptr cinfo) {
+        auto & dmgr = reinterpret_cast<CustomJpegDestMgr&>(*cinfo->dest);
         ALOGV("%s:%d Out of buffer", __FUNCTION__, __LINE__);
+        dmgr.mOverflow = true;
         return 0;
     };
 
@@ -454,12 +526,30 @@ int encodeJpegYU12(
         ALOGV("%s:%d Done with jpeg: %zu", __FUNCTION__, __LINE__, dmgr.mEncodedSize);
     };
     cinfo.dest = reinterpret_cast<struct jpeg_destination_mgr*>(&dmgr);
+}
+
+JpegEncoder::Compressor::~Compressor() {
+    jpeg_destroy_compress(&cinfo);
+}
+
+int JpegEncoder::Compressor::compress(
+        const Size& inSz, const YCbCrLayout& inLayout,
+        uint32_t firstRow, uint32_t numRows, int jpegQuality,
+        const void *app1Buffer, size_t app1Size,
+        void *out, size_t maxOutSize, size_t &actualCodeSize)
+{
+    /* Initialize our destination manager */
+    dmgr.mBuffer = static_cast<JOCTET*>(out);
+    dmgr.mBufferSize = maxOutSize;
+    dmgr.mEncodedSize = 0;
+    dmgr.mSuccess = true;
+    dmgr.mOverflow = false;
 
     /* We are going to be using JPEG in raw data mode, so we are passing
      * straight subsampled planar YCbCr and it will not touch our pixel
      * data or do any scaling or anything */
     cinfo.image_width = inSz.width;
-    cinfo.image_height = inSz.height;
+    cinfo.image_height = numRows;
     cinfo.input_components = 3;
     cinfo.in_color_space = JCS_YCbCr;
 
@@ -499,13 +589,16 @@ int encodeJpegYU12(
      * TODO: Does it need to be horizontally MCU aligned too? */
 
     size_t mcuV = DCTSIZE*maxVSampFactor;
-    size_t paddedHeight = mcuV * ((inSz.height + mcuV - 1) / mcuV);
+    size_t paddedHeight = mcuV * ((numRows + mcuV - 1) / mcuV);
 
     /* libjpeg uses arrays of row pointers, which makes it really easy to pad
-     * data vertically (unfortunately doesn't help horizontally) */
-    std::vector<JSAMPROW> yLines (paddedHeight);
-    std::vector<JSAMPROW> cbLines(paddedHeight/cVSubSampling);
-    std::vector<JSAMPROW> crLines(paddedHeight/cVSubSampling);
+     * data vertically (unfortunately doesn't help horizontally). The arrays
+     * only ever grow so a steady stream of captures does not reallocate. */
+    if (yLines.size() < paddedHeight) {
+        yLines.resize(paddedHeight);
+        cbLines.resize(paddedHeight/cVSubSampling);
+        crLines.resize(paddedHeight/cVSubSampling);
+    }
 
     uint8_t *py = static_cast<uint8_t*>(inLayout.y);
     uint8_t *pcr = static_cast<uint8_t*>(inLayout.cr);
@@ -515,11 +608,11 @@ int encodeJpegYU12(
     {
         /* Once we are in the padding territory we still point to the last line
          * effectively replicating it several times ~ CLAMP_TO_EDGE */
-        int li = std::min(i, inSz.height - 1);
+        int li = std::min(firstRow + i, inSz.height - 1);
         yLines[i]  = static_cast<JSAMPROW>(py + li * inLayout.yStride);
         if(i < paddedHeight / cVSubSampling)
         {
-            li = std::min(i, (inSz.height - 1) / cVSubSampling);
+            li = std::min((firstRow / cVSubSampling) + i, (inSz.height - 1) / cVSubSampling);
             crLines[i] = static_cast<JSAMPROW>(pcr + li * inLayout.cStride);
             cbLines[i] = static_cast<JSAMPROW>(pcb + li * inLayout.cStride);
         }
@@ -547,19 +640,323 @@ int encodeJpegYU12(
             ALOGE("%s: compressed %u lines, expected %u (total %u/%u)",
               __FUNCTION__, done, batchSize, cinfo.next_scanline,
               cinfo.image_height);
-            return -1;
+            /* Reset the compressor so it can be reused for the next image */
+            jpeg_abort_compress(&cinfo);
+            return dmgr.mOverflow ? -ENOSPC : -1;
         }
     }
 
     /* This will flush everything */
     jpeg_finish_compress(&cinfo);
 
+    if (!dmgr.mSuccess) {
+        jpeg_abort_compress(&cinfo);
+        return dmgr.mOverflow ? -ENOSPC : -1;
+    }
+
     /* Grab the actual code size and set it */
     actualCodeSize = dmgr.mEncodedSize;
 
     return 0;
 }
 
+namespace {
+
+constexpr uint8_t kJpegMarkerSOF0 = 0xC0;
+constexpr uint8_t kJpegMarkerRST0 = 0xD0;
+constexpr uint8_t kJpegMarkerSOS = 0xDA;
+constexpr uint8_t kJpegMarkerDRI = 0xDD;
+constexpr uint8_t kJpegMarkerAPP0 = 0xE0;
+constexpr uint8_t kJpegMarkerAPP1 = 0xE1;
+constexpr uint8_t kJpegMarkerEOI = 0xD9;
+// Largest restart interval the 16 bit DRI field can hold, in MCUs
+constexpr uint32_t kMaxRestartInterval = 0xFFFF;
+// Room for the headers libjpeg writes in front of each strip
+constexpr size_t kStripHeaderSize = 1024;
+
+/* Finds the first `marker` segment in the JPEG header, walking segment by
+ * segment from SOI up to and including SOS. Returns the offset of the 0xFF
+ * byte and the offset right past the segment, or -1 if it is not there. */
+ssize_t findJpegMarker(const uint8_t* code, size_t size, uint8_t marker, size_t* segmentEnd) {
+    size_t pos = 2; // Skip SOI
+    while (pos + 4 <= size && code[pos] == 0xFF) {
+        uint8_t m = code[pos + 1];
+        size_t end = pos + 2 + ((code[pos + 2] << 8) | code[pos + 3]);
+        if (end > size) {
+            return -1;
+        }
+        if (m == marker) {
+            *segmentEnd = end;
+            return pos;
+        }
+        if (m == kJpegMarkerSOS) { // Entropy coded data follows
+            return -1;
+        }
+        pos = end;
+    }
+    return -1;
+}
+
+} // anonymous namespace
+
+WorkerPool::~WorkerPool() {
+    {
+        std::lock_guard<std::mutex> lk(mLock);
+        mExiting = true;
+    }
+    mTaskCond.notify_all();
+    for (auto& thread : mThreads) {
+        thread.join();
+    }
+}
+
+void WorkerPool::reserve(uint32_t numThreads) {
+    while (mThreads.size() < numThreads) {
+        mThreads.emplace_back(&WorkerPool::threadLoop, this);
+    }
+}
+
+void WorkerPool::post(std::function<void()> task) {
+    {
+        std::lock_guard<std::mutex> lk(mLock);
+        mTasks.push_back(std::move(task));
+        mNumPendingTasks++;
+    }
+    mTaskCond.notify_one();
+}
+
+void WorkerPool::wait() {
+    std::unique_lock<std::mutex> lk(mLock);
+    mIdleCond.wait(lk, [this] { return mNumPendingTasks == 0; });
+}
+
+void WorkerPool::threadLoop() {
+    std::unique_lock<std::mutex> lk(mLock);
+    while (true) {
+        mTaskCond.wait(lk, [this] { return mExiting || !mTasks.empty(); });
+        if (mTasks.empty()) {
+            return;
+        }
+        std::function<void()> task = std::move(mTasks.front());
+        mTasks.pop_front();
+        lk.unlock();
+        task();
+        lk.lock();
+        if (--mNumPendingTasks == 0) {
+            mIdleCond.notify_all();
+        }
+    }
+}
+
+JpegEncoder::JpegEncoder(uint32_t numStrips) {
+    setNumStrips(numStrips);
+}
+
+JpegEncoder::~JpegEncoder() {}
+
+void JpegEncoder::setNumStrips(uint32_t numStrips) {
+    mNumStrips = std::max(numStrips, 1u);
+}
+
+void JpegEncoder::reserveStripCode(Strip* strip, size_t size) {
+    if (strip->capacity < size) {
+        strip->code.reset(new uint8_t[size]);
+        strip->capacity = size;
+    }
+}
+
+int JpegEncoder::encode(
+        const Size& inSz, const YCbCrLayout& inLayout,
+        int jpegQuality, const void *app1Buffer, size_t app1Size,
+        void *out, size_t maxOutSize, size_t &actualCodeSize) {
+    if (mNumStrips == 1) {
+        // Nothing to stitch, let libjpeg write straight into the output
+        if (mStrips.empty()) {
+            mStrips.resize(1);
+        }
+        Strip& strip = mStrips[0];
+        if (strip.compressor == nullptr) {
+            strip.compressor = std::make_unique<Compressor>();
+        }
+        mNumUsedStrips = 0;
+        return strip.compressor->compress(inSz, inLayout, 0, inSz.height, jpegQuality,
+                app1Buffer, app1Size, out, maxOutSize, actualCodeSize);
+    }
+
+    int ret = compress(inSz, inLayout, jpegQuality, maxOutSize);
+    if (ret != 0) {
+        return ret;
+    }
+    return write(app1Buffer, app1Size, out, maxOutSize, actualCodeSize);
+}
+
+int JpegEncoder::compress(
+        const Size& inSz, const YCbCrLayout& inLayout, int jpegQuality, size_t maxCodeSize) {
+    mNumUsedStrips = 0;
+    if (inSz.width == 0 || inSz.height == 0) {
+        return -EINVAL;
+    }
+
+    // Strips must start on a MCU row boundary (16 lines for YUV420), and one
+    // strip worth of MCUs must fit in the restart interval
+    const uint32_t mcuSize = DCTSIZE * 2;
+    const uint32_t mcusPerRow = (inSz.width + mcuSize - 1) / mcuSize;
+    const uint32_t mcuRows = (inSz.height + mcuSize - 1) / mcuSize;
+    uint32_t mcuRowsPerStrip = (mcuRows + mNumStrips - 1) / mNumStrips;
+    mcuRowsPerStrip = std::min(mcuRowsPerStrip, kMaxRestartInterval / mcusPerRow);
+    if (mcuRowsPerStrip == 0) {
+        ALOGE("%s: image width %u too large for restart markers", __FUNCTION__, inSz.width);
+        return -EINVAL;
+    }
+    const uint32_t numStrips = (mcuRows + mcuRowsPerStrip - 1) / mcuRowsPerStrip;
+
+    // Scratch buffers start at twice the strip's share of maxCodeSize, and a
+    // strip that does not fit is compressed again below with the full size
+    const size_t stripCodeSize = std::min(maxCodeSize,
+            2 * maxCodeSize / numStrips + kStripHeaderSize);
+    if (mStrips.size() < numStrips) {
+        mStrips.resize(numStrips);
+    }
+    for (uint32_t i = 0; i < numStrips; i++) {
+        Strip& strip = mStrips[i];
+        if (strip.compressor == nullptr) {
+            strip.compressor = std::make_unique<Compressor>();
+        }
+        reserveStripCode(&strip, stripCodeSize);
+        strip.size = 0;
+        strip.ret = 0;
+    }
+
+    auto compressStrip = [this, &inSz, &inLayout, jpegQuality, mcuRowsPerStrip, mcuSize](
+            uint32_t i) {
+        Strip& strip = mStrips[i];
+        uint32_t firstRow = i * mcuRowsPerStrip * mcuSize;
+        uint32_t numRows = std::min(mcuRowsPerStrip * mcuSize, inSz.height - firstRow);
+        strip.ret = strip.compressor->compress(inSz, inLayout, firstRow, numRows, jpegQuality,
+                nullptr, 0, strip.code.get(), strip.capacity, strip.size);
+    };
+
+    // Strip 0 is compressed on the calling thread
+    mWorkers.reserve(numStrips - 1);
+    for (uint32_t i = 1; i < numStrips; i++) {
+        mWorkers.post([&compressStrip, i] { compressStrip(i); });
+    }
+    compressStrip(0);
+    mWorkers.wait();
+
+    for (uint32_t i = 0; i < numStrips; i++) {
+        if (mStrips[i].ret == -ENOSPC && mStrips[i].capacity < maxCodeSize) {
+            reserveStripCode(&mStrips[i], maxCodeSize);
+            compressStrip(i);
+        }
+        if (mStrips[i].ret != 0) {
+            ALOGE("%s: strip %u/%u failed with %d", __FUNCTION__, i, numStrips, mStrips[i].ret);
+            return mStrips[i].ret;
+        }
+    }
+
+    mSize = inSz;
+    mRestartInterval = mcusPerRow * mcuRowsPerStrip;
+    mNumUsedStrips = numStrips;
+    return 0;
+}
+
+int JpegEncoder::write(const void *app1Buffer, size_t app1Size,
+        void *out, size_t maxOutSize, size_t &actualCodeSize) {
+    if (mNumUsedStrips == 0) {
+        ALOGE("%s: no compressed image to write", __FUNCTION__);
+        return -EINVAL;
+    }
+    if (app1Buffer != nullptr && app1Size + 2 > 0xFFFF) {
+        ALOGE("%s: APP1 size %zu too large", __FUNCTION__, app1Size);
+        return -EINVAL;
+    }
+
+    uint8_t* head = mStrips[0].code.get();
+    const size_t headSize = mStrips[0].size;
+    size_t sofEnd, sosEnd, app0End = 2;
+    ssize_t sofPos = findJpegMarker(head, headSize, kJpegMarkerSOF0, &sofEnd);
+    ssize_t sosPos = findJpegMarker(head, headSize, kJpegMarkerSOS, &sosEnd);
+    if (sofPos < 0 || sosPos < 0 || headSize < sosEnd + 2) {
+        ALOGE("%s: malformed JPEG header", __FUNCTION__);
+        return -EINVAL;
+    }
+    // Like libjpeg we put the APP1 segment right after the JFIF APP0 segment
+    if (findJpegMarker(head, headSize, kJpegMarkerAPP0, &app0End) < 0) {
+        app0End = 2;
+    }
+
+    // Every strip is encoded as its own image, patch the header of the first
+    // one to describe the full height
+    if (mNumUsedStrips > 1) {
+        head[sofPos + 5] = static_cast<uint8_t>(mSize.height >> 8);
+        head[sofPos + 6] = static_cast<uint8_t>(mSize.height & 0xFF);
+    }
+
+    uint8_t* dst = static_cast<uint8_t*>(out);
+    size_t pos = 0;
+    auto append = [&](const void* src, size_t size) {
+        if (pos + size > maxOutSize) {
+            return false;
+        }
+        memcpy(dst + pos, src, size);
+        pos += size;
+        return true;
+    };
+    auto appendMarker = [&](uint8_t marker, const uint8_t* payload, size_t size) {
+        uint8_t seg[4] = { 0xFF, marker, 0, 0 };
+        if (payload == nullptr) {
+            return append(seg, 2);
+        }
+        seg[2] = static_cast<uint8_t>((size + 2) >> 8);
+        seg[3] = static_cast<uint8_t>((size + 2) & 0xFF);
+        return append(seg, 4) && append(payload, size);
+    };
+
+    bool ok = append(head, app0End);
+    if (ok && app1Buffer != nullptr && app1Size != 0) {
+        ok = appendMarker(kJpegMarkerAPP1, static_cast<const uint8_t*>(app1Buffer), app1Size);
+    }
+    ok = ok && append(head + app0End, sosPos - app0End);
+    if (ok && mNumUsedStrips > 1) {
+        uint8_t dri[2] = { static_cast<uint8_t>(mRestartInterval >> 8),
+                           static_cast<uint8_t>(mRestartInterval & 0xFF) };
+        ok = appendMarker(kJpegMarkerDRI, dri, sizeof(dri));
+    }
+    // SOS and the entropy coded data of the first strip, minus its EOI
+    ok = ok && append(head + sosPos, headSize - 2 - sosPos);
+
+    for (uint32_t i = 1; ok && i < mNumUsedStrips; i++) {
+        const Strip& strip = mStrips[i];
+        size_t stripSosEnd;
+        if (findJpegMarker(strip.code.get(), strip.size, kJpegMarkerSOS, &stripSosEnd) < 0 ||
+                strip.size < stripSosEnd + 2) {
+            ALOGE("%s: malformed JPEG strip %u", __FUNCTION__, i);
+            return -EINVAL;
+        }
+        ok = appendMarker(kJpegMarkerRST0 + ((i - 1) % 8), nullptr, 0) &&
+                append(strip.code.get() + stripSosEnd, strip.size - 2 - stripSosEnd);
+    }
+    ok = ok && appendMarker(kJpegMarkerEOI, nullptr, 0);
+
+    if (!ok) {
+        ALOGE("%s: JPEG does not fit in %zu bytes", __FUNCTION__, maxOutSize);
+        return -ENOSPC;
+    }
+    actualCodeSize = pos;
+    return 0;
+}
+
+int encodeJpegYU12(
+        const Size & inSz, const YCbCrLayout& inLayout,
+        int jpegQuality, const void *app1Buffer, size_t app1Size,
+        void *out, const size_t maxOutSize, size_t &actualCodeSize)
+{
+    JpegEncoder encoder;
+    return encoder.encode(inSz, inLayout, jpegQuality, app1Buffer, app1Size,
+            out, maxOutSize, actualCodeSize);
+}
+
 Size getMaxThumbnailResolution(const common::V1_0::helper::CameraMetadata& chars) {
     Size thumbSize { 0, 0 };
     camera_metadata_ro_entry entry =
@@ -709,6 +1106,10 @@ namespace {
     const int kDefaultNumStillBuffer = 2;
     const int kDefaultOrientation = 0; // suitable for natural landscape displays like tablet/TV
                                        // For phone devices 270 is better
+    const int kDefaultNumDecodeThreads = 0;
+    const int kDefaultNumPipelineFrames = 3;
+    const V4L2MemoryType kDefaultV4l2MemoryType = V4L2MemoryType::MMAP;
+    const int kDefaultNumJpegEncodeStrips = 1;
 } // anonymous namespace
 
 const char* ExternalCameraConfig::kDefaultCfgPath = "/vendor/etc/external_camera_config.xml";
@@ -834,6 +1235,44 @@ ExternalCameraConfig ExternalCameraConfig::loadFromCfg(const char* cfgPath) {
         ret.orientation = orientation->IntAttribute("degree", /*Default*/kDefaultOrientation);
     }
 
+    XMLElement *decodePipeline = deviceCfg->FirstChildElement("DecodePipeline");
+    if (decodePipeline == nullptr) {
+        ALOGI("%s: no decode pipeline specified", __FUNCTION__);
+    } else {
+        ret.numDecodeThreads = decodePipeline->UnsignedAttribute(
+                "numThreads", /*Default*/kDefaultNumDecodeThreads);
+        ret.numPipelineFrames = decodePipeline->UnsignedAttribute(
+                "numFrames", /*Default*/kDefaultNumPipelineFrames);
+    }
+
+    XMLElement *v4l2Memory = deviceCfg->FirstChildElement("V4l2Memory");
+    if (v4l2Memory == nullptr) {
+        ALOGI("%s: no v4l2 memory type specified", __FUNCTION__);
+    } else {
+        const char* type = v4l2Memory->Attribute("type");
+        if (type == nullptr || !strcmp(type, "mmap")) {
+            ret.v4l2MemoryType = V4L2MemoryType::MMAP;
+        } else if (!strcmp(type, "userptr")) {
+            ret.v4l2MemoryType = V4L2MemoryType::USERPTR;
+        } else if (!strcmp(type, "dmabuf")) {
+            ret.v4l2MemoryType = V4L2MemoryType::DMABUF;
+        } else {
+            ALOGW("%s: unknown v4l2 memory type %s, use mmap", __FUNCTION__, type);
+        }
+    }
+
+    XMLElement *jpegEncoder = deviceCfg->FirstChildElement("JpegEncoder");
+    if (jpegEncoder == nullptr) {
+        ALOGI("%s: no jpeg encoder specified", __FUNCTION__);
+    } else {
+        ret.numJpegEncodeStrips = jpegEncoder->UnsignedAttribute(
+                "numStrips", /*Default*/kDefaultNumJpegEncodeStrips);
+        if (ret.numJpegEncodeStrips == 0) {
+            ALOGW("%s: invalid jpeg encoder strip count 0, use 1", __FUNCTION__);
+            ret.numJpegEncodeStrips = 1;
+        }
+    }
+
     ALOGI("%s: external camera cfg loaded: maxJpgBufSize %d,"
             " num video buffers %d, num still buffers %d, orientation %d",
             __FUNCTION__, ret.maxJpegBufSize,
@@ -848,6 +1287,10 @@ ExternalCameraConfig ExternalCameraConfig::loadFromCfg(const char* cfgPath) {
     }
     ALOGI("%s: minStreamSize: %dx%d" , __FUNCTION__,
          ret.minStreamSize.width, ret.minStreamSize.height);
+    ALOGI("%s: decode pipeline: %d threads, %d frames", __FUNCTION__,
+            ret.numDecodeThreads, ret.numPipelineFrames);
+    ALOGI("%s: v4l2 memory type %d", __FUNCTION__, static_cast<int>(ret.v4l2MemoryType));
+    ALOGI("%s: jpeg encoder: %d strips", __FUNCTION__, ret.numJpegEncodeStrips);
     return ret;
 }
 
@@ -885,7 +1328,11 @@ ExternalCameraConfig::ExternalCameraConfig() :
         numVideoBuffers(kDefaultNumVideoBuffer),
         numStillBuffers(kDefaultNumStillBuffer),
         depthEnabled(false),
-        orientation(kDefaultOrientation) {
+        orientation(kDefaultOrientation),
+        numDecodeThreads(kDefaultNumDecodeThreads),
+        numPipelineFrames(kDefaultNumPipelineFrames),
+        v4l2MemoryType(kDefaultV4l2MemoryType),
+        numJpegEncodeStrips(kDefaultNumJpegEncodeStrips) {
     fpsLimits.push_back({/*Size*/{ 640,  480}, /*FPS upper bound*/30.0});
     fpsLimits.push_back({/*Size*/{1280,  720}, /*FPS upper bound*/7.5});
     fpsLimits.push_back({/*Size*/{1920, 1080}, /*FPS upper bound*/5.0});
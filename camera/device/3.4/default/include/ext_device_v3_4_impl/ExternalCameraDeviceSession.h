@@ -22,9 +22,11 @@
 #include <fmq/MessageQueue.h>
 #include <hidl/MQDescriptor.h>
 #include <hidl/Status.h>
+#include <linux/videodev2.h>
 #include <include/convert.h>
 #include <chrono>
 #include <condition_variable>
+#include <deque>
 #include <list>
 #include <unordered_map>
 #include <unordered_set>
@@ -70,6 +72,7 @@ using ::android::hardware::camera::common::V1_0::helper::ExifUtils;
 using ::android::hardware::camera::external::common::ExternalCameraConfig;
 using ::android::hardware::camera::external::common::Size;
 using ::android::hardware::camera::external::common::SizeHasher;
+using ::android::hardware::camera::external::common::V4L2MemoryType;
 using ::android::hardware::graphics::common::V1_0::BufferUsage;
 using ::android::hardware::graphics::common::V1_0::Dataspace;
 using ::android::hardware::graphics::common::V1_0::PixelFormat;
@@ -128,6 +131,13 @@ struct ExternalCameraDeviceSession : public virtual RefBase,
 
         void setExifMakeModel(const std::string& make, const std::string& model);
 
+        // Enable the multi-threaded MJPEG decode pipeline. Must be called before
+        // allocateIntermediateBuffers. numDecodeThreads == 0 keeps the serial decode path.
+        void setDecodePipeline(uint32_t numDecodeThreads, uint32_t numPipelineFrames);
+
+        // Number of strips JPEG stills are split into and encoded in parallel
+        void setJpegEncodeStrips(uint32_t numStrips);
+
         // The remaining request list is returned for offline processing
         std::list<std::shared_ptr<HalRequest>> switchToOffline();
 
@@ -149,6 +159,10 @@ struct ExternalCameraDeviceSession : public virtual RefBase,
                 sp<AllocatedFrame>& in, const Size& outSize,
                 YCbCrLayout* out);
 
+        // Whether the MJPEG frame of req can be decoded straight into its single output
+        // buffer, skipping mYu12Frame
+        bool canDecodeToOutputLocked(const HalRequest& req) const;
+
         int cropAndScaleThumbLocked(
                 sp<AllocatedFrame>& in, const Size& outSize,
                 YCbCrLayout* out);
@@ -158,6 +172,61 @@ struct ExternalCameraDeviceSession : public virtual RefBase,
 
         void clearIntermediateBuffers();
 
+        // Decode pipeline stages, used for latency reporting in dump(). The stages of a
+        // request don't overlap, except for kStageShotToShot.
+        enum PipelineStage {
+            kStageQueue = 0, // submitRequest -> output thread picks up the pipelined decode
+            kStageDecode,    // MJPEG decode, to YU12 or straight into the output buffer
+            kStageConvert,   // crop/scale and format conversion of the YUV outputs
+            kStageDeliver,   // processCaptureResult
+            kStageJpeg,      // createJpegLocked
+            kStageShotToShot, // between the completion of two consecutive JPEG stills
+            kNumPipelineStages
+        };
+
+        struct StageStats {
+            uint64_t count = 0;
+            nsecs_t totalNs = 0;
+            nsecs_t maxNs = 0;
+        };
+
+        // One request in flight in the decode pipeline
+        struct DecodeSlot {
+            enum State { PENDING, DECODING, DONE };
+
+            std::shared_ptr<HalRequest> req;
+            State state = PENDING;
+            // Set when the request is flushed while a worker is decoding it. The worker
+            // then returns the frame to the pool instead of handing it to the output thread.
+            bool cancelled = false;
+            int result = 0;
+            nsecs_t submitTs = 0; // When the request was submitted to the pipeline
+            sp<AllocatedFrame> frame; // Pooled YU12 frame, valid once state is DECODING
+            YCbCrLayout layout;
+        };
+
+        class DecodeThread : public android::Thread {
+        public:
+            explicit DecodeThread(OutputThread* parent) : mParent(parent) {}
+            virtual bool threadLoop() override;
+        private:
+            OutputThread* const mParent; // The parent joins this thread before destruction
+        };
+
+        bool isDecodePipelineEnabled() const { return mNumDecodeThreads != 0; }
+        bool decodeOnce(); // Called by DecodeThread
+        void queueDecodeSlot(const std::shared_ptr<HalRequest>&);
+        // Returns the decoded slot of req, or nullptr if req is not in the pipeline
+        std::shared_ptr<DecodeSlot> waitForDecodedSlot(const std::shared_ptr<HalRequest>& req);
+        void releaseDecodeSlot(const std::shared_ptr<DecodeSlot>&);
+        void releaseFrameLocked(const sp<AllocatedFrame>&);
+        void cancelPendingDecodes();
+        void stopDecodeThreads();
+        Status allocateFramePool(const Size& v4lSize);
+        void recordStageLatency(PipelineStage stage, nsecs_t latencyNs);
+        void recordStageLatencyLocked(PipelineStage stage, nsecs_t latencyNs);
+        void updateMuteStateLocked(const common::V1_0::helper::CameraMetadata& settings);
+
         const wp<OutputThreadInterface> mParent;
         const CroppingType mCroppingType;
         const common::V1_0::helper::CameraMetadata mCameraCharacteristics;
@@ -172,8 +241,9 @@ struct ExternalCameraDeviceSession : public virtual RefBase,
 
         // V4L2 frameIn
         // (MJPG decode)-> mYu12Frame
-        // (Scale)-> mScaledYu12Frames
+        // (Scale)-> mScaledYu12Frames, shared by all streams of the same size
         // (Format convert) -> output gralloc frames
+        // A single output stream of the V4L2 size is decoded directly to its gralloc frame
         mutable std::mutex mBufferLock; // Protect access to intermediate buffers
         sp<AllocatedFrame> mYu12Frame;
         sp<AllocatedFrame> mYu12ThumbFrame;
@@ -188,6 +258,33 @@ struct ExternalCameraDeviceSession : public virtual RefBase,
 
         std::string mExifMake;
         std::string mExifModel;
+
+        // Still capture encoders, reused across captures. The thumbnail and EXIF are
+        // generated on mJpegHelper while mJpegEncoder compresses the main image.
+        JpegEncoder mJpegEncoder;
+        JpegEncoder mThumbEncoder;
+        WorkerPool mJpegHelper;
+        nsecs_t mLastJpegDoneTs = 0;
+
+        // MJPEG decode pipeline
+        // processCaptureRequest (V4L2 DQBUF)
+        // -> submitRequest: one DecodeSlot per request, in request order
+        // (DecodeThread: MJPG decode)-> pooled YU12 frame
+        // (OutputThread: swap into mYu12Frame, scale/convert/encode)-> output gralloc frames
+        // The depth of the pipeline is bounded by the number of V4L2 buffers and the number
+        // of pooled frames decodes can run ahead of the output thread.
+        uint32_t mNumDecodeThreads = 0;
+        uint32_t mNumPipelineFrames = 0;
+        std::vector<sp<DecodeThread>> mDecodeThreads;
+        mutable std::mutex mPipelineLock; // Protect the members below
+        std::condition_variable mDecodeCond;     // signaled when decode work may be available
+        std::condition_variable mDecodeDoneCond; // signaled when a slot finishes decoding
+        std::deque<std::shared_ptr<DecodeSlot>> mDecodeSlots;
+        std::vector<sp<AllocatedFrame>> mFreeFrames;
+        Size mFramePoolSize = {0, 0};
+        bool mDecodeExiting = false;
+        StageStats mStageStats[kNumPipelineStages];
+        uint64_t mNumDroppedFrames = 0;
     };
 
 protected:
@@ -267,7 +364,16 @@ protected:
     // slowest fps that is at least 30, or fastest fps if 30 is not supported
     int configureV4l2StreamLocked(const SupportedV4L2Format& fmt, double fps = 0.0);
     int v4l2StreamOffLocked();
+    // Release the buffers requested by a configureV4l2StreamLocked call that failed
+    void releaseV4l2BuffersLocked();
     int setV4l2FpsLocked(double fps);
+    // V4L2_MEMORY_* matching mCfg.v4l2MemoryType
+    uint32_t getV4l2Memory() const;
+    // Fill the memory type (and user pointer for USERPTR) of a buffer about to be queued
+    void setV4l2BufferMemory(v4l2_buffer* buffer) const;
+    int allocateV4l2UserPtrBuffersLocked(uint32_t count, uint32_t bufferSize);
+    int exportV4l2BufferLocked(uint32_t index, uint32_t length);
+    void freeV4l2BuffersLocked();
     static Status isStreamCombinationSupported(const V3_2::StreamConfiguration& config,
             const std::vector<SupportedV4L2Format>& supportedFormats,
             const ExternalCameraConfig& devCfg);
@@ -350,6 +456,19 @@ protected:
     std::condition_variable mV4L2BufferReturned;
     size_t mNumDequeuedV4l2Buffers = 0;
     uint32_t mMaxV4L2BufferSize = 0;
+    // Input bandwidth counters, reported in dumpState
+    uint64_t mNumV4l2FramesDequeued = 0;
+    uint64_t mV4l2BytesDequeued = 0;
+
+    // Capture buffers mapped for the whole streaming session when mCfg.v4l2MemoryType is
+    // USERPTR or DMABUF. Set up in configureV4l2StreamLocked and released in
+    // v4l2StreamOffLocked, both of which only run while no V4L2 buffer is dequeued.
+    struct V4L2Buffer {
+        uint8_t* data = nullptr;
+        size_t length = 0;
+        unique_fd dmaBufFd; // DMABUF only
+    };
+    std::vector<V4L2Buffer> mV4L2Buffers;
 
     // Not protected by mLock (but might be used when mLock is locked)
     sp<OutputThread> mOutputThread;
@@ -22,7 +22,12 @@
 #include <android/hardware/graphics/common/1.0/types.h>
 #include <android/hardware/graphics/mapper/2.0/IMapper.h>
 #include <inttypes.h>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
 #include <mutex>
+#include <thread>
 #include <unordered_map>
 #include <unordered_set>
 #include <vector>
@@ -64,6 +69,13 @@ struct SizeHasher {
     }
 };
 
+// How V4L2 capture buffers are allocated and mapped
+enum class V4L2MemoryType {
+    MMAP,    // Driver allocated, mmap'ed for each dequeued frame
+    USERPTR, // Allocated by the HAL from a pool, handed to the driver as user pointers
+    DMABUF,  // Driver allocated, exported with VIDIOC_EXPBUF and mapped once when streaming
+};
+
 struct ExternalCameraConfig {
     static const char* kDefaultCfgPath;
     static ExternalCameraConfig loadFromCfg(const char* cfgPath = kDefaultCfgPath);
@@ -102,6 +114,20 @@ struct ExternalCameraConfig {
     // The value of android.sensor.orientation
     int32_t orientation;
 
+    // Number of MJPEG decode worker threads. 0 disables the decode pipeline and MJPEG frames
+    // are decoded serially on the output thread.
+    uint32_t numDecodeThreads;
+
+    // Number of YU12 frames the decode pipeline may decode ahead of the output thread
+    uint32_t numPipelineFrames;
+
+    // V4L2 capture buffer memory type
+    V4L2MemoryType v4l2MemoryType;
+
+    // Number of horizontal strips JPEG stills are split into and encoded in parallel.
+    // 1 encodes the whole image on the output thread.
+    uint32_t numJpegEncodeStrips;
+
 private:
     ExternalCameraConfig();
     static bool updateFpsList(tinyxml2::XMLElement* fpsList, std::vector<FpsLimitation>& fpsLimits);
@@ -145,6 +171,10 @@ class V4L2Frame : public Frame {
 public:
     V4L2Frame(uint32_t w, uint32_t h, uint32_t fourcc, int bufIdx, int fd,
               uint32_t dataSize, uint64_t offset);
+    // Frame backed by a capture buffer the caller keeps mapped (USERPTR or DMABUF memory).
+    // map() returns the data directly and unmap() is a no-op.
+    V4L2Frame(uint32_t w, uint32_t h, uint32_t fourcc, int bufIdx,
+              uint8_t* data, uint32_t dataSize);
     ~V4L2Frame() override;
 
     virtual int getData(uint8_t** outData, size_t* dataSize) override;
@@ -159,6 +189,7 @@ private:
     const uint64_t mOffset; // used for mmap
     uint8_t* mData = nullptr;
     bool  mMapped = false;
+    const bool mOwnsMapping = true;
 };
 
 // A RAII class representing a CPU allocated YUV frame used as intermeidate buffers
@@ -242,6 +273,89 @@ int getCropRect(CroppingType ct, const Size& inSize,
 
 int formatConvert(const YCbCrLayout& in, const YCbCrLayout& out, Size sz, uint32_t format);
 
+// Decode a MJPEG frame of size sz directly into out, laid out as format.
+// Supports YV12/YU12/NV12/NV21; returns -EINVAL for other formats.
+int decodeMjpeg(const uint8_t* in, size_t inSize, const YCbCrLayout& out, Size sz,
+        uint32_t format);
+
+// Whether a MJPEG frame of size frameSize can be decoded straight into the output buffers,
+// which needs a single YUV buffer of the same size, as decodeMjpeg neither crops nor scales.
+bool canDecodeMjpegToOutput(const std::vector<HalStreamBuffer>& buffers, Size frameSize);
+
+// Threads kept alive across still captures, so each capture does not pay for
+// creating and joining threads
+class WorkerPool {
+public:
+    WorkerPool() = default;
+    ~WorkerPool();
+
+    // Grows the pool to at least numThreads threads
+    void reserve(uint32_t numThreads);
+    void post(std::function<void()> task);
+    // Returns once every posted task has run
+    void wait();
+
+private:
+    void threadLoop();
+
+    std::mutex mLock;
+    std::condition_variable mTaskCond; // new task or exiting
+    std::condition_variable mIdleCond; // mNumPendingTasks dropped to 0
+    std::deque<std::function<void()>> mTasks;
+    size_t mNumPendingTasks = 0; // queued or running
+    bool mExiting = false;
+    std::vector<std::thread> mThreads;
+};
+
+// Encodes YU12 images to JPEG. The libjpeg compressor objects, scratch
+// buffers and worker threads are kept alive across captures. When configured
+// with more than one strip, the image is split into horizontal strips that are
+// compressed in parallel and stitched back together with restart markers.
+class JpegEncoder {
+public:
+    explicit JpegEncoder(uint32_t numStrips = 1);
+    ~JpegEncoder();
+
+    void setNumStrips(uint32_t numStrips);
+
+    // Same contract as encodeJpegYU12
+    int encode(const Size &inSz,
+            const YCbCrLayout& inLayout, int jpegQuality,
+            const void *app1Buffer, size_t app1Size,
+            void *out, size_t maxOutSize,
+            size_t &actualCodeSize);
+
+    // Split encoding so the APP1 segment can be generated while the main
+    // image is being compressed: compress() encodes into internal scratch
+    // buffers, write() then emits the final JPEG with the APP1 segment.
+    int compress(const Size &inSz, const YCbCrLayout& inLayout, int jpegQuality,
+            size_t maxCodeSize);
+    int write(const void *app1Buffer, size_t app1Size,
+            void *out, size_t maxOutSize, size_t &actualCodeSize);
+
+private:
+    struct Compressor;
+    struct Strip {
+        std::unique_ptr<Compressor> compressor;
+        std::unique_ptr<uint8_t[]> code;
+        size_t capacity = 0;
+        size_t size = 0;
+        int ret = 0;
+    };
+
+    // Grows the scratch code buffer, it is never shrunk so captures reuse it
+    static void reserveStripCode(Strip* strip, size_t size);
+
+    uint32_t mNumStrips = 1;
+    std::vector<Strip> mStrips;
+    // Compresses strips 1..N-1, strip 0 runs on the calling thread
+    WorkerPool mWorkers;
+    // Number of strips holding the last compress() output, 0 if none
+    uint32_t mNumUsedStrips = 0;
+    uint32_t mRestartInterval = 0;
+    Size mSize;
+};
+
 int encodeJpegYU12(const Size &inSz,
         const YCbCrLayout& inLayout, int jpegQuality,
         const void *app1Buffer, size_t app1Size,
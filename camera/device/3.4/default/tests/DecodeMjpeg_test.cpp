@@ -0,0 +1,164 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Checks that decoding MJPEG straight into an output buffer produces the same image as the
+// fallback path, which decodes to YU12 and then converts to the output format.
+
+#include <gtest/gtest.h>
+
+#include <linux/videodev2.h>
+
+#include "ExternalCameraUtils.h"
+
+#include <cerrno>
+#include <vector>
+
+namespace {
+
+using ::android::sp;
+using ::android::hardware::camera::device::V3_4::implementation::AllocatedFrame;
+using ::android::hardware::camera::device::V3_4::implementation::canDecodeMjpegToOutput;
+using ::android::hardware::camera::device::V3_4::implementation::decodeMjpeg;
+using ::android::hardware::camera::device::V3_4::implementation::encodeJpegYU12;
+using ::android::hardware::camera::device::V3_4::implementation::FLEX_YUV_GENERIC;
+using ::android::hardware::camera::device::V3_4::implementation::formatConvert;
+using ::android::hardware::camera::device::V3_4::implementation::getFourCcFromLayout;
+using ::android::hardware::camera::device::V3_4::implementation::HalStreamBuffer;
+using ::android::hardware::camera::external::common::Size;
+using ::android::hardware::graphics::common::V1_0::PixelFormat;
+using ::android::hardware::graphics::mapper::V2_0::YCbCrLayout;
+
+constexpr Size kFrameSize = {320, 240};
+
+// A 4:2:0 image in one buffer, laid out as one of the formats decodeMjpeg supports
+class YuvImage {
+  public:
+    YuvImage(Size sz, uint32_t fourcc) : mData(sz.width * sz.height * 3 / 2) {
+        uint8_t* y = mData.data();
+        uint8_t* c = y + sz.width * sz.height;
+        size_t planeSize = sz.width * sz.height / 4;
+        switch (fourcc) {
+            case V4L2_PIX_FMT_YUV420:
+                mLayout = {y, c, c + planeSize, sz.width, sz.width / 2, 1};
+                break;
+            case V4L2_PIX_FMT_YVU420:
+                mLayout = {y, c + planeSize, c, sz.width, sz.width / 2, 1};
+                break;
+            case V4L2_PIX_FMT_NV12:
+                mLayout = {y, c, c + 1, sz.width, sz.width, 2};
+                break;
+            case V4L2_PIX_FMT_NV21:
+                mLayout = {y, c + 1, c, sz.width, sz.width, 2};
+                break;
+        }
+    }
+
+    const YCbCrLayout& layout() const { return mLayout; }
+    const std::vector<uint8_t>& data() const { return mData; }
+
+  private:
+    std::vector<uint8_t> mData;
+    YCbCrLayout mLayout = {};
+};
+
+// Encodes a frame with gradients in all planes, so that a swapped or misplaced plane shows up
+std::vector<uint8_t> encodeGradient(Size sz) {
+    sp<AllocatedFrame> frame = new AllocatedFrame(sz.width, sz.height);
+    YCbCrLayout layout;
+    if (frame->allocate(&layout) != 0) {
+        return {};
+    }
+    for (uint32_t row = 0; row < sz.height; row++) {
+        for (uint32_t col = 0; col < sz.width; col++) {
+            static_cast<uint8_t*>(layout.y)[row * layout.yStride + col] = (row + col) & 0xff;
+        }
+    }
+    for (uint32_t row = 0; row < sz.height / 2; row++) {
+        for (uint32_t col = 0; col < sz.width / 2; col++) {
+            static_cast<uint8_t*>(layout.cb)[row * layout.cStride + col] = 64 + col / 2;
+            static_cast<uint8_t*>(layout.cr)[row * layout.cStride + col] = 192 - row / 2;
+        }
+    }
+
+    std::vector<uint8_t> jpeg(sz.width * sz.height * 3 / 2);
+    size_t jpegSize = 0;
+    if (encodeJpegYU12(sz, layout, 90 /* jpegQuality */, nullptr /* app1Buffer */,
+                       0 /* app1Size */, jpeg.data(), jpeg.size(), jpegSize) != 0) {
+        return {};
+    }
+    jpeg.resize(jpegSize);
+    return jpeg;
+}
+
+HalStreamBuffer makeBuffer(PixelFormat format, Size sz) {
+    HalStreamBuffer halBuf = {};
+    halBuf.format = format;
+    halBuf.width = sz.width;
+    halBuf.height = sz.height;
+    return halBuf;
+}
+
+TEST(DecodeMjpegTest, DecodesToOutputOnlyForSingleUnscaledYuvBuffer) {
+    const HalStreamBuffer yuv = makeBuffer(PixelFormat::YCBCR_420_888, kFrameSize);
+    EXPECT_TRUE(canDecodeMjpegToOutput({yuv}, kFrameSize));
+    EXPECT_TRUE(canDecodeMjpegToOutput({makeBuffer(PixelFormat::YV12, kFrameSize)}, kFrameSize));
+
+    // Anything else goes through the intermediate YU12 frame
+    EXPECT_FALSE(canDecodeMjpegToOutput({}, kFrameSize));
+    EXPECT_FALSE(canDecodeMjpegToOutput({yuv, yuv}, kFrameSize));
+    EXPECT_FALSE(canDecodeMjpegToOutput({makeBuffer(PixelFormat::BLOB, kFrameSize)}, kFrameSize));
+    EXPECT_FALSE(canDecodeMjpegToOutput({makeBuffer(PixelFormat::Y16, kFrameSize)}, kFrameSize));
+    EXPECT_FALSE(canDecodeMjpegToOutput(
+            {makeBuffer(PixelFormat::YCBCR_420_888, {kFrameSize.width / 2, kFrameSize.height / 2})},
+            kFrameSize));
+    EXPECT_FALSE(canDecodeMjpegToOutput(
+            {makeBuffer(PixelFormat::YCBCR_420_888, {kFrameSize.width, kFrameSize.height / 2})},
+            kFrameSize));
+}
+
+TEST(DecodeMjpegTest, DecodesToOutputLikeFallback) {
+    const std::vector<uint8_t> jpeg = encodeGradient(kFrameSize);
+    ASSERT_FALSE(jpeg.empty());
+
+    // The fallback path of the output thread
+    YuvImage yu12(kFrameSize, V4L2_PIX_FMT_YUV420);
+    ASSERT_EQ(decodeMjpeg(jpeg.data(), jpeg.size(), yu12.layout(), kFrameSize,
+                          V4L2_PIX_FMT_YUV420),
+              0);
+
+    for (uint32_t fourcc : {V4L2_PIX_FMT_YUV420, V4L2_PIX_FMT_YVU420, V4L2_PIX_FMT_NV12,
+                            V4L2_PIX_FMT_NV21}) {
+        SCOPED_TRACE(fourcc);
+        YuvImage converted(kFrameSize, fourcc);
+        ASSERT_EQ(getFourCcFromLayout(converted.layout()), fourcc);
+        ASSERT_EQ(formatConvert(yu12.layout(), converted.layout(), kFrameSize, fourcc), 0);
+
+        YuvImage decoded(kFrameSize, fourcc);
+        ASSERT_EQ(decodeMjpeg(jpeg.data(), jpeg.size(), decoded.layout(), kFrameSize, fourcc), 0);
+        EXPECT_EQ(decoded.data(), converted.data());
+    }
+}
+
+TEST(DecodeMjpegTest, RejectsFlexibleLayout) {
+    const std::vector<uint8_t> jpeg = encodeGradient(kFrameSize);
+    ASSERT_FALSE(jpeg.empty());
+    YuvImage image(kFrameSize, V4L2_PIX_FMT_YUV420);
+    ASSERT_EQ(getFourCcFromLayout(YCbCrLayout{}), FLEX_YUV_GENERIC);
+    EXPECT_EQ(decodeMjpeg(jpeg.data(), jpeg.size(), image.layout(), kFrameSize, FLEX_YUV_GENERIC),
+              -EINVAL);
+}
+
+}  // namespace
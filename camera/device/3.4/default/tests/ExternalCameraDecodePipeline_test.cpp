@@ -0,0 +1,215 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Runs the OutputThread MJPEG decode pipeline against a fake session, with requests that have no
+// output buffers, so that only the decode and the ordering of the results are exercised.
+
+#include <gtest/gtest.h>
+
+#include <linux/videodev2.h>
+
+#include "ExternalCameraDeviceSession.h"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <mutex>
+#include <vector>
+
+namespace {
+
+using ::android::sp;
+using ::android::hardware::camera::common::V1_0::Status;
+using ::android::hardware::camera::device::V3_2::CaptureResult;
+using ::android::hardware::camera::device::V3_2::ErrorCode;
+using ::android::hardware::camera::device::V3_2::NotifyMsg;
+using ::android::hardware::camera::device::V3_4::implementation::AllocatedFrame;
+using ::android::hardware::camera::device::V3_4::implementation::CroppingType;
+using ::android::hardware::camera::device::V3_4::implementation::encodeJpegYU12;
+using ::android::hardware::camera::device::V3_4::implementation::ExternalCameraDeviceSession;
+using ::android::hardware::camera::device::V3_4::implementation::Frame;
+using ::android::hardware::camera::device::V3_4::implementation::HalRequest;
+using ::android::hardware::camera::device::V3_4::implementation::OutputThreadInterface;
+using ::android::hardware::camera::external::common::Size;
+using ::android::hardware::graphics::mapper::V2_0::YCbCrLayout;
+
+using OutputThread = ExternalCameraDeviceSession::OutputThread;
+
+constexpr Size kFrameSize = {640, 480};
+constexpr Size kThumbSize = {160, 120};
+constexpr uint32_t kNumDecodeThreads = 2;
+constexpr uint32_t kNumPipelineFrames = 3;
+constexpr auto kResultTimeout = std::chrono::seconds(5);
+
+// An MJPEG frame as dequeued from V4L2
+class MjpegFrame : public Frame {
+  public:
+    explicit MjpegFrame(std::vector<uint8_t> data)
+        : Frame(kFrameSize.width, kFrameSize.height, V4L2_PIX_FMT_MJPEG), mData(std::move(data)) {}
+
+    int getData(uint8_t** outData, size_t* dataSize) override {
+        *outData = mData.data();
+        *dataSize = mData.size();
+        return 0;
+    }
+
+  private:
+    std::vector<uint8_t> mData;
+};
+
+// Records the frame numbers returned by the OutputThread
+class FakeSession : public OutputThreadInterface {
+  public:
+    Status importBuffer(int32_t, uint64_t, buffer_handle_t, buffer_handle_t**, bool) override {
+        return Status::INTERNAL_ERROR;
+    }
+
+    void notifyError(uint32_t, int32_t, ErrorCode) override {}
+
+    Status processCaptureRequestError(const std::shared_ptr<HalRequest>& req,
+                                      std::vector<NotifyMsg>*,
+                                      std::vector<CaptureResult>*) override {
+        std::lock_guard<std::mutex> lock(mLock);
+        mErrors.push_back(req->frameNumber);
+        mCond.notify_all();
+        return Status::OK;
+    }
+
+    Status processCaptureResult(std::shared_ptr<HalRequest>& req) override {
+        std::lock_guard<std::mutex> lock(mLock);
+        mResults.push_back(req->frameNumber);
+        mCond.notify_all();
+        return Status::OK;
+    }
+
+    ssize_t getJpegBufferSize(uint32_t, uint32_t) const override { return 0; }
+
+    // Waits for |count| requests to be returned, with or without an error.
+    bool waitForReturned(size_t count) {
+        std::unique_lock<std::mutex> lock(mLock);
+        return mCond.wait_for(lock, kResultTimeout,
+                              [&] { return mResults.size() + mErrors.size() >= count; });
+    }
+
+    std::mutex mLock;
+    std::condition_variable mCond;
+    std::vector<uint32_t> mResults;
+    std::vector<uint32_t> mErrors;
+};
+
+std::vector<uint8_t> encodeTestFrame() {
+    sp<AllocatedFrame> frame = new AllocatedFrame(kFrameSize.width, kFrameSize.height);
+    YCbCrLayout layout;
+    if (frame->allocate(&layout) != 0) {
+        return {};
+    }
+    uint8_t* data;
+    size_t dataSize;
+    frame->getData(&data, &dataSize);
+    memset(data, 0x80, dataSize);
+
+    std::vector<uint8_t> jpeg(kFrameSize.width * kFrameSize.height * 3 / 2);
+    size_t jpegSize = 0;
+    if (encodeJpegYU12(kFrameSize, layout, 90 /* jpegQuality */, nullptr /* app1Buffer */,
+                       0 /* app1Size */, jpeg.data(), jpeg.size(), jpegSize) != 0) {
+        return {};
+    }
+    jpeg.resize(jpegSize);
+    return jpeg;
+}
+
+class ExternalCameraDecodePipelineTest : public ::testing::Test {
+  protected:
+    void SetUp() override {
+        mJpeg = encodeTestFrame();
+        ASSERT_FALSE(mJpeg.empty());
+        mSession = new FakeSession();
+        mThread = new OutputThread(mSession, CroppingType::VERTICAL, {});
+        mThread->setDecodePipeline(kNumDecodeThreads, kNumPipelineFrames);
+        ASSERT_EQ(mThread->allocateIntermediateBuffers(kFrameSize, kThumbSize, {}, 0),
+                  Status::OK);
+        mThread->run("ExtCamPipelineTest");
+    }
+
+    void TearDown() override {
+        mThread->requestExit();
+        mThread->join();
+    }
+
+    void submit(uint32_t frameNumber, std::vector<uint8_t> data) {
+        auto req = std::make_shared<HalRequest>();
+        req->frameNumber = frameNumber;
+        req->frameIn = new MjpegFrame(std::move(data));
+        req->shutterTs = 0;
+        ASSERT_EQ(mThread->submitRequest(req), Status::OK);
+    }
+
+    std::vector<uint8_t> mJpeg;
+    sp<FakeSession> mSession;
+    sp<OutputThread> mThread;
+};
+
+TEST_F(ExternalCameraDecodePipelineTest, ReturnsResultsInRequestOrder) {
+    constexpr uint32_t kNumRequests = 20;
+    for (uint32_t i = 0; i < kNumRequests; i++) {
+        submit(i, mJpeg);
+    }
+    ASSERT_TRUE(mSession->waitForReturned(kNumRequests));
+
+    std::lock_guard<std::mutex> lock(mSession->mLock);
+    EXPECT_TRUE(mSession->mErrors.empty());
+    ASSERT_EQ(mSession->mResults.size(), kNumRequests);
+    for (uint32_t i = 0; i < kNumRequests; i++) {
+        EXPECT_EQ(mSession->mResults[i], i);
+    }
+}
+
+TEST_F(ExternalCameraDecodePipelineTest, MalformedFrameOnlyFailsItsRequest) {
+    submit(0, mJpeg);
+    submit(1, std::vector<uint8_t>(mJpeg.size(), 0xab));
+    submit(2, mJpeg);
+    ASSERT_TRUE(mSession->waitForReturned(3));
+
+    std::lock_guard<std::mutex> lock(mSession->mLock);
+    EXPECT_EQ(mSession->mResults, std::vector<uint32_t>({0, 2}));
+    EXPECT_EQ(mSession->mErrors, std::vector<uint32_t>({1}));
+}
+
+TEST_F(ExternalCameraDecodePipelineTest, FlushReturnsEveryRequestOnce) {
+    constexpr uint32_t kNumRequests = 20;
+    for (uint32_t i = 0; i < kNumRequests; i++) {
+        submit(i, mJpeg);
+    }
+    mThread->flush();
+    ASSERT_TRUE(mSession->waitForReturned(kNumRequests));
+
+    // The pipeline keeps working once flushed
+    submit(kNumRequests, mJpeg);
+    ASSERT_TRUE(mSession->waitForReturned(kNumRequests + 1));
+
+    std::lock_guard<std::mutex> lock(mSession->mLock);
+    std::vector<uint32_t> returned = mSession->mResults;
+    returned.insert(returned.end(), mSession->mErrors.begin(), mSession->mErrors.end());
+    std::sort(returned.begin(), returned.end());
+    ASSERT_EQ(returned.size(), kNumRequests + 1);
+    for (uint32_t i = 0; i <= kNumRequests; i++) {
+        EXPECT_EQ(returned[i], i);
+    }
+    EXPECT_EQ(mSession->mResults.back(), kNumRequests);
+}
+
+}  // namespace
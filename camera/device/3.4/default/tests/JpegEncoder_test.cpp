@@ -0,0 +1,175 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Checks that JPEGs stitched from strips decode to the same image as a single-pass encode.
+
+#include <gtest/gtest.h>
+
+#include <jpeglib.h>
+
+#include "ExternalCameraUtils.h"
+
+#include <vector>
+
+namespace {
+
+using ::android::sp;
+using ::android::hardware::camera::device::V3_4::implementation::AllocatedFrame;
+using ::android::hardware::camera::device::V3_4::implementation::JpegEncoder;
+using ::android::hardware::camera::external::common::Size;
+using ::android::hardware::graphics::mapper::V2_0::YCbCrLayout;
+
+constexpr int kJpegQuality = 90;
+constexpr uint8_t kMarkerDRI = 0xDD;
+
+struct DecodedImage {
+    uint32_t width = 0;
+    uint32_t height = 0;
+    std::vector<uint8_t> rgb;
+};
+
+struct DecodeError : public jpeg_error_mgr {
+    bool failed = false;
+};
+
+bool decodeJpeg(const std::vector<uint8_t>& jpeg, DecodedImage* out) {
+    jpeg_decompress_struct dinfo = {};
+    DecodeError jerr;
+    dinfo.err = jpeg_std_error(&jerr);
+    jerr.output_message = [](j_common_ptr) {};
+    jerr.error_exit = [](j_common_ptr cinfo) {
+        static_cast<DecodeError*>(cinfo->err)->failed = true;
+    };
+    jpeg_create_decompress(&dinfo);
+    jpeg_mem_src(&dinfo, const_cast<uint8_t*>(jpeg.data()), jpeg.size());
+
+    bool ok = jpeg_read_header(&dinfo, TRUE) == JPEG_HEADER_OK && !jerr.failed;
+    if (ok) {
+        dinfo.out_color_space = JCS_RGB;
+        ok = jpeg_start_decompress(&dinfo) && !jerr.failed;
+    }
+    if (ok) {
+        out->width = dinfo.output_width;
+        out->height = dinfo.output_height;
+        size_t stride = dinfo.output_width * dinfo.output_components;
+        out->rgb.resize(stride * dinfo.output_height);
+        while (ok && dinfo.output_scanline < dinfo.output_height) {
+            JSAMPROW row = out->rgb.data() + dinfo.output_scanline * stride;
+            ok = jpeg_read_scanlines(&dinfo, &row, 1) == 1 && !jerr.failed;
+        }
+    }
+    if (ok) {
+        jpeg_finish_decompress(&dinfo);
+        ok = !jerr.failed;
+    }
+    jpeg_destroy_decompress(&dinfo);
+    return ok;
+}
+
+bool hasMarker(const std::vector<uint8_t>& jpeg, uint8_t marker) {
+    for (size_t i = 0; i + 1 < jpeg.size(); i++) {
+        if (jpeg[i] == 0xFF && jpeg[i + 1] == marker) {
+            return true;
+        }
+    }
+    return false;
+}
+
+class JpegEncoderTest : public ::testing::TestWithParam<Size> {
+  protected:
+    void SetUp() override {
+        mSize = GetParam();
+        mFrame = new AllocatedFrame(mSize.width, mSize.height);
+        ASSERT_EQ(mFrame->allocate(&mLayout), 0);
+
+        // Gradients plus a checkerboard, so every strip has different content
+        uint8_t* y = static_cast<uint8_t*>(mLayout.y);
+        for (uint32_t r = 0; r < mSize.height; r++) {
+            for (uint32_t c = 0; c < mSize.width; c++) {
+                uint8_t checker = ((r / 8 + c / 8) % 2) ? 0x40 : 0;
+                y[r * mLayout.yStride + c] = static_cast<uint8_t>((r + c) / 4 + checker);
+            }
+        }
+        uint8_t* cb = static_cast<uint8_t*>(mLayout.cb);
+        uint8_t* cr = static_cast<uint8_t*>(mLayout.cr);
+        for (uint32_t r = 0; r < mSize.height / 2; r++) {
+            for (uint32_t c = 0; c < mSize.width / 2; c++) {
+                cb[r * mLayout.cStride + c] = static_cast<uint8_t>(r * 255 / mSize.height);
+                cr[r * mLayout.cStride + c] = static_cast<uint8_t>(c * 255 / mSize.width);
+            }
+        }
+    }
+
+    std::vector<uint8_t> encode(JpegEncoder& encoder) {
+        std::vector<uint8_t> jpeg(mSize.width * mSize.height * 3);
+        size_t jpegSize = 0;
+        if (encoder.encode(mSize, mLayout, kJpegQuality, nullptr /* app1Buffer */,
+                           0 /* app1Size */, jpeg.data(), jpeg.size(), jpegSize) != 0) {
+            return {};
+        }
+        jpeg.resize(jpegSize);
+        return jpeg;
+    }
+
+    Size mSize;
+    sp<AllocatedFrame> mFrame;
+    YCbCrLayout mLayout;
+};
+
+TEST_P(JpegEncoderTest, StripsDecodeLikeSinglePass) {
+    JpegEncoder singlePass;
+    std::vector<uint8_t> reference = encode(singlePass);
+    ASSERT_FALSE(reference.empty());
+    DecodedImage expected;
+    ASSERT_TRUE(decodeJpeg(reference, &expected));
+    ASSERT_EQ(expected.width, mSize.width);
+    ASSERT_EQ(expected.height, mSize.height);
+
+    JpegEncoder encoder;
+    for (uint32_t numStrips : {2u, 3u, 7u}) {
+        SCOPED_TRACE(numStrips);
+        encoder.setNumStrips(numStrips);
+        // Encode twice so the second run reuses the workers and scratch buffers
+        for (int run = 0; run < 2; run++) {
+            std::vector<uint8_t> jpeg = encode(encoder);
+            ASSERT_FALSE(jpeg.empty());
+            EXPECT_TRUE(hasMarker(jpeg, kMarkerDRI));
+
+            DecodedImage decoded;
+            ASSERT_TRUE(decodeJpeg(jpeg, &decoded));
+            ASSERT_EQ(decoded.width, expected.width);
+            ASSERT_EQ(decoded.height, expected.height);
+            EXPECT_EQ(decoded.rgb, expected.rgb);
+        }
+    }
+}
+
+TEST_P(JpegEncoderTest, FailsWhenOutputTooSmall) {
+    JpegEncoder encoder(3);
+    std::vector<uint8_t> jpeg(1024);
+    size_t jpegSize = 0;
+    EXPECT_NE(encoder.encode(mSize, mLayout, kJpegQuality, nullptr, 0, jpeg.data(), jpeg.size(),
+                             jpegSize),
+              0);
+    // The encoder still works once given enough room
+    EXPECT_FALSE(encode(encoder).empty());
+}
+
+// 472 is not a multiple of the 16 line MCU, so the last strip is padded
+INSTANTIATE_TEST_SUITE_P(Sizes, JpegEncoderTest,
+                         ::testing::Values(Size{640, 480}, Size{640, 472}, Size{320, 64}));
+
+}  // namespace
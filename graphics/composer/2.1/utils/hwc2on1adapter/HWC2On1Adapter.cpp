@@ -528,6 +528,9 @@ HWC2On1Adapter::Display::Display(HWC2On1Adapter& device, HWC2::DisplayType type)
     mHwc1LayerMap(),
     mNumAvailableRects(0),
     mNextAvailableRect(nullptr),
+    mNumAllocatedLayers(0),
+    mNumAllocatedRects(0),
+    mLayersChanged(true),
     mGeometryChanged(false)
     {}
 
@@ -566,7 +569,7 @@ Error HWC2On1Adapter::Display::createLayer(hwc2_layer_t* outLayerId) {
     mDevice.mLayers.emplace(std::make_pair(layer->getId(), layer));
     *outLayerId = layer->getId();
     ALOGV("[%" PRIu64 "] created layer %" PRIu64, mId, *outLayerId);
-    markGeometryChanged();
+    markLayersChanged();
     return Error::None;
 }
 
@@ -589,7 +592,7 @@ Error HWC2On1Adapter::Display::destroyLayer(hwc2_layer_t layerId) {
         }
     }
     ALOGV("[%" PRIu64 "] destroyed layer %" PRIu64, mId, layerId);
-    markGeometryChanged();
+    markLayersChanged();
     return Error::None;
 }
 
@@ -1023,7 +1026,7 @@ Error HWC2On1Adapter::Display::updateLayerZ(hwc2_layer_t layerId, uint32_t z) {
 
     layer->setZ(z);
     mLayers.emplace(std::move(layer));
-    markGeometryChanged();
+    markLayersChanged();
 
     return Error::None;
 }
@@ -1214,8 +1217,21 @@ bool HWC2On1Adapter::Display::prepare() {
         return false;
     }
 
-    allocateRequestedContents();
-    assignHwc1LayerIds();
+    // The HWC1 contents are kept between frames. Layer IDs only need to be
+    // reassigned when the layers changed, and the rect pool only needs to be
+    // laid out again when a visible region changed.
+    bool applyAll = mLayersChanged || !mHwc1RequestedContents;
+    bool relayoutRects = applyAll;
+    for (const auto& layer : mLayers) {
+        relayoutRects = relayoutRects || layer->hasVisibleRegionChanged();
+    }
+    if (relayoutRects && allocateRequestedContents()) {
+        applyAll = true;
+    }
+    if (applyAll) {
+        assignHwc1LayerIds();
+        mLayersChanged = false;
+    }
 
     mHwc1RequestedContents->retireFenceFd = -1;
     mHwc1RequestedContents->flags = 0;
@@ -1232,10 +1248,10 @@ bool HWC2On1Adapter::Display::prepare() {
         hwc1Layer.releaseFenceFd = -1;
         hwc1Layer.acquireFenceFd = -1;
         ALOGV("Applying states for layer %" PRIu64 " ", layer->getId());
-        layer->applyState(hwc1Layer);
+        layer->applyState(hwc1Layer, applyAll, relayoutRects);
     }
 
-    prepareFramebufferTarget();
+    prepareFramebufferTarget(relayoutRects);
 
     resetGeometryMarker();
 
@@ -1780,7 +1796,7 @@ void HWC2On1Adapter::Display::initializeActiveConfig() {
 
 }
 
-void HWC2On1Adapter::Display::allocateRequestedContents() {
+bool HWC2On1Adapter::Display::allocateRequestedContents() {
     // What needs to be allocated:
     // 1 hwc_display_contents_1_t
     // 1 hwc_layer_1_t for each layer
@@ -1804,6 +1820,14 @@ void HWC2On1Adapter::Display::allocateRequestedContents() {
 
     size_t numRects = numVisibleRegion + numSurfaceDamages;
     auto numLayers = mLayers.size() + 1;
+    if (mHwc1RequestedContents && numLayers == mNumAllocatedLayers &&
+            numRects <= mNumAllocatedRects) {
+        auto contents = mHwc1RequestedContents.get();
+        mNextAvailableRect = reinterpret_cast<hwc_rect_t*>(&contents->hwLayers[numLayers]);
+        mNumAvailableRects = mNumAllocatedRects;
+        return false;
+    }
+
     size_t size = sizeof(hwc_display_contents_1_t) +
             sizeof(hwc_layer_1_t) * numLayers +
             sizeof(hwc_rect_t) * numRects;
@@ -1811,6 +1835,9 @@ void HWC2On1Adapter::Display::allocateRequestedContents() {
     mHwc1RequestedContents.reset(contents);
     mNextAvailableRect = reinterpret_cast<hwc_rect_t*>(&contents->hwLayers[numLayers]);
     mNumAvailableRects = numRects;
+    mNumAllocatedLayers = numLayers;
+    mNumAllocatedRects = numRects;
+    return true;
 }
 
 void HWC2On1Adapter::Display::assignHwc1LayerIds() {
@@ -1865,7 +1892,7 @@ void HWC2On1Adapter::Display::updateLayerRequests(
     }
 }
 
-void HWC2On1Adapter::Display::prepareFramebufferTarget() {
+void HWC2On1Adapter::Display::prepareFramebufferTarget(bool relayoutRects) {
     // We check that mActiveConfig is valid in Display::prepare
     int32_t width = mActiveConfig->getAttribute(Attribute::Width);
     int32_t height = mActiveConfig->getAttribute(Attribute::Height);
@@ -1886,8 +1913,11 @@ void HWC2On1Adapter::Display::prepareFramebufferTarget() {
     hwc1Target.displayFrame = {0, 0, width, height};
     hwc1Target.planeAlpha = 255;
 
+    // The size of the region never changes, so its rect is only taken from the
+    // pool when the pool is laid out again.
     hwc1Target.visibleRegionScreen.numRects = 1;
-    hwc_rect_t* rects = GetRects(1);
+    hwc_rect_t* rects = relayoutRects ? GetRects(1) :
+            const_cast<hwc_rect_t*>(hwc1Target.visibleRegionScreen.rects);
     rects[0].left = 0;
     rects[0].top = 0;
     rects[0].right = width;
@@ -1919,7 +1949,9 @@ HWC2On1Adapter::Layer::Layer(Display& display)
     mZ(0),
     mReleaseFence(),
     mHwc1Id(0),
-    mHasUnsupportedPlaneAlpha(false) {}
+    mHasUnsupportedPlaneAlpha(false),
+    mCommonStateChanged(true),
+    mVisibleRegionChanged(true) {}
 
 bool HWC2On1Adapter::SortLayersByZ::operator()(const std::shared_ptr<Layer>& lhs,
                                                const std::shared_ptr<Layer>& rhs) const {
@@ -1962,20 +1994,28 @@ Error HWC2On1Adapter::Layer::setSurfaceDamage(hwc_region_t damage) {
 // Layer state functions
 
 Error HWC2On1Adapter::Layer::setBlendMode(BlendMode mode) {
-    mBlendMode = mode;
-    mDisplay.markGeometryChanged();
+    if (mode != mBlendMode) {
+        mBlendMode = mode;
+        mCommonStateChanged = true;
+        mDisplay.markGeometryChanged();
+    }
     return Error::None;
 }
 
 Error HWC2On1Adapter::Layer::setColor(hwc_color_t color) {
-    mColor = color;
-    mDisplay.markGeometryChanged();
+    if (color.r != mColor.r || color.g != mColor.g || color.b != mColor.b ||
+            color.a != mColor.a) {
+        mColor = color;
+        mDisplay.markGeometryChanged();
+    }
     return Error::None;
 }
 
 Error HWC2On1Adapter::Layer::setCompositionType(Composition type) {
-    mCompositionType = type;
-    mDisplay.markGeometryChanged();
+    if (type != mCompositionType) {
+        mCompositionType = type;
+        mDisplay.markGeometryChanged();
+    }
     return Error::None;
 }
 
@@ -1983,49 +2023,65 @@ Error HWC2On1Adapter::Layer::setDataspace(android_dataspace_t) {
     return Error::None;
 }
 
+static bool compareRects(const hwc_rect_t& rect1, const hwc_rect_t& rect2) {
+    return rect1.left == rect2.left &&
+            rect1.right == rect2.right &&
+            rect1.top == rect2.top &&
+            rect1.bottom == rect2.bottom;
+}
+
 Error HWC2On1Adapter::Layer::setDisplayFrame(hwc_rect_t frame) {
-    mDisplayFrame = frame;
-    mDisplay.markGeometryChanged();
+    if (!compareRects(frame, mDisplayFrame)) {
+        mDisplayFrame = frame;
+        mCommonStateChanged = true;
+        mDisplay.markGeometryChanged();
+    }
     return Error::None;
 }
 
 Error HWC2On1Adapter::Layer::setPlaneAlpha(float alpha) {
-    mPlaneAlpha = alpha;
-    mDisplay.markGeometryChanged();
+    if (alpha != mPlaneAlpha) {
+        mPlaneAlpha = alpha;
+        mCommonStateChanged = true;
+        mDisplay.markGeometryChanged();
+    }
     return Error::None;
 }
 
 Error HWC2On1Adapter::Layer::setSidebandStream(const native_handle_t* stream) {
-    mSidebandStream = stream;
-    mDisplay.markGeometryChanged();
+    if (stream != mSidebandStream) {
+        mSidebandStream = stream;
+        mDisplay.markGeometryChanged();
+    }
     return Error::None;
 }
 
 Error HWC2On1Adapter::Layer::setSourceCrop(hwc_frect_t crop) {
-    mSourceCrop = crop;
-    mDisplay.markGeometryChanged();
+    if (crop.left != mSourceCrop.left || crop.top != mSourceCrop.top ||
+            crop.right != mSourceCrop.right || crop.bottom != mSourceCrop.bottom) {
+        mSourceCrop = crop;
+        mCommonStateChanged = true;
+        mDisplay.markGeometryChanged();
+    }
     return Error::None;
 }
 
 Error HWC2On1Adapter::Layer::setTransform(Transform transform) {
-    mTransform = transform;
-    mDisplay.markGeometryChanged();
+    if (transform != mTransform) {
+        mTransform = transform;
+        mCommonStateChanged = true;
+        mDisplay.markGeometryChanged();
+    }
     return Error::None;
 }
 
-static bool compareRects(const hwc_rect_t& rect1, const hwc_rect_t& rect2) {
-    return rect1.left == rect2.left &&
-            rect1.right == rect2.right &&
-            rect1.top == rect2.top &&
-            rect1.bottom == rect2.bottom;
-}
-
 Error HWC2On1Adapter::Layer::setVisibleRegion(hwc_region_t visible) {
     if ((getNumVisibleRegions() != visible.numRects) ||
         !std::equal(mVisibleRegion.begin(), mVisibleRegion.end(), visible.rects,
                     compareRects)) {
         mVisibleRegion.resize(visible.numRects);
         std::copy_n(visible.rects, visible.numRects, mVisibleRegion.begin());
+        mVisibleRegionChanged = true;
         mDisplay.markGeometryChanged();
     }
     return Error::None;
@@ -2045,8 +2101,19 @@ const sp<MiniFence>& HWC2On1Adapter::Layer::getReleaseFence() const {
     return mReleaseFence.get();
 }
 
-void HWC2On1Adapter::Layer::applyState(hwc_layer_1_t& hwc1Layer) {
-    applyCommonState(hwc1Layer);
+void HWC2On1Adapter::Layer::applyState(hwc_layer_1_t& hwc1Layer, bool applyAll,
+        bool relayoutRects) {
+    if (applyAll || mCommonStateChanged) {
+        applyCommonState(hwc1Layer);
+        mCommonStateChanged = false;
+    }
+    if (applyAll || relayoutRects) {
+        applyVisibleRegion(hwc1Layer);
+        mVisibleRegionChanged = false;
+    }
+    // HWC1 writes the composition type and hints during prepare, so they are
+    // always reset.
+    hwc1Layer.hints = 0;
     applyCompositionType(hwc1Layer);
     switch (mCompositionType) {
         case Composition::SolidColor : applySolidColorState(hwc1Layer); break;
@@ -2150,7 +2217,9 @@ void HWC2On1Adapter::Layer::applyCommonState(hwc_layer_1_t& hwc1Layer) {
     }
 
     hwc1Layer.transform = static_cast<uint32_t>(mTransform);
+}
 
+void HWC2On1Adapter::Layer::applyVisibleRegion(hwc_layer_1_t& hwc1Layer) {
     auto& hwc1VisibleRegion = hwc1Layer.visibleRegionScreen;
     hwc1VisibleRegion.numRects = mVisibleRegion.size();
     hwc_rect_t* rects = mDisplay.GetRects(hwc1VisibleRegion.numRects);
@@ -278,6 +278,13 @@ private:
 
             void markGeometryChanged() { mGeometryChanged = true; }
             void resetGeometryMarker() { mGeometryChanged = false;}
+
+            // Called when layers are created, destroyed or reordered, after
+            // which every HWC1 layer is rebuilt on the next prepare().
+            void markLayersChanged() {
+                mLayersChanged = true;
+                mGeometryChanged = true;
+            }
         private:
             class Config {
                 public:
@@ -388,7 +395,7 @@ private:
 
             // Set all fields in HWC1 comm array for layer containing the
             // HWC_FRAMEBUFFER_TARGET (always the last layer).
-            void prepareFramebufferTarget();
+            void prepareFramebufferTarget(bool relayoutRects);
 
             // Display ID generator.
             static std::atomic<hwc2_display_t> sNextId;
@@ -410,8 +417,10 @@ private:
 
             // Allocate RAM able to store all layers and rects used for
             // communication with HWC1. Place allocated RAM in variable
-            // mHwc1RequestedContents.
-            void allocateRequestedContents();
+            // mHwc1RequestedContents. The previous allocation is kept if it
+            // holds the same number of layers and enough rects, in which case
+            // only the rect pool is rewound. Returns true if it reallocated.
+            bool allocateRequestedContents();
 
             // Array of structs exchanged between client and hwc1 device.
             // Sent to device upon calling prepare().
@@ -454,6 +463,14 @@ private:
             size_t mNumAvailableRects;
             hwc_rect_t* mNextAvailableRect;
 
+            // Capacity of mHwc1RequestedContents.
+            size_t mNumAllocatedLayers;
+            size_t mNumAllocatedRects;
+
+            // True if layers have been created, destroyed or reordered since
+            // the last call to Display::prepare()
+            bool mLayersChanged;
+
             // True if any of the Layers contained in this Display have been
             // updated with anything other than a buffer since last call to
             // Display::set()
@@ -560,8 +577,14 @@ private:
             void setHwc1Id(size_t id) { mHwc1Id = id; }
             size_t getHwc1Id() const { return mHwc1Id; }
 
-            // Write state to HWC1 communication struct.
-            void applyState(struct hwc_layer_1& hwc1Layer);
+            // Write state to HWC1 communication struct. Unless applyAll is
+            // set, only the state changed since the last call is written.
+            // The visible region is written to rects from Display::GetRects
+            // if relayoutRects is set, and left as is otherwise.
+            void applyState(struct hwc_layer_1& hwc1Layer, bool applyAll,
+                    bool relayoutRects);
+
+            bool hasVisibleRegionChanged() const { return mVisibleRegionChanged; }
 
             std::string dump() const;
 
@@ -577,6 +600,7 @@ private:
             }
         private:
             void applyCommonState(struct hwc_layer_1& hwc1Layer);
+            void applyVisibleRegion(struct hwc_layer_1& hwc1Layer);
             void applySolidColorState(struct hwc_layer_1& hwc1Layer);
             void applySidebandState(struct hwc_layer_1& hwc1Layer);
             void applyBufferState(struct hwc_layer_1& hwc1Layer);
@@ -605,6 +629,11 @@ private:
 
             size_t mHwc1Id;
             bool mHasUnsupportedPlaneAlpha;
+
+            // True if the state written by applyCommonState or
+            // applyVisibleRegion changed since it was last written.
+            bool mCommonStateChanged;
+            bool mVisibleRegionChanged;
     };
 
     // Utility tempate calling a Layer object method based on ID parameters:
@@ -189,13 +189,14 @@ int32_t setColorModeHook(hwc2_device_t* device, hwc2_display_t display, int32_t
 }
 
 int32_t setColorTransformHook(hwc2_device_t* device, hwc2_display_t display,
-                              const float* /*matrix*/, int32_t /*hint*/) {
+                              const float* /*matrix*/, int32_t hint) {
     auto& adapter = HWC2OnFbAdapter::cast(device);
     if (adapter.getDisplayId() != display) {
         return HWC2_ERROR_BAD_DISPLAY;
     }
 
-    // we always force client composition
+    // we force client composition unless the transform is the identity
+    adapter.setColorTransform(hint == HAL_COLOR_TRANSFORM_IDENTITY);
     adapter.setState(HWC2OnFbAdapter::State::MODIFIED);
     return HWC2_ERROR_NONE;
 }
@@ -319,6 +320,7 @@ int32_t validateDisplayHook(hwc2_device_t* device, hwc2_display_t display, uint3
         return HWC2_ERROR_BAD_DISPLAY;
     }
 
+    adapter.validateLayers();
     const auto& dirtyLayers = adapter.getDirtyLayers();
     *outNumTypes = dirtyLayers.size();
     *outNumRequests = 0;
@@ -399,6 +401,11 @@ int32_t presentDisplayHook(hwc2_device_t* device, hwc2_display_t display,
         return HWC2_ERROR_NOT_VALIDATED;
     }
 
+    if (!adapter.composeLayers()) {
+        // Nothing is presented, the client must validate the layers again.
+        adapter.setState(HWC2OnFbAdapter::State::MODIFIED);
+        return HWC2_ERROR_NOT_VALIDATED;
+    }
     adapter.postBuffer();
     *outPresentFence = -1;
 
@@ -454,7 +461,7 @@ int32_t setCursorPositionHook(hwc2_device_t* device, hwc2_display_t display, hwc
 }
 
 int32_t setLayerBufferHook(hwc2_device_t* device, hwc2_display_t display, hwc2_layer_t layer,
-                           buffer_handle_t /*buffer*/, int32_t acquireFence) {
+                           buffer_handle_t buffer, int32_t acquireFence) {
     if (acquireFence >= 0) {
         sync_wait(acquireFence, -1);
         close(acquireFence);
@@ -464,11 +471,17 @@ int32_t setLayerBufferHook(hwc2_device_t* device, hwc2_display_t display, hwc2_l
     if (adapter.getDisplayId() != display) {
         return HWC2_ERROR_BAD_DISPLAY;
     }
-    if (!adapter.hasLayer(layer)) {
+    auto* layerState = adapter.getLayer(layer);
+    if (!layerState) {
         return HWC2_ERROR_BAD_LAYER;
     }
 
-    // no state change
+    // The compositor accepted the layer for its buffer, so a new buffer must be
+    // validated again. Other layers are composed by the client: no state change.
+    if (layerState->buffer != buffer && adapter.isComposedLayer(layer)) {
+        adapter.setState(HWC2OnFbAdapter::State::MODIFIED);
+    }
+    layerState->buffer = buffer;
     return HWC2_ERROR_NONE;
 }
 
@@ -492,10 +505,12 @@ int32_t setLayerCompositionTypeHook(hwc2_device_t* device, hwc2_display_t displa
     if (adapter.getDisplayId() != display) {
         return HWC2_ERROR_BAD_DISPLAY;
     }
-    if (!adapter.markLayerDirty(layer, type != HWC2_COMPOSITION_CLIENT)) {
+    auto* layerState = adapter.getLayer(layer);
+    if (!layerState) {
         return HWC2_ERROR_BAD_LAYER;
     }
 
+    layerState->composition = type;
     adapter.setState(HWC2OnFbAdapter::State::MODIFIED);
     return HWC2_ERROR_NONE;
 }
@@ -515,6 +530,26 @@ int32_t setLayerStateHook(hwc2_device_t* device, hwc2_display_t display, hwc2_la
     return HWC2_ERROR_NONE;
 }
 
+// Like setLayerStateHook, for the state the software compositor uses.
+template <typename T, T SoftwareCompositor::Layer::*field>
+int32_t setLayerPropertyHook(hwc2_device_t* device, hwc2_display_t display, hwc2_layer_t layer,
+                             T value) {
+    auto& adapter = HWC2OnFbAdapter::cast(device);
+    if (adapter.getDisplayId() != display) {
+        return HWC2_ERROR_BAD_DISPLAY;
+    }
+    auto* layerState = adapter.getLayer(layer);
+    if (!layerState) {
+        return HWC2_ERROR_BAD_LAYER;
+    }
+
+    layerState->*field = value;
+    adapter.setState(HWC2OnFbAdapter::State::MODIFIED);
+    return HWC2_ERROR_NONE;
+}
+
+using Layer = SoftwareCompositor::Layer;
+
 template <typename PFN, typename T>
 static hwc2_function_pointer_t asFP(T function) {
     static_assert(std::is_same<PFN, T>::value, "Incompatible function pointer");
@@ -605,25 +640,31 @@ hwc2_function_pointer_t getFunctionHook(hwc2_device_t* /*device*/, int32_t descr
         case HWC2_FUNCTION_SET_LAYER_COMPOSITION_TYPE:
             return asFP<HWC2_PFN_SET_LAYER_COMPOSITION_TYPE>(setLayerCompositionTypeHook);
         case HWC2_FUNCTION_SET_LAYER_BLEND_MODE:
-            return asFP<HWC2_PFN_SET_LAYER_BLEND_MODE>(setLayerStateHook<int32_t>);
+            return asFP<HWC2_PFN_SET_LAYER_BLEND_MODE>(
+                    setLayerPropertyHook<int32_t, &Layer::blendMode>);
         case HWC2_FUNCTION_SET_LAYER_COLOR:
-            return asFP<HWC2_PFN_SET_LAYER_COLOR>(setLayerStateHook<hwc_color_t>);
+            return asFP<HWC2_PFN_SET_LAYER_COLOR>(setLayerPropertyHook<hwc_color_t, &Layer::color>);
         case HWC2_FUNCTION_SET_LAYER_DATASPACE:
-            return asFP<HWC2_PFN_SET_LAYER_DATASPACE>(setLayerStateHook<int32_t>);
+            return asFP<HWC2_PFN_SET_LAYER_DATASPACE>(
+                    setLayerPropertyHook<int32_t, &Layer::dataspace>);
         case HWC2_FUNCTION_SET_LAYER_DISPLAY_FRAME:
-            return asFP<HWC2_PFN_SET_LAYER_DISPLAY_FRAME>(setLayerStateHook<hwc_rect_t>);
+            return asFP<HWC2_PFN_SET_LAYER_DISPLAY_FRAME>(
+                    setLayerPropertyHook<hwc_rect_t, &Layer::displayFrame>);
         case HWC2_FUNCTION_SET_LAYER_PLANE_ALPHA:
-            return asFP<HWC2_PFN_SET_LAYER_PLANE_ALPHA>(setLayerStateHook<float>);
+            return asFP<HWC2_PFN_SET_LAYER_PLANE_ALPHA>(
+                    setLayerPropertyHook<float, &Layer::planeAlpha>);
         case HWC2_FUNCTION_SET_LAYER_SIDEBAND_STREAM:
             return asFP<HWC2_PFN_SET_LAYER_SIDEBAND_STREAM>(setLayerStateHook<buffer_handle_t>);
         case HWC2_FUNCTION_SET_LAYER_SOURCE_CROP:
-            return asFP<HWC2_PFN_SET_LAYER_SOURCE_CROP>(setLayerStateHook<hwc_frect_t>);
+            return asFP<HWC2_PFN_SET_LAYER_SOURCE_CROP>(
+                    setLayerPropertyHook<hwc_frect_t, &Layer::sourceCrop>);
         case HWC2_FUNCTION_SET_LAYER_TRANSFORM:
-            return asFP<HWC2_PFN_SET_LAYER_TRANSFORM>(setLayerStateHook<int32_t>);
+            return asFP<HWC2_PFN_SET_LAYER_TRANSFORM>(
+                    setLayerPropertyHook<int32_t, &Layer::transform>);
         case HWC2_FUNCTION_SET_LAYER_VISIBLE_REGION:
             return asFP<HWC2_PFN_SET_LAYER_VISIBLE_REGION>(setLayerStateHook<hwc_region_t>);
         case HWC2_FUNCTION_SET_LAYER_Z_ORDER:
-            return asFP<HWC2_PFN_SET_LAYER_Z_ORDER>(setLayerStateHook<uint32_t>);
+            return asFP<HWC2_PFN_SET_LAYER_Z_ORDER>(setLayerPropertyHook<uint32_t, &Layer::z>);
 
         default:
             ALOGE("unknown function descriptor %d", descriptor);
@@ -713,10 +754,22 @@ HWC2OnFbAdapter::State HWC2OnFbAdapter::getState() const {
     return mState;
 }
 
+void HWC2OnFbAdapter::enableSoftwareComposition(
+        std::unique_ptr<SoftwareCompositor::BufferMapper> mapper) {
+    if (!SoftwareCompositor::isSupportedFormat(mFbInfo.format)) {
+        ALOGW("software composition is not supported for framebuffer format %d", mFbInfo.format);
+        return;
+    }
+    mCompositor = std::make_unique<SoftwareCompositor>(std::move(mapper));
+    if (!mCompositor->allocateTargets(mFbInfo.width, mFbInfo.height, mFbInfo.format)) {
+        ALOGI("framebuffer targets are not available, leaving the bottom layer to the client");
+    }
+}
+
 hwc2_layer_t HWC2OnFbAdapter::addLayer() {
     hwc2_layer_t id = ++mNextLayerId;
 
-    mLayers.insert(id);
+    mLayers.emplace(id, SoftwareCompositor::Layer{});
     mDirtyLayers.insert(id);
 
     return id;
@@ -724,6 +777,8 @@ hwc2_layer_t HWC2OnFbAdapter::addLayer() {
 
 bool HWC2OnFbAdapter::removeLayer(hwc2_layer_t layer) {
     mDirtyLayers.erase(layer);
+    mComposedLayers.clear();
+    mComposesAllLayers = false;
     return mLayers.erase(layer);
 }
 
@@ -731,18 +786,60 @@ bool HWC2OnFbAdapter::hasLayer(hwc2_layer_t layer) const {
     return mLayers.count(layer) > 0;
 }
 
-bool HWC2OnFbAdapter::markLayerDirty(hwc2_layer_t layer, bool dirty) {
-    if (mLayers.count(layer) == 0) {
-        return false;
-    }
+SoftwareCompositor::Layer* HWC2OnFbAdapter::getLayer(hwc2_layer_t layer) {
+    auto iter = mLayers.find(layer);
+    return iter != mLayers.end() ? &iter->second : nullptr;
+}
 
-    if (dirty) {
-        mDirtyLayers.insert(layer);
-    } else {
-        mDirtyLayers.erase(layer);
-    }
+bool HWC2OnFbAdapter::isComposedLayer(hwc2_layer_t layer) const {
+    auto iter = mLayers.find(layer);
+    return iter != mLayers.end() &&
+            std::find(mComposedLayers.begin(), mComposedLayers.end(), &iter->second) !=
+            mComposedLayers.end();
+}
 
-    return true;
+void HWC2OnFbAdapter::setColorTransform(bool isIdentity) {
+    mHasColorTransform = !isIdentity;
+}
+
+/*
+ * Without a software compositor, every layer is changed to CLIENT.
+ *
+ * With one, layers are composed into the client target after the client
+ * composed into it, so they must all be above the CLIENT layers. Going from
+ * the top, layers are kept while the compositor supports them, and the rest
+ * are changed to CLIENT.
+ *
+ * The client only renders a new client target when it has layers to compose,
+ * and the previous one may still be scanned out. When the compositor has
+ * targets of its own, frames it composes entirely go to those instead.
+ * Otherwise, the bottom layer is always left to the client.
+ */
+void HWC2OnFbAdapter::validateLayers() {
+    mDirtyLayers.clear();
+    mComposedLayers.clear();
+
+    std::vector<std::pair<hwc2_layer_t, const SoftwareCompositor::Layer*>> layers;
+    layers.reserve(mLayers.size());
+    for (const auto& [id, layer] : mLayers) {
+        layers.emplace_back(id, &layer);
+    }
+    std::sort(layers.begin(), layers.end(),
+              [](const auto& a, const auto& b) { return a.second->z > b.second->z; });
+
+    bool composing = mCompositor && !mHasColorTransform;
+    for (size_t i = 0; i < layers.size(); i++) {
+        const auto& [id, layer] = layers[i];
+        composing = composing && (i + 1 < layers.size() || mCompositor->hasTargets()) &&
+                mCompositor->canCompose(*layer, mFbInfo.format);
+        if (composing) {
+            mComposedLayers.push_back(layer);
+        } else if (layer->composition != HWC2_COMPOSITION_CLIENT) {
+            mDirtyLayers.insert(id);
+        }
+    }
+    std::reverse(mComposedLayers.begin(), mComposedLayers.end());
+    mComposesAllLayers = composing && mCompositor->hasTargets();
 }
 
 const std::unordered_set<hwc2_layer_t>& HWC2OnFbAdapter::getDirtyLayers() const {
@@ -750,6 +847,9 @@ const std::unordered_set<hwc2_layer_t>& HWC2OnFbAdapter::getDirtyLayers() const
 }
 
 void HWC2OnFbAdapter::clearDirtyLayers() {
+    for (auto layer : mDirtyLayers) {
+        mLayers[layer].composition = HWC2_COMPOSITION_CLIENT;
+    }
     mDirtyLayers.clear();
 }
 
@@ -779,13 +879,35 @@ void HWC2OnFbAdapter::setBuffer(buffer_handle_t buffer) {
         mFbDevice->compositionComplete(mFbDevice);
     }
     mBuffer = buffer;
+    mHasNewBuffer = true;
+}
+
+bool HWC2OnFbAdapter::composeLayers() {
+    if (mComposesAllLayers) {
+        mComposedTarget = mCompositor->composeToTarget(mComposedLayers);
+        return mComposedTarget != nullptr;
+    }
+    if (mComposedLayers.empty()) {
+        return true;
+    }
+    // Composing into the buffer of the last frame would tear, since it may be
+    // the one being scanned out.
+    if (!mHasNewBuffer || !mBuffer) {
+        ALOGE("no client target for this frame, skipping software composition");
+        return false;
+    }
+    return mCompositor->compose(mBuffer, mComposedLayers);
 }
 
 bool HWC2OnFbAdapter::postBuffer() {
     int error = 0;
-    if (mBuffer) {
+    if (mComposedTarget) {
+        error = mFbDevice->post(mFbDevice, mComposedTarget);
+    } else if (mBuffer) {
         error = mFbDevice->post(mFbDevice, mBuffer);
     }
+    mComposedTarget = nullptr;
+    mHasNewBuffer = false;
 
     return error == 0;
 }
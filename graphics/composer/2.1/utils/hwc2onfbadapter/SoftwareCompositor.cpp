@@ -0,0 +1,440 @@
+/*
+ * Copyright 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "HWC2OnFbAdapter"
+
+//#define LOG_NDEBUG 0
+
+#include "hwc2onfbadapter/SoftwareCompositor.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include <log/log.h>
+
+#if defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+namespace android {
+
+namespace {
+
+/*
+ * All supported formats store one pixel in 4 bytes with alpha (or padding) in
+ * the last byte, so a pixel is handled as a little-endian uint32_t and
+ * blending does not depend on the order of the color channels.
+ */
+constexpr uint32_t kAlphaShift = 24;
+constexpr uint32_t kOpaqueAlpha = 0xffu << kAlphaShift;
+
+// x / 255, rounded, for x in [0, 255 * 255].
+inline uint32_t div255(uint32_t x) {
+    x += 128;
+    return (x + (x >> 8)) >> 8;
+}
+
+// Scales the 4 channels of a pixel by alpha / 255.
+inline uint32_t scalePixel(uint32_t pixel, uint32_t alpha) {
+    uint32_t result = 0;
+    for (uint32_t shift = 0; shift < 32; shift += 8) {
+        result |= div255(((pixel >> shift) & 0xff) * alpha) << shift;
+    }
+    return result;
+}
+
+// src + dst * (1 - src.a) for premultiplied src, saturated per channel.
+inline uint32_t blendPixel(uint32_t src, uint32_t dst) {
+    const uint32_t inverseAlpha = 255 - (src >> kAlphaShift);
+    uint32_t result = 0;
+    for (uint32_t shift = 0; shift < 32; shift += 8) {
+        const uint32_t channel =
+                ((src >> shift) & 0xff) + div255(((dst >> shift) & 0xff) * inverseAlpha);
+        result |= std::min(channel, 255u) << shift;
+    }
+    return result;
+}
+
+#if defined(__ARM_NEON)
+inline uint8x8_t div255(uint16x8_t x) {
+    const uint16x8_t rounded = vaddq_u16(x, vdupq_n_u16(128));
+    return vshrn_n_u16(vaddq_u16(rounded, vshrq_n_u16(rounded, 8)), 8);
+}
+
+inline uint8x8x4_t loadPixels(const uint32_t* src, bool reverse) {
+    uint8x8x4_t pixels = vld4_u8(reinterpret_cast<const uint8_t*>(src));
+    if (reverse) {
+        for (int c = 0; c < 4; c++) {
+            pixels.val[c] = vrev64_u8(pixels.val[c]);
+        }
+    }
+    return pixels;
+}
+#endif
+
+void fillRow(uint32_t* dst, uint32_t count, uint32_t pixel) {
+    std::fill_n(dst, count, pixel);
+}
+
+void blendSolidRow(uint32_t* dst, uint32_t count, uint32_t pixel) {
+    uint32_t i = 0;
+#if defined(__ARM_NEON)
+    const uint8x8_t inverseAlpha = vdup_n_u8(static_cast<uint8_t>(255 - (pixel >> kAlphaShift)));
+    uint8x8_t src[4];
+    for (int c = 0; c < 4; c++) {
+        src[c] = vdup_n_u8(static_cast<uint8_t>(pixel >> (8 * c)));
+    }
+    for (; i + 8 <= count; i += 8) {
+        uint8x8x4_t d = vld4_u8(reinterpret_cast<uint8_t*>(dst + i));
+        for (int c = 0; c < 4; c++) {
+            d.val[c] = vqadd_u8(src[c], div255(vmull_u8(d.val[c], inverseAlpha)));
+        }
+        vst4_u8(reinterpret_cast<uint8_t*>(dst + i), d);
+    }
+#endif
+    for (; i < count; i++) {
+        dst[i] = blendPixel(pixel, dst[i]);
+    }
+}
+
+// Copies count pixels from src, or from src read backwards if reverse is set,
+// making them opaque.
+void copyRow(uint32_t* dst, const uint32_t* src, uint32_t count, bool reverse) {
+    if (reverse) {
+        for (uint32_t i = 0; i < count; i++) {
+            dst[i] = src[count - 1 - i] | kOpaqueAlpha;
+        }
+    } else {
+        for (uint32_t i = 0; i < count; i++) {
+            dst[i] = src[i] | kOpaqueAlpha;
+        }
+    }
+}
+
+// Blends count premultiplied pixels from src, or from src read backwards if
+// reverse is set, scaled by planeAlpha / 255, over dst.
+void blendRow(uint32_t* dst, const uint32_t* src, uint32_t count, bool reverse,
+              uint32_t planeAlpha) {
+    uint32_t i = 0;
+#if defined(__ARM_NEON)
+    const uint8x8_t alpha = vdup_n_u8(static_cast<uint8_t>(planeAlpha));
+    for (; i + 8 <= count; i += 8) {
+        uint8x8x4_t s = loadPixels(reverse ? src + count - 8 - i : src + i, reverse);
+        if (planeAlpha != 255) {
+            for (int c = 0; c < 4; c++) {
+                s.val[c] = div255(vmull_u8(s.val[c], alpha));
+            }
+        }
+        const uint8x8_t inverseAlpha = vmvn_u8(s.val[3]);
+        uint8x8x4_t d = vld4_u8(reinterpret_cast<uint8_t*>(dst + i));
+        for (int c = 0; c < 4; c++) {
+            d.val[c] = vqadd_u8(s.val[c], div255(vmull_u8(d.val[c], inverseAlpha)));
+        }
+        vst4_u8(reinterpret_cast<uint8_t*>(dst + i), d);
+    }
+#endif
+    for (; i < count; i++) {
+        uint32_t pixel = reverse ? src[count - 1 - i] : src[i];
+        if (planeAlpha != 255) {
+            pixel = scalePixel(pixel, planeAlpha);
+        }
+        dst[i] = blendPixel(pixel, dst[i]);
+    }
+}
+
+bool isOpaqueFormat(int format) {
+    return format == HAL_PIXEL_FORMAT_RGBX_8888;
+}
+
+// Whether pixels of format src can be read as pixels of format dst.
+bool hasSameByteOrder(int src, int dst) {
+    if (src == HAL_PIXEL_FORMAT_BGRA_8888 || dst == HAL_PIXEL_FORMAT_BGRA_8888) {
+        return src == dst;
+    }
+    return true;
+}
+
+uint32_t toPixel(hwc_color_t color, int format) {
+    if (format == HAL_PIXEL_FORMAT_BGRA_8888) {
+        std::swap(color.r, color.b);
+    }
+    return uint32_t(color.r) | uint32_t(color.g) << 8 | uint32_t(color.b) << 16 |
+            uint32_t(color.a) << kAlphaShift;
+}
+
+uint32_t toAlpha(float alpha) {
+    return uint32_t(std::lround(std::clamp(alpha, 0.0f, 1.0f) * 255.0f));
+}
+
+bool isSupportedDataspace(int32_t dataspace) {
+    switch (dataspace) {
+        case HAL_DATASPACE_UNKNOWN:
+        case HAL_DATASPACE_SRGB:
+        case HAL_DATASPACE_V0_SRGB:
+            return true;
+        default:
+            return false;
+    }
+}
+
+bool isSupportedBlendMode(int32_t blendMode) {
+    return blendMode == HWC2_BLEND_MODE_NONE || blendMode == HWC2_BLEND_MODE_PREMULTIPLIED;
+}
+
+bool isIntegral(float value) {
+    return std::floor(value) == value;
+}
+
+// Whether the source crop of layer, mapped to buffer, can be read as pixels of
+// format.
+bool fitsBuffer(const SoftwareCompositor::Layer& layer, const SoftwareCompositor::Surface& buffer,
+                int format) {
+    const auto& crop = layer.sourceCrop;
+    return SoftwareCompositor::isSupportedFormat(buffer.format) &&
+            hasSameByteOrder(buffer.format, format) && crop.left >= 0.0f && crop.top >= 0.0f &&
+            crop.right <= float(buffer.width) && crop.bottom <= float(buffer.height);
+}
+
+// Returns the display frame of layer clipped to target.
+hwc_rect_t clip(const hwc_rect_t& frame, const SoftwareCompositor::Surface& target) {
+    return {std::max(frame.left, 0), std::max(frame.top, 0),
+            std::min(frame.right, int32_t(target.width)),
+            std::min(frame.bottom, int32_t(target.height))};
+}
+
+class ScopedLock {
+public:
+    ScopedLock(SoftwareCompositor::BufferMapper& mapper, buffer_handle_t buffer, bool write)
+          : mMapper(mapper), mBuffer(buffer) {
+        mLocked = buffer && mMapper.lock(buffer, write, &mSurface);
+    }
+    ~ScopedLock() {
+        if (mLocked) {
+            mMapper.unlock(mBuffer);
+        }
+    }
+
+    bool isLocked() const { return mLocked; }
+    const SoftwareCompositor::Surface& getSurface() const { return mSurface; }
+
+private:
+    SoftwareCompositor::BufferMapper& mMapper;
+    buffer_handle_t mBuffer;
+    bool mLocked{false};
+    SoftwareCompositor::Surface mSurface{};
+};
+
+} // anonymous namespace
+
+SoftwareCompositor::SoftwareCompositor(std::unique_ptr<BufferMapper> mapper)
+      : mMapper(std::move(mapper)) {}
+
+SoftwareCompositor::~SoftwareCompositor() {
+    for (auto target : mTargets) {
+        mMapper->freeTarget(target);
+    }
+}
+
+bool SoftwareCompositor::allocateTargets(uint32_t width, uint32_t height, int format) {
+    for (size_t i = 0; i < kNumTargets; i++) {
+        buffer_handle_t target = mMapper->allocateTarget(width, height, format);
+        if (!target) {
+            for (auto allocated : mTargets) {
+                mMapper->freeTarget(allocated);
+            }
+            mTargets.clear();
+            return false;
+        }
+        mTargets.push_back(target);
+    }
+    return true;
+}
+
+bool SoftwareCompositor::hasTargets() const {
+    return !mTargets.empty();
+}
+
+bool SoftwareCompositor::isSupportedFormat(int format) {
+    return format == HAL_PIXEL_FORMAT_RGBA_8888 || format == HAL_PIXEL_FORMAT_RGBX_8888 ||
+            format == HAL_PIXEL_FORMAT_BGRA_8888;
+}
+
+bool SoftwareCompositor::canCompose(const Layer& layer, int format) const {
+    if (!isSupportedFormat(format) || !isSupportedBlendMode(layer.blendMode)) {
+        return false;
+    }
+
+    // Plane alpha is only supported on premultiplied layers.
+    const bool hasPlaneAlpha = toAlpha(layer.planeAlpha) != 255;
+    if (layer.composition == HWC2_COMPOSITION_SOLID_COLOR) {
+        return layer.blendMode == HWC2_BLEND_MODE_PREMULTIPLIED || !hasPlaneAlpha;
+    }
+    if (layer.composition != HWC2_COMPOSITION_DEVICE || !isSupportedDataspace(layer.dataspace)) {
+        return false;
+    }
+
+    // Flips and 180 degree rotations only, and no scaling.
+    const auto& crop = layer.sourceCrop;
+    const auto& frame = layer.displayFrame;
+    if ((layer.transform & HWC_TRANSFORM_ROT_90) != 0 || !isIntegral(crop.left) ||
+        !isIntegral(crop.top) || !isIntegral(crop.right) || !isIntegral(crop.bottom) ||
+        crop.right - crop.left != float(frame.right - frame.left) ||
+        crop.bottom - crop.top != float(frame.bottom - frame.top) || frame.right <= frame.left ||
+        frame.bottom <= frame.top) {
+        return false;
+    }
+
+    ScopedLock lock(*mMapper, layer.buffer, false);
+    if (!lock.isLocked()) {
+        return false;
+    }
+    const auto& buffer = lock.getSurface();
+    if (!fitsBuffer(layer, buffer, format)) {
+        return false;
+    }
+
+    const bool opaque = layer.blendMode == HWC2_BLEND_MODE_NONE || isOpaqueFormat(buffer.format);
+    return !opaque || !hasPlaneAlpha;
+}
+
+bool SoftwareCompositor::compose(buffer_handle_t target, const std::vector<const Layer*>& layers) {
+    return compose(target, layers, false);
+}
+
+buffer_handle_t SoftwareCompositor::composeToTarget(const std::vector<const Layer*>& layers) {
+    if (mTargets.empty()) {
+        return nullptr;
+    }
+    buffer_handle_t target = mTargets[mNextTarget];
+    if (!compose(target, layers, true)) {
+        return nullptr;
+    }
+    mNextTarget = (mNextTarget + 1) % mTargets.size();
+    return target;
+}
+
+bool SoftwareCompositor::compose(buffer_handle_t target, const std::vector<const Layer*>& layers,
+                                 bool clear) {
+    ScopedLock lock(*mMapper, target, true);
+    if (!lock.isLocked() || !isSupportedFormat(lock.getSurface().format)) {
+        ALOGE("failed to map the framebuffer for software composition");
+        return false;
+    }
+    const auto& surface = lock.getSurface();
+
+    // Map all the layer buffers first, so that a layer that cannot be composed
+    // anymore fails the frame instead of missing from it.
+    std::vector<std::unique_ptr<ScopedLock>> buffers(layers.size());
+    for (size_t i = 0; i < layers.size(); i++) {
+        if (layers[i]->composition == HWC2_COMPOSITION_SOLID_COLOR) {
+            continue;
+        }
+        buffers[i] = std::make_unique<ScopedLock>(*mMapper, layers[i]->buffer, false);
+        if (!buffers[i]->isLocked() ||
+            !fitsBuffer(*layers[i], buffers[i]->getSurface(), surface.format)) {
+            ALOGE("layer buffer cannot be composed anymore, failing software composition");
+            return false;
+        }
+    }
+
+    if (clear) {
+        for (uint32_t y = 0; y < surface.height; y++) {
+            fillRow(static_cast<uint32_t*>(surface.data) + y * surface.stride, surface.width,
+                    kOpaqueAlpha);
+        }
+    }
+    for (size_t i = 0; i < layers.size(); i++) {
+        if (buffers[i]) {
+            composeBuffer(surface, *layers[i], buffers[i]->getSurface());
+        } else {
+            composeSolidColor(surface, *layers[i]);
+        }
+    }
+
+    return true;
+}
+
+void SoftwareCompositor::composeSolidColor(const Surface& target, const Layer& layer) {
+    const hwc_rect_t rect = clip(layer.displayFrame, target);
+    if (rect.right <= rect.left || rect.bottom <= rect.top) {
+        return;
+    }
+
+    hwc_color_t color = layer.color;
+    bool opaque = true;
+    if (layer.blendMode == HWC2_BLEND_MODE_PREMULTIPLIED) {
+        const uint32_t alpha = div255(color.a * toAlpha(layer.planeAlpha));
+        if (alpha == 0) {
+            return;
+        }
+        color = {uint8_t(div255(color.r * alpha)), uint8_t(div255(color.g * alpha)),
+                 uint8_t(div255(color.b * alpha)), uint8_t(alpha)};
+        opaque = alpha == 255;
+    } else {
+        color.a = 255;
+    }
+    const uint32_t pixel = toPixel(color, target.format);
+
+    const uint32_t count = uint32_t(rect.right - rect.left);
+    for (int32_t y = rect.top; y < rect.bottom; y++) {
+        uint32_t* dst = static_cast<uint32_t*>(target.data) + y * target.stride + rect.left;
+        if (opaque) {
+            fillRow(dst, count, pixel);
+        } else {
+            blendSolidRow(dst, count, pixel);
+        }
+    }
+}
+
+void SoftwareCompositor::composeBuffer(const Surface& target, const Layer& layer,
+                                       const Surface& buffer) {
+    const auto& frame = layer.displayFrame;
+    const auto& crop = layer.sourceCrop;
+    const int32_t width = frame.right - frame.left;
+    const int32_t height = frame.bottom - frame.top;
+
+    const hwc_rect_t rect = clip(frame, target);
+    if (rect.right <= rect.left || rect.bottom <= rect.top) {
+        return;
+    }
+
+    const bool flipH = (layer.transform & HWC_TRANSFORM_FLIP_H) != 0;
+    const bool flipV = (layer.transform & HWC_TRANSFORM_FLIP_V) != 0;
+    const bool opaque = layer.blendMode == HWC2_BLEND_MODE_NONE || isOpaqueFormat(buffer.format);
+    const uint32_t planeAlpha = toAlpha(layer.planeAlpha);
+
+    // Frame-relative columns of the clipped rect, and where they come from in
+    // the source crop. A horizontally flipped row is read backwards.
+    const int32_t u0 = rect.left - frame.left;
+    const int32_t u1 = rect.right - frame.left;
+    const int32_t srcX = int32_t(crop.left) + (flipH ? width - u1 : u0);
+    const uint32_t count = uint32_t(u1 - u0);
+
+    for (int32_t y = rect.top; y < rect.bottom; y++) {
+        const int32_t v = y - frame.top;
+        const int32_t srcY = int32_t(crop.top) + (flipV ? height - 1 - v : v);
+        const uint32_t* src =
+                static_cast<const uint32_t*>(buffer.data) + srcY * buffer.stride + srcX;
+        uint32_t* dst = static_cast<uint32_t*>(target.data) + y * target.stride + rect.left;
+        if (opaque) {
+            copyRow(dst, src, count, flipH);
+        } else {
+            blendRow(dst, src, count, flipH, planeAlpha);
+        }
+    }
+}
+
+} // namespace android
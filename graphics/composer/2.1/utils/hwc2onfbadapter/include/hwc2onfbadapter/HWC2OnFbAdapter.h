@@ -18,10 +18,13 @@
 #define ANDROID_SF_HWC2_ON_FB_ADAPTER_H
 
 #include <condition_variable>
+#include <memory>
 #include <mutex>
 #include <string>
 #include <thread>
+#include <unordered_map>
 #include <unordered_set>
+#include <vector>
 
 #define HWC2_INCLUDE_STRINGIFICATION
 #define HWC2_USE_CPP11
@@ -29,6 +32,8 @@
 #undef HWC2_INCLUDE_STRINGIFICATION
 #undef HWC2_USE_CPP11
 
+#include "hwc2onfbadapter/SoftwareCompositor.h"
+
 struct framebuffer_device_t;
 
 namespace android {
@@ -67,14 +72,31 @@ public:
     void setState(State state);
     State getState() const;
 
+    // Composes SOLID_COLOR layers and simple DEVICE layers on the CPU instead
+    // of changing them to CLIENT. mapper gives access to the client target and
+    // layer buffers, and may allocate targets that let the compositor compose
+    // frames without the client. Must be called before the device is used.
+    void enableSoftwareComposition(std::unique_ptr<SoftwareCompositor::BufferMapper> mapper);
+
     hwc2_layer_t addLayer();
     bool removeLayer(hwc2_layer_t layer);
     bool hasLayer(hwc2_layer_t layer) const;
-    bool markLayerDirty(hwc2_layer_t layer, bool dirty);
+    SoftwareCompositor::Layer* getLayer(hwc2_layer_t layer);
+    // Whether the last validateLayers left layer to the software compositor.
+    bool isComposedLayer(hwc2_layer_t layer) const;
+    void setColorTransform(bool isIdentity);
+
+    // Decides which layers must be changed to CLIENT composition.
+    void validateLayers();
     const std::unordered_set<hwc2_layer_t>& getDirtyLayers() const;
+    // Changes the dirty layers to CLIENT composition.
     void clearDirtyLayers();
 
     void setBuffer(buffer_handle_t buffer);
+    // Composes the layers that were not changed to CLIENT composition into the
+    // buffer set by setBuffer since the last postBuffer, or into a target of
+    // the compositor when no layer was.
+    bool composeLayers();
     bool postBuffer();
 
     void setVsyncCallback(HWC2_PFN_VSYNC callback, hwc2_callback_data_t data);
@@ -90,10 +112,21 @@ private:
     State mState{State::MODIFIED};
 
     uint64_t mNextLayerId{0};
-    std::unordered_set<hwc2_layer_t> mLayers;
+    std::unordered_map<hwc2_layer_t, SoftwareCompositor::Layer> mLayers;
     std::unordered_set<hwc2_layer_t> mDirtyLayers;
+    bool mHasColorTransform{false};
+
+    std::unique_ptr<SoftwareCompositor> mCompositor;
+    // Layers composed by mCompositor, ordered from bottom to top.
+    std::vector<const SoftwareCompositor::Layer*> mComposedLayers;
+    // Whether mComposedLayers are all the layers, composed without the client.
+    bool mComposesAllLayers{false};
+    // The target of mCompositor to post instead of mBuffer.
+    buffer_handle_t mComposedTarget{nullptr};
 
     buffer_handle_t mBuffer{nullptr};
+    // Whether setBuffer was called since the last postBuffer.
+    bool mHasNewBuffer{false};
 
     std::unordered_set<HWC2::Capability> mCapabilities;
 
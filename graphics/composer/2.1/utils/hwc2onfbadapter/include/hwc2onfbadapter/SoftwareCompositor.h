@@ -0,0 +1,126 @@
+/*
+ * Copyright 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_SF_HWC2_ON_FB_SOFTWARE_COMPOSITOR_H
+#define ANDROID_SF_HWC2_ON_FB_SOFTWARE_COMPOSITOR_H
+
+#include <memory>
+#include <vector>
+
+#define HWC2_INCLUDE_STRINGIFICATION
+#define HWC2_USE_CPP11
+#include <hardware/hwcomposer2.h>
+#undef HWC2_INCLUDE_STRINGIFICATION
+#undef HWC2_USE_CPP11
+
+namespace android {
+
+/*
+ * A CPU compositor for the layers that are cheap to compose without a GPU:
+ *
+ *  - SOLID_COLOR layers, and
+ *  - DEVICE layers with a 32-bit RGBA, RGBX or BGRA buffer of the framebuffer's
+ *    byte order, that are opaque or premultiplied, not scaled, and at most
+ *    flipped or rotated by 180 degrees.
+ *
+ * Layers are composed directly into the framebuffer buffer, over whatever the
+ * client composed into it. When the board can allocate framebuffer buffers,
+ * the compositor also owns targets of its own, so that frames without CLIENT
+ * layers need no client composition at all.
+ */
+class SoftwareCompositor {
+public:
+    // Describes CPU accessible pixels. stride is in pixels.
+    struct Surface {
+        void* data;
+        uint32_t width;
+        uint32_t height;
+        uint32_t stride;
+        int format;
+    };
+
+    // Gives CPU access to gralloc buffers. Implemented by the board, since
+    // gralloc0 does not describe the layout of its buffers.
+    class BufferMapper {
+    public:
+        virtual ~BufferMapper() = default;
+
+        // Maps buffer for reading, or for writing if write is set. Returns
+        // false if the buffer cannot be mapped.
+        virtual bool lock(buffer_handle_t buffer, bool write, Surface* outSurface) = 0;
+        virtual void unlock(buffer_handle_t buffer) = 0;
+
+        // Allocates a buffer the framebuffer device can post, or returns
+        // nullptr if the board does not support it.
+        virtual buffer_handle_t allocateTarget(uint32_t /*width*/, uint32_t /*height*/,
+                                               int /*format*/) {
+            return nullptr;
+        }
+        virtual void freeTarget(buffer_handle_t /*buffer*/) {}
+    };
+
+    // The HWC2 state of a layer.
+    struct Layer {
+        int32_t composition{HWC2_COMPOSITION_INVALID};
+        int32_t blendMode{HWC2_BLEND_MODE_NONE};
+        hwc_color_t color{0, 0, 0, 0};
+        int32_t dataspace{HAL_DATASPACE_UNKNOWN};
+        hwc_rect_t displayFrame{0, 0, 0, 0};
+        float planeAlpha{1.0f};
+        hwc_frect_t sourceCrop{0.0f, 0.0f, 0.0f, 0.0f};
+        int32_t transform{0};
+        uint32_t z{0};
+        buffer_handle_t buffer{nullptr};
+    };
+
+    explicit SoftwareCompositor(std::unique_ptr<BufferMapper> mapper);
+    ~SoftwareCompositor();
+
+    // Allocates the targets of the compositor. Returns false, leaving the
+    // compositor without targets, if the mapper cannot allocate them.
+    bool allocateTargets(uint32_t width, uint32_t height, int format);
+    bool hasTargets() const;
+
+    // Returns true if layer can be composed into a framebuffer of format.
+    bool canCompose(const Layer& layer, int format) const;
+
+    // Composes layers, ordered from bottom to top, into target. Fails without
+    // touching target if a layer cannot be composed anymore, e.g., because its
+    // buffer changed since canCompose.
+    bool compose(buffer_handle_t target, const std::vector<const Layer*>& layers);
+
+    // Clears the next target of the compositor to opaque black and composes
+    // layers into it. Returns the target, or nullptr if compose failed. The
+    // targets are used in turn, so the one returned last may be scanned out.
+    buffer_handle_t composeToTarget(const std::vector<const Layer*>& layers);
+
+    static bool isSupportedFormat(int format);
+
+private:
+    static constexpr size_t kNumTargets = 2;
+
+    bool compose(buffer_handle_t target, const std::vector<const Layer*>& layers, bool clear);
+    void composeSolidColor(const Surface& target, const Layer& layer);
+    void composeBuffer(const Surface& target, const Layer& layer, const Surface& buffer);
+
+    std::unique_ptr<BufferMapper> mMapper;
+    std::vector<buffer_handle_t> mTargets;
+    size_t mNextTarget{0};
+};
+
+} // namespace android
+
+#endif // ANDROID_SF_HWC2_ON_FB_SOFTWARE_COMPOSITOR_H
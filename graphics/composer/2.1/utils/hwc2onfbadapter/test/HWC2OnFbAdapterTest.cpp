@@ -0,0 +1,304 @@
+/*
+ * Copyright 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <hwc2onfbadapter/HWC2OnFbAdapter.h>
+
+#include <gtest/gtest.h>
+#include <hardware/fb.h>
+
+#include <map>
+#include <unordered_set>
+#include <vector>
+
+#include "MemoryMapper.h"
+
+namespace android {
+namespace {
+
+constexpr uint32_t kWidth = 16;
+constexpr uint32_t kHeight = 4;
+constexpr uint32_t kOpaqueRed = 0xff0000ff;
+constexpr uint32_t kOpaqueBlue = 0xffff0000;
+
+// A framebuffer device that records the posted buffers.
+struct FakeFramebuffer {
+    framebuffer_device_t device;
+    std::vector<buffer_handle_t> posted;
+};
+
+int postHook(framebuffer_device_t* device, buffer_handle_t buffer) {
+    reinterpret_cast<FakeFramebuffer*>(device)->posted.push_back(buffer);
+    return 0;
+}
+
+int closeHook(hw_device_t* /*device*/) {
+    return 0;
+}
+
+class HWC2OnFbAdapterTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        mBuffers[mTarget] = {std::vector<uint32_t>(kWidth * kHeight, kOpaqueBlue), kWidth,
+                             kHeight, HAL_PIXEL_FORMAT_RGBA_8888};
+        mBuffers[mLayerBuffer] = {std::vector<uint32_t>(kWidth * kHeight, kOpaqueRed), kWidth,
+                                  kHeight, HAL_PIXEL_FORMAT_RGBA_8888};
+        mAdapter = std::make_unique<HWC2OnFbAdapter>(&mFramebuffer.device);
+    }
+
+    void TearDown() override { mAdapter->close(); }
+
+    // Enables the compositor, with targets of its own at handles from firstTarget if it is set.
+    void enableSoftwareComposition(uintptr_t firstTarget = 0) {
+        mAdapter->enableSoftwareComposition(
+                std::make_unique<MemoryMapper>(&mBuffers, firstTarget));
+    }
+
+    // Calls the setLayerBuffer function of the device, as the client would.
+    int32_t setLayerBuffer(hwc2_layer_t layer, buffer_handle_t buffer) {
+        auto hook = reinterpret_cast<HWC2_PFN_SET_LAYER_BUFFER>(
+                mAdapter->getFunction(mAdapter.get(), HWC2_FUNCTION_SET_LAYER_BUFFER));
+        return hook(mAdapter.get(), HWC2OnFbAdapter::getDisplayId(), layer, buffer, -1);
+    }
+
+    // Calls the presentDisplay function of the device, as the client would.
+    int32_t presentDisplay() {
+        auto hook = reinterpret_cast<HWC2_PFN_PRESENT_DISPLAY>(
+                mAdapter->getFunction(mAdapter.get(), HWC2_FUNCTION_PRESENT_DISPLAY));
+        int32_t presentFence = -1;
+        return hook(mAdapter.get(), HWC2OnFbAdapter::getDisplayId(), &presentFence);
+    }
+
+    // Adds a layer at z that the compositor can compose, or cannot if scaled is set.
+    hwc2_layer_t addBufferLayer(uint32_t z, bool scaled = false) {
+        hwc2_layer_t id = mAdapter->addLayer();
+        auto* layer = mAdapter->getLayer(id);
+        layer->composition = HWC2_COMPOSITION_DEVICE;
+        layer->displayFrame = {0, 0, int32_t(kWidth), int32_t(kHeight)};
+        layer->sourceCrop = {0.0f, 0.0f, float(kWidth) / (scaled ? 2.0f : 1.0f), float(kHeight)};
+        layer->z = z;
+        layer->buffer = mLayerBuffer;
+        return id;
+    }
+
+    std::unordered_set<hwc2_layer_t> validate() {
+        mAdapter->validateLayers();
+        return mAdapter->getDirtyLayers();
+    }
+
+    uint32_t targetPixel(uint32_t x, uint32_t y, buffer_handle_t target = nullptr) {
+        return mBuffers[target ? target : mTarget].pixels[y * kWidth + x];
+    }
+
+    FakeFramebuffer mFramebuffer{
+            .device = {.common = {.tag = HARDWARE_DEVICE_TAG, .close = closeHook},
+                       .width = kWidth,
+                       .height = kHeight,
+                       .stride = int(kWidth),
+                       .format = HAL_PIXEL_FORMAT_RGBA_8888,
+                       .xdpi = 160.0f,
+                       .ydpi = 160.0f,
+                       .fps = 60.0f,
+                       .post = postHook}};
+    const buffer_handle_t mTarget = makeHandle(0x1000);
+    const buffer_handle_t mLayerBuffer = makeHandle(0x2000);
+    const buffer_handle_t mOwnTargets[2] = {makeHandle(0x3000), makeHandle(0x3001)};
+    std::map<buffer_handle_t, MemoryMapper::Buffer> mBuffers;
+    std::unique_ptr<HWC2OnFbAdapter> mAdapter;
+};
+
+TEST_F(HWC2OnFbAdapterTest, ChangesAllLayersToClientWithoutCompositor) {
+    // setup test
+    hwc2_layer_t bottom = addBufferLayer(0);
+    hwc2_layer_t top = addBufferLayer(1);
+
+    // run test and verify result
+    EXPECT_EQ(std::unordered_set<hwc2_layer_t>({bottom, top}), validate());
+}
+
+TEST_F(HWC2OnFbAdapterTest, ChangesLayersToClientFromFirstUnsupportedLayerDown) {
+    // setup test
+    enableSoftwareComposition();
+    hwc2_layer_t bottom = addBufferLayer(0);
+    hwc2_layer_t scaled = addBufferLayer(1, true);
+    addBufferLayer(2);
+    hwc2_layer_t color = mAdapter->addLayer();
+    auto* colorLayer = mAdapter->getLayer(color);
+    colorLayer->composition = HWC2_COMPOSITION_SOLID_COLOR;
+    colorLayer->z = 3;
+
+    // run test
+    auto dirtyLayers = validate();
+    mAdapter->clearDirtyLayers();
+
+    // verify result
+    EXPECT_EQ(std::unordered_set<hwc2_layer_t>({bottom, scaled}), dirtyLayers);
+    EXPECT_EQ(HWC2_COMPOSITION_CLIENT, mAdapter->getLayer(bottom)->composition);
+    EXPECT_EQ(HWC2_COMPOSITION_CLIENT, mAdapter->getLayer(scaled)->composition);
+    EXPECT_EQ(HWC2_COMPOSITION_SOLID_COLOR, colorLayer->composition);
+
+    // Validating again does not change the layers the client now composes.
+    EXPECT_TRUE(validate().empty());
+}
+
+TEST_F(HWC2OnFbAdapterTest, LeavesBottomLayerToClient) {
+    // setup test
+    enableSoftwareComposition();
+    hwc2_layer_t bottom = addBufferLayer(0);
+    addBufferLayer(1);
+
+    // run test and verify result
+    EXPECT_EQ(std::unordered_set<hwc2_layer_t>({bottom}), validate());
+}
+
+TEST_F(HWC2OnFbAdapterTest, ComposesSingleLayerIntoOwnTarget) {
+    // setup test
+    enableSoftwareComposition(0x3000);
+    addBufferLayer(0);
+
+    // run test and verify result
+    EXPECT_TRUE(validate().empty());
+    EXPECT_TRUE(mAdapter->composeLayers());
+    EXPECT_TRUE(mAdapter->postBuffer());
+    EXPECT_EQ(std::vector<buffer_handle_t>({mOwnTargets[0]}), mFramebuffer.posted);
+    EXPECT_EQ(kOpaqueRed, targetPixel(0, 0, mOwnTargets[0]));
+    EXPECT_EQ(kOpaqueBlue, targetPixel(0, 0));
+
+    // The posted target may be scanned out, so the next frame goes to the other one.
+    EXPECT_TRUE(mAdapter->composeLayers());
+    EXPECT_TRUE(mAdapter->postBuffer());
+    EXPECT_EQ(std::vector<buffer_handle_t>({mOwnTargets[0], mOwnTargets[1]}),
+              mFramebuffer.posted);
+    EXPECT_EQ(kOpaqueRed, targetPixel(0, 0, mOwnTargets[1]));
+}
+
+TEST_F(HWC2OnFbAdapterTest, ClearsOwnTarget) {
+    // setup test
+    enableSoftwareComposition(0x3000);
+    hwc2_layer_t color = mAdapter->addLayer();
+    auto* colorLayer = mAdapter->getLayer(color);
+    colorLayer->composition = HWC2_COMPOSITION_SOLID_COLOR;
+    colorLayer->color = {0xff, 0x00, 0x00, 0xff};
+    colorLayer->displayFrame = {0, 0, 1, 1};
+    mBuffers[mOwnTargets[0]].pixels.assign(kWidth * kHeight, kOpaqueBlue);
+
+    // run test
+    EXPECT_TRUE(validate().empty());
+    EXPECT_TRUE(mAdapter->composeLayers());
+
+    // verify result
+    EXPECT_EQ(kOpaqueRed, targetPixel(0, 0, mOwnTargets[0]));
+    EXPECT_EQ(0xff000000, targetPixel(1, 0, mOwnTargets[0]));
+}
+
+TEST_F(HWC2OnFbAdapterTest, LeavesBottomLayerToClientWhenNotAllLayersAreComposed) {
+    // setup test
+    enableSoftwareComposition(0x3000);
+    hwc2_layer_t bottom = addBufferLayer(0, true);
+    addBufferLayer(1);
+
+    // run test and verify result
+    EXPECT_EQ(std::unordered_set<hwc2_layer_t>({bottom}), validate());
+    mAdapter->clearDirtyLayers();
+    mAdapter->setBuffer(mTarget);
+    EXPECT_TRUE(mAdapter->composeLayers());
+    EXPECT_TRUE(mAdapter->postBuffer());
+    EXPECT_EQ(std::vector<buffer_handle_t>({mTarget}), mFramebuffer.posted);
+}
+
+TEST_F(HWC2OnFbAdapterTest, RevalidatesWhenComposedLayerBufferChanges) {
+    // setup test
+    enableSoftwareComposition();
+    hwc2_layer_t bottom = addBufferLayer(0);
+    hwc2_layer_t top = addBufferLayer(1);
+    validate();
+    mAdapter->clearDirtyLayers();
+    mAdapter->setState(HWC2OnFbAdapter::State::VALIDATED);
+
+    // run test and verify result
+    // The client composes the bottom layer, whatever its buffer.
+    EXPECT_EQ(HWC2_ERROR_NONE, setLayerBuffer(bottom, makeHandle(0x2001)));
+    EXPECT_EQ(HWC2OnFbAdapter::State::VALIDATED, mAdapter->getState());
+
+    EXPECT_EQ(HWC2_ERROR_NONE, setLayerBuffer(top, mLayerBuffer));
+    EXPECT_EQ(HWC2OnFbAdapter::State::VALIDATED, mAdapter->getState());
+
+    EXPECT_EQ(HWC2_ERROR_NONE, setLayerBuffer(top, makeHandle(0x2001)));
+    EXPECT_EQ(HWC2OnFbAdapter::State::MODIFIED, mAdapter->getState());
+}
+
+TEST_F(HWC2OnFbAdapterTest, FailsPresentWhenComposedLayerCannotBeComposed) {
+    // setup test
+    enableSoftwareComposition(0x3000);
+    hwc2_layer_t layer = addBufferLayer(0);
+    validate();
+    mAdapter->setState(HWC2OnFbAdapter::State::VALIDATED);
+    // The buffer is resized behind the back of the adapter.
+    mBuffers[mLayerBuffer].width = kWidth / 2;
+
+    // run test and verify result
+    EXPECT_EQ(HWC2_ERROR_NOT_VALIDATED, presentDisplay());
+    EXPECT_EQ(HWC2OnFbAdapter::State::MODIFIED, mAdapter->getState());
+    EXPECT_TRUE(mFramebuffer.posted.empty());
+
+    // Validating again hands the layer to the client.
+    EXPECT_EQ(std::unordered_set<hwc2_layer_t>({layer}), validate());
+}
+
+TEST_F(HWC2OnFbAdapterTest, ChangesAllLayersToClientWithColorTransform) {
+    // setup test
+    enableSoftwareComposition();
+    hwc2_layer_t bottom = addBufferLayer(0);
+    hwc2_layer_t top = addBufferLayer(1);
+    mAdapter->setColorTransform(false);
+
+    // run test and verify result
+    EXPECT_EQ(std::unordered_set<hwc2_layer_t>({bottom, top}), validate());
+}
+
+TEST_F(HWC2OnFbAdapterTest, ComposesOnlyIntoNewClientTarget) {
+    // setup test
+    enableSoftwareComposition();
+    addBufferLayer(0, true);
+    hwc2_layer_t color = mAdapter->addLayer();
+    auto* colorLayer = mAdapter->getLayer(color);
+    colorLayer->composition = HWC2_COMPOSITION_SOLID_COLOR;
+    colorLayer->color = {0xff, 0x00, 0x00, 0xff};
+    colorLayer->displayFrame = {0, 0, 1, 1};
+    colorLayer->z = 1;
+    validate();
+    mAdapter->clearDirtyLayers();
+
+    // run test and verify result
+    // The client target of the last frame may be on screen, so it is left alone.
+    EXPECT_FALSE(mAdapter->composeLayers());
+    EXPECT_EQ(kOpaqueBlue, targetPixel(0, 0));
+
+    mAdapter->setBuffer(mTarget);
+    EXPECT_TRUE(mAdapter->composeLayers());
+    EXPECT_TRUE(mAdapter->postBuffer());
+    EXPECT_EQ(kOpaqueRed, targetPixel(0, 0));
+    EXPECT_EQ(kOpaqueBlue, targetPixel(1, 0));
+    EXPECT_EQ(std::vector<buffer_handle_t>({mTarget}), mFramebuffer.posted);
+
+    // Presenting again without a new client target does not compose.
+    mBuffers[mTarget].pixels[0] = kOpaqueBlue;
+    validate();
+    EXPECT_FALSE(mAdapter->composeLayers());
+    EXPECT_EQ(kOpaqueBlue, targetPixel(0, 0));
+}
+
+}  // namespace
+}  // namespace android
@@ -0,0 +1,77 @@
+/*
+ * Copyright 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_SF_HWC2_ON_FB_TEST_MEMORY_MAPPER_H
+#define ANDROID_SF_HWC2_ON_FB_TEST_MEMORY_MAPPER_H
+
+#include <hwc2onfbadapter/SoftwareCompositor.h>
+
+#include <map>
+#include <vector>
+
+namespace android {
+
+// Backs fake buffer handles with pixels in memory.
+class MemoryMapper : public SoftwareCompositor::BufferMapper {
+public:
+    struct Buffer {
+        std::vector<uint32_t> pixels;
+        uint32_t width;
+        uint32_t height;
+        int format;
+    };
+
+    // Allocates targets at handles from firstTarget, or none if it is 0.
+    explicit MemoryMapper(std::map<buffer_handle_t, Buffer>* buffers, uintptr_t firstTarget = 0)
+          : mBuffers(buffers), mNextTarget(firstTarget) {}
+
+    bool lock(buffer_handle_t handle, bool /*write*/,
+              SoftwareCompositor::Surface* outSurface) override {
+        auto iter = mBuffers->find(handle);
+        if (iter == mBuffers->end()) {
+            return false;
+        }
+        auto& buffer = iter->second;
+        *outSurface = {buffer.pixels.data(), buffer.width, buffer.height, buffer.width,
+                       buffer.format};
+        return true;
+    }
+
+    void unlock(buffer_handle_t /*handle*/) override {}
+
+    buffer_handle_t allocateTarget(uint32_t width, uint32_t height, int format) override {
+        if (!mNextTarget) {
+            return nullptr;
+        }
+        auto handle = reinterpret_cast<buffer_handle_t>(mNextTarget++);
+        (*mBuffers)[handle] = {std::vector<uint32_t>(width * height), width, height, format};
+        return handle;
+    }
+
+    void freeTarget(buffer_handle_t handle) override { mBuffers->erase(handle); }
+
+private:
+    std::map<buffer_handle_t, Buffer>* mBuffers;
+    uintptr_t mNextTarget;
+};
+
+inline buffer_handle_t makeHandle(uintptr_t id) {
+    return reinterpret_cast<buffer_handle_t>(id);
+}
+
+} // namespace android
+
+#endif // ANDROID_SF_HWC2_ON_FB_TEST_MEMORY_MAPPER_H
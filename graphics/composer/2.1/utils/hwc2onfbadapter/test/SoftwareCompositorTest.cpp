@@ -0,0 +1,235 @@
+/*
+ * Copyright 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <hwc2onfbadapter/SoftwareCompositor.h>
+
+#include <gtest/gtest.h>
+
+#include <map>
+#include <vector>
+
+#include "MemoryMapper.h"
+
+namespace android {
+namespace {
+
+constexpr uint32_t kWidth = 16;
+constexpr uint32_t kHeight = 4;
+constexpr uint32_t kOpaqueRed = 0xff0000ff;
+constexpr uint32_t kOpaqueBlue = 0xffff0000;
+
+class SoftwareCompositorTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        mBuffers[mTarget] = {std::vector<uint32_t>(kWidth * kHeight, kOpaqueBlue), kWidth,
+                             kHeight, HAL_PIXEL_FORMAT_RGBA_8888};
+        mCompositor = std::make_unique<SoftwareCompositor>(
+                std::make_unique<MemoryMapper>(&mBuffers));
+    }
+
+    // Adds a buffer whose pixel at (x, y) is pixel(x, y).
+    template <typename F>
+    buffer_handle_t addBuffer(uint32_t width, uint32_t height, int format, F pixel) {
+        buffer_handle_t handle = makeHandle(mBuffers.size() + 1);
+        MemoryMapper::Buffer buffer{std::vector<uint32_t>(width * height), width, height, format};
+        for (uint32_t y = 0; y < height; y++) {
+            for (uint32_t x = 0; x < width; x++) {
+                buffer.pixels[y * width + x] = pixel(x, y);
+            }
+        }
+        mBuffers[handle] = std::move(buffer);
+        return handle;
+    }
+
+    uint32_t targetPixel(uint32_t x, uint32_t y) {
+        return mBuffers[mTarget].pixels[y * kWidth + x];
+    }
+
+    static SoftwareCompositor::Layer makeBufferLayer(buffer_handle_t buffer, uint32_t width,
+                                                     uint32_t height) {
+        SoftwareCompositor::Layer layer;
+        layer.composition = HWC2_COMPOSITION_DEVICE;
+        layer.displayFrame = {0, 0, int32_t(width), int32_t(height)};
+        layer.sourceCrop = {0.0f, 0.0f, float(width), float(height)};
+        layer.buffer = buffer;
+        return layer;
+    }
+
+    const buffer_handle_t mTarget = makeHandle(0x1000);
+    std::map<buffer_handle_t, MemoryMapper::Buffer> mBuffers;
+    std::unique_ptr<SoftwareCompositor> mCompositor;
+};
+
+TEST_F(SoftwareCompositorTest, FillsSolidColor) {
+    // setup test
+    SoftwareCompositor::Layer layer;
+    layer.composition = HWC2_COMPOSITION_SOLID_COLOR;
+    layer.color = {0xff, 0x00, 0x00, 0xff};
+    layer.displayFrame = {2, 1, 10, 3};
+
+    // run test
+    ASSERT_TRUE(mCompositor->canCompose(layer, HAL_PIXEL_FORMAT_RGBA_8888));
+    ASSERT_TRUE(mCompositor->compose(mTarget, {&layer}));
+
+    // verify result
+    EXPECT_EQ(kOpaqueRed, targetPixel(2, 1));
+    EXPECT_EQ(kOpaqueRed, targetPixel(9, 2));
+    EXPECT_EQ(kOpaqueBlue, targetPixel(1, 1));
+    EXPECT_EQ(kOpaqueBlue, targetPixel(10, 2));
+    EXPECT_EQ(kOpaqueBlue, targetPixel(5, 0));
+    EXPECT_EQ(kOpaqueBlue, targetPixel(5, 3));
+}
+
+TEST_F(SoftwareCompositorTest, BlendsPremultipliedBuffer) {
+    // setup test
+    // half transparent premultiplied red
+    buffer_handle_t buffer = addBuffer(kWidth, kHeight, HAL_PIXEL_FORMAT_RGBA_8888,
+                                       [](uint32_t, uint32_t) { return 0x80000080u; });
+    auto layer = makeBufferLayer(buffer, kWidth, kHeight);
+    layer.blendMode = HWC2_BLEND_MODE_PREMULTIPLIED;
+
+    // run test
+    ASSERT_TRUE(mCompositor->canCompose(layer, HAL_PIXEL_FORMAT_RGBA_8888));
+    ASSERT_TRUE(mCompositor->compose(mTarget, {&layer}));
+
+    // verify result
+    for (uint32_t y = 0; y < kHeight; y++) {
+        for (uint32_t x = 0; x < kWidth; x++) {
+            EXPECT_EQ(0xff7f0080u, targetPixel(x, y)) << "at " << x << ", " << y;
+        }
+    }
+}
+
+TEST_F(SoftwareCompositorTest, CopiesFlippedBuffer) {
+    // setup test
+    buffer_handle_t buffer = addBuffer(kWidth, kHeight, HAL_PIXEL_FORMAT_RGBX_8888,
+                                       [](uint32_t x, uint32_t y) { return y << 8 | x; });
+    auto layer = makeBufferLayer(buffer, kWidth, kHeight);
+    layer.transform = HWC_TRANSFORM_FLIP_H | HWC_TRANSFORM_FLIP_V;
+
+    // run test
+    ASSERT_TRUE(mCompositor->canCompose(layer, HAL_PIXEL_FORMAT_RGBA_8888));
+    ASSERT_TRUE(mCompositor->compose(mTarget, {&layer}));
+
+    // verify result
+    for (uint32_t y = 0; y < kHeight; y++) {
+        for (uint32_t x = 0; x < kWidth; x++) {
+            const uint32_t expected = 0xff000000u | (kHeight - 1 - y) << 8 | (kWidth - 1 - x);
+            EXPECT_EQ(expected, targetPixel(x, y)) << "at " << x << ", " << y;
+        }
+    }
+}
+
+TEST_F(SoftwareCompositorTest, ClipsToTarget) {
+    // setup test
+    buffer_handle_t buffer = addBuffer(kWidth, kHeight, HAL_PIXEL_FORMAT_RGBA_8888,
+                                       [](uint32_t x, uint32_t y) { return y << 8 | x; });
+    auto layer = makeBufferLayer(buffer, kWidth, kHeight);
+    layer.displayFrame = {-4, 2, int32_t(kWidth) - 4, int32_t(kHeight) + 2};
+
+    // run test
+    ASSERT_TRUE(mCompositor->canCompose(layer, HAL_PIXEL_FORMAT_RGBA_8888));
+    ASSERT_TRUE(mCompositor->compose(mTarget, {&layer}));
+
+    // verify result
+    EXPECT_EQ(kOpaqueBlue, targetPixel(0, 1));
+    EXPECT_EQ(0xff000004u, targetPixel(0, 2));
+    EXPECT_EQ(0xff00010fu, targetPixel(kWidth - 5, 3));
+    EXPECT_EQ(kOpaqueBlue, targetPixel(kWidth - 4, 3));
+}
+
+TEST_F(SoftwareCompositorTest, FailsWithoutTouchingTargetWhenLayerCannotBeComposed) {
+    // setup test
+    SoftwareCompositor::Layer color;
+    color.composition = HWC2_COMPOSITION_SOLID_COLOR;
+    color.color = {0xff, 0x00, 0x00, 0xff};
+    color.displayFrame = {0, 0, int32_t(kWidth), int32_t(kHeight)};
+    buffer_handle_t buffer = addBuffer(kWidth, kHeight, HAL_PIXEL_FORMAT_RGBA_8888,
+                                       [](uint32_t, uint32_t) { return 0u; });
+    auto layer = makeBufferLayer(buffer, kWidth, kHeight);
+    ASSERT_TRUE(mCompositor->canCompose(layer, HAL_PIXEL_FORMAT_RGBA_8888));
+    mBuffers[buffer].format = HAL_PIXEL_FORMAT_BGRA_8888;
+
+    // run test and verify result
+    EXPECT_FALSE(mCompositor->compose(mTarget, {&color, &layer}));
+    EXPECT_EQ(kOpaqueBlue, targetPixel(0, 0));
+}
+
+TEST_F(SoftwareCompositorTest, ComposesToTargetsInTurn) {
+    // setup test
+    std::map<buffer_handle_t, MemoryMapper::Buffer> buffers;
+    SoftwareCompositor compositor(std::make_unique<MemoryMapper>(&buffers, 0x3000));
+    SoftwareCompositor::Layer layer;
+    layer.composition = HWC2_COMPOSITION_SOLID_COLOR;
+    layer.color = {0xff, 0x00, 0x00, 0xff};
+    layer.displayFrame = {0, 0, 1, 1};
+
+    // run test
+    ASSERT_TRUE(compositor.allocateTargets(kWidth, kHeight, HAL_PIXEL_FORMAT_RGBA_8888));
+    buffer_handle_t first = compositor.composeToTarget({&layer});
+    buffer_handle_t second = compositor.composeToTarget({&layer});
+
+    // verify result
+    EXPECT_EQ(makeHandle(0x3000), first);
+    EXPECT_EQ(makeHandle(0x3001), second);
+    EXPECT_EQ(first, compositor.composeToTarget({&layer}));
+    EXPECT_EQ(kOpaqueRed, buffers[first].pixels[0]);
+    EXPECT_EQ(0xff000000, buffers[first].pixels[1]);
+}
+
+TEST_F(SoftwareCompositorTest, HasNoTargetsWithoutAllocator) {
+    // run test and verify result
+    EXPECT_FALSE(mCompositor->allocateTargets(kWidth, kHeight, HAL_PIXEL_FORMAT_RGBA_8888));
+    EXPECT_FALSE(mCompositor->hasTargets());
+    EXPECT_EQ(nullptr, mCompositor->composeToTarget({}));
+}
+
+TEST_F(SoftwareCompositorTest, RejectsUnsupportedLayers) {
+    // setup test
+    buffer_handle_t buffer = addBuffer(kWidth, kHeight, HAL_PIXEL_FORMAT_RGBA_8888,
+                                       [](uint32_t, uint32_t) { return 0u; });
+    buffer_handle_t bgraBuffer = addBuffer(kWidth, kHeight, HAL_PIXEL_FORMAT_BGRA_8888,
+                                           [](uint32_t, uint32_t) { return 0u; });
+
+    auto scaled = makeBufferLayer(buffer, kWidth, kHeight);
+    scaled.displayFrame.right *= 2;
+    auto rotated = makeBufferLayer(buffer, kWidth, kHeight);
+    rotated.transform = HWC_TRANSFORM_ROT_90;
+    auto coverage = makeBufferLayer(buffer, kWidth, kHeight);
+    coverage.blendMode = HWC2_BLEND_MODE_COVERAGE;
+    auto opaqueWithAlpha = makeBufferLayer(buffer, kWidth, kHeight);
+    opaqueWithAlpha.planeAlpha = 0.5f;
+    auto swapped = makeBufferLayer(bgraBuffer, kWidth, kHeight);
+    auto unmapped = makeBufferLayer(makeHandle(0x2000), kWidth, kHeight);
+    auto client = makeBufferLayer(buffer, kWidth, kHeight);
+    client.composition = HWC2_COMPOSITION_CLIENT;
+
+    // run test and verify result
+    EXPECT_TRUE(mCompositor->canCompose(makeBufferLayer(buffer, kWidth, kHeight),
+                                        HAL_PIXEL_FORMAT_RGBA_8888));
+    EXPECT_FALSE(mCompositor->canCompose(scaled, HAL_PIXEL_FORMAT_RGBA_8888));
+    EXPECT_FALSE(mCompositor->canCompose(rotated, HAL_PIXEL_FORMAT_RGBA_8888));
+    EXPECT_FALSE(mCompositor->canCompose(coverage, HAL_PIXEL_FORMAT_RGBA_8888));
+    EXPECT_FALSE(mCompositor->canCompose(opaqueWithAlpha, HAL_PIXEL_FORMAT_RGBA_8888));
+    EXPECT_FALSE(mCompositor->canCompose(swapped, HAL_PIXEL_FORMAT_RGBA_8888));
+    EXPECT_FALSE(mCompositor->canCompose(unmapped, HAL_PIXEL_FORMAT_RGBA_8888));
+    EXPECT_FALSE(mCompositor->canCompose(client, HAL_PIXEL_FORMAT_RGBA_8888));
+    EXPECT_FALSE(mCompositor->canCompose(makeBufferLayer(buffer, kWidth, kHeight),
+                                         HAL_PIXEL_FORMAT_RGB_565));
+}
+
+}  // namespace
+}  // namespace android
@@ -0,0 +1,88 @@
+/*
+ * Copyright 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Measures the encode time and the parceled size of the commands ComposerClientWriter produces for
+// a steady-state scene, i.e., one where every layer gets a new buffer each frame but its geometry
+// and blending do not change, with and without layer state tracking.
+
+#include <android/binder_parcel.h>
+#include <android/hardware/graphics/composer3/ComposerClientWriter.h>
+#include <benchmark/benchmark.h>
+
+namespace aidl::android::hardware::graphics::composer3 {
+namespace {
+
+constexpr int64_t kDisplay = 0;
+constexpr int64_t kNumLayers = 20;
+
+void writeFrame(ComposerClientWriter& writer) {
+    for (int64_t layer = 0; layer < kNumLayers; ++layer) {
+        const int32_t offset = static_cast<int32_t>(layer) * 10;
+        const Rect frame = {.left = offset, .top = offset, .right = offset + 100,
+                            .bottom = offset + 100};
+        writer.setLayerBuffer(kDisplay, layer, /*slot=*/0, /*buffer=*/nullptr,
+                              /*acquireFence=*/-1);
+        writer.setLayerCompositionType(kDisplay, layer, Composition::DEVICE);
+        writer.setLayerBlendMode(kDisplay, layer, BlendMode::PREMULTIPLIED);
+        writer.setLayerDataspace(kDisplay, layer, Dataspace::SRGB);
+        writer.setLayerDisplayFrame(kDisplay, layer, frame);
+        writer.setLayerSourceCrop(kDisplay, layer, {.left = 0, .top = 0, .right = 100,
+                                                   .bottom = 100});
+        writer.setLayerPlaneAlpha(kDisplay, layer, 1.0f);
+        writer.setLayerTransform(kDisplay, layer, Transform::NONE);
+        writer.setLayerZOrder(kDisplay, layer, static_cast<uint32_t>(layer));
+    }
+    writer.validateDisplay(kDisplay, ComposerClientWriter::kNoTimestamp);
+}
+
+size_t getParceledSize(const std::vector<DisplayCommand>& commands) {
+    AParcel* parcel = AParcel_create();
+    for (const auto& command : commands) {
+        command.writeToParcel(parcel);
+    }
+    const size_t size = static_cast<size_t>(AParcel_getDataSize(parcel));
+    AParcel_delete(parcel);
+    return size;
+}
+
+void BM_WriteSteadyStateFrame(benchmark::State& state) {
+    ComposerClientWriter writer;
+    writer.setLayerStateTracking(state.range(0) != 0);
+
+    // The first frame always carries the full layer state.
+    writeFrame(writer);
+    writer.getPendingCommands();
+    writer.reset();
+
+    for (auto _ : state) {
+        writeFrame(writer);
+        benchmark::DoNotOptimize(writer.getPendingCommands());
+        writer.reset();
+    }
+
+    writeFrame(writer);
+    state.counters["bytes"] = static_cast<double>(getParceledSize(writer.getPendingCommands()));
+    writer.reset();
+    state.SetItemsProcessed(state.iterations() * kNumLayers);
+    state.SetLabel(state.range(0) != 0 ? "tracked" : "untracked");
+}
+
+BENCHMARK(BM_WriteSteadyStateFrame)->Arg(0)->Arg(1);
+
+}  // namespace
+}  // namespace aidl::android::hardware::graphics::composer3
+
+BENCHMARK_MAIN();
@@ -19,6 +19,7 @@
 #include <algorithm>
 #include <limits>
 #include <memory>
+#include <optional>
 #include <unordered_map>
 #include <unordered_set>
 #include <vector>
@@ -68,11 +69,48 @@ class ComposerClientWriter {
     virtual ~ComposerClientWriter() { reset(); }
 
     void reset() {
+        if (mTrackLayerState) {
+            // Keep the layer vectors of the sent commands for the next frame's commands.
+            for (auto& command : mCommands) {
+                command.layers.clear();
+                mFreeLayerVectors.emplace_back(std::move(command.layers));
+            }
+        }
         mDisplayCommand.reset();
         mLayerCommand.reset();
         mCommands.clear();
     }
 
+    /**
+     * Enables or disables layer state tracking. When enabled, the writer remembers the last value
+     * written for the geometry and blending properties of each layer (blend mode, dataspace,
+     * display frame, plane alpha, source crop, transform, z order, color and brightness), and
+     * omits a property from the command if it has not changed since. It also reuses the storage of
+     * the commands across reset() calls. The composition type is always written, since
+     * validateDisplay() and acceptDisplayChanges() change it on the composer side.
+     *
+     * The remembered state must match what the composer has received, so callers must call
+     * forgetLayerState() when destroying a layer and invalidateLayerState() when pending commands
+     * are dropped or fail to execute.
+     */
+    void setLayerStateTracking(bool enabled) {
+        mTrackLayerState = enabled;
+        if (!enabled) {
+            mLayerStates.clear();
+            mFreeLayerVectors.clear();
+        }
+    }
+
+    void forgetLayerState(int64_t display, int64_t layer) {
+        if (auto it = mLayerStates.find(display); it != mLayerStates.end()) {
+            it->second.erase(layer);
+        }
+    }
+
+    void forgetDisplayState(int64_t display) { mLayerStates.erase(display); }
+
+    void invalidateLayerState() { mLayerStates.clear(); }
+
     void setColorTransform(int64_t display, const float* matrix) {
         std::vector<float> matVec;
         matVec.reserve(16);
@@ -137,12 +175,14 @@ class ComposerClientWriter {
     }
 
     void setLayerBlendMode(int64_t display, int64_t layer, BlendMode mode) {
+        if (isLayerStateUnchanged(display, layer, &LayerState::blendMode, mode)) return;
         ParcelableBlendMode parcelableBlendMode;
         parcelableBlendMode.blendMode = mode;
         getLayerCommand(display, layer).blendMode.emplace(std::move(parcelableBlendMode));
     }
 
     void setLayerColor(int64_t display, int64_t layer, Color color) {
+        if (isLayerStateUnchanged(display, layer, &LayerState::color, color)) return;
         getLayerCommand(display, layer).color.emplace(std::move(color));
     }
 
@@ -153,16 +193,19 @@ class ComposerClientWriter {
     }
 
     void setLayerDataspace(int64_t display, int64_t layer, Dataspace dataspace) {
+        if (isLayerStateUnchanged(display, layer, &LayerState::dataspace, dataspace)) return;
         ParcelableDataspace dataspacePayload;
         dataspacePayload.dataspace = dataspace;
         getLayerCommand(display, layer).dataspace.emplace(std::move(dataspacePayload));
     }
 
     void setLayerDisplayFrame(int64_t display, int64_t layer, const Rect& frame) {
+        if (isLayerStateUnchanged(display, layer, &LayerState::displayFrame, frame)) return;
         getLayerCommand(display, layer).displayFrame.emplace(frame);
     }
 
     void setLayerPlaneAlpha(int64_t display, int64_t layer, float alpha) {
+        if (isLayerStateUnchanged(display, layer, &LayerState::planeAlpha, alpha)) return;
         PlaneAlpha planeAlpha;
         planeAlpha.alpha = alpha;
         getLayerCommand(display, layer).planeAlpha.emplace(std::move(planeAlpha));
@@ -175,10 +218,12 @@ class ComposerClientWriter {
     }
 
     void setLayerSourceCrop(int64_t display, int64_t layer, const FRect& crop) {
+        if (isLayerStateUnchanged(display, layer, &LayerState::sourceCrop, crop)) return;
         getLayerCommand(display, layer).sourceCrop.emplace(crop);
     }
 
     void setLayerTransform(int64_t display, int64_t layer, Transform transform) {
+        if (isLayerStateUnchanged(display, layer, &LayerState::transform, transform)) return;
         ParcelableTransform transformPayload;
         transformPayload.transform = transform;
         getLayerCommand(display, layer).transform.emplace(std::move(transformPayload));
@@ -189,6 +234,7 @@ class ComposerClientWriter {
     }
 
     void setLayerZOrder(int64_t display, int64_t layer, uint32_t z) {
+        if (isLayerStateUnchanged(display, layer, &LayerState::z, z)) return;
         ZOrder zorder;
         zorder.z = static_cast<int32_t>(z);
         getLayerCommand(display, layer).z.emplace(std::move(zorder));
@@ -211,6 +257,7 @@ class ComposerClientWriter {
     }
 
     void setLayerBrightness(int64_t display, int64_t layer, float brightness) {
+        if (isLayerStateUnchanged(display, layer, &LayerState::brightness, brightness)) return;
         getLayerCommand(display, layer)
                 .brightness.emplace(LayerBrightness{.brightness = brightness});
     }
@@ -226,10 +273,38 @@ class ComposerClientWriter {
     }
 
   private:
+    // The last values written for a layer while layer state tracking is enabled.
+    struct LayerState {
+        std::optional<BlendMode> blendMode;
+        std::optional<Color> color;
+        std::optional<Dataspace> dataspace;
+        std::optional<Rect> displayFrame;
+        std::optional<float> planeAlpha;
+        std::optional<FRect> sourceCrop;
+        std::optional<Transform> transform;
+        std::optional<uint32_t> z;
+        std::optional<float> brightness;
+    };
+
     std::optional<DisplayCommand> mDisplayCommand;
     std::optional<LayerCommand> mLayerCommand;
     std::vector<DisplayCommand> mCommands;
 
+    bool mTrackLayerState = false;
+    std::unordered_map<int64_t, std::unordered_map<int64_t, LayerState>> mLayerStates;
+    std::vector<std::vector<LayerCommand>> mFreeLayerVectors;
+
+    // Returns true if the property can be omitted, otherwise remembers the new value.
+    template <typename T>
+    bool isLayerStateUnchanged(int64_t display, int64_t layer, std::optional<T> LayerState::*field,
+                               const T& value) {
+        if (!mTrackLayerState) return false;
+        auto& last = mLayerStates[display][layer].*field;
+        if (last == value) return true;
+        last = value;
+        return false;
+    }
+
     Buffer getBuffer(uint32_t slot, const native_handle_t* bufferHandle, int fence) {
         Buffer bufferCommand;
         bufferCommand.slot = static_cast<int32_t>(slot);
@@ -258,6 +333,10 @@ class ComposerClientWriter {
             flushDisplayCommand();
             mDisplayCommand.emplace();
             mDisplayCommand->display = display;
+            if (!mFreeLayerVectors.empty()) {
+                mDisplayCommand->layers = std::move(mFreeLayerVectors.back());
+                mFreeLayerVectors.pop_back();
+            }
         }
         return *mDisplayCommand;
     }
@@ -0,0 +1,206 @@
+/*
+ * Copyright 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Checks the DisplayCommands ComposerClientWriter emits with layer state tracking.
+
+#include <android/hardware/graphics/composer3/ComposerClientWriter.h>
+#include <gtest/gtest.h>
+
+#include <vector>
+
+namespace aidl::android::hardware::graphics::composer3 {
+namespace {
+
+constexpr int64_t kDisplay = 0;
+constexpr int64_t kOtherDisplay = 1;
+constexpr int64_t kLayer = 10;
+constexpr int64_t kOtherLayer = 11;
+const Rect kFrame = {.left = 0, .top = 0, .right = 100, .bottom = 100};
+
+class ComposerClientWriterTest : public ::testing::Test {
+  protected:
+    void SetUp() override { mWriter.setLayerStateTracking(true); }
+
+    void writeLayer(int64_t display, int64_t layer, Composition composition = Composition::DEVICE,
+                    float alpha = 1.0f) {
+        mWriter.setLayerCompositionType(display, layer, composition);
+        mWriter.setLayerBlendMode(display, layer, BlendMode::PREMULTIPLIED);
+        mWriter.setLayerDisplayFrame(display, layer, kFrame);
+        mWriter.setLayerPlaneAlpha(display, layer, alpha);
+        mWriter.setLayerZOrder(display, layer, 1);
+    }
+
+    // Ends the frame with a validate, so every frame has a display command.
+    const std::vector<DisplayCommand>& endFrame(int64_t display = kDisplay) {
+        mWriter.validateDisplay(display, ComposerClientWriter::kNoTimestamp);
+        return mWriter.getPendingCommands();
+    }
+
+    // Returns the command of layer in the only display command, or nullptr if it has none.
+    static const LayerCommand* findLayer(const std::vector<DisplayCommand>& commands,
+                                         int64_t layer) {
+        EXPECT_EQ(commands.size(), 1u);
+        if (commands.empty()) return nullptr;
+        for (const auto& command : commands.front().layers) {
+            if (command.layer == layer) return &command;
+        }
+        return nullptr;
+    }
+
+    static void expectAllProperties(const LayerCommand* command) {
+        ASSERT_NE(command, nullptr);
+        EXPECT_TRUE(command->composition.has_value());
+        EXPECT_TRUE(command->blendMode.has_value());
+        EXPECT_TRUE(command->displayFrame.has_value());
+        EXPECT_TRUE(command->planeAlpha.has_value());
+        EXPECT_TRUE(command->z.has_value());
+    }
+
+    ComposerClientWriter mWriter;
+};
+
+TEST_F(ComposerClientWriterTest, WritesEverythingWithoutTracking) {
+    mWriter.setLayerStateTracking(false);
+    writeLayer(kDisplay, kLayer);
+    endFrame();
+    mWriter.reset();
+
+    writeLayer(kDisplay, kLayer);
+    expectAllProperties(findLayer(endFrame(), kLayer));
+}
+
+TEST_F(ComposerClientWriterTest, ElidesUnchangedProperties) {
+    writeLayer(kDisplay, kLayer);
+    expectAllProperties(findLayer(endFrame(), kLayer));
+    mWriter.reset();
+
+    writeLayer(kDisplay, kLayer, Composition::DEVICE, 0.5f);
+    const LayerCommand* command = findLayer(endFrame(), kLayer);
+    ASSERT_NE(command, nullptr);
+    EXPECT_FALSE(command->blendMode.has_value());
+    EXPECT_FALSE(command->displayFrame.has_value());
+    EXPECT_FALSE(command->z.has_value());
+    ASSERT_TRUE(command->planeAlpha.has_value());
+    EXPECT_EQ(command->planeAlpha->alpha, 0.5f);
+}
+
+TEST_F(ComposerClientWriterTest, SkipsUnchangedLayerWithoutComposition) {
+    mWriter.setLayerBlendMode(kDisplay, kLayer, BlendMode::PREMULTIPLIED);
+    mWriter.setLayerDisplayFrame(kDisplay, kLayer, kFrame);
+    endFrame();
+    mWriter.reset();
+
+    mWriter.setLayerBlendMode(kDisplay, kLayer, BlendMode::PREMULTIPLIED);
+    mWriter.setLayerDisplayFrame(kDisplay, kLayer, kFrame);
+    const auto& commands = endFrame();
+    ASSERT_EQ(commands.size(), 1u);
+    EXPECT_TRUE(commands.front().layers.empty());
+    EXPECT_TRUE(commands.front().validateDisplay);
+}
+
+TEST_F(ComposerClientWriterTest, AlwaysWritesCompositionType) {
+    // Frame 1: the client asks for DEVICE, validate changes the layer to CLIENT and the client
+    // accepts the change.
+    writeLayer(kDisplay, kLayer, Composition::DEVICE);
+    endFrame();
+    mWriter.reset();
+    mWriter.acceptDisplayChanges(kDisplay);
+    mWriter.getPendingCommands();
+    mWriter.reset();
+
+    // Frame 2: asking for DEVICE again must reach the composer.
+    writeLayer(kDisplay, kLayer, Composition::DEVICE);
+    const LayerCommand* command = findLayer(endFrame(), kLayer);
+    ASSERT_NE(command, nullptr);
+    ASSERT_TRUE(command->composition.has_value());
+    EXPECT_EQ(command->composition->composition, Composition::DEVICE);
+}
+
+TEST_F(ComposerClientWriterTest, ForgetLayerStateWritesLayerAgain) {
+    writeLayer(kDisplay, kLayer);
+    writeLayer(kDisplay, kOtherLayer);
+    endFrame();
+    mWriter.reset();
+
+    mWriter.forgetLayerState(kDisplay, kLayer);
+    writeLayer(kDisplay, kLayer);
+    writeLayer(kDisplay, kOtherLayer);
+    const auto& commands = endFrame();
+    expectAllProperties(findLayer(commands, kLayer));
+    const LayerCommand* other = findLayer(commands, kOtherLayer);
+    ASSERT_NE(other, nullptr);
+    EXPECT_FALSE(other->blendMode.has_value());
+}
+
+TEST_F(ComposerClientWriterTest, ForgetDisplayStateOnlyAffectsThatDisplay) {
+    writeLayer(kDisplay, kLayer);
+    writeLayer(kOtherDisplay, kLayer);
+    mWriter.getPendingCommands();
+    mWriter.reset();
+
+    mWriter.forgetDisplayState(kOtherDisplay);
+    writeLayer(kOtherDisplay, kLayer);
+    expectAllProperties(findLayer(endFrame(kOtherDisplay), kLayer));
+    mWriter.reset();
+
+    writeLayer(kDisplay, kLayer);
+    const LayerCommand* command = findLayer(endFrame(), kLayer);
+    ASSERT_NE(command, nullptr);
+    EXPECT_FALSE(command->blendMode.has_value());
+}
+
+TEST_F(ComposerClientWriterTest, InvalidateLayerStateWritesEverythingAgain) {
+    writeLayer(kDisplay, kLayer);
+    writeLayer(kDisplay, kOtherLayer);
+    endFrame();
+    mWriter.reset();
+
+    mWriter.invalidateLayerState();
+    writeLayer(kDisplay, kLayer);
+    writeLayer(kDisplay, kOtherLayer);
+    const auto& commands = endFrame();
+    expectAllProperties(findLayer(commands, kLayer));
+    expectAllProperties(findLayer(commands, kOtherLayer));
+}
+
+TEST_F(ComposerClientWriterTest, RecyclesLayerVectors) {
+    constexpr int64_t kNumLayers = 8;
+    for (int64_t layer = 0; layer < kNumLayers; ++layer) {
+        writeLayer(kDisplay, layer);
+    }
+    const auto& commands = endFrame();
+    ASSERT_EQ(commands.size(), 1u);
+    ASSERT_EQ(commands.front().layers.size(), static_cast<size_t>(kNumLayers));
+    const LayerCommand* storage = commands.front().layers.data();
+    mWriter.reset();
+
+    // The next frame's display command reuses the storage, and starts out empty.
+    for (int64_t layer = 0; layer < kNumLayers; ++layer) {
+        writeLayer(kDisplay, layer, Composition::CLIENT);
+    }
+    const auto& nextCommands = endFrame();
+    ASSERT_EQ(nextCommands.size(), 1u);
+    EXPECT_EQ(nextCommands.front().layers.data(), storage);
+    ASSERT_EQ(nextCommands.front().layers.size(), static_cast<size_t>(kNumLayers));
+    for (const auto& command : nextCommands.front().layers) {
+        ASSERT_TRUE(command.composition.has_value());
+        EXPECT_EQ(command.composition->composition, Composition::CLIENT);
+        EXPECT_FALSE(command.blendMode.has_value());
+    }
+}
+
+}  // namespace
+}  // namespace aidl::android::hardware::graphics::composer3
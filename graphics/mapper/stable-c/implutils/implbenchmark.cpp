@@ -0,0 +1,214 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Measures the per-frame StandardMetadata queries SurfaceFlinger and codecs issue against an
+// IMapper-StableC implementation, encoding every value on each call vs. serving them from a
+// StandardMetadataCache, one at a time or batched.
+
+#include <android/hardware/graphics/mapper/utils/IMapperMetadataCache.h>
+#include <android/hardware/graphics/mapper/utils/IMapperMetadataTypes.h>
+#include <benchmark/benchmark.h>
+
+#include <vector>
+
+using namespace ::android::hardware::graphics::mapper;
+using namespace ::aidl::android::hardware::graphics::common;
+
+namespace {
+
+// What a typical implementation keeps per buffer
+struct FakeBufferMetadata {
+    uint64_t bufferId = 1;
+    uint64_t width = 1920;
+    uint64_t height = 1080;
+    uint32_t stride = 1920;
+    PixelFormat format = PixelFormat::YCBCR_420_888;
+    BufferUsage usage = BufferUsage::GPU_TEXTURE | BufferUsage::VIDEO_DECODER;
+    Dataspace dataspace = Dataspace::BT2020_ITU_PQ;
+    BlendMode blendMode = BlendMode::NONE;
+    std::vector<Rect> crop{Rect{0, 0, 1920, 1080}};
+    std::vector<PlaneLayout> planeLayouts;
+    std::optional<Smpte2086> smpte2086 = Smpte2086{{0.708f, 0.292f}, {0.170f, 0.797f},
+                                                   {0.131f, 0.046f}, {0.3127f, 0.3290f},
+                                                   1000.0f, 0.005f};
+    std::optional<Cta861_3> cta861_3 = Cta861_3{1000.0f, 400.0f};
+    std::optional<std::vector<uint8_t>> smpte2094_40 = std::vector<uint8_t>(64, 0x40);
+
+    FakeBufferMetadata() {
+        // Y, then interleaved CbCr at half resolution
+        for (int plane = 0; plane < 2; plane++) {
+            PlaneLayout& layout = planeLayouts.emplace_back();
+            const int64_t numComponents = plane == 0 ? 1 : 2;
+            for (int64_t i = 0; i < numComponents; i++) {
+                PlaneLayoutComponent& component = layout.components.emplace_back();
+                component.type.name = "android.hardware.graphics.common.PlaneLayoutComponentType";
+                component.type.value = 1 << (plane + i);
+                component.offsetInBits = i * 8;
+                component.sizeInBits = 8;
+            }
+            layout.sampleIncrementInBits = 8 * numComponents;
+            layout.strideInBytes = 1920;
+            layout.widthInSamples = plane == 0 ? 1920 : 960;
+            layout.heightInSamples = plane == 0 ? 1080 : 540;
+            layout.totalSizeInBytes = layout.strideInBytes * layout.heightInSamples;
+            layout.horizontalSubsampling = plane == 0 ? 1 : 2;
+            layout.verticalSubsampling = plane == 0 ? 1 : 2;
+        }
+    }
+
+    template <StandardMetadataType T>
+    int32_t operator()(auto&& provide) const {
+        if constexpr (T == StandardMetadataType::BUFFER_ID) {
+            return provide(bufferId);
+        } else if constexpr (T == StandardMetadataType::WIDTH) {
+            return provide(width);
+        } else if constexpr (T == StandardMetadataType::HEIGHT) {
+            return provide(height);
+        } else if constexpr (T == StandardMetadataType::STRIDE) {
+            return provide(stride);
+        } else if constexpr (T == StandardMetadataType::PIXEL_FORMAT_REQUESTED) {
+            return provide(format);
+        } else if constexpr (T == StandardMetadataType::USAGE) {
+            return provide(usage);
+        } else if constexpr (T == StandardMetadataType::DATASPACE) {
+            return provide(dataspace);
+        } else if constexpr (T == StandardMetadataType::BLEND_MODE) {
+            return provide(blendMode);
+        } else if constexpr (T == StandardMetadataType::CROP) {
+            return provide(crop);
+        } else if constexpr (T == StandardMetadataType::PLANE_LAYOUTS) {
+            return provide(planeLayouts);
+        } else if constexpr (T == StandardMetadataType::SMPTE2086) {
+            return provide(smpte2086);
+        } else if constexpr (T == StandardMetadataType::CTA861_3) {
+            return provide(cta861_3);
+        } else if constexpr (T == StandardMetadataType::SMPTE2094_40) {
+            return provide(smpte2094_40);
+        }
+        return -AIMAPPER_ERROR_UNSUPPORTED;
+    }
+};
+
+// What SurfaceFlinger reads for every layer it composites, every frame. All of these are mutable,
+// so the cache passes them through to the implementation.
+const std::vector<StandardMetadataType> kCompositionQueries{
+        StandardMetadataType::DATASPACE, StandardMetadataType::BLEND_MODE,
+        StandardMetadataType::CROP,      StandardMetadataType::SMPTE2086,
+        StandardMetadataType::CTA861_3,  StandardMetadataType::SMPTE2094_40};
+
+// What a codec reads for every buffer it locks. All of these are fixed at allocation, so cached.
+const std::vector<StandardMetadataType> kCodecQueries{
+        StandardMetadataType::BUFFER_ID, StandardMetadataType::WIDTH,
+        StandardMetadataType::HEIGHT,    StandardMetadataType::STRIDE,
+        StandardMetadataType::USAGE,     StandardMetadataType::PIXEL_FORMAT_REQUESTED,
+        StandardMetadataType::PLANE_LAYOUTS};
+
+const std::vector<StandardMetadataType>& getQueries(const benchmark::State& state) {
+    return state.range(0) == 0 ? kCompositionQueries : kCodecQueries;
+}
+
+const buffer_handle_t kFakeBuffer = reinterpret_cast<buffer_handle_t>(0x1234);
+
+void setLabel(benchmark::State& state) {
+    const auto& queries = getQueries(state);
+    state.SetItemsProcessed(state.iterations() * queries.size());
+    state.SetLabel(state.range(0) == 0 ? "composition" : "codec");
+}
+
+void BM_Uncached(benchmark::State& state) {
+    const FakeBufferMetadata metadata;
+    const auto& queries = getQueries(state);
+    std::vector<uint8_t> buffer(4096);
+
+    for (auto _ : state) {
+        for (auto type : queries) {
+            benchmark::DoNotOptimize(
+                    provideStandardMetadata(type, buffer.data(), buffer.size(), metadata));
+        }
+        benchmark::ClobberMemory();
+    }
+    setLabel(state);
+}
+
+void BM_Cached(benchmark::State& state) {
+    const FakeBufferMetadata metadata;
+    const auto& queries = getQueries(state);
+    StandardMetadataCache cache;
+    std::vector<uint8_t> buffer(4096);
+
+    for (auto _ : state) {
+        for (auto type : queries) {
+            benchmark::DoNotOptimize(cache.getStandardMetadata(kFakeBuffer, type, buffer.data(),
+                                                               buffer.size(), metadata));
+        }
+        benchmark::ClobberMemory();
+    }
+    setLabel(state);
+}
+
+void BM_CachedBatched(benchmark::State& state) {
+    const FakeBufferMetadata metadata;
+    const auto& queries = getQueries(state);
+    StandardMetadataCache cache;
+    std::vector<int32_t> sizes(queries.size());
+    std::vector<uint8_t> buffer(4096);
+
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(cache.getStandardMetadata(kFakeBuffer, queries, sizes,
+                                                           buffer.data(), buffer.size(), metadata));
+        benchmark::ClobberMemory();
+    }
+    setLabel(state);
+}
+
+// Every frame sets a new dataspace before reading the values back, e.g., a video that switches
+// between SDR & HDR content.
+void BM_CachedWithUpdate(benchmark::State& state) {
+    FakeBufferMetadata metadata;
+    const auto& queries = getQueries(state);
+    StandardMetadataCache cache;
+    std::vector<uint8_t> buffer(4096);
+    std::vector<uint8_t> dataspace(4096);
+    const int32_t dataspaceSize =
+            StandardMetadata<StandardMetadataType::DATASPACE>::value::encode(
+                    Dataspace::BT2020_ITU_HLG, dataspace.data(), dataspace.size());
+
+    for (auto _ : state) {
+        cache.setStandardMetadata(kFakeBuffer, StandardMetadataType::DATASPACE, dataspace.data(),
+                                  dataspaceSize,
+                                  [&]<StandardMetadataType T>(auto&& value) -> AIMapper_Error {
+                                      if constexpr (T == StandardMetadataType::DATASPACE) {
+                                          metadata.dataspace = value;
+                                      }
+                                      return AIMAPPER_ERROR_NONE;
+                                  });
+        for (auto type : queries) {
+            benchmark::DoNotOptimize(cache.getStandardMetadata(kFakeBuffer, type, buffer.data(),
+                                                               buffer.size(), metadata));
+        }
+        benchmark::ClobberMemory();
+    }
+    setLabel(state);
+}
+
+BENCHMARK(BM_Uncached)->Arg(0)->Arg(1);
+BENCHMARK(BM_Cached)->Arg(0)->Arg(1);
+BENCHMARK(BM_CachedBatched)->Arg(0)->Arg(1);
+BENCHMARK(BM_CachedWithUpdate)->Arg(0)->Arg(1);
+
+}  // namespace
+
+BENCHMARK_MAIN();
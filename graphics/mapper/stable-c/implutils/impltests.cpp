@@ -16,6 +16,7 @@
 
 #include <gtest/gtest.h>
 
+#include <android/hardware/graphics/mapper/utils/IMapperMetadataCache.h>
 #include <android/hardware/graphics/mapper/utils/IMapperMetadataTypes.h>
 #include <android/hardware/graphics/mapper/utils/IMapperProvider.h>
 #include <drm/drm_fourcc.h>
@@ -343,6 +344,174 @@ TEST(MetadataProvider, outOfBounds) {
             << "100 (out of range) should have resulted in UNSUPPORTED";
 }
 
+// Counts the calls to provide; the value of each type is static_cast<int>(type) + offset
+struct CountingProvider {
+    int calls = 0;
+    int offset = 0;
+
+    template <StandardMetadataType T>
+    int32_t operator()(auto&& provide) {
+        calls++;
+        if constexpr (T == StandardMetadataType::BUFFER_ID) {
+            return provide(static_cast<uint64_t>(offset));
+        } else if constexpr (T == StandardMetadataType::DATASPACE) {
+            return provide(static_cast<Dataspace>(static_cast<int>(T) + offset));
+        } else if constexpr (T == StandardMetadataType::CROP) {
+            return provide(std::vector<Rect>{Rect{0, 0, offset, offset}});
+        }
+        return -AIMAPPER_ERROR_UNSUPPORTED;
+    }
+};
+
+static const buffer_handle_t kFakeBuffer = reinterpret_cast<buffer_handle_t>(0x1234);
+
+TEST(MetadataCache, cachesValue) {
+    using BufferId = StandardMetadata<StandardMetadataType::BUFFER_ID>::value;
+    StandardMetadataCache cache;
+    CountingProvider provider{.offset = 10};
+    std::vector<uint8_t> buffer(10000, 0);
+
+    for (int i = 0; i < 3; i++) {
+        int32_t size = cache.getStandardMetadata(kFakeBuffer, StandardMetadataType::BUFFER_ID,
+                                                 buffer.data(), buffer.size(), provider);
+        EXPECT_EQ(8 + HeaderSize, size);
+        EXPECT_EQ(10, BufferId::decode(buffer.data(), size).value_or(0));
+    }
+    // Encoded straight into the caller's buffer once, then never again
+    EXPECT_EQ(1, provider.calls);
+}
+
+TEST(MetadataCache, mutableValuesAreNotCached) {
+    using Dataspace_ = StandardMetadata<StandardMetadataType::DATASPACE>::value;
+    StandardMetadataCache cache;
+    CountingProvider provider{.offset = 10};
+    std::vector<uint8_t> buffer(10000, 0);
+
+    for (int i = 0; i < 3; i++) {
+        // Another process changes the value in the shared metadata region
+        provider.offset = 10 + i;
+        int32_t size = cache.getStandardMetadata(kFakeBuffer, StandardMetadataType::DATASPACE,
+                                                 buffer.data(), buffer.size(), provider);
+        EXPECT_EQ(4 + HeaderSize, size);
+        auto read = Dataspace_::decode(buffer.data(), size);
+        ASSERT_TRUE(read.has_value());
+        EXPECT_EQ(static_cast<int>(StandardMetadataType::DATASPACE) + 10 + i,
+                  static_cast<int>(*read));
+    }
+    EXPECT_EQ(3, provider.calls);
+    EXPECT_FALSE(StandardMetadataCache::isCacheable(StandardMetadataType::DATASPACE));
+    EXPECT_FALSE(StandardMetadataCache::isCacheable(StandardMetadataType::CROP));
+    EXPECT_TRUE(StandardMetadataCache::isCacheable(StandardMetadataType::PLANE_LAYOUTS));
+}
+
+TEST(MetadataCache, reportsSizeWhenTooSmall) {
+    StandardMetadataCache cache;
+    CountingProvider provider;
+    std::vector<uint8_t> buffer(10, 0);
+
+    EXPECT_EQ(8 + HeaderSize, cache.getStandardMetadata(kFakeBuffer,
+                                                        StandardMetadataType::BUFFER_ID,
+                                                        buffer.data(), buffer.size(), provider));
+    EXPECT_EQ(std::vector<uint8_t>(10, 0), buffer);
+    EXPECT_EQ(8 + HeaderSize, cache.getStandardMetadata(kFakeBuffer,
+                                                        StandardMetadataType::BUFFER_ID, nullptr,
+                                                        0, provider));
+    EXPECT_EQ(2, provider.calls);
+
+    // Cached once read into a large enough buffer
+    buffer.resize(8 + HeaderSize);
+    for (int i = 0; i < 2; i++) {
+        EXPECT_EQ(8 + HeaderSize,
+                  cache.getStandardMetadata(kFakeBuffer, StandardMetadataType::BUFFER_ID,
+                                            buffer.data(), buffer.size(), provider));
+    }
+    EXPECT_EQ(3, provider.calls);
+}
+
+TEST(MetadataCache, setInvalidates) {
+    using BufferId = StandardMetadata<StandardMetadataType::BUFFER_ID>::value;
+    StandardMetadataCache cache;
+    CountingProvider provider{.offset = 1};
+    std::vector<uint8_t> buffer(10000, 0);
+
+    cache.getStandardMetadata(kFakeBuffer, StandardMetadataType::BUFFER_ID, buffer.data(),
+                              buffer.size(), provider);
+    EXPECT_EQ(1, BufferId::decode(buffer.data(), buffer.size()).value_or(0));
+
+    std::vector<uint8_t> newValue(8 + HeaderSize);
+    ASSERT_EQ(8 + HeaderSize, BufferId::encode(2, newValue.data(), newValue.size()));
+    AIMapper_Error result = cache.setStandardMetadata(
+            kFakeBuffer, StandardMetadataType::BUFFER_ID, newValue.data(), newValue.size(),
+            [&]<StandardMetadataType T>(auto&& value) {
+                if constexpr (T == StandardMetadataType::BUFFER_ID) {
+                    provider.offset = static_cast<int>(value);
+                }
+                return AIMAPPER_ERROR_NONE;
+            });
+    EXPECT_EQ(AIMAPPER_ERROR_NONE, result);
+
+    cache.getStandardMetadata(kFakeBuffer, StandardMetadataType::BUFFER_ID, buffer.data(),
+                              buffer.size(), provider);
+    EXPECT_EQ(2, BufferId::decode(buffer.data(), buffer.size()).value_or(0));
+    EXPECT_EQ(2, provider.calls);
+}
+
+TEST(MetadataCache, forgetBuffer) {
+    StandardMetadataCache cache;
+    CountingProvider provider;
+    std::vector<uint8_t> buffer(10000, 0);
+
+    for (int i = 0; i < 2; i++) {
+        cache.getStandardMetadata(kFakeBuffer, StandardMetadataType::BUFFER_ID, buffer.data(),
+                                  buffer.size(), provider);
+    }
+    cache.forgetBuffer(kFakeBuffer);
+    cache.getStandardMetadata(kFakeBuffer, StandardMetadataType::BUFFER_ID, buffer.data(),
+                              buffer.size(), provider);
+    EXPECT_EQ(2, provider.calls);
+}
+
+TEST(MetadataCache, errorsAreNotCached) {
+    StandardMetadataCache cache;
+    CountingProvider provider;
+
+    for (int i = 0; i < 2; i++) {
+        EXPECT_EQ(-AIMAPPER_ERROR_UNSUPPORTED,
+                  cache.getStandardMetadata(kFakeBuffer, StandardMetadataType::NAME, nullptr, 0,
+                                            provider));
+    }
+    EXPECT_EQ(2, provider.calls);
+    EXPECT_EQ(-AIMAPPER_ERROR_UNSUPPORTED,
+              cache.getStandardMetadata(kFakeBuffer, StandardMetadataType::INVALID, nullptr, 0,
+                                        provider));
+}
+
+TEST(MetadataCache, batched) {
+    using BufferId = StandardMetadata<StandardMetadataType::BUFFER_ID>::value;
+    using Crop = StandardMetadata<StandardMetadataType::CROP>::value;
+    StandardMetadataCache cache;
+    CountingProvider provider{.offset = 5};
+    const std::vector<StandardMetadataType> types{StandardMetadataType::BUFFER_ID,
+                                                  StandardMetadataType::NAME,
+                                                  StandardMetadataType::CROP};
+    std::vector<int32_t> sizes(types.size());
+    std::vector<uint8_t> buffer(10000, 0);
+
+    int32_t total = cache.getStandardMetadata(kFakeBuffer, types, sizes, nullptr, 0, provider);
+    EXPECT_EQ(8 + HeaderSize, sizes[0]);
+    EXPECT_EQ(-AIMAPPER_ERROR_UNSUPPORTED, sizes[1]);
+    EXPECT_EQ(8 + 16 + HeaderSize, sizes[2]);
+    EXPECT_EQ(sizes[0] + sizes[2], total);
+
+    EXPECT_EQ(total, cache.getStandardMetadata(kFakeBuffer, types, sizes, buffer.data(),
+                                               buffer.size(), provider));
+    EXPECT_EQ(5, BufferId::decode(buffer.data(), sizes[0]).value_or(0));
+    auto crop = Crop::decode(buffer.data() + sizes[0], sizes[2]);
+    ASSERT_TRUE(crop.has_value());
+    ASSERT_EQ(1, crop->size());
+    EXPECT_EQ(5, (*crop)[0].right);
+}
+
 template <StandardMetadataType T>
 std::vector<uint8_t> encode(const typename StandardMetadata<T>::value_type& value) {
     using Value = typename StandardMetadata<T>::value;
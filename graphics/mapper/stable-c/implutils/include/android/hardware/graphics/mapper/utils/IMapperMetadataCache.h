@@ -0,0 +1,246 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <android/hardware/graphics/mapper/IMapper.h>
+#include <android/hardware/graphics/mapper/utils/IMapperMetadataTypes.h>
+#include <log/log.h>
+
+#include <algorithm>
+#include <array>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <unordered_map>
+#include <vector>
+
+namespace android::hardware::graphics::mapper {
+
+/**
+ * Caches the encoded StandardMetadata of buffers for an IMapper-StableC implementation.
+ *
+ * Most metadata is read far more often than it is written; SurfaceFlinger and codecs query the
+ * size, format, plane layouts, etc... of every buffer on every frame. Instead of encoding the
+ * value again on each getStandardMetadata, the implementation can serve it through this cache,
+ * which only calls back into the implementation the first time a type is read.
+ *
+ * The cache lives in one process, while mutable metadata such as the dataspace or the crop lives
+ * in the buffer's shared metadata region, where any process that imported the buffer may change
+ * it. So only the types that are fixed when the buffer is allocated are cached; reads of the
+ * other types are passed through to provide.
+ *
+ * The provide & apply functions have the same signatures as the ones passed to
+ * provideStandardMetadata & applyStandardMetadata, so adopting the cache is a matter of routing
+ * getStandardMetadata & setStandardMetadata through it:
+ *
+ *     int32_t getStandardMetadata(buffer_handle_t buffer, int64_t type, void* dest,
+ *                                 size_t destSize) override {
+ *         return mCache.getStandardMetadata(buffer, static_cast<StandardMetadataType>(type),
+ *                                           dest, destSize, [&]<StandardMetadataType T>(
+ *                                                   auto&& provide) { ... });
+ *     }
+ *
+ * Buffers are keyed by their handle, so the implementation must call forgetBuffer() from
+ * freeBuffer() before the handle can be reused.
+ */
+class StandardMetadataCache {
+  public:
+    static constexpr size_t kNumTypes = ndk::internal::enum_values<StandardMetadataType>.size();
+
+    /**
+     * Writes the encoded value of type for buffer into destBuffer, encoding it with provide if it
+     * isn't cached yet. Returns the same as provideStandardMetadata: the size of the encoded value,
+     * even if it didn't fit in destBuffer, or a negative AIMapper_Error. Errors are not cached.
+     */
+    template <typename F>
+    int32_t getStandardMetadata(buffer_handle_t _Nonnull buffer, StandardMetadataType type,
+                                void* _Nullable destBuffer, size_t destBufferSize, F&& provide) {
+        const auto index = static_cast<size_t>(type);
+        if (type == StandardMetadataType::INVALID || index >= kNumTypes) {
+            return -AIMAPPER_ERROR_UNSUPPORTED;
+        }
+        if (!isCacheable(type)) {
+            return provideStandardMetadata(type, destBuffer, destBufferSize, provide);
+        }
+
+        uint64_t generation;
+        {
+            std::lock_guard lock(mMutex);
+            auto [it, inserted] = mEntries.try_emplace(buffer);
+            Entry& entry = it->second;
+            if (inserted) {
+                entry.generation = ++mGeneration;
+            }
+            if (const auto& cached = entry.values[index]) {
+                return copyOut(*cached, destBuffer, destBufferSize);
+            }
+            generation = entry.generation;
+        }
+
+        // Encode straight into destBuffer, without holding the lock as the implementation may take
+        // its own locks. Only a value that fit is cached; a caller that was only told the size
+        // calls again with a large enough buffer. If the buffer was invalidated meanwhile the value
+        // may already be stale, so it isn't cached either.
+        const int32_t size = provideStandardMetadata(type, destBuffer, destBufferSize, provide);
+        if (size < 0 || !destBuffer || static_cast<size_t>(size) > destBufferSize) {
+            forgetIfEmpty(buffer);
+            return size;
+        }
+        const auto* value = static_cast<const uint8_t*>(destBuffer);
+        {
+            std::lock_guard lock(mMutex);
+            auto it = mEntries.find(buffer);
+            if (it != mEntries.end() && it->second.generation == generation) {
+                it->second.values[index].emplace(value, value + size);
+            }
+        }
+        return size;
+    }
+
+    /**
+     * Returns whether the values of type are cached, i.e., whether they are fixed when the buffer
+     * is allocated.
+     */
+    static constexpr bool isCacheable(StandardMetadataType type) {
+        switch (type) {
+            case StandardMetadataType::BUFFER_ID:
+            case StandardMetadataType::NAME:
+            case StandardMetadataType::WIDTH:
+            case StandardMetadataType::HEIGHT:
+            case StandardMetadataType::LAYER_COUNT:
+            case StandardMetadataType::PIXEL_FORMAT_REQUESTED:
+            case StandardMetadataType::PIXEL_FORMAT_FOURCC:
+            case StandardMetadataType::PIXEL_FORMAT_MODIFIER:
+            case StandardMetadataType::USAGE:
+            case StandardMetadataType::ALLOCATION_SIZE:
+            case StandardMetadataType::COMPRESSION:
+            case StandardMetadataType::INTERLACED:
+            case StandardMetadataType::CHROMA_SITING:
+            case StandardMetadataType::PLANE_LAYOUTS:
+            case StandardMetadataType::STRIDE:
+                return true;
+            default:
+                return false;
+        }
+    }
+
+    /**
+     * Batched getStandardMetadata: writes the encoded values of types back to back into
+     * destBuffer, and the size (or negative error) of each into outSizes, which must be as long
+     * as types. Values that fail are skipped. Returns the total size of all the values, which may
+     * exceed destBufferSize, in which case only the values that fit entirely were written.
+     */
+    template <typename F>
+    int32_t getStandardMetadata(buffer_handle_t _Nonnull buffer,
+                                std::span<const StandardMetadataType> types,
+                                std::span<int32_t> outSizes, void* _Nullable destBuffer,
+                                size_t destBufferSize, F&& provide) {
+        LOG_ALWAYS_FATAL_IF(outSizes.size() < types.size(), "outSizes is too small");
+        uint8_t* dest = reinterpret_cast<uint8_t*>(destBuffer);
+        size_t remaining = destBuffer ? destBufferSize : 0;
+        int32_t totalSize = 0;
+        for (size_t i = 0; i < types.size(); i++) {
+            const int32_t size =
+                    getStandardMetadata(buffer, types[i], dest, remaining, provide);
+            outSizes[i] = size;
+            if (size < 0) {
+                continue;
+            }
+            if (__builtin_add_overflow(totalSize, size, &totalSize)) {
+                return -AIMAPPER_ERROR_BAD_VALUE;
+            }
+            if (static_cast<size_t>(size) <= remaining) {
+                dest += size;
+                remaining -= size;
+            } else {
+                // Keep the values in order: once one doesn't fit, none of the following are
+                // written either.
+                remaining = 0;
+            }
+        }
+        return totalSize;
+    }
+
+    /**
+     * Decodes metadata and passes it to apply, like applyStandardMetadata. The cached value of
+     * type, if any, is dropped whether or not apply succeeds, as it may have partially applied it.
+     */
+    template <typename F>
+    AIMapper_Error setStandardMetadata(buffer_handle_t _Nonnull buffer, StandardMetadataType type,
+                                       const void* _Nonnull metadata, size_t metadataSize,
+                                       F&& apply) {
+        AIMapper_Error result =
+                applyStandardMetadata(type, metadata, metadataSize, std::forward<F>(apply));
+        invalidate(buffer, type);
+        return result;
+    }
+
+    /**
+     * Drops the cached value of type for buffer.
+     */
+    void invalidate(buffer_handle_t _Nonnull buffer, StandardMetadataType type) {
+        const auto index = static_cast<size_t>(type);
+        std::lock_guard lock(mMutex);
+        auto it = mEntries.find(buffer);
+        if (it != mEntries.end() && index < kNumTypes) {
+            it->second.values[index].reset();
+            it->second.generation = ++mGeneration;
+        }
+    }
+
+    /**
+     * Drops all the cached values for buffer. Must be called when the buffer is freed.
+     */
+    void forgetBuffer(buffer_handle_t _Nonnull buffer) {
+        std::lock_guard lock(mMutex);
+        mEntries.erase(buffer);
+    }
+
+  private:
+    struct Entry {
+        // Renewed on every invalidation, so that a value encoded concurrently with it is not cached.
+        // Unique across entries, so that this also holds if the entry is dropped and recreated.
+        uint64_t generation = 0;
+        std::array<std::optional<std::vector<uint8_t>>, kNumTypes> values;
+    };
+
+    // Avoids keeping entries around for handles that were never successfully read, such as
+    // ones the implementation rejected as invalid
+    void forgetIfEmpty(buffer_handle_t _Nonnull buffer) {
+        std::lock_guard lock(mMutex);
+        auto it = mEntries.find(buffer);
+        if (it != mEntries.end() &&
+            std::none_of(it->second.values.begin(), it->second.values.end(),
+                         [](const auto& value) { return value.has_value(); })) {
+            mEntries.erase(it);
+        }
+    }
+
+    static int32_t copyOut(const std::vector<uint8_t>& value, void* _Nullable destBuffer,
+                           size_t destBufferSize) {
+        if (destBuffer && value.size() <= destBufferSize) {
+            memcpy(destBuffer, value.data(), value.size());
+        }
+        return static_cast<int32_t>(value.size());
+    }
+
+    std::mutex mMutex;
+    uint64_t mGeneration = 0;
+    std::unordered_map<buffer_handle_t, Entry> mEntries;
+};
+
+}  // namespace android::hardware::graphics::mapper
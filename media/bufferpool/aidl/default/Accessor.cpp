@@ -21,6 +21,8 @@
 #include <time.h>
 #include <unistd.h>
 #include <utils/Log.h>
+#include <algorithm>
+#include <chrono>
 #include <thread>
 
 #include "Accessor.h"
@@ -32,6 +34,11 @@ namespace aidl::android::hardware::media::bufferpool2::implementation {
 namespace {
     static constexpr nsecs_t kEvictGranularityNs = 1000000000; // 1 sec
     static constexpr nsecs_t kEvictDurationNs = 5000000000; // 5 secs
+    // Status messages are posted via FMQs which cannot be waited on, so
+    // pending invalidations are also retried, with a backoff doubling from
+    // the minimum up to the maximum interval until the next signal.
+    static constexpr nsecs_t kInvalidationRetryMinNs = 1000; // 1 usec
+    static constexpr nsecs_t kInvalidationRetryMaxNs = 10000000; // 10 msecs
 }
 
 #ifdef __ANDROID_VNDK__
@@ -163,7 +170,12 @@ AIBinder_DeathRecipient *ConnectionDeathRecipient::getRecipient() {
 }
 
 Accessor::Accessor(const std::shared_ptr<BufferPoolAllocator> &allocator)
-    : mAllocator(allocator), mScheduleEvictTs(0) {}
+    : Accessor(allocator, nullptr) {}
+
+Accessor::Accessor(const std::shared_ptr<BufferPoolAllocator> &allocator,
+                   const std::shared_ptr<BufferPoolEvictionPolicy> &evictionPolicy)
+    : mAllocator(allocator), mScheduleEvictTs(0),
+      mBufferPool(evictionPolicy) {}
 
 Accessor::~Accessor() {
 }
@@ -192,8 +204,15 @@ BufferPoolStatus Accessor::allocate(
         size_t allocSize;
         status = mAllocator->allocate(params, &alloc, &allocSize);
         lock.lock();
+        if (status == ResultStatus::NO_MEMORY && mBufferPool.handleAllocationFailure()) {
+            // The memory of the evicted free buffers may be enough
+            lock.unlock();
+            status = mAllocator->allocate(params, &alloc, &allocSize);
+            lock.lock();
+        }
         if (status == ResultStatus::OK) {
-            status = mBufferPool.addNewBuffer(alloc, allocSize, params, bufferId, handle);
+            status = mBufferPool.addNewBuffer(alloc, allocSize, params,
+                                              mAllocator->configKey(params), bufferId, handle);
         }
         ALOGV("create a buffer %d : %u %p",
               status == ResultStatus::OK, *bufferId, *handle);
@@ -212,18 +231,16 @@ BufferPoolStatus Accessor::fetch(
         BufferId bufferId, const native_handle_t** handle) {
     std::lock_guard<std::mutex> lock(mBufferPool.mMutex);
     mBufferPool.processStatusMessages();
-    auto found = mBufferPool.mTransactions.find(transactionId);
-    if (found != mBufferPool.mTransactions.end() &&
-            contains(&mBufferPool.mPendingTransactions,
-                     connectionId, transactionId)) {
-        if (found->second->mSenderValidated &&
-                found->second->mStatus == BufferStatus::TRANSFER_FROM &&
-                found->second->mBufferId == bufferId) {
-            found->second->mStatus = BufferStatus::TRANSFER_FETCH;
-            auto bufferIt = mBufferPool.mBuffers.find(bufferId);
-            if (bufferIt != mBufferPool.mBuffers.end()) {
+    TransactionStatus *found = mBufferPool.mTransactions.find(transactionId);
+    if (found && found->mReceiver == connectionId) {
+        if (found->mSenderValidated &&
+                found->mStatus == BufferStatus::TRANSFER_FROM &&
+                found->mBufferId == bufferId) {
+            found->mStatus = BufferStatus::TRANSFER_FETCH;
+            InternalBuffer *buffer = mBufferPool.mBuffers.find(bufferId);
+            if (buffer) {
                 mBufferPool.mStats.onBufferFetched();
-                *handle = bufferIt->second->handle();
+                *handle = buffer->handle();
                 return ResultStatus::OK;
             }
         }
@@ -291,6 +308,13 @@ BufferPoolStatus Accessor::close(ConnectionId connectionId) {
     return ResultStatus::OK;
 }
 
+binder_status_t Accessor::dump(int fd, const char** /* args */, uint32_t /* numArgs */) {
+    std::lock_guard<std::mutex> lock(mBufferPool.mMutex);
+    mBufferPool.processStatusMessages();
+    mBufferPool.dump(fd);
+    return STATUS_OK;
+}
+
 void Accessor::cleanUp(bool clearCache) {
     // transaction timeout, buffer caching TTL handling
     std::lock_guard<std::mutex> lock(mBufferPool.mMutex);
@@ -326,25 +350,32 @@ void Accessor::invalidatorThread(
             std::map<uint32_t, const std::weak_ptr<Accessor>> &accessors,
             std::mutex &mutex,
             std::condition_variable &cv,
-            bool &ready) {
-    constexpr uint32_t NUM_SPIN_TO_INCREASE_SLEEP = 1024;
-    constexpr uint32_t NUM_SPIN_TO_LOG = 1024*8;
-    constexpr useconds_t MAX_SLEEP_US = 10000;
-    uint32_t numSpin = 0;
-    useconds_t sleepUs = 1;
-
+            bool &signaled) {
+    std::unique_lock<std::mutex> lock(mutex);
+    nsecs_t retryNs = kInvalidationRetryMinNs;
     while(true) {
-        std::map<uint32_t, const std::weak_ptr<Accessor>> copied;
-        {
-            std::unique_lock<std::mutex> lock(mutex);
-            while (!ready) {
-                numSpin = 0;
-                sleepUs = 1;
-                cv.wait(lock);
+        if (accessors.size() == 0) {
+            cv.wait(lock, [&] { return accessors.size() > 0; });
+            retryNs = kInvalidationRetryMinNs;
+        } else if (!signaled) {
+            // Waits for a buffer pool state change, or retries pending
+            // invalidations for status messages which are not processed yet.
+            cv.wait_for(lock, std::chrono::nanoseconds(retryNs),
+                        [&] { return signaled || accessors.size() == 0; });
+            if (accessors.size() == 0) {
+                continue;
             }
-            copied.insert(accessors.begin(), accessors.end());
         }
-        std::list<ConnectionId> erased;
+        if (signaled) {
+            signaled = false;
+            retryNs = kInvalidationRetryMinNs;
+        } else {
+            retryNs = std::min(retryNs * 2, kInvalidationRetryMaxNs);
+        }
+        std::map<uint32_t, const std::weak_ptr<Accessor>> copied(
+                accessors.begin(), accessors.end());
+        lock.unlock();
+        std::list<uint32_t> erased;
         for (auto it = copied.begin(); it != copied.end(); ++it) {
             const std::shared_ptr<Accessor> acc = it->second.lock();
             if (!acc) {
@@ -353,67 +384,49 @@ void Accessor::invalidatorThread(
                 acc->handleInvalidateAck();
             }
         }
-        {
-            std::unique_lock<std::mutex> lock(mutex);
-            for (auto it = erased.begin(); it != erased.end(); ++it) {
-                accessors.erase(*it);
-            }
-            if (accessors.size() == 0) {
-                ready = false;
-            } else {
-                // N.B. Since there is not a efficient way to wait over FMQ,
-                // polling over the FMQ is the current way to prevent draining
-                // CPU.
-                lock.unlock();
-                ++numSpin;
-                if (numSpin % NUM_SPIN_TO_INCREASE_SLEEP == 0 &&
-                    sleepUs < MAX_SLEEP_US) {
-                    sleepUs *= 10;
-                }
-                if (numSpin % NUM_SPIN_TO_LOG == 0) {
-                    ALOGW("invalidator thread spinning");
-                }
-                ::usleep(sleepUs);
-            }
+        lock.lock();
+        for (auto it = erased.begin(); it != erased.end(); ++it) {
+            accessors.erase(*it);
         }
     }
 }
 
-Accessor::AccessorInvalidator::AccessorInvalidator() : mReady(false) {
+Accessor::AccessorInvalidator::AccessorInvalidator() : mSignaled(false) {
     std::thread invalidator(
             invalidatorThread,
             std::ref(mAccessors),
             std::ref(mMutex),
             std::ref(mCv),
-            std::ref(mReady));
+            std::ref(mSignaled));
     invalidator.detach();
 }
 
 void Accessor::AccessorInvalidator::addAccessor(
         uint32_t accessorId, const std::weak_ptr<Accessor> &accessor) {
-    bool notify = false;
     std::unique_lock<std::mutex> lock(mMutex);
     if (mAccessors.find(accessorId) == mAccessors.end()) {
-        if (!mReady) {
-            mReady = true;
-            notify = true;
-        }
         mAccessors.emplace(accessorId, accessor);
-        ALOGV("buffer invalidation added bp:%u %d", accessorId, notify);
+        ALOGV("buffer invalidation added bp:%u", accessorId);
     }
+    mSignaled = true;
     lock.unlock();
-    if (notify) {
-        mCv.notify_one();
+    mCv.notify_one();
+}
+
+void Accessor::AccessorInvalidator::notify(uint32_t accessorId) {
+    std::unique_lock<std::mutex> lock(mMutex);
+    if (mAccessors.find(accessorId) == mAccessors.end() || mSignaled) {
+        return;
     }
+    mSignaled = true;
+    lock.unlock();
+    mCv.notify_one();
 }
 
 void Accessor::AccessorInvalidator::delAccessor(uint32_t accessorId) {
     std::lock_guard<std::mutex> lock(mMutex);
     mAccessors.erase(accessorId);
     ALOGV("buffer invalidation deleted bp:%u", accessorId);
-    if (mAccessors.size() == 0) {
-        mReady = false;
-    }
 }
 
 std::unique_ptr<Accessor::AccessorInvalidator> Accessor::sInvalidator;
@@ -429,15 +442,16 @@ void Accessor::evictorThread(
         std::mutex &mutex,
         std::condition_variable &cv) {
     std::list<const std::weak_ptr<Accessor>> evictList;
+    std::unique_lock<std::mutex> lock(mutex);
     while (true) {
         int expired = 0;
         int evicted = 0;
+        while (accessors.size() == 0) {
+            cv.wait(lock);
+        }
+        nsecs_t nextEvictTs = INT64_MAX;
         {
             nsecs_t now = systemTime();
-            std::unique_lock<std::mutex> lock(mutex);
-            while (accessors.size() == 0) {
-                cv.wait(lock);
-            }
             auto it = accessors.begin();
             while (it != accessors.end()) {
                 if (now > (it->second + kEvictDurationNs)) {
@@ -445,10 +459,12 @@ void Accessor::evictorThread(
                     evictList.push_back(it->first);
                     it = accessors.erase(it);
                 } else {
+                    nextEvictTs = std::min(nextEvictTs, it->second + kEvictDurationNs);
                     ++it;
                 }
             }
         }
+        lock.unlock();
         // evict idle accessors;
         for (auto it = evictList.begin(); it != evictList.end(); ++it) {
             const std::shared_ptr<Accessor> accessor = it->lock();
@@ -461,7 +477,12 @@ void Accessor::evictorThread(
             ALOGD("evictor expired: %d, evicted: %d", expired, evicted);
         }
         evictList.clear();
-        ::usleep(kEvictGranularityNs / 1000);
+        lock.lock();
+        // Sleeps until the earliest accessor expires. Accessors which are
+        // added later expire later, and refreshed ones are checked again then.
+        if (nextEvictTs != INT64_MAX) {
+            cv.wait_for(lock, std::chrono::nanoseconds(nextEvictTs - systemTime()));
+        }
     }
 }
 
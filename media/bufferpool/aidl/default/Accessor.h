@@ -74,6 +74,9 @@ struct Accessor : public BnAccessor {
     ::ndk::ScopedAStatus connect(const std::shared_ptr<IObserver>& in_observer,
                                  IAccessor::ConnectionInfo* _aidl_return) override;
 
+    /** Dumps the statistics of the buffer pool. */
+    binder_status_t dump(int fd, const char** args, uint32_t numArgs) override;
+
     /**
      * Creates a buffer pool accessor which uses the specified allocator.
      *
@@ -81,6 +84,17 @@ struct Accessor : public BnAccessor {
      */
     explicit Accessor(const std::shared_ptr<BufferPoolAllocator> &allocator);
 
+    /**
+     * Creates a buffer pool accessor which uses the specified allocator and
+     * eviction policy.
+     *
+     * @param allocator         buffer allocator.
+     * @param evictionPolicy    the eviction policy of the buffer pool, or
+     *                          nullptr to use an AdaptiveEvictionPolicy.
+     */
+    Accessor(const std::shared_ptr<BufferPoolAllocator> &allocator,
+             const std::shared_ptr<BufferPoolEvictionPolicy> &evictionPolicy);
+
     /** Destructs a buffer pool accessor. */
     ~Accessor();
 
@@ -195,14 +209,21 @@ private:
     nsecs_t mScheduleEvictTs;
     BufferPool mBufferPool;
 
+    /**
+     * Delivers pending buffer invalidations of accessors. Runs when an
+     * accessor's buffer pool state changes, and otherwise retries while
+     * invalidations are pending.
+     */
     struct  AccessorInvalidator {
         std::map<uint32_t, const std::weak_ptr<Accessor>> mAccessors;
         std::mutex mMutex;
         std::condition_variable mCv;
-        bool mReady;
+        bool mSignaled;
 
         AccessorInvalidator();
         void addAccessor(uint32_t accessorId, const std::weak_ptr<Accessor> &accessor);
+        /// Notifies that invalidations of an accessor may make progress.
+        void notify(uint32_t accessorId);
         void delAccessor(uint32_t accessorId);
     };
 
@@ -212,8 +233,12 @@ private:
         std::map<uint32_t, const std::weak_ptr<Accessor>> &accessors,
         std::mutex &mutex,
         std::condition_variable &cv,
-        bool &ready);
+        bool &signaled);
 
+    /**
+     * Clears the caches of accessors which have been idle for a while. Sleeps
+     * until the earliest accessor may expire.
+     */
     struct AccessorEvictor {
         std::map<const std::weak_ptr<Accessor>, nsecs_t, std::owner_less<>> mAccessors;
         std::mutex mMutex;
@@ -0,0 +1,86 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#define LOG_TAG "AidlBufferPoolEvict"
+//#define LOG_NDEBUG 0
+
+#include <bufferpool2/AdaptiveEvictionPolicy.h>
+#include <utils/Log.h>
+#include <algorithm>
+
+namespace aidl::android::hardware::media::bufferpool2::implementation {
+
+namespace {
+    static constexpr size_t kMaxFreeBufferCount = 64;
+    // Free buffers are kept regardless of idleness below this size, so that
+    // small pools do not churn allocations.
+    static constexpr size_t kMinFreeSize = 1024*1024*4;
+
+    static constexpr int64_t kMinIdleMs = 500; // 0.5 sec
+    static constexpr int64_t kMaxIdleMs = 5000; // 5 secs
+    static constexpr int64_t kInitialIdleMs = 1000; // 1 sec
+
+    // # of allocations between getCacheLimits() calls to adapt to.
+    static constexpr size_t kMinAllocationsToAdapt = 8;
+}
+
+AdaptiveEvictionPolicy::AdaptiveEvictionPolicy(size_t maxFreeSize)
+    : mMaxFreeSize(maxFreeSize),
+      mFreeSizeLimit(maxFreeSize),
+      mMaxIdleMs(kInitialIdleMs),
+      mLastAllocations(0),
+      mLastRecycles(0),
+      mLastAllocationFailures(0) {}
+
+BufferPoolCacheLimits AdaptiveEvictionPolicy::getCacheLimits(
+        const BufferPoolCacheStatus &status) {
+    size_t allocations = status.mTotalAllocations - mLastAllocations;
+    size_t recycles = status.mTotalRecycles - mLastRecycles;
+    bool allocationFailed = status.mTotalAllocationFailures != mLastAllocationFailures;
+    mLastAllocations = status.mTotalAllocations;
+    mLastRecycles = status.mTotalRecycles;
+    mLastAllocationFailures = status.mTotalAllocationFailures;
+    if (allocationFailed) {
+        mFreeSizeLimit /= 2;
+        ALOGD("allocation failed, free size limit %zu", mFreeSizeLimit);
+    } else if (allocations > 0 && mFreeSizeLimit < mMaxFreeSize) {
+        mFreeSizeLimit = std::min(std::max(mFreeSizeLimit * 2, kMinFreeSize), mMaxFreeSize);
+    }
+    if (allocations >= kMinAllocationsToAdapt) {
+        if (recycles * 4 < allocations * 3) {
+            // Less than 75% hits: buffers are dropped before they are reused.
+            mMaxIdleMs = std::min(mMaxIdleMs * 2, kMaxIdleMs);
+        } else if (recycles * 20 >= allocations * 19) {
+            // 95% or more hits: what is reused is reused soon.
+            mMaxIdleMs = std::max(mMaxIdleMs / 2, kMinIdleMs);
+        }
+        ALOGV("recycled %zu/%zu, idle %lld ms",
+              recycles, allocations, (long long)mMaxIdleMs);
+    }
+
+    BufferPoolCacheLimits limits;
+    limits.mMaxFreeSize = mFreeSizeLimit;
+    limits.mMaxFreeBuffers = kMaxFreeBufferCount;
+    if (allocationFailed) {
+        limits.mMaxIdleMs = 0;
+        limits.mMinFreeSize = 0;
+    } else {
+        limits.mMaxIdleMs = mMaxIdleMs;
+        limits.mMinFreeSize = std::min(kMinFreeSize, mFreeSizeLimit);
+    }
+    return limits;
+}
+
+}  // namespace aidl::android::hardware::media::bufferpool2::implementation
@@ -19,10 +19,12 @@
 
 #include <sys/types.h>
 #include <stdint.h>
+#include <stdio.h>
 #include <time.h>
 #include <unistd.h>
 #include <utils/Log.h>
 #include <thread>
+#include <bufferpool2/AdaptiveEvictionPolicy.h>
 #include "Accessor.h"
 #include "BufferPool.h"
 #include "Connection.h"
@@ -33,20 +35,18 @@ namespace aidl::android::hardware::media::bufferpool2::implementation {
 namespace {
     static constexpr int64_t kCleanUpDurationMs = 500; // 0.5 sec
     static constexpr int64_t kLogDurationMs = 5000; // 5 secs
-
-    static constexpr size_t kMinAllocBytesForEviction = 1024*1024*15;
-    static constexpr size_t kMinBufferCountForEviction = 25;
-    static constexpr size_t kMaxUnusedBufferCount = 64;
-    static constexpr size_t kUnusedBufferCountTarget = kMaxUnusedBufferCount - 16;
 }
 
-BufferPool::BufferPool()
+BufferPool::BufferPool(const std::shared_ptr<BufferPoolEvictionPolicy> &evictionPolicy)
     : mTimestampMs(::android::elapsedRealtime()),
       mLastCleanUpMs(mTimestampMs),
       mLastLogMs(mTimestampMs),
       mSeq(0),
-      mStartSeq(0) {
+      mStartSeq(0),
+      mEvictionPolicy(evictionPolicy ? evictionPolicy
+                                     : std::make_shared<AdaptiveEvictionPolicy>()) {
     mValid = mInvalidationChannel.isValid();
+    mCacheLimits = mEvictionPolicy->getCacheLimits(getCacheStatus());
 }
 
 
@@ -92,6 +92,7 @@ void BufferPool::Invalidation::onAck(
     }
     if (isMessageLater(msgId, it->second)) {
         mAcks[conId] = msgId;
+        Accessor::sInvalidator->notify(mId);
     }
 }
 
@@ -110,6 +111,7 @@ void BufferPool::Invalidation::onBufferInvalidated(
             }
             channel.postInvalidation(msgId, it->mFrom, it->mTo);
             it = mPendings.erase(it);
+            Accessor::sInvalidator->notify(mId);
             continue;
         }
         ++it;
@@ -178,36 +180,27 @@ void BufferPool::Invalidation::onHandleAck(
 
 bool BufferPool::handleOwnBuffer(
         ConnectionId connectionId, BufferId bufferId) {
-
-    bool added = insert(&mUsingBuffers, connectionId, bufferId);
-    if (added) {
-        auto iter = mBuffers.find(bufferId);
-        iter->second->mOwnerCount++;
+    InternalBuffer *buffer = mBuffers.find(bufferId);
+    if (!buffer || !buffer->mOwners.insert(connectionId)) {
+        return false;
     }
-    insert(&mUsingConnections, bufferId, connectionId);
-    return added;
+    mConnectionEntries[connectionId].mBuffers.emplace(bufferId, buffer);
+    return true;
 }
 
 bool BufferPool::handleReleaseBuffer(
         ConnectionId connectionId, BufferId bufferId) {
-    bool deleted = erase(&mUsingBuffers, connectionId, bufferId);
+    InternalBuffer *buffer = mBuffers.find(bufferId);
+    bool deleted = buffer && buffer->mOwners.erase(connectionId);
     if (deleted) {
-        auto iter = mBuffers.find(bufferId);
-        iter->second->mOwnerCount--;
-        if (iter->second->mOwnerCount == 0 &&
-                iter->second->mTransactionCount == 0) {
-            if (!iter->second->mInvalidated) {
-                mStats.onBufferUnused(iter->second->mAllocSize);
-                mFreeBuffers.insert(bufferId);
-            } else {
-                mStats.onBufferUnused(iter->second->mAllocSize);
-                mStats.onBufferEvicted(iter->second->mAllocSize);
-                mBuffers.erase(iter);
-                mInvalidation.onBufferInvalidated(bufferId, mInvalidationChannel);
-            }
+        auto entries = mConnectionEntries.find(connectionId);
+        if (entries != mConnectionEntries.end()) {
+            entries->second.mBuffers.erase(bufferId);
+        }
+        if (buffer->mOwners.empty() && buffer->mTransactionCount == 0) {
+            freeBuffer(buffer);
         }
     }
-    erase(&mUsingConnections, bufferId, connectionId);
     ALOGV("release buffer %u : %d", bufferId, deleted);
     return deleted;
 }
@@ -221,16 +214,15 @@ bool BufferPool::handleTransferTo(const BufferStatusMessage &message) {
         return true;
     }
     // the buffer should exist and be owned.
-    auto bufferIter = mBuffers.find(message.bufferId);
-    if (bufferIter == mBuffers.end() ||
-            !contains(&mUsingBuffers, message.connectionId, FromAidl(message.bufferId))) {
+    InternalBuffer *buffer = mBuffers.find(message.bufferId);
+    if (!buffer || !buffer->mOwners.contains(message.connectionId)) {
         return false;
     }
-    auto found = mTransactions.find(message.transactionId);
-    if (found != mTransactions.end()) {
+    TransactionStatus *found = mTransactions.find(message.transactionId);
+    if (found) {
         // transfer_from was received earlier.
-        found->second->mSender = message.connectionId;
-        found->second->mSenderValidated = true;
+        found->mSender = message.connectionId;
+        found->mSenderValidated = true;
         return true;
     }
     if (mConnectionIds.find(message.targetConnectionId) == mConnectionIds.end()) {
@@ -239,63 +231,36 @@ bool BufferPool::handleTransferTo(const BufferStatusMessage &message) {
               this, (long long)message.targetConnectionId);
         return false;
     }
-    mStats.onBufferSent();
-    mTransactions.insert(std::make_pair(
-            message.transactionId,
-            std::make_unique<TransactionStatus>(message, mTimestampMs)));
-    insert(&mPendingTransactions, message.targetConnectionId,
-           FromAidl(message.transactionId));
-    bufferIter->second->mTransactionCount++;
+    addTransaction(message, buffer);
     return true;
 }
 
 bool BufferPool::handleTransferFrom(const BufferStatusMessage &message) {
-    auto found = mTransactions.find(message.transactionId);
-    if (found == mTransactions.end()) {
+    TransactionStatus *found = mTransactions.find(message.transactionId);
+    if (!found) {
         // TODO: is it feasible to check ownership here?
-        mStats.onBufferSent();
-        mTransactions.insert(std::make_pair(
-                message.transactionId,
-                std::make_unique<TransactionStatus>(message, mTimestampMs)));
-        insert(&mPendingTransactions, message.connectionId,
-               FromAidl(message.transactionId));
-        auto bufferIter = mBuffers.find(message.bufferId);
-        bufferIter->second->mTransactionCount++;
+        addTransaction(message, mBuffers.find(message.bufferId));
     } else {
-        if (message.connectionId == found->second->mReceiver) {
-            found->second->mStatus = BufferStatus::TRANSFER_FROM;
+        if (message.connectionId == found->mReceiver) {
+            found->mStatus = BufferStatus::TRANSFER_FROM;
         }
     }
     return true;
 }
 
 bool BufferPool::handleTransferResult(const BufferStatusMessage &message) {
-    auto found = mTransactions.find(message.transactionId);
-    if (found != mTransactions.end()) {
-        bool deleted = erase(&mPendingTransactions, message.connectionId,
-                             FromAidl(message.transactionId));
+    TransactionStatus *found = mTransactions.find(message.transactionId);
+    if (found) {
+        // Only the receiver of a pending transaction finishes it.
+        bool deleted = found->mReceiver == message.connectionId;
         if (deleted) {
-            if (!found->second->mSenderValidated) {
+            if (!found->mSenderValidated) {
                 mCompletedTransactions.insert(message.transactionId);
             }
-            auto bufferIter = mBuffers.find(message.bufferId);
             if (message.status == BufferStatus::TRANSFER_OK) {
                 handleOwnBuffer(message.connectionId, message.bufferId);
             }
-            bufferIter->second->mTransactionCount--;
-            if (bufferIter->second->mOwnerCount == 0
-                && bufferIter->second->mTransactionCount == 0) {
-                if (!bufferIter->second->mInvalidated) {
-                    mStats.onBufferUnused(bufferIter->second->mAllocSize);
-                    mFreeBuffers.insert(message.bufferId);
-                } else {
-                    mStats.onBufferUnused(bufferIter->second->mAllocSize);
-                    mStats.onBufferEvicted(bufferIter->second->mAllocSize);
-                    mBuffers.erase(bufferIter);
-                    mInvalidation.onBufferInvalidated(message.bufferId, mInvalidationChannel);
-                }
-            }
-            mTransactions.erase(found);
+            removeTransaction(found);
         }
         ALOGV("transfer finished %llu %u - %d", (unsigned long long)message.transactionId,
               message.bufferId, deleted);
@@ -306,6 +271,44 @@ bool BufferPool::handleTransferResult(const BufferStatusMessage &message) {
     return false;
 }
 
+void BufferPool::addTransaction(const BufferStatusMessage &message, InternalBuffer *buffer) {
+    mStats.onBufferSent();
+    TransactionStatus *transaction =
+            mTransactions.emplace(message.transactionId, message, mTimestampMs);
+    mConnectionEntries[transaction->mReceiver].mTransactions.emplace(
+            transaction->mId, transaction);
+    buffer->mTransactionCount++;
+}
+
+void BufferPool::removeTransaction(TransactionStatus *transaction) {
+    const TransactionId transactionId = transaction->mId;
+    InternalBuffer *buffer = mBuffers.find(transaction->mBufferId);
+    auto entries = mConnectionEntries.find(transaction->mReceiver);
+    if (entries != mConnectionEntries.end()) {
+        entries->second.mTransactions.erase(transactionId);
+    }
+    mTransactions.erase(transactionId);
+
+    buffer->mTransactionCount--;
+    if (buffer->mOwners.empty() && buffer->mTransactionCount == 0) {
+        freeBuffer(buffer);
+    }
+}
+
+void BufferPool::freeBuffer(InternalBuffer *buffer) {
+    // TODO: handle freebuffer insert fail
+    mStats.onBufferUnused(buffer->mAllocSize);
+    if (!buffer->mInvalidated) {
+        mFreeBuffers.add(buffer, mTimestampMs);
+    } else {
+        BufferId bufferId = buffer->mId;
+        mStats.onBufferEvicted(buffer->mAllocSize);
+        mFreeBuffers.remove(buffer);
+        mBuffers.erase(bufferId);
+        mInvalidation.onBufferInvalidated(bufferId, mInvalidationChannel);
+    }
+}
+
 void BufferPool::processStatusMessages() {
     std::vector<BufferStatusMessage> messages;
     mObserver.getBufferStatusChanges(messages);
@@ -353,83 +356,88 @@ void BufferPool::processStatusMessages() {
 }
 
 bool BufferPool::handleClose(ConnectionId connectionId) {
-    // Cleaning buffers
-    auto buffers = mUsingBuffers.find(connectionId);
-    if (buffers != mUsingBuffers.end()) {
-        for (const BufferId& bufferId : buffers->second) {
-            bool deleted = erase(&mUsingConnections, bufferId, connectionId);
-            if (deleted) {
-                auto bufferIter = mBuffers.find(bufferId);
-                bufferIter->second->mOwnerCount--;
-                if (bufferIter->second->mOwnerCount == 0 &&
-                        bufferIter->second->mTransactionCount == 0) {
-                    // TODO: handle freebuffer insert fail
-                    if (!bufferIter->second->mInvalidated) {
-                        mStats.onBufferUnused(bufferIter->second->mAllocSize);
-                        mFreeBuffers.insert(bufferId);
-                    } else {
-                        mStats.onBufferUnused(bufferIter->second->mAllocSize);
-                        mStats.onBufferEvicted(bufferIter->second->mAllocSize);
-                        mBuffers.erase(bufferIter);
-                        mInvalidation.onBufferInvalidated(bufferId, mInvalidationChannel);
-                    }
-                }
+    auto entries = mConnectionEntries.find(connectionId);
+    if (entries != mConnectionEntries.end()) {
+        // Cleaning buffers
+        entries->second.mBuffers.forEach([&](BufferId, InternalBuffer *buffer) {
+            buffer->mOwners.erase(connectionId);
+            if (buffer->mOwners.empty() && buffer->mTransactionCount == 0) {
+                freeBuffer(buffer);
             }
-        }
-        mUsingBuffers.erase(buffers);
-    }
+        });
 
-    // Cleaning transactions
-    auto pending = mPendingTransactions.find(connectionId);
-    if (pending != mPendingTransactions.end()) {
-        for (const TransactionId& transactionId : pending->second) {
-            auto iter = mTransactions.find(transactionId);
-            if (iter != mTransactions.end()) {
-                if (!iter->second->mSenderValidated) {
-                    mCompletedTransactions.insert(transactionId);
-                }
-                BufferId bufferId = iter->second->mBufferId;
-                auto bufferIter = mBuffers.find(bufferId);
-                bufferIter->second->mTransactionCount--;
-                if (bufferIter->second->mOwnerCount == 0 &&
-                    bufferIter->second->mTransactionCount == 0) {
-                    // TODO: handle freebuffer insert fail
-                    if (!bufferIter->second->mInvalidated) {
-                        mStats.onBufferUnused(bufferIter->second->mAllocSize);
-                        mFreeBuffers.insert(bufferId);
-                    } else {
-                        mStats.onBufferUnused(bufferIter->second->mAllocSize);
-                        mStats.onBufferEvicted(bufferIter->second->mAllocSize);
-                        mBuffers.erase(bufferIter);
-                        mInvalidation.onBufferInvalidated(bufferId, mInvalidationChannel);
-                    }
-                }
-                mTransactions.erase(iter);
+        // Cleaning transactions
+        entries->second.mTransactions.forEach(
+                [&](TransactionId transactionId, TransactionStatus *transaction) {
+            if (!transaction->mSenderValidated) {
+                mCompletedTransactions.insert(transactionId);
             }
-        }
+            removeTransaction(transaction);
+        });
+        mConnectionEntries.erase(entries);
     }
     mConnectionIds.erase(connectionId);
     return true;
 }
 
+void BufferPool::FreeBuffers::add(InternalBuffer *buffer, int64_t timestampMs) {
+    if (buffer->mFree) {
+        ALOGW("bufferpool2 inconsistent!");
+        return;
+    }
+    buffer->mFree = true;
+    buffer->mFreedMs = timestampMs;
+    mLru.pushBack(buffer);
+    mBuckets[buffer->mConfigKey].pushBack(buffer);
+}
+
+void BufferPool::FreeBuffers::remove(InternalBuffer *buffer) {
+    if (buffer->mFree) {
+        buffer->mFree = false;
+        mLru.remove(buffer);
+        mBuckets[buffer->mConfigKey].remove(buffer);
+    }
+}
+
+InternalBuffer *BufferPool::FreeBuffers::findCompatible(
+        const std::shared_ptr<BufferPoolAllocator> &allocator,
+        const std::vector<uint8_t> &params) {
+    auto bucket = mBuckets.find(allocator->configKey(params));
+    if (bucket == mBuckets.end()) {
+        return nullptr;
+    }
+    // Buffers of the same key are usually compatible, so this is O(1) unless
+    // the allocator classifies coarsely.
+    for (InternalBuffer *buffer = bucket->second.mTail; buffer;
+            buffer = buffer->mBucketLink.mPrev) {
+        if (allocator->compatible(params, buffer->mConfig)) {
+            return buffer;
+        }
+    }
+    return nullptr;
+}
+
+void BufferPool::FreeBuffers::compact() {
+    for (auto it = mBuckets.begin(); it != mBuckets.end();) {
+        if (it->second.empty()) {
+            it = mBuckets.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
 bool BufferPool::getFreeBuffer(
         const std::shared_ptr<BufferPoolAllocator> &allocator,
         const std::vector<uint8_t> &params, BufferId *pId,
         const native_handle_t** handle) {
-    auto bufferIt = mFreeBuffers.begin();
-    for (;bufferIt != mFreeBuffers.end(); ++bufferIt) {
-        BufferId bufferId = *bufferIt;
-        if (allocator->compatible(params, mBuffers[bufferId]->mConfig)) {
-            break;
-        }
-    }
-    if (bufferIt != mFreeBuffers.end()) {
-        BufferId id = *bufferIt;
-        mFreeBuffers.erase(bufferIt);
-        mStats.onBufferRecycled(mBuffers[id]->mAllocSize);
-        *handle = mBuffers[id]->handle();
-        *pId = id;
-        ALOGV("recycle a buffer %u %p", id, *handle);
+    InternalBuffer *buffer = mFreeBuffers.findCompatible(allocator, params);
+    if (buffer) {
+        mFreeBuffers.remove(buffer);
+        mStats.onBufferRecycled(buffer->mAllocSize);
+        *handle = buffer->handle();
+        *pId = buffer->mId;
+        ALOGV("recycle a buffer %u %p", buffer->mId, *handle);
         return true;
     }
     return false;
@@ -439,6 +447,7 @@ BufferPoolStatus BufferPool::addNewBuffer(
         const std::shared_ptr<BufferPoolAllocation> &alloc,
         const size_t allocSize,
         const std::vector<uint8_t> &params,
+        uint64_t configKey,
         BufferId *pId,
         const native_handle_t** handle) {
 
@@ -446,28 +455,44 @@ BufferPoolStatus BufferPool::addNewBuffer(
     if (mSeq == Connection::SYNC_BUFFERID) {
         mSeq = 0;
     }
-    std::unique_ptr<InternalBuffer> buffer =
-            std::make_unique<InternalBuffer>(
-                    bufferId, alloc, allocSize, params);
-    if (buffer) {
-        auto res = mBuffers.insert(std::make_pair(
-                bufferId, std::move(buffer)));
-        if (res.second) {
-            mStats.onBufferAllocated(allocSize);
-            *handle = alloc->handle();
-            *pId = bufferId;
-            return ResultStatus::OK;
-        }
+    if (mBuffers.emplace(bufferId, bufferId, alloc, allocSize, params, configKey)) {
+        mStats.onBufferAllocated(allocSize);
+        *handle = alloc->handle();
+        *pId = bufferId;
+        return ResultStatus::OK;
     }
     return ResultStatus::NO_MEMORY;
 }
 
+BufferPoolCacheStatus BufferPool::getCacheStatus() const {
+    BufferPoolCacheStatus status;
+    status.mSizeCached = mStats.mSizeCached;
+    status.mBuffersCached = mStats.mBuffersCached;
+    status.mSizeInUse = mStats.mSizeInUse;
+    status.mBuffersInUse = mStats.mBuffersInUse;
+    status.mTotalAllocations = mStats.mTotalAllocations;
+    status.mTotalRecycles = mStats.mTotalRecycles;
+    status.mTotalAllocationFailures = mStats.mTotalAllocationFailures;
+    status.mTimestampMs = mTimestampMs;
+    return status;
+}
+
+bool BufferPool::exceedsCacheLimits() const {
+    return mStats.buffersNotInUse() > mCacheLimits.mMaxFreeBuffers ||
+            mStats.sizeNotInUse() > mCacheLimits.mMaxFreeSize;
+}
+
+bool BufferPool::shouldEvict(const InternalBuffer *buffer) const {
+    return exceedsCacheLimits() ||
+            (mTimestampMs > buffer->mFreedMs + mCacheLimits.mMaxIdleMs &&
+             mStats.sizeNotInUse() > mCacheLimits.mMinFreeSize);
+}
+
 void BufferPool::cleanUp(bool clearCache) {
-    if (clearCache || mTimestampMs > mLastCleanUpMs + kCleanUpDurationMs ||
-            mStats.buffersNotInUse() > kMaxUnusedBufferCount) {
+    bool periodic = mTimestampMs > mLastCleanUpMs + kCleanUpDurationMs;
+    if (clearCache || periodic || exceedsCacheLimits()) {
         mLastCleanUpMs = mTimestampMs;
-        if (mTimestampMs > mLastLogMs + kLogDurationMs ||
-                mStats.buffersNotInUse() > kMaxUnusedBufferCount) {
+        if (mTimestampMs > mLastLogMs + kLogDurationMs || exceedsCacheLimits()) {
             mLastLogMs = mTimestampMs;
             ALOGD("bufferpool2 %p : %zu(%zu size) total buffers - "
                   "%zu(%zu size) used buffers - %zu/%zu (recycle/alloc) - "
@@ -477,52 +502,83 @@ void BufferPool::cleanUp(bool clearCache) {
                   mStats.mTotalRecycles, mStats.mTotalAllocations,
                   mStats.mTotalFetches, mStats.mTotalTransfers);
         }
-        for (auto freeIt = mFreeBuffers.begin(); freeIt != mFreeBuffers.end();) {
-            if (!clearCache && mStats.buffersNotInUse() <= kUnusedBufferCountTarget &&
-                    (mStats.mSizeCached < kMinAllocBytesForEviction ||
-                     mBuffers.size() < kMinBufferCountForEviction)) {
+        if (periodic) {
+            mCacheLimits = mEvictionPolicy->getCacheLimits(getCacheStatus());
+        }
+        // Buffers are visited from the least recently freed, so once a buffer
+        // is not idle, none of the following ones is. Inconsistent buffers,
+        // which are still used, are left in the free buffers.
+        for (InternalBuffer *buffer = mFreeBuffers.leastRecentlyFreed(); buffer;) {
+            if (!clearCache && !shouldEvict(buffer)) {
                 break;
             }
-            auto it = mBuffers.find(*freeIt);
-            if (it != mBuffers.end() &&
-                    it->second->mOwnerCount == 0 && it->second->mTransactionCount == 0) {
-                mStats.onBufferEvicted(it->second->mAllocSize);
-                mBuffers.erase(it);
-                freeIt = mFreeBuffers.erase(freeIt);
+            InternalBuffer *next = buffer->mLruLink.mNext;
+            if (buffer->mOwners.empty() && buffer->mTransactionCount == 0) {
+                mFreeBuffers.remove(buffer);
+                mStats.onBufferEvicted(buffer->mAllocSize);
+                mBuffers.erase(buffer->mId);
             } else {
-                ++freeIt;
                 ALOGW("bufferpool2 inconsistent!");
             }
+            buffer = next;
         }
+        mFreeBuffers.compact();
     }
 }
 
+bool BufferPool::handleAllocationFailure() {
+    mStats.onAllocationFailed();
+    size_t freeBuffers = mStats.buffersNotInUse();
+    cleanUp(true);
+    mCacheLimits = mEvictionPolicy->getCacheLimits(getCacheStatus());
+    ALOGD("bufferpool2 %p : allocation failed, %zu free buffers evicted",
+          this, freeBuffers - mStats.buffersNotInUse());
+    return mStats.buffersNotInUse() < freeBuffers;
+}
+
+void BufferPool::dump(int fd) const {
+    dprintf(fd, "bufferpool2 %p\n", this);
+    dprintf(fd, "  cached: %zu buffers (%zu size), in use: %zu buffers (%zu size)\n",
+            mStats.mBuffersCached, mStats.mSizeCached,
+            mStats.mBuffersInUse, mStats.mSizeInUse);
+    dprintf(fd, "  allocs: %zu, %d%% recycled, %zu failed; evictions: %zu\n",
+            mStats.mTotalAllocations,
+            percentage(mStats.mTotalRecycles, mStats.mTotalAllocations),
+            mStats.mTotalAllocationFailures, mStats.mTotalEvictions);
+    dprintf(fd, "  transfers: %zu, %d%% unfetched\n",
+            mStats.mTotalTransfers,
+            percentage(mStats.mTotalTransfers - mStats.mTotalFetches, mStats.mTotalTransfers));
+    dprintf(fd, "  free buffer limits: %zu buffers, %zu size; "
+            "idle %lld ms above %zu size\n",
+            mCacheLimits.mMaxFreeBuffers, mCacheLimits.mMaxFreeSize,
+            (long long)mCacheLimits.mMaxIdleMs, mCacheLimits.mMinFreeSize);
+}
+
 void BufferPool::invalidate(
         bool needsAck, BufferId from, BufferId to,
         const std::shared_ptr<Accessor> &impl) {
-    for (auto freeIt = mFreeBuffers.begin(); freeIt != mFreeBuffers.end();) {
-        if (isBufferInRange(from, to, *freeIt)) {
-            auto it = mBuffers.find(*freeIt);
-            if (it != mBuffers.end() &&
-                it->second->mOwnerCount == 0 && it->second->mTransactionCount == 0) {
-                mStats.onBufferEvicted(it->second->mAllocSize);
-                mBuffers.erase(it);
-                freeIt = mFreeBuffers.erase(freeIt);
-                continue;
+    for (InternalBuffer *buffer = mFreeBuffers.leastRecentlyFreed(); buffer;) {
+        InternalBuffer *next = buffer->mLruLink.mNext;
+        if (isBufferInRange(from, to, buffer->mId)) {
+            if (buffer->mOwners.empty() && buffer->mTransactionCount == 0) {
+                mFreeBuffers.remove(buffer);
+                mStats.onBufferEvicted(buffer->mAllocSize);
+                mBuffers.erase(buffer->mId);
             } else {
                 ALOGW("bufferpool2 inconsistent!");
             }
         }
-        ++freeIt;
+        buffer = next;
     }
+    mFreeBuffers.compact();
 
     size_t left = 0;
-    for (auto it = mBuffers.begin(); it != mBuffers.end(); ++it) {
-        if (isBufferInRange(from, to, it->first)) {
-            it->second->invalidate();
+    mBuffers.forEach([&](BufferId bufferId, InternalBuffer &buffer) {
+        if (isBufferInRange(from, to, bufferId)) {
+            buffer.invalidate();
             ++left;
         }
-    }
+    });
     mInvalidation.onInvalidationRequest(needsAck, from, to, left, mInvalidationChannel, impl);
 }
 
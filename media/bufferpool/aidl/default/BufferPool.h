@@ -18,12 +18,14 @@
 
 #include <map>
 #include <set>
+#include <unordered_map>
 #include <vector>
 #include <mutex>
 #include <condition_variable>
 #include <utils/Timers.h>
 
 #include "BufferStatus.h"
+#include "DataHelper.h"
 
 namespace aidl::android::hardware::media::bufferpool2::implementation {
 
@@ -31,8 +33,6 @@ using BufferStatus = aidl::android::hardware::media::bufferpool2::BufferStatus;
 using BufferStatusMessage = aidl::android::hardware::media::bufferpool2::BufferStatusMessage;
 
 struct Accessor;
-struct InternalBuffer;
-struct TransactionStatus;
 
 /**
  * Buffer pool implementation.
@@ -52,20 +52,70 @@ private:
     BufferStatusObserver mObserver;
     BufferInvalidationChannel mInvalidationChannel;
 
-    std::map<ConnectionId, std::set<BufferId>> mUsingBuffers;
-    std::map<BufferId, std::set<ConnectionId>> mUsingConnections;
-
-    std::map<ConnectionId, std::set<TransactionId>> mPendingTransactions;
     // Transactions completed before TRANSFER_TO message arrival.
     // Fetch does not occur for the transactions.
     // Only transaction id is kept for the transactions in short duration.
     std::set<TransactionId> mCompletedTransactions;
-    // Currently active(pending) transations' status & information.
-    std::map<TransactionId, std::unique_ptr<TransactionStatus>>
-            mTransactions;
+    // Currently active(pending) transations' status & information. A
+    // transaction is pending on its receiver connection.
+    SlabMap<TransactionId, TransactionStatus> mTransactions;
+
+    // Buffers of the pool. Their owner connections are kept in the buffers.
+    SlabMap<BufferId, InternalBuffer> mBuffers;
+
+    // The buffers owned by, and the transactions pending on, a connection,
+    // so that closing it only visits those.
+    struct ConnectionEntries {
+        SlabMap<BufferId, InternalBuffer *> mBuffers;
+        SlabMap<TransactionId, TransactionStatus *> mTransactions;
+    };
+    std::unordered_map<ConnectionId, ConnectionEntries> mConnectionEntries;
+
+    /// Adds a pending transaction, and indexes it by its receiver.
+    void addTransaction(const BufferStatusMessage &message, InternalBuffer *buffer);
+
+    /// Removes a pending transaction, and frees its buffer if it is not used anymore.
+    void removeTransaction(TransactionStatus *transaction);
+
+    /// Makes a buffer which is not used anymore free, or destroys it if it
+    /// was invalidated.
+    void freeBuffer(InternalBuffer *buffer);
+
+    /**
+     * Buffers which are available to be recycled, bucketed by the config key
+     * of the allocator. Within a bucket a buffer is recycled in O(1), most
+     * recently freed first, while eviction takes the least recently freed
+     * buffer over all buckets.
+     */
+    struct FreeBuffers {
+        // All free buffers, least recently freed first.
+        BufferList<&InternalBuffer::mLruLink> mLru;
+        // Free buffers of each config key, least recently freed first.
+        std::unordered_map<uint64_t, BufferList<&InternalBuffer::mBucketLink>> mBuckets;
+
+        size_t size() const {
+            return mLru.mSize;
+        }
+
+        /// Adds a buffer which became free at timestampMs.
+        void add(InternalBuffer *buffer, int64_t timestampMs);
+
+        /// Removes a buffer, which is about to be recycled or evicted.
+        void remove(InternalBuffer *buffer);
 
-    std::map<BufferId, std::unique_ptr<InternalBuffer>> mBuffers;
-    std::set<BufferId> mFreeBuffers;
+        /// Returns the most recently freed buffer compatible with params.
+        InternalBuffer *findCompatible(
+                const std::shared_ptr<BufferPoolAllocator> &allocator,
+                const std::vector<uint8_t> &params);
+
+        /// Returns the least recently freed buffer.
+        InternalBuffer *leastRecentlyFreed() const {
+            return mLru.mHead;
+        }
+
+        /// Drops buckets which are empty.
+        void compact();
+    } mFreeBuffers;
     std::set<ConnectionId> mConnectionIds;
 
     struct Invalidation {
@@ -139,10 +189,15 @@ private:
         size_t mTotalTransfers;
         /// # of transfers that had to be fetched.
         size_t mTotalFetches;
+        /// # of buffers evicted from the cache.
+        size_t mTotalEvictions;
+        /// # of allocations the allocator failed for lack of memory.
+        size_t mTotalAllocationFailures;
 
         Stats()
             : mSizeCached(0), mBuffersCached(0), mSizeInUse(0), mBuffersInUse(0),
-              mTotalAllocations(0), mTotalRecycles(0), mTotalTransfers(0), mTotalFetches(0) {}
+              mTotalAllocations(0), mTotalRecycles(0), mTotalTransfers(0), mTotalFetches(0),
+              mTotalEvictions(0), mTotalAllocationFailures(0) {}
 
         /// # of currently unused buffers
         size_t buffersNotInUse() const {
@@ -150,6 +205,12 @@ private:
             return mBuffersCached - mBuffersInUse;
         }
 
+        /// Total size of currently unused buffers
+        size_t sizeNotInUse() const {
+            ALOG_ASSERT(mSizeCached >= mSizeInUse);
+            return mSizeCached - mSizeInUse;
+        }
+
         /// A new buffer is allocated on an allocation request.
         void onBufferAllocated(size_t allocSize) {
             mSizeCached += allocSize;
@@ -165,6 +226,8 @@ private:
         void onBufferEvicted(size_t allocSize) {
             mSizeCached -= allocSize;
             mBuffersCached--;
+
+            mTotalEvictions++;
         }
 
         /// A buffer is recycled on an allocation request.
@@ -191,20 +254,42 @@ private:
         void onBufferFetched() {
             mTotalFetches++;
         }
+
+        /// The allocator failed an allocation for lack of memory.
+        void onAllocationFailed() {
+            mTotalAllocationFailures++;
+        }
     } mStats;
 
     bool isValid() {
         return mValid;
     }
 
+    /// Sizes the cached free buffers.
+    const std::shared_ptr<BufferPoolEvictionPolicy> mEvictionPolicy;
+    BufferPoolCacheLimits mCacheLimits;
+
+    BufferPoolCacheStatus getCacheStatus() const;
+
+    /// Whether the free buffers exceed the count or size limit.
+    bool exceedsCacheLimits() const;
+
+    /// Whether the least recently freed buffer should be evicted.
+    bool shouldEvict(const InternalBuffer *buffer) const;
+
     void invalidate(bool needsAck, BufferId from, BufferId to,
                     const std::shared_ptr<Accessor> &impl);
 
     static void createInvalidator();
 
 public:
-    /** Creates a buffer pool. */
-    BufferPool();
+    /**
+     * Creates a buffer pool.
+     *
+     * @param evictionPolicy    the eviction policy of the buffer pool, or
+     *                          nullptr to use an AdaptiveEvictionPolicy.
+     */
+    explicit BufferPool(const std::shared_ptr<BufferPoolEvictionPolicy> &evictionPolicy);
 
     /** Destroys a buffer pool. */
     ~BufferPool();
@@ -301,6 +386,7 @@ public:
      * @param alloc     the newly allocated buffer.
      * @param allocSize the size of the newly allocated buffer.
      * @param params    the allocation parameters.
+     * @param configKey the config key of the allocation parameters.
      * @param pId       the buffer id for the newly allocated buffer.
      * @param handle    the native handle for the newly allocated buffer.
      *
@@ -312,6 +398,7 @@ public:
             const std::shared_ptr<BufferPoolAllocation> &alloc,
             const size_t allocSize,
             const std::vector<uint8_t> &params,
+            uint64_t configKey,
             BufferId *pId,
             const native_handle_t **handle);
 
@@ -324,12 +411,25 @@ public:
      */
     void cleanUp(bool clearCache = false);
 
+    /**
+     * Handles an allocation which the allocator failed for lack of memory:
+     * frees all buffers waiting to be recycled, and applies the limits the
+     * eviction policy returns for the failure.
+     *
+     * @return whether buffers were freed, so that the allocation may succeed
+     *         when retried.
+     */
+    bool handleAllocationFailure();
+
     /**
      * Processes pending buffer status messages and invalidate all current
      * free buffers. Active buffers are invalidated after being inactive.
      */
     void flush(const std::shared_ptr<Accessor> &impl);
 
+    /** Dumps the statistics and the cache limits of the buffer pool. */
+    void dump(int fd) const;
+
     friend struct Accessor;
 };
 
@@ -56,6 +56,7 @@ public:
                                 bool *isNew);
 
     BufferPoolStatus create(const std::shared_ptr<BufferPoolAllocator> &allocator,
+                        const std::shared_ptr<BufferPoolEvictionPolicy> &evictionPolicy,
                         ConnectionId *pConnectionId);
 
     BufferPoolStatus close(ConnectionId connectionId);
@@ -217,8 +218,10 @@ BufferPoolStatus ClientManager::Impl::registerSender(
 
 BufferPoolStatus ClientManager::Impl::create(
         const std::shared_ptr<BufferPoolAllocator> &allocator,
+        const std::shared_ptr<BufferPoolEvictionPolicy> &evictionPolicy,
         ConnectionId *pConnectionId) {
-    std::shared_ptr<Accessor> accessor = ::ndk::SharedRefBase::make<Accessor>(allocator);
+    std::shared_ptr<Accessor> accessor =
+            ::ndk::SharedRefBase::make<Accessor>(allocator, evictionPolicy);
     if (!accessor || !accessor->isValid()) {
         return ResultStatus::CRITICAL_ERROR;
     }
@@ -446,8 +449,15 @@ ClientManager::~ClientManager() {
 BufferPoolStatus ClientManager::create(
         const std::shared_ptr<BufferPoolAllocator> &allocator,
         ConnectionId *pConnectionId) {
+    return create(allocator, nullptr, pConnectionId);
+}
+
+BufferPoolStatus ClientManager::create(
+        const std::shared_ptr<BufferPoolAllocator> &allocator,
+        const std::shared_ptr<BufferPoolEvictionPolicy> &evictionPolicy,
+        ConnectionId *pConnectionId) {
     if (mImpl) {
-        return mImpl->create(allocator, pConnectionId);
+        return mImpl->create(allocator, evictionPolicy, pConnectionId);
     }
     return ResultStatus::CRITICAL_ERROR;
 }
@@ -19,71 +19,289 @@
 #include <aidl/android/hardware/media/bufferpool2/BufferStatusMessage.h>
 #include <bufferpool2/BufferPoolTypes.h>
 
-#include <map>
-#include <set>
+#include <memory>
+#include <optional>
+#include <vector>
 
 namespace aidl::android::hardware::media::bufferpool2::implementation {
 
-// Helper template methods for handling map of set.
-template<class T, class U>
-bool insert(std::map<T, std::set<U>> *mapOfSet, T key, U value) {
-    auto iter = mapOfSet->find(key);
-    if (iter == mapOfSet->end()) {
-        std::set<U> valueSet{value};
-        mapOfSet->insert(std::make_pair(key, valueSet));
+// Set of a few values. Up to N values are stored inline, without allocation.
+template<class T, size_t N>
+class SmallSet {
+public:
+    size_t size() const {
+        return mSize;
+    }
+
+    bool empty() const {
+        return mSize == 0;
+    }
+
+    bool contains(T value) const {
+        for (size_t i = 0; i < mSize; ++i) {
+            if (at(i) == value) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /// Returns {@code true} when the value was not in the set.
+    bool insert(T value) {
+        if (contains(value)) {
+            return false;
+        }
+        if (mSize < N) {
+            mInline[mSize] = value;
+        } else {
+            mOverflow.push_back(value);
+        }
+        ++mSize;
         return true;
-    } else if (iter->second.find(value)  == iter->second.end()) {
-        iter->second.insert(value);
+    }
+
+    /// Returns {@code true} when the value was in the set.
+    bool erase(T value) {
+        for (size_t i = 0; i < mSize; ++i) {
+            if (at(i) == value) {
+                at(i) = at(mSize - 1);
+                if (mSize > N) {
+                    mOverflow.pop_back();
+                }
+                --mSize;
+                return true;
+            }
+        }
+        return false;
+    }
+
+private:
+    T &at(size_t i) {
+        return i < N ? mInline[i] : mOverflow[i - N];
+    }
+
+    const T &at(size_t i) const {
+        return i < N ? mInline[i] : mOverflow[i - N];
+    }
+
+    T mInline[N];
+    std::vector<T> mOverflow;
+    size_t mSize = 0;
+};
+
+// Hash of buffer, transaction and connection ids for SlabMap. Ids are mostly
+// sequential; spread them over the table.
+struct IdHash {
+    template<class K>
+    size_t operator()(K key) const {
+        return static_cast<size_t>((static_cast<uint64_t>(key) * 0x9E3779B97F4A7C15ULL) >> 32);
+    }
+};
+
+// Map from ids to values for internal BufferPool use. Values are stored in
+// fixed size chunks which are reused after erasure, so that their addresses
+// are stable and insertion rarely allocates. They are indexed by an open
+// addressing hash table.
+template<class K, class V, class Hash = IdHash>
+class SlabMap {
+public:
+    SlabMap() : mIndex(kMinIndexSize, kEmpty) {}
+
+    SlabMap(const SlabMap &) = delete;
+    SlabMap &operator=(const SlabMap &) = delete;
+
+    size_t size() const {
+        return mSize;
+    }
+
+    /// Returns the value of the key, or nullptr.
+    V *find(K key) {
+        size_t pos;
+        return lookup(key, &pos) ? &*slot(mIndex[pos]).mValue : nullptr;
+    }
+
+    /// Constructs the value of a new key, or returns nullptr if the key exists.
+    template<class... Args>
+    V *emplace(K key, Args&&... args) {
+        size_t pos;
+        if (lookup(key, &pos)) {
+            return nullptr;
+        }
+        if ((mSize + 1) * 4 > mIndex.size() * 3) {
+            growIndex();
+            lookup(key, &pos);
+        }
+        uint32_t id = allocateSlot();
+        Slot &entry = slot(id);
+        entry.mKey = key;
+        entry.mValue.emplace(std::forward<Args>(args)...);
+        mIndex[pos] = id;
+        ++mSize;
+        return &*entry.mValue;
+    }
+
+    /// Returns {@code true} when the key existed.
+    bool erase(K key) {
+        size_t pos;
+        if (!lookup(key, &pos)) {
+            return false;
+        }
+        uint32_t id = mIndex[pos];
+        slot(id).mValue.reset();
+        mFreeSlots.push_back(id);
+        removeFromIndex(pos);
+        --mSize;
         return true;
     }
-    return false;
-}
 
-// Helper template methods for handling map of set.
-template<class T, class U>
-bool erase(std::map<T, std::set<U>> *mapOfSet, T key, U value) {
-    bool ret = false;
-    auto iter = mapOfSet->find(key);
-    if (iter != mapOfSet->end()) {
-        if (iter->second.erase(value) > 0) {
-            ret = true;
+    /**
+     * Calls f(key, value) for all the entries. f may erase the entry it is
+     * called for, but must not insert.
+     */
+    template<class F>
+    void forEach(F f) {
+        for (uint32_t id = 0; id < mNumSlots; ++id) {
+            Slot &entry = slot(id);
+            if (entry.mValue) {
+                f(entry.mKey, *entry.mValue);
+            }
         }
-        if (iter->second.size() == 0) {
-            mapOfSet->erase(iter);
+    }
+
+private:
+    static constexpr uint32_t kEmpty = UINT32_MAX;
+    static constexpr size_t kMinIndexSize = 16;
+    static constexpr size_t kChunkSize = 64;
+
+    struct Slot {
+        K mKey;
+        std::optional<V> mValue;
+    };
+
+    static size_t hash(K key) {
+        return Hash()(key);
+    }
+
+    Slot &slot(uint32_t id) {
+        return mChunks[id / kChunkSize][id % kChunkSize];
+    }
+
+    // Finds the index position of the key, or the position to insert it at.
+    bool lookup(K key, size_t *pos) {
+        const size_t mask = mIndex.size() - 1;
+        for (size_t i = hash(key) & mask;; i = (i + 1) & mask) {
+            if (mIndex[i] == kEmpty) {
+                *pos = i;
+                return false;
+            }
+            if (slot(mIndex[i]).mKey == key) {
+                *pos = i;
+                return true;
+            }
         }
     }
-    return ret;
-}
 
-// Helper template methods for handling map of set.
-template<class T, class U>
-bool contains(std::map<T, std::set<U>> *mapOfSet, T key, U value) {
-    auto iter = mapOfSet->find(key);
-    if (iter != mapOfSet->end()) {
-        auto setIter = iter->second.find(value);
-        return setIter != iter->second.end();
+    // Backward shift deletion, which keeps lookups free of tombstones.
+    void removeFromIndex(size_t pos) {
+        const size_t mask = mIndex.size() - 1;
+        size_t hole = pos;
+        for (size_t i = (pos + 1) & mask; mIndex[i] != kEmpty; i = (i + 1) & mask) {
+            size_t home = hash(slot(mIndex[i]).mKey) & mask;
+            if (((i - home) & mask) >= ((i - hole) & mask)) {
+                mIndex[hole] = mIndex[i];
+                hole = i;
+            }
+        }
+        mIndex[hole] = kEmpty;
+    }
+
+    void growIndex() {
+        std::vector<uint32_t> index(mIndex.size() * 2, kEmpty);
+        const size_t mask = index.size() - 1;
+        for (uint32_t id : mIndex) {
+            if (id != kEmpty) {
+                size_t i = hash(slot(id).mKey) & mask;
+                while (index[i] != kEmpty) {
+                    i = (i + 1) & mask;
+                }
+                index[i] = id;
+            }
+        }
+        mIndex.swap(index);
+    }
+
+    uint32_t allocateSlot() {
+        if (!mFreeSlots.empty()) {
+            uint32_t id = mFreeSlots.back();
+            mFreeSlots.pop_back();
+            return id;
+        }
+        if (mNumSlots == mChunks.size() * kChunkSize) {
+            mChunks.push_back(std::make_unique<Slot[]>(kChunkSize));
+        }
+        return mNumSlots++;
     }
-    return false;
-}
+
+    std::vector<std::unique_ptr<Slot[]>> mChunks;
+    std::vector<uint32_t> mFreeSlots;
+    uint32_t mNumSlots = 0;
+    std::vector<uint32_t> mIndex;
+    size_t mSize = 0;
+};
+
+struct InternalBuffer;
+
+// Links of an InternalBuffer in a BufferList.
+struct BufferListLink {
+    InternalBuffer *mPrev = nullptr;
+    InternalBuffer *mNext = nullptr;
+};
+
+// Intrusive doubly linked list of InternalBuffers. A buffer can be in one
+// list per link member, and is added and removed without allocation.
+template<BufferListLink InternalBuffer::*Link>
+struct BufferList {
+    InternalBuffer *mHead = nullptr;
+    InternalBuffer *mTail = nullptr;
+    size_t mSize = 0;
+
+    bool empty() const {
+        return mSize == 0;
+    }
+
+    void pushBack(InternalBuffer *buffer);
+
+    void remove(InternalBuffer *buffer);
+};
 
 // Buffer data structure for internal BufferPool use.(storage/fetching)
 struct InternalBuffer {
     BufferId mId;
-    size_t mOwnerCount;
+    // Connections which own the buffer. Mostly one, or two during a transfer.
+    SmallSet<ConnectionId, 2> mOwners;
     size_t mTransactionCount;
     const std::shared_ptr<BufferPoolAllocation> mAllocation;
     const size_t mAllocSize;
     const std::vector<uint8_t> mConfig;
+    // BufferPoolAllocator::configKey() of mConfig
+    const uint64_t mConfigKey;
     bool mInvalidated;
+    // Whether the buffer is in the free buffer lists, since when, and its
+    // links in them.
+    bool mFree = false;
+    int64_t mFreedMs = 0;
+    BufferListLink mLruLink;
+    BufferListLink mBucketLink;
 
     InternalBuffer(
             BufferId id,
             const std::shared_ptr<BufferPoolAllocation> &alloc,
             const size_t allocSize,
-            const std::vector<uint8_t> &allocConfig)
-            : mId(id), mOwnerCount(0), mTransactionCount(0),
+            const std::vector<uint8_t> &allocConfig,
+            uint64_t configKey)
+            : mId(id), mTransactionCount(0),
             mAllocation(alloc), mAllocSize(allocSize), mConfig(allocConfig),
-            mInvalidated(false) {}
+            mConfigKey(configKey), mInvalidated(false) {}
 
     const native_handle_t *handle() {
         return mAllocation->handle();
@@ -94,6 +312,36 @@ struct InternalBuffer {
     }
 };
 
+template<BufferListLink InternalBuffer::*Link>
+void BufferList<Link>::pushBack(InternalBuffer *buffer) {
+    (buffer->*Link).mPrev = mTail;
+    (buffer->*Link).mNext = nullptr;
+    if (mTail) {
+        (mTail->*Link).mNext = buffer;
+    } else {
+        mHead = buffer;
+    }
+    mTail = buffer;
+    ++mSize;
+}
+
+template<BufferListLink InternalBuffer::*Link>
+void BufferList<Link>::remove(InternalBuffer *buffer) {
+    BufferListLink &link = buffer->*Link;
+    if (link.mPrev) {
+        (link.mPrev->*Link).mNext = link.mNext;
+    } else {
+        mHead = link.mNext;
+    }
+    if (link.mNext) {
+        (link.mNext->*Link).mPrev = link.mPrev;
+    } else {
+        mTail = link.mPrev;
+    }
+    link = BufferListLink();
+    --mSize;
+}
+
 // Buffer transacion status/message data structure for internal BufferPool use.
 struct TransactionStatus {
     TransactionId mId;
@@ -0,0 +1,60 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include "BufferPoolTypes.h"
+
+namespace aidl::android::hardware::media::bufferpool2::implementation {
+
+/**
+ * Default eviction policy of a buffer pool.
+ *
+ * Keeps free buffers within a byte budget, and drops free buffers which are
+ * not recycled for a while. The idle duration adapts to the recycle hit rate:
+ * it grows while allocations miss the cache, and shrinks while they hit, so
+ * that buffers which get reused are kept and the others are dropped.
+ *
+ * Allocations which fail for lack of memory halve the byte budget and drop
+ * idle buffers as soon as possible. The budget grows back while allocations
+ * succeed.
+ */
+class AdaptiveEvictionPolicy : public BufferPoolEvictionPolicy {
+public:
+    /// Default total size of free buffers of a buffer pool.
+    static constexpr size_t kDefaultMaxFreeSize = 1024 * 1024 * 64;
+
+    /**
+     * Creates an eviction policy.
+     *
+     * @param maxFreeSize   max total size of free buffers.
+     */
+    explicit AdaptiveEvictionPolicy(size_t maxFreeSize = kDefaultMaxFreeSize);
+
+    BufferPoolCacheLimits getCacheLimits(const BufferPoolCacheStatus &status) override;
+
+private:
+    const size_t mMaxFreeSize;
+    // The byte budget, which is below mMaxFreeSize after allocation failures.
+    size_t mFreeSizeLimit;
+    int64_t mMaxIdleMs;
+    // Allocation counts at the previous getCacheLimits().
+    size_t mLastAllocations;
+    size_t mLastRecycles;
+    size_t mLastAllocationFailures;
+};
+
+}  // namespace aidl::android::hardware::media::bufferpool2::implementation
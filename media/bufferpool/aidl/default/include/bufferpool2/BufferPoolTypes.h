@@ -88,8 +88,69 @@ struct BufferPoolAllocation {
     ~BufferPoolAllocation() {};
 };
 
+/**
+ * Snapshot of the buffers cached by a buffer pool.
+ */
+struct BufferPoolCacheStatus {
+    /// Total size of allocations which are used or available to use.
+    /// (bytes or pixels)
+    size_t mSizeCached;
+    /// # of cached buffers which are used or available to use.
+    size_t mBuffersCached;
+    /// Total size of allocations which are currently used. (bytes or pixels)
+    size_t mSizeInUse;
+    /// # of currently used buffers
+    size_t mBuffersInUse;
+    /// # of allocations called on bufferpool so far.
+    size_t mTotalAllocations;
+    /// # of allocations that were served from the cache so far.
+    size_t mTotalRecycles;
+    /// # of allocations the allocator failed for lack of memory so far.
+    size_t mTotalAllocationFailures;
+    /// elapsedRealtime() of the snapshot.
+    int64_t mTimestampMs;
+};
+
+/**
+ * Limits on the free buffers a buffer pool keeps cached for recycling. Least
+ * recently freed buffers are evicted first, while a limit is exceeded.
+ */
+struct BufferPoolCacheLimits {
+    /// Max total size of free buffers.
+    size_t mMaxFreeSize;
+    /// Max # of free buffers.
+    size_t mMaxFreeBuffers;
+    /// Buffers which have been free for longer are evicted, as long as the
+    /// total size of free buffers is above mMinFreeSize.
+    int64_t mMaxIdleMs;
+    size_t mMinFreeSize;
+};
+
+/**
+ * Eviction policy of a buffer pool, which sizes the set of cached free
+ * buffers. An instance serves a single buffer pool.
+ */
+class BufferPoolEvictionPolicy {
+public:
+    /**
+     * Returns the limits of free buffers. Called periodically while the buffer
+     * pool is used, and right after an allocation fails for lack of memory.
+     * The result is applied until the next call.
+     *
+     * @param status    the current cache status of the buffer pool.
+     */
+    virtual BufferPoolCacheLimits getCacheLimits(const BufferPoolCacheStatus &status) = 0;
+
+    virtual ~BufferPoolEvictionPolicy() = default;
+};
+
 /**
  * Allocator wrapper class for buffer pool.
+ *
+ * configKey() was added to the vtable of this class, so allocators built
+ * against an older version of this header are not ABI compatible and must be
+ * rebuilt against this one. The eviction policy of a buffer pool is given to
+ * its Accessor instead, see ClientManager::create().
  */
 class BufferPoolAllocator {
 public:
@@ -115,6 +176,19 @@ public:
     virtual bool compatible(const std::vector<uint8_t> &newParams,
                             const std::vector<uint8_t> &oldParams) = 0;
 
+    /**
+     * Returns a key which classifies allocation parameters for recycling.
+     * Parameters with different keys must never be compatible, so that free
+     * buffers can be looked up by key instead of testing each of them with
+     * compatible(). The key of the same parameters must not change.
+     *
+     * The default puts all parameters into a single class.
+     */
+    virtual uint64_t configKey(const std::vector<uint8_t> &params) {
+        (void)params;
+        return 0;
+    }
+
 protected:
     BufferPoolAllocator() = default;
 
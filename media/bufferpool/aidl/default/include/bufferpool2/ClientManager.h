@@ -52,6 +52,26 @@ struct ClientManager : public BnClientManager {
     BufferPoolStatus create(const std::shared_ptr<BufferPoolAllocator> &allocator,
                         ConnectionId *pConnectionId);
 
+    /**
+     * Creates a local connection with a newly created buffer pool, which
+     * sizes its free buffers with the specified eviction policy.
+     *
+     * @param allocator         for new buffer allocation.
+     * @param evictionPolicy    the eviction policy of the buffer pool, or
+     *                          nullptr to use an AdaptiveEvictionPolicy. It
+     *                          must not be shared with other buffer pools.
+     * @param pConnectionId     Id of the created connection. This is
+     *                          system-wide unique.
+     *
+     * @return OK when a buffer pool and a local connection is successfully
+     *         created.
+     *         ResultStatus::NO_MEMORY when there is no memory.
+     *         CRITICAL_ERROR otherwise.
+     */
+    BufferPoolStatus create(const std::shared_ptr<BufferPoolAllocator> &allocator,
+                        const std::shared_ptr<BufferPoolEvictionPolicy> &evictionPolicy,
+                        ConnectionId *pConnectionId);
+
     /**
      * Register a created connection as sender for remote process.
      *
@@ -179,6 +179,13 @@ bool TestBufferPoolAllocator::compatible(const std::vector<uint8_t> &newParams,
   return false;
 }
 
+uint64_t TestBufferPoolAllocator::configKey(const std::vector<uint8_t> &params) {
+  // Only parameters of the same capacity can be the same.
+  Params ashmemParams;
+  memcpy(&ashmemParams, params.data(), std::min(sizeof(Params), params.size()));
+  return ashmemParams.data.capacity;
+}
+
 bool TestBufferPoolAllocator::Fill(const native_handle_t *handle, const unsigned char val) {
   if (!HandleAshmem::isValid(handle)) {
     return false;
@@ -239,7 +246,11 @@ bool TestBufferPoolAllocator::UnmapMemoryForMutex(void *mem) {
 
 void getTestAllocatorParams(std::vector<uint8_t> *params) {
   constexpr static int kAllocationSize = 1024 * 10;
-  Params ashmemParams(kAllocationSize);
+  getTestAllocatorParams(params, kAllocationSize);
+}
+
+void getTestAllocatorParams(std::vector<uint8_t> *params, uint32_t capacity) {
+  Params ashmemParams(capacity);
 
   params->assign(ashmemParams.array, ashmemParams.array + sizeof(ashmemParams));
 }
@@ -52,6 +52,8 @@ class TestBufferPoolAllocator : public BufferPoolAllocator {
   bool compatible(const std::vector<uint8_t> &newParams,
                   const std::vector<uint8_t> &oldParams) override;
 
+  uint64_t configKey(const std::vector<uint8_t> &params) override;
+
   static bool Fill(const native_handle_t *handle, const unsigned char val);
 
   static bool Verify(const native_handle_t *handle, const unsigned char val);
@@ -65,3 +67,5 @@ class TestBufferPoolAllocator : public BufferPoolAllocator {
 void getTestAllocatorParams(std::vector<uint8_t> *params);
 
 void getIpcMutexParams(std::vector<uint8_t> *params);
+
+void getTestAllocatorParams(std::vector<uint8_t> *params, uint32_t capacity);
@@ -0,0 +1,113 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Measures allocate/recycle throughput of a local buffer pool caching buffers
+// of mixed configs, with free buffers looked up by config key or, like an
+// allocator which does not provide config keys, by testing each of them.
+
+#define LOG_TAG "buffferpool_benchmark"
+
+#include <benchmark/benchmark.h>
+
+#include <bufferpool2/ClientManager.h>
+#include <memory>
+#include <vector>
+#include "allocator.h"
+
+using aidl::android::hardware::media::bufferpool2::implementation::BufferPoolStatus;
+using aidl::android::hardware::media::bufferpool2::implementation::ClientManager;
+using aidl::android::hardware::media::bufferpool2::implementation::ConnectionId;
+using aidl::android::hardware::media::bufferpool2::BufferPoolData;
+
+namespace {
+
+// # of distinct buffer configs, and # of buffers of each config being cached.
+// Together close to what a 4K decoder with mixed output & reference buffers
+// keeps.
+constexpr static int kNumConfigs = 8;
+constexpr static int kBuffersPerConfig = 8;
+
+// Allocator which classifies all params alike, so that free buffers are
+// matched by compatible() only.
+class KeylessAllocator : public TestBufferPoolAllocator {
+ public:
+  uint64_t configKey(const std::vector<uint8_t> &) override { return 0; }
+};
+
+bool allocate(const std::shared_ptr<ClientManager> &manager, ConnectionId connectionId,
+              const std::vector<uint8_t> &params, std::shared_ptr<BufferPoolData> *buffer) {
+  native_handle_t *allocHandle = nullptr;
+  BufferPoolStatus status = manager->allocate(connectionId, params, &allocHandle, buffer);
+  if (allocHandle) {
+    native_handle_close(allocHandle);
+    native_handle_delete(allocHandle);
+  }
+  return status == ResultStatus::OK;
+}
+
+void BM_RecycleMixedConfigs(benchmark::State &state) {
+  const bool keyed = state.range(0) != 0;
+  std::shared_ptr<ClientManager> manager = ClientManager::getInstance();
+  std::shared_ptr<BufferPoolAllocator> allocator =
+      keyed ? std::make_shared<TestBufferPoolAllocator>() : std::make_shared<KeylessAllocator>();
+  ConnectionId connectionId;
+  if (manager->create(allocator, &connectionId) != ResultStatus::OK) {
+    state.SkipWithError("failed to create a buffer pool");
+    return;
+  }
+
+  std::vector<std::vector<uint8_t>> params(kNumConfigs);
+  for (int i = 0; i < kNumConfigs; ++i) {
+    getTestAllocatorParams(&params[i], 4096 * (i + 1));
+  }
+
+  // Fill the cache with buffers of all the configs.
+  {
+    std::vector<std::shared_ptr<BufferPoolData>> buffers(kNumConfigs * kBuffersPerConfig);
+    for (size_t i = 0; i < buffers.size(); ++i) {
+      if (!allocate(manager, connectionId, params[i % kNumConfigs], &buffers[i])) {
+        state.SkipWithError("failed to allocate a buffer");
+        manager->close(connectionId);
+        return;
+      }
+    }
+  }
+
+  // Keep half of the buffers of each config in use, so that a recycled buffer
+  // is somewhere in the middle of the free buffers.
+  std::vector<std::shared_ptr<BufferPoolData>> inUse(kNumConfigs * kBuffersPerConfig / 2);
+  size_t next = 0;
+  int config = 0;
+  for (auto _ : state) {
+    if (!allocate(manager, connectionId, params[config], &inUse[next])) {
+      state.SkipWithError("failed to allocate a buffer");
+      break;
+    }
+    next = (next + 1) % inUse.size();
+    config = (config + 3) % kNumConfigs;
+  }
+  inUse.clear();
+
+  state.SetItemsProcessed(state.iterations());
+  state.SetLabel(keyed ? "keyed" : "keyless");
+  manager->close(connectionId);
+}
+
+BENCHMARK(BM_RecycleMixedConfigs)->Arg(0)->Arg(1);
+
+}  // namespace
+
+BENCHMARK_MAIN();
@@ -20,6 +20,7 @@
 
 #include <android-base/logging.h>
 #include <binder/ProcessState.h>
+#include <bufferpool2/AdaptiveEvictionPolicy.h>
 #include <bufferpool2/ClientManager.h>
 #include <unistd.h>
 #include <iostream>
@@ -27,7 +28,10 @@
 #include <vector>
 #include "allocator.h"
 
+using aidl::android::hardware::media::bufferpool2::implementation::AdaptiveEvictionPolicy;
 using aidl::android::hardware::media::bufferpool2::implementation::BufferId;
+using aidl::android::hardware::media::bufferpool2::implementation::BufferPoolCacheLimits;
+using aidl::android::hardware::media::bufferpool2::implementation::BufferPoolCacheStatus;
 using aidl::android::hardware::media::bufferpool2::implementation::BufferPoolStatus;
 using aidl::android::hardware::media::bufferpool2::implementation::ClientManager;
 using aidl::android::hardware::media::bufferpool2::implementation::ConnectionId;
@@ -169,6 +173,64 @@ TEST_F(BufferpoolSingleTest, TransferBuffer) {
   }
 }
 
+// Eviction policy test.
+// Check whether idle free buffers are kept longer while allocations miss the
+// cache, and for a shorter time while they hit.
+TEST(AdaptiveEvictionPolicyTest, AdaptsToHitRate) {
+  constexpr size_t kMaxFreeSize = 1024 * 1024 * 32;
+  AdaptiveEvictionPolicy policy(kMaxFreeSize);
+  BufferPoolCacheStatus status{};
+  BufferPoolCacheLimits limits = policy.getCacheLimits(status);
+  EXPECT_EQ(limits.mMaxFreeSize, kMaxFreeSize);
+  const int64_t initialIdleMs = limits.mMaxIdleMs;
+
+  // All misses
+  status.mTotalAllocations += 100;
+  limits = policy.getCacheLimits(status);
+  EXPECT_GT(limits.mMaxIdleMs, initialIdleMs);
+
+  // All hits
+  for (int i = 0; i < 4; ++i) {
+    status.mTotalAllocations += 100;
+    status.mTotalRecycles += 100;
+    limits = policy.getCacheLimits(status);
+  }
+  EXPECT_LT(limits.mMaxIdleMs, initialIdleMs);
+  EXPECT_EQ(limits.mMaxFreeSize, kMaxFreeSize);
+}
+
+// Eviction policy test.
+// Check whether failed allocations shrink the free buffer limits, and whether
+// the limits are restored while allocations succeed.
+TEST(AdaptiveEvictionPolicyTest, ShrinksOnAllocationFailure) {
+  constexpr size_t kMaxFreeSize = 1024 * 1024 * 32;
+  AdaptiveEvictionPolicy policy(kMaxFreeSize);
+  BufferPoolCacheStatus status{};
+  BufferPoolCacheLimits normal = policy.getCacheLimits(status);
+
+  status.mTotalAllocationFailures++;
+  BufferPoolCacheLimits limits = policy.getCacheLimits(status);
+  EXPECT_EQ(limits.mMaxFreeSize, kMaxFreeSize / 2);
+  EXPECT_EQ(limits.mMaxIdleMs, 0);
+  EXPECT_EQ(limits.mMinFreeSize, 0u);
+
+  status.mTotalAllocationFailures++;
+  limits = policy.getCacheLimits(status);
+  EXPECT_EQ(limits.mMaxFreeSize, kMaxFreeSize / 4);
+
+  // Without allocations, nothing is known about the memory.
+  limits = policy.getCacheLimits(status);
+  EXPECT_EQ(limits.mMaxFreeSize, kMaxFreeSize / 4);
+  EXPECT_GT(limits.mMaxIdleMs, 0);
+
+  for (int i = 0; i < 2; ++i) {
+    status.mTotalAllocations++;
+    limits = policy.getCacheLimits(status);
+  }
+  EXPECT_EQ(limits.mMaxFreeSize, normal.mMaxFreeSize);
+  EXPECT_EQ(limits.mMinFreeSize, normal.mMinFreeSize);
+}
+
 }  // anonymous namespace
 
 int main(int argc, char** argv) {
@@ -0,0 +1,188 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "buffferpool_unit_test"
+
+#include <gtest/gtest.h>
+
+#include <android-base/logging.h>
+#include <memory>
+#include <set>
+#include <vector>
+#include "DataHelper.h"
+
+using aidl::android::hardware::media::bufferpool2::implementation::SlabMap;
+
+namespace {
+
+// Places key 0xHHNN at index position HH of the table, so that tests choose
+// which keys collide.
+struct HomeHash {
+  size_t operator()(uint32_t key) const { return key >> 8; }
+};
+
+using CollidingMap = SlabMap<uint32_t, uint32_t, HomeHash>;
+
+// The positions of the smallest table.
+constexpr uint32_t kMinTableSize = 16;
+
+uint32_t makeKey(uint32_t home, uint32_t n) {
+  return (home << 8) | n;
+}
+
+void expectEntries(CollidingMap& map, const std::vector<uint32_t>& keys) {
+  EXPECT_EQ(keys.size(), map.size());
+  for (uint32_t key : keys) {
+    uint32_t* value = map.find(key);
+    ASSERT_NE(value, nullptr) << "key " << std::hex << key;
+    EXPECT_EQ(key, *value);
+  }
+}
+
+// Colliding keys at the end of the table wrap around to its start.
+TEST(SlabMapTest, FindsKeysCollidingAcrossWrapAround) {
+  CollidingMap map;
+  std::vector<uint32_t> keys;
+  for (uint32_t n = 0; n < 4; ++n) {
+    keys.push_back(makeKey(kMinTableSize - 1, n));
+  }
+  keys.push_back(makeKey(0, 0));
+  for (uint32_t key : keys) {
+    ASSERT_NE(map.emplace(key, key), nullptr);
+  }
+  expectEntries(map, keys);
+  EXPECT_EQ(map.find(makeKey(kMinTableSize - 1, 4)), nullptr);
+  EXPECT_EQ(map.find(makeKey(0, 1)), nullptr);
+  EXPECT_EQ(map.emplace(keys[2], 0), nullptr);
+  EXPECT_EQ(keys[2], *map.find(keys[2]));
+}
+
+// Erasing a key shifts the keys probed after it back, across the end of the
+// table, unless that would move them before their home position.
+TEST(SlabMapTest, FindsShiftedKeysAfterErase) {
+  CollidingMap map;
+  const uint32_t a = makeKey(kMinTableSize - 2, 0);
+  const uint32_t b = makeKey(kMinTableSize - 1, 0);
+  const uint32_t c = makeKey(kMinTableSize - 2, 1);
+  const uint32_t d = makeKey(0, 0);
+  const uint32_t e = makeKey(kMinTableSize - 1, 1);
+  const uint32_t f = makeKey(1, 0);
+  // Positions 14..15 then 0..3 hold a b c d e f.
+  for (uint32_t key : {a, b, c, d, e, f}) {
+    ASSERT_NE(map.emplace(key, key), nullptr);
+  }
+
+  EXPECT_TRUE(map.erase(a));
+  expectEntries(map, {b, c, d, e, f});
+  EXPECT_TRUE(map.erase(d));
+  expectEntries(map, {b, c, e, f});
+  EXPECT_TRUE(map.erase(b));
+  expectEntries(map, {c, e, f});
+  EXPECT_FALSE(map.erase(b));
+
+  // The freed positions are usable again.
+  for (uint32_t key : {a, b, d}) {
+    ASSERT_NE(map.emplace(key, key), nullptr);
+  }
+  expectEntries(map, {a, b, c, d, e, f});
+}
+
+TEST(SlabMapTest, GrowsUnderLoad) {
+  constexpr uint32_t kNumKeys = 10000;
+  SlabMap<uint32_t, uint32_t> map;
+  std::vector<uint32_t*> values;
+  for (uint32_t key = 0; key < kNumKeys; ++key) {
+    uint32_t* value = map.emplace(key, key);
+    ASSERT_NE(value, nullptr);
+    values.push_back(value);
+  }
+  EXPECT_EQ(kNumKeys, map.size());
+  for (uint32_t key = 0; key < kNumKeys; ++key) {
+    // Values stay where they were constructed while the table grows.
+    ASSERT_EQ(values[key], map.find(key));
+    EXPECT_EQ(key, *values[key]);
+  }
+  EXPECT_EQ(map.find(kNumKeys), nullptr);
+
+  // Colliding keys survive growth, which moves them to other positions.
+  CollidingMap colliding;
+  std::vector<uint32_t> keys;
+  for (uint32_t home = 0; home < 64; ++home) {
+    for (uint32_t n = 0; n < 3; ++n) {
+      keys.push_back(makeKey(home % kMinTableSize, home * 3 + n));
+      ASSERT_NE(colliding.emplace(keys.back(), keys.back()), nullptr);
+    }
+  }
+  expectEntries(colliding, keys);
+}
+
+TEST(SlabMapTest, ErasesDuringForEach) {
+  constexpr uint32_t kNumKeys = 200;
+  SlabMap<uint32_t, uint32_t> map;
+  for (uint32_t key = 0; key < kNumKeys; ++key) {
+    map.emplace(key, key);
+  }
+  std::multiset<uint32_t> visited;
+  map.forEach([&](uint32_t key, uint32_t& value) {
+    EXPECT_EQ(key, value);
+    visited.insert(key);
+    if (key % 2 == 0) {
+      EXPECT_TRUE(map.erase(key));
+    }
+  });
+  EXPECT_EQ(kNumKeys, visited.size());
+  EXPECT_EQ(kNumKeys, std::set<uint32_t>(visited.begin(), visited.end()).size());
+  EXPECT_EQ(kNumKeys / 2, map.size());
+  for (uint32_t key = 0; key < kNumKeys; ++key) {
+    EXPECT_EQ(key % 2 == 0, map.find(key) == nullptr);
+  }
+}
+
+TEST(SlabMapTest, ReusesSlotsOfErasedValues) {
+  constexpr uint32_t kNumKeys = 100;
+  SlabMap<uint32_t, std::shared_ptr<int>> map;
+  std::set<std::shared_ptr<int>*> slots;
+  std::vector<std::weak_ptr<int>> erased;
+  for (uint32_t key = 0; key < kNumKeys; ++key) {
+    auto value = std::make_shared<int>(key);
+    erased.push_back(value);
+    slots.insert(map.emplace(key, std::move(value)));
+  }
+  for (uint32_t key = 0; key < kNumKeys; ++key) {
+    EXPECT_TRUE(map.erase(key));
+  }
+  // Values are destroyed on erase, not when their slot is reused.
+  for (const auto& value : erased) {
+    EXPECT_TRUE(value.expired());
+  }
+
+  // New keys take the slots of the erased ones.
+  for (uint32_t key = kNumKeys; key < 2 * kNumKeys; ++key) {
+    std::shared_ptr<int>* slot = map.emplace(key, std::make_shared<int>(key));
+    EXPECT_EQ(1u, slots.count(slot));
+    EXPECT_EQ(int(key), **slot);
+  }
+  EXPECT_EQ(kNumKeys, map.size());
+}
+
+}  // anonymous namespace
+
+int main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  int status = RUN_ALL_TESTS();
+  LOG(INFO) << "Test result = " << status;
+  return status;
+}
@@ -0,0 +1,239 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Measures end-to-end buffer round trips through ClientManager in process:
+// allocate -> postSend -> receive -> release of both ends, from 1 to 16
+// threads. Buffers are received by a second ClientManager, which registers its
+// own connection to the buffer pool like a receiving process would. Each
+// thread either has its own buffer pool and receiver, like independent
+// decoders, or all threads share one sender and one receiver connection,
+// which shows the contention on the locks of the clients and the pool.
+// Reports the recycle hit rate of allocations.
+//
+// Also measures the status FMQs alone: each thread posts TRANSFER_TO messages
+// to its own status queue, while one thread drains all of them like the
+// buffer pool does. Reports the rate at which messages are drained.
+//
+// Everything runs in one process, so the cost of binder calls and of cross
+// process wakeups is not included.
+
+#define LOG_TAG "buffferpool_benchmark"
+
+#include <benchmark/benchmark.h>
+
+#include <bufferpool2/ClientManager.h>
+#include <atomic>
+#include <list>
+#include <memory>
+#include <thread>
+#include <vector>
+#include "BufferStatus.h"
+#include "allocator.h"
+
+using aidl::android::hardware::media::bufferpool2::BufferStatus;
+using aidl::android::hardware::media::bufferpool2::BufferStatusMessage;
+using aidl::android::hardware::media::bufferpool2::implementation::BufferId;
+using aidl::android::hardware::media::bufferpool2::implementation::BufferPoolStatus;
+using aidl::android::hardware::media::bufferpool2::implementation::BufferStatusChannel;
+using aidl::android::hardware::media::bufferpool2::implementation::BufferStatusObserver;
+using aidl::android::hardware::media::bufferpool2::implementation::ClientManager;
+using aidl::android::hardware::media::bufferpool2::implementation::ConnectionId;
+using aidl::android::hardware::media::bufferpool2::implementation::StatusDescriptor;
+using aidl::android::hardware::media::bufferpool2::implementation::TransactionId;
+using aidl::android::hardware::media::bufferpool2::BufferPoolData;
+
+namespace {
+
+// Connections shared by the threads.
+ConnectionId sSharedConnectionId;
+std::shared_ptr<ClientManager> sSharedReceiverManager;
+ConnectionId sSharedReceiverId;
+// The largest buffer id allocated from the shared buffer pool.
+std::atomic<int64_t> sSharedMaxBufferId;
+
+void deleteHandle(native_handle_t *handle) {
+  if (handle) {
+    native_handle_close(handle);
+    native_handle_delete(handle);
+  }
+}
+
+void BM_RoundTrip(benchmark::State &state) {
+  const bool shared = state.range(0) != 0;
+  std::shared_ptr<ClientManager> manager = ClientManager::getInstance();
+  ConnectionId connectionId;
+  std::shared_ptr<ClientManager> receiverManager;
+  ConnectionId receiverId;
+  if (!shared || state.thread_index() == 0) {
+    std::shared_ptr<BufferPoolAllocator> allocator =
+        std::make_shared<TestBufferPoolAllocator>();
+    if (manager->create(allocator, &connectionId) != ResultStatus::OK) {
+      state.SkipWithError("failed to create a buffer pool");
+      return;
+    }
+    receiverManager = ::ndk::SharedRefBase::make<ClientManager>();
+    bool isNew;
+    if (manager->registerSender(receiverManager, connectionId, &receiverId, &isNew) !=
+        ResultStatus::OK) {
+      manager->close(connectionId);
+      state.SkipWithError("failed to register a receiver");
+      return;
+    }
+    if (shared) {
+      sSharedConnectionId = connectionId;
+      sSharedReceiverManager = receiverManager;
+      sSharedReceiverId = receiverId;
+      sSharedMaxBufferId = -1;
+    }
+  }
+  // Threads start the loop together, after the setup of thread 0.
+
+  std::vector<uint8_t> params;
+  getTestAllocatorParams(&params);
+  // A buffer pool gives new buffers sequential ids from 0, so the number of
+  // buffers it allocated is the largest id allocated so far plus one. Unlike
+  // ids seen by each thread, this also holds when threads share the pool.
+  int64_t maxBufferId = -1;
+  for (auto _ : state) {
+    if (!receiverManager) {
+      connectionId = sSharedConnectionId;
+      receiverManager = sSharedReceiverManager;
+      receiverId = sSharedReceiverId;
+    }
+    std::shared_ptr<BufferPoolData> sbuffer, rbuffer;
+    native_handle_t *allocHandle = nullptr;
+    native_handle_t *recvHandle = nullptr;
+    TransactionId transactionId;
+    int64_t postMs;
+    if (manager->allocate(connectionId, params, &allocHandle, &sbuffer) != ResultStatus::OK) {
+      state.SkipWithError("failed to allocate a buffer");
+      break;
+    }
+    if (sbuffer->mId > maxBufferId) {
+      maxBufferId = sbuffer->mId;
+      if (shared) {
+        int64_t sharedMax = sSharedMaxBufferId.load(std::memory_order_relaxed);
+        while (maxBufferId > sharedMax &&
+               !sSharedMaxBufferId.compare_exchange_weak(sharedMax, maxBufferId,
+                                                         std::memory_order_relaxed)) {
+        }
+      }
+    }
+    if (manager->postSend(receiverId, sbuffer, &transactionId, &postMs) != ResultStatus::OK ||
+        receiverManager->receive(receiverId, transactionId, sbuffer->mId, postMs, &recvHandle,
+                                 &rbuffer) != ResultStatus::OK) {
+      deleteHandle(allocHandle);
+      state.SkipWithError("failed to transfer a buffer");
+      break;
+    }
+    deleteHandle(allocHandle);
+    deleteHandle(recvHandle);
+  }
+
+  state.SetItemsProcessed(state.iterations());
+  // All the threads are done with the loop, and have updated the shared max.
+  const int64_t allocations = state.iterations() * (shared ? state.threads() : 1);
+  const int64_t newBuffers = (shared ? sSharedMaxBufferId.load() : maxBufferId) + 1;
+  state.counters["recycle_hit_rate"] = benchmark::Counter(
+      allocations ? 1. - static_cast<double>(newBuffers) / allocations : 0,
+      benchmark::Counter::kAvgThreads);
+  state.SetLabel(shared ? "shared pool" : "pool per thread");
+  if (!shared || state.thread_index() == 0) {
+    receiverManager->close(receiverId);
+    manager->close(connectionId);
+    sSharedReceiverManager.reset();
+  }
+}
+
+BENCHMARK(BM_RoundTrip)->Arg(0)->Arg(1)->ThreadRange(1, 16)->UseRealTime();
+
+// The status queues of the threads, and the thread draining them.
+struct StatusQueues {
+  BufferStatusObserver mObserver;
+  std::vector<std::unique_ptr<BufferStatusChannel>> mChannels;
+  std::atomic<bool> mStop{false};
+  std::atomic<int64_t> mDrained{0};
+  std::thread mDrainer;
+};
+std::unique_ptr<StatusQueues> sStatusQueues;
+
+bool openStatusQueues(int numThreads) {
+  sStatusQueues = std::make_unique<StatusQueues>();
+  for (int i = 0; i < numThreads; ++i) {
+    StatusDescriptor desc;
+    if (sStatusQueues->mObserver.open(i, &desc) != ResultStatus::OK) {
+      return false;
+    }
+    sStatusQueues->mChannels.push_back(std::make_unique<BufferStatusChannel>(desc));
+    if (!sStatusQueues->mChannels.back()->isValid()) {
+      return false;
+    }
+  }
+  StatusQueues *queues = sStatusQueues.get();
+  queues->mDrainer = std::thread([queues] {
+    std::vector<BufferStatusMessage> messages;
+    while (!queues->mStop.load(std::memory_order_relaxed)) {
+      queues->mObserver.getBufferStatusChanges(messages);
+      if (messages.empty()) {
+        std::this_thread::yield();
+      }
+      queues->mDrained.fetch_add(messages.size(), std::memory_order_relaxed);
+      messages.clear();
+    }
+  });
+  return true;
+}
+
+void BM_StatusMessages(benchmark::State &state) {
+  if (state.thread_index() == 0 && !openStatusQueues(state.threads())) {
+    state.SkipWithError("failed to open the status queues");
+  }
+  // Threads start the loop together, after the setup of thread 0.
+
+  std::list<BufferId> pending, posted;
+  TransactionId transactionId = 0;
+  for (auto _ : state) {
+    if (!sStatusQueues->mDrainer.joinable()) {
+      state.SkipWithError("no status queues");
+      break;
+    }
+    BufferStatusChannel &channel = *sStatusQueues->mChannels[state.thread_index()];
+    // Waits for the drainer when the queue is full.
+    while (!channel.postBufferStatusMessage(transactionId, 0, BufferStatus::TRANSFER_TO,
+                                            state.thread_index(), 0, pending, posted)) {
+      std::this_thread::yield();
+    }
+    ++transactionId;
+  }
+
+  state.SetItemsProcessed(state.iterations());
+  if (state.thread_index() == 0) {
+    // Only the messages drained while the threads were posting count.
+    state.counters["status_messages"] = benchmark::Counter(
+        sStatusQueues->mDrained.load(), benchmark::Counter::kIsRate);
+    sStatusQueues->mStop = true;
+    if (sStatusQueues->mDrainer.joinable()) {
+      sStatusQueues->mDrainer.join();
+    }
+    sStatusQueues.reset();
+  }
+}
+
+BENCHMARK(BM_StatusMessages)->ThreadRange(1, 16)->UseRealTime();
+
+}  // namespace
+
+BENCHMARK_MAIN();
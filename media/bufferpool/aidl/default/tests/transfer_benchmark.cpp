@@ -0,0 +1,146 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Measures how fast a buffer pool processes the buffer status messages of
+// buffer transfers between local connections, i.e. TRANSFER_TO from the
+// sender, TRANSFER_FROM & TRANSFER_OK from the receiver and NOT_USED from the
+// sender, for buffers passed around 8 connections.
+
+#define LOG_TAG "buffferpool_benchmark"
+
+#include <benchmark/benchmark.h>
+
+#include <android/binder_auto_utils.h>
+#include <list>
+#include <memory>
+#include <vector>
+#include "Accessor.h"
+#include "BufferStatus.h"
+#include "allocator.h"
+
+using aidl::android::hardware::media::bufferpool2::BufferStatus;
+using aidl::android::hardware::media::bufferpool2::implementation::Accessor;
+using aidl::android::hardware::media::bufferpool2::implementation::BufferId;
+using aidl::android::hardware::media::bufferpool2::implementation::BufferPoolStatus;
+using aidl::android::hardware::media::bufferpool2::implementation::BufferStatusChannel;
+using aidl::android::hardware::media::bufferpool2::implementation::Connection;
+using aidl::android::hardware::media::bufferpool2::implementation::ConnectionId;
+using aidl::android::hardware::media::bufferpool2::implementation::InvalidationDescriptor;
+using aidl::android::hardware::media::bufferpool2::implementation::StatusDescriptor;
+using aidl::android::hardware::media::bufferpool2::implementation::TransactionId;
+
+namespace {
+
+constexpr static int kNumConnections = 8;
+// # of buffers each connection owns at the start.
+constexpr static int kBuffersPerConnection = 4;
+// # of buffer transfers whose messages are processed at once. Status messages
+// are processed in batches like this when clients transfer 1000 buffers/s.
+constexpr static int kTransfersPerIteration = 1000;
+
+struct Client {
+    std::shared_ptr<Connection> mConnection;
+    ConnectionId mId;
+    std::unique_ptr<BufferStatusChannel> mChannel;
+};
+
+struct Buffer {
+    BufferId mId;
+    int mOwner;
+};
+
+void BM_ProcessTransfers(benchmark::State &state) {
+    // Normally created by ClientManager.
+    Accessor::createInvalidator();
+    Accessor::createEvictor();
+
+    std::shared_ptr<BufferPoolAllocator> allocator =
+            std::make_shared<TestBufferPoolAllocator>();
+    std::shared_ptr<Accessor> accessor = ::ndk::SharedRefBase::make<Accessor>(allocator);
+    if (!accessor->isValid()) {
+        state.SkipWithError("failed to create a buffer pool");
+        return;
+    }
+
+    std::vector<Client> clients(kNumConnections);
+    for (Client &client : clients) {
+        uint32_t msgId;
+        StatusDescriptor statusDesc;
+        InvalidationDescriptor invDesc;
+        BufferPoolStatus status = accessor->connect(
+                nullptr, true, &client.mConnection, &client.mId, &msgId, &statusDesc, &invDesc);
+        if (status != ResultStatus::OK) {
+            state.SkipWithError("failed to connect to the buffer pool");
+            return;
+        }
+        client.mChannel = std::make_unique<BufferStatusChannel>(statusDesc);
+    }
+
+    std::vector<uint8_t> params;
+    getTestAllocatorParams(&params);
+    std::vector<Buffer> buffers;
+    for (int i = 0; i < kNumConnections * kBuffersPerConnection; ++i) {
+        BufferId id;
+        const native_handle_t *handle;
+        int owner = i % kNumConnections;
+        if (accessor->allocate(clients[owner].mId, params, &id, &handle) != ResultStatus::OK) {
+            state.SkipWithError("failed to allocate a buffer");
+            return;
+        }
+        buffers.push_back({id, owner});
+    }
+
+    std::list<BufferId> pending, posted;
+    TransactionId transactionId = 0;
+    size_t next = 0;
+    for (auto _ : state) {
+        state.PauseTiming();
+        for (int i = 0; i < kTransfersPerIteration; ++i) {
+            Buffer &buffer = buffers[next];
+            next = (next + 1) % buffers.size();
+            Client &sender = clients[buffer.mOwner];
+            buffer.mOwner = (buffer.mOwner + 1) % kNumConnections;
+            Client &receiver = clients[buffer.mOwner];
+            ++transactionId;
+            sender.mChannel->postBufferStatusMessage(
+                    transactionId, buffer.mId, BufferStatus::TRANSFER_TO,
+                    sender.mId, receiver.mId, pending, posted);
+            receiver.mChannel->postBufferStatusMessage(
+                    transactionId, buffer.mId, BufferStatus::TRANSFER_FROM,
+                    receiver.mId, -1, pending, posted);
+            receiver.mChannel->postBufferStatusMessage(
+                    transactionId, buffer.mId, BufferStatus::TRANSFER_OK,
+                    receiver.mId, -1, pending, posted);
+            pending.push_back(buffer.mId);
+            sender.mChannel->postBufferRelease(sender.mId, pending, posted);
+        }
+        posted.clear();
+        state.ResumeTiming();
+
+        accessor->cleanUp(false);
+    }
+
+    state.SetItemsProcessed(state.iterations() * kTransfersPerIteration);
+    for (Client &client : clients) {
+        accessor->close(client.mId);
+    }
+}
+
+BENCHMARK(BM_ProcessTransfers);
+
+}  // namespace
+
+BENCHMARK_MAIN();
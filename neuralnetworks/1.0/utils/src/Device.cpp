@@ -31,6 +31,7 @@
 #include <nnapi/Result.h>
 #include <nnapi/Types.h>
 #include <nnapi/hal/CommonUtils.h>
+#include <nnapi/hal/ConvertedModelCache.h>
 #include <nnapi/hal/TransferValue.h>
 
 #include <functional>
@@ -130,11 +131,12 @@ nn::GeneralResult<std::vector<bool>> Device::getSupportedOperations(const nn::Mo
     const nn::Model& modelInShared =
             NN_TRY(hal::utils::flushDataFromPointerToShared(&model, &maybeModelInShared));
 
-    const auto hidlModel = NN_TRY(convert(modelInShared));
+    const auto hidlModel = NN_TRY(hal::utils::convertModelCached(
+            modelInShared, [](const nn::Model& m) { return convert(m); }));
 
     auto cb = hal::utils::CallbackValue(supportedOperationsCallback);
 
-    const auto ret = kDevice->getSupportedOperations(hidlModel, cb);
+    const auto ret = kDevice->getSupportedOperations(*hidlModel, cb);
     HANDLE_TRANSPORT_FAILURE(ret);
 
     return cb.take();
@@ -151,12 +153,13 @@ nn::GeneralResult<nn::SharedPreparedModel> Device::prepareModel(
     const nn::Model& modelInShared =
             NN_TRY(hal::utils::flushDataFromPointerToShared(&model, &maybeModelInShared));
 
-    const auto hidlModel = NN_TRY(convert(modelInShared));
+    const auto hidlModel = NN_TRY(hal::utils::convertModelCached(
+            modelInShared, [](const nn::Model& m) { return convert(m); }));
 
     const auto cb = sp<PreparedModelCallback>::make();
     const auto scoped = kDeathHandler.protectCallback(cb.get());
 
-    const auto ret = kDevice->prepareModel(hidlModel, cb);
+    const auto ret = kDevice->prepareModel(*hidlModel, cb);
     const auto status = HANDLE_TRANSPORT_FAILURE(ret);
     HANDLE_STATUS_HIDL(status) << "model preparation failed with " << toString(status);
 
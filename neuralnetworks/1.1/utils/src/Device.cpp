@@ -32,6 +32,7 @@
 #include <nnapi/hal/1.0/HandleError.h>
 #include <nnapi/hal/1.0/ProtectCallback.h>
 #include <nnapi/hal/CommonUtils.h>
+#include <nnapi/hal/ConvertedModelCache.h>
 
 #include <functional>
 #include <memory>
@@ -130,11 +131,12 @@ nn::GeneralResult<std::vector<bool>> Device::getSupportedOperations(const nn::Mo
     const nn::Model& modelInShared =
             NN_TRY(hal::utils::flushDataFromPointerToShared(&model, &maybeModelInShared));
 
-    const auto hidlModel = NN_TRY(convert(modelInShared));
+    const auto hidlModel = NN_TRY(hal::utils::convertModelCached(
+            modelInShared, [](const nn::Model& m) { return convert(m); }));
 
     auto cb = hal::utils::CallbackValue(V1_0::utils::supportedOperationsCallback);
 
-    const auto ret = kDevice->getSupportedOperations_1_1(hidlModel, cb);
+    const auto ret = kDevice->getSupportedOperations_1_1(*hidlModel, cb);
     HANDLE_TRANSPORT_FAILURE(ret);
 
     return cb.take();
@@ -151,13 +153,14 @@ nn::GeneralResult<nn::SharedPreparedModel> Device::prepareModel(
     const nn::Model& modelInShared =
             NN_TRY(hal::utils::flushDataFromPointerToShared(&model, &maybeModelInShared));
 
-    const auto hidlModel = NN_TRY(convert(modelInShared));
+    const auto hidlModel = NN_TRY(hal::utils::convertModelCached(
+            modelInShared, [](const nn::Model& m) { return convert(m); }));
     const auto hidlPreference = NN_TRY(convert(preference));
 
     const auto cb = sp<V1_0::utils::PreparedModelCallback>::make();
     const auto scoped = kDeathHandler.protectCallback(cb.get());
 
-    const auto ret = kDevice->prepareModel_1_1(hidlModel, hidlPreference, cb);
+    const auto ret = kDevice->prepareModel_1_1(*hidlModel, hidlPreference, cb);
     const auto status = HANDLE_TRANSPORT_FAILURE(ret);
     HANDLE_STATUS_HIDL(status) << "model preparation failed with " << toString(status);
 
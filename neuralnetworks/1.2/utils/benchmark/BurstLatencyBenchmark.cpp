@@ -0,0 +1,201 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Measures the round-trip latency of the 1.2 burst FMQ channels: the controller serializes and
+// sends a request, an echo server thread receives it, optionally simulates an execution, and sends
+// the result back. The fixed and adaptive polling policies are run back to back with the same
+// maximum polling time window, and the p50/p99 latencies and the CPU time spent are reported.
+//
+// Usage: neuralnetworks_utils_hal_1_2_burst_latency_benchmark [-n iterations] [-w windowUs]
+//                                                             [-e executionUs] [-g gapUs]
+//                                                             [-m fixed|adaptive|both]
+
+#include <android/hardware/neuralnetworks/1.0/types.h>
+#include <android/hardware/neuralnetworks/1.2/types.h>
+#include <nnapi/hal/1.2/BurstUtils.h>
+
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/resource.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <limits>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+namespace V1_0 = ::android::hardware::neuralnetworks::V1_0;
+namespace V1_2 = ::android::hardware::neuralnetworks::V1_2;
+using Clock = std::chrono::steady_clock;
+
+constexpr V1_2::Timing kNoTiming = {std::numeric_limits<uint64_t>::max(),
+                                    std::numeric_limits<uint64_t>::max()};
+
+struct Options {
+    int iterations = 10000;
+    std::chrono::microseconds pollingTimeWindow{200};
+    std::chrono::microseconds executionTime{50};
+    std::chrono::microseconds interRequestGap{0};
+};
+
+// Busy-waits so that the simulated execution does not itself go through the scheduler.
+void spinFor(std::chrono::microseconds duration) {
+    const auto end = Clock::now() + duration;
+    while (Clock::now() < end) {
+    }
+}
+
+double getCpuTimeMs() {
+    struct rusage usage = {};
+    getrusage(RUSAGE_SELF, &usage);
+    const auto toMs = [](const timeval& tv) { return tv.tv_sec * 1e3 + tv.tv_usec / 1e3; };
+    return toMs(usage.ru_utime) + toMs(usage.ru_stime);
+}
+
+double percentile(const std::vector<double>& sorted, double p) {
+    const size_t index = std::min(sorted.size() - 1, static_cast<size_t>(p * sorted.size()));
+    return sorted[index];
+}
+
+int run(bool adaptive, const Options& options) {
+    auto [requestSender, requestDescriptor] =
+            V1_2::utils::RequestChannelSender::create(V1_2::utils::kExecutionBurstChannelLength)
+                    .value();
+    auto [resultReceiver, resultDescriptor] =
+            V1_2::utils::ResultChannelReceiver::create(V1_2::utils::kExecutionBurstChannelLength,
+                                                       options.pollingTimeWindow, adaptive)
+                    .value();
+    auto requestReceiver = V1_2::utils::RequestChannelReceiver::create(
+                                   *requestDescriptor, options.pollingTimeWindow, adaptive)
+                                   .value();
+    auto resultSender = V1_2::utils::ResultChannelSender::create(*resultDescriptor).value();
+
+    std::thread server([&requestReceiver = *requestReceiver, &resultSender = *resultSender,
+                        executionTime = options.executionTime] {
+        const std::vector<V1_2::OutputShape> outputShapes = {{.dimensions = {1},
+                                                              .isSufficient = true}};
+        while (requestReceiver.getBlocking().has_value()) {
+            spinFor(executionTime);
+            resultSender.send(V1_0::ErrorStatus::NONE, outputShapes, kNoTiming);
+        }
+    });
+
+    const V1_0::Request request = {
+            .inputs = {{.hasNoValue = false,
+                        .location = {.poolIndex = 0, .offset = 0, .length = 4},
+                        .dimensions = {1}}},
+            .outputs = {{.hasNoValue = false,
+                         .location = {.poolIndex = 1, .offset = 0, .length = 4},
+                         .dimensions = {1}}},
+            .pools = {}};
+    const std::vector<int32_t> slots = {0, 1};
+    std::vector<V1_2::FmqRequestDatum> requestPacket;
+
+    std::vector<double> latenciesUs;
+    latenciesUs.reserve(options.iterations);
+    const double cpuTimeStartMs = getCpuTimeMs();
+    int ret = 0;
+    for (int i = 0; i < options.iterations; ++i) {
+        if (options.interRequestGap.count() > 0) {
+            std::this_thread::sleep_for(options.interRequestGap);
+        }
+        const auto start = Clock::now();
+        V1_2::utils::serialize(request, V1_2::MeasureTiming::NO, slots, &requestPacket);
+        if (!requestSender->sendPacket(requestPacket).ok() ||
+            !resultReceiver->getBlocking().has_value()) {
+            fprintf(stderr, "burst round trip failed\n");
+            ret = 1;
+            break;
+        }
+        latenciesUs.push_back(
+                std::chrono::duration<double, std::micro>(Clock::now() - start).count());
+    }
+    const double cpuTimeMs = getCpuTimeMs() - cpuTimeStartMs;
+
+    requestReceiver->invalidate();
+    server.join();
+    if (ret != 0) {
+        return ret;
+    }
+
+    std::sort(latenciesUs.begin(), latenciesUs.end());
+    printf("%-8s iterations %d, latency p50 %.1f us, p99 %.1f us, max %.1f us, cpu %.1f ms\n",
+           adaptive ? "adaptive" : "fixed", options.iterations, percentile(latenciesUs, 0.50),
+           percentile(latenciesUs, 0.99), latenciesUs.back(), cpuTimeMs);
+    return 0;
+}
+
+void usage(const char* name) {
+    fprintf(stderr,
+            "Usage: %s [-n iterations] [-w windowUs] [-e executionUs] [-g gapUs] "
+            "[-m fixed|adaptive|both]\n",
+            name);
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    Options options;
+    std::string mode = "both";
+
+    int opt;
+    while ((opt = getopt(argc, argv, "n:w:e:g:m:h")) != -1) {
+        switch (opt) {
+            case 'n':
+                options.iterations = atoi(optarg);
+                break;
+            case 'w':
+                options.pollingTimeWindow = std::chrono::microseconds(atoi(optarg));
+                break;
+            case 'e':
+                options.executionTime = std::chrono::microseconds(atoi(optarg));
+                break;
+            case 'g':
+                options.interRequestGap = std::chrono::microseconds(atoi(optarg));
+                break;
+            case 'm':
+                mode = optarg;
+                break;
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+    if (options.iterations <= 0 || options.pollingTimeWindow.count() < 0 ||
+        options.executionTime.count() < 0 || options.interRequestGap.count() < 0 ||
+        (mode != "fixed" && mode != "adaptive" && mode != "both")) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    printf("Burst round trip, polling window %lld us, execution %lld us, gap %lld us\n",
+           static_cast<long long>(options.pollingTimeWindow.count()),
+           static_cast<long long>(options.executionTime.count()),
+           static_cast<long long>(options.interRequestGap.count()));
+    int ret = 0;
+    if (mode == "fixed" || mode == "both") {
+        ret |= run(/*adaptive=*/false, options);
+    }
+    if (mode == "adaptive" || mode == "both") {
+        ret |= run(/*adaptive=*/true, options);
+    }
+    return ret;
+}
@@ -189,7 +189,14 @@ class Burst final : public nn::IBurst, public std::enable_shared_from_this<Burst
             const hal::utils::RequestRelocation& relocation, FallbackFunction fallback) const;
 
   private:
+    // Same as executeInternal, for callers which already set mExecutionInFlight.
+    nn::ExecutionResult<std::pair<std::vector<nn::OutputShape>, nn::Timing>> executeLocked(
+            const std::vector<FmqRequestDatum>& requestPacket,
+            const hal::utils::RequestRelocation& relocation, FallbackFunction fallback) const;
+
     mutable std::atomic_flag mExecutionInFlight = ATOMIC_FLAG_INIT;
+    // Request packet storage reused by execute. Only accessed while mExecutionInFlight is set.
+    mutable std::vector<FmqRequestDatum> mRequestPacket;
     const nn::SharedPreparedModel kPreparedModel;
     const std::unique_ptr<RequestChannelSender> mRequestChannelSender;
     const std::unique_ptr<ResultChannelReceiver> mResultChannelReceiver;
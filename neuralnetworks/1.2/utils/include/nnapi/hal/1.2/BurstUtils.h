@@ -28,6 +28,7 @@
 #include <atomic>
 #include <chrono>
 #include <memory>
+#include <optional>
 #include <tuple>
 #include <utility>
 #include <vector>
@@ -57,6 +58,47 @@ std::chrono::microseconds getBurstControllerPollingTimeWindow();
  */
 std::chrono::microseconds getBurstServerPollingTimeWindow();
 
+/**
+ * BurstPollingPolicy decides how long a burst channel receiver polls the FMQ before waiting on the
+ * blocking futex.
+ *
+ * In adaptive mode, the policy keeps an exponentially weighted moving average of how long the
+ * receiver waited for each packet (the time between requests on the server side, the execution
+ * latency on the controller side) and only polls for a small multiple of it, bounded by the maximum
+ * polling time window. When packets typically take longer than the maximum polling time window to
+ * arrive, polling is skipped altogether because it would only spend power before falling back to
+ * the futex, except for a periodic probe at the maximum polling time window. Each wait time is
+ * clamped to twice the maximum polling time window, so the policy recovers within a few packets
+ * after an idle period. In fixed mode, the receiver always polls for the maximum polling time
+ * window.
+ *
+ * This class is not thread-safe. It is meant to be used by the single thread receiving packets.
+ */
+class BurstPollingPolicy final {
+  public:
+    BurstPollingPolicy(std::chrono::microseconds maxPollingTimeWindow, bool adaptive);
+
+    /**
+     * Get how long the receiver should poll for the next packet.
+     *
+     * @return Polling time in microseconds.
+     */
+    std::chrono::microseconds getPollingTimeWindow() const;
+
+    /**
+     * Record how long the receiver waited for a packet.
+     *
+     * @param waitTime Time between starting to wait for the packet and receiving it.
+     */
+    void update(std::chrono::microseconds waitTime);
+
+  private:
+    const std::chrono::microseconds kMaxPollingTimeWindow;
+    const bool kAdaptive;
+    std::optional<double> mAverageWaitTimeUs;
+    uint32_t mNumPacketsWithoutPolling = 0;
+};
+
 /**
  * Function to serialize a request.
  *
@@ -68,6 +110,20 @@ std::chrono::microseconds getBurstServerPollingTimeWindow();
 std::vector<FmqRequestDatum> serialize(const V1_0::Request& request, MeasureTiming measure,
                                        const std::vector<int32_t>& slots);
 
+/**
+ * Function to serialize a request into an existing packet.
+ *
+ * The packet is cleared before being filled, but its storage is reused, so serializing many
+ * requests into the same packet does not allocate once the packet has grown large enough.
+ *
+ * @param request Request object without the pool information.
+ * @param measure Whether to collect timing information for the execution.
+ * @param memoryIds Slot identifiers corresponding to memory resources for the request.
+ * @param packet Output serialized FMQ request data.
+ */
+void serialize(const V1_0::Request& request, MeasureTiming measure,
+               const std::vector<int32_t>& slots, std::vector<FmqRequestDatum>* packet);
+
 /**
  * Deserialize the FMQ request data.
  *
@@ -92,6 +148,19 @@ nn::Result<std::tuple<V1_0::Request, std::vector<int32_t>, MeasureTiming>> deser
 std::vector<FmqResultDatum> serialize(V1_0::ErrorStatus errorStatus,
                                       const std::vector<OutputShape>& outputShapes, Timing timing);
 
+/**
+ * Function to serialize results into an existing packet.
+ *
+ * The packet is cleared before being filled, but its storage is reused.
+ *
+ * @param errorStatus Status of the execution.
+ * @param outputShapes Dynamic shapes of the output tensors.
+ * @param timing Timing information of the execution.
+ * @param packet Output serialized FMQ result data.
+ */
+void serialize(V1_0::ErrorStatus errorStatus, const std::vector<OutputShape>& outputShapes,
+               Timing timing, std::vector<FmqResultDatum>* packet);
+
 /**
  * Deserialize the FMQ result data.
  *
@@ -168,11 +237,13 @@ class RequestChannelReceiver final {
      * @param pollingTimeWindow How much time (in microseconds) the RequestChannelReceiver is
      *     allowed to poll the FMQ before waiting on the blocking futex. Polling may result in lower
      *     latencies at the potential cost of more power usage.
+     * @param adaptivePolling Whether to adapt the polling time to the observed time between
+     *     requests, see BurstPollingPolicy. pollingTimeWindow is then the upper bound.
      * @return RequestChannelReceiver on successful creation, nullptr otherwise.
      */
     static nn::GeneralResult<std::unique_ptr<RequestChannelReceiver>> create(
             const MQDescriptorSync<FmqRequestDatum>& requestChannel,
-            std::chrono::microseconds pollingTimeWindow);
+            std::chrono::microseconds pollingTimeWindow, bool adaptivePolling = true);
 
     /**
      * Get the request from the channel.
@@ -194,14 +265,16 @@ class RequestChannelReceiver final {
 
     RequestChannelReceiver(PrivateConstructorTag tag,
                            const MQDescriptorSync<FmqRequestDatum>& requestChannel,
-                           std::chrono::microseconds pollingTimeWindow);
+                           std::chrono::microseconds pollingTimeWindow, bool adaptivePolling);
 
   private:
-    nn::Result<std::vector<FmqRequestDatum>> getPacketBlocking();
+    nn::Result<void> getPacketBlocking(std::vector<FmqRequestDatum>* packet);
 
     MessageQueue<FmqRequestDatum, kSynchronizedReadWrite> mFmqRequestChannel;
     std::atomic<bool> mTeardown{false};
-    const std::chrono::microseconds kPollingTimeWindow;
+    BurstPollingPolicy mPollingPolicy;
+    // Reused across calls to getBlocking to avoid reallocating the packet for every request.
+    std::vector<FmqRequestDatum> mPacket;
 };
 
 /**
@@ -239,6 +312,8 @@ class ResultChannelSender final {
 
   private:
     MessageQueue<FmqResultDatum, kSynchronizedReadWrite> mFmqResultChannel;
+    // Reused across calls to send to avoid reallocating the packet for every result.
+    std::vector<FmqResultDatum> mPacket;
 };
 
 /**
@@ -259,12 +334,15 @@ class ResultChannelReceiver final : public neuralnetworks::utils::IProtectedCall
      * @param pollingTimeWindow How much time (in microseconds) the ResultChannelReceiver is allowed
      *     to poll the FMQ before waiting on the blocking futex. Polling may result in lower
      *     latencies at the potential cost of more power usage.
+     * @param adaptivePolling Whether to adapt the polling time to the observed execution latency,
+     *     see BurstPollingPolicy. pollingTimeWindow is then the upper bound.
      * @return A pair of ResultChannelReceiver and the FMQ descriptor on successful creation, or
      *     GeneralError otherwise.
      */
     static nn::GeneralResult<std::pair<std::unique_ptr<ResultChannelReceiver>,
                                        const MQDescriptorSync<FmqResultDatum>*>>
-    create(size_t channelLength, std::chrono::microseconds pollingTimeWindow);
+    create(size_t channelLength, std::chrono::microseconds pollingTimeWindow,
+           bool adaptivePolling = true);
 
     /**
      * Get the result from the channel.
@@ -288,12 +366,16 @@ class ResultChannelReceiver final : public neuralnetworks::utils::IProtectedCall
     nn::Result<std::vector<FmqResultDatum>> getPacketBlocking();
 
     ResultChannelReceiver(PrivateConstructorTag tag, size_t channelLength,
-                          std::chrono::microseconds pollingTimeWindow);
+                          std::chrono::microseconds pollingTimeWindow, bool adaptivePolling);
 
   private:
+    nn::Result<void> getPacketBlocking(std::vector<FmqResultDatum>* packet);
+
     MessageQueue<FmqResultDatum, kSynchronizedReadWrite> mFmqResultChannel;
     std::atomic<bool> mValid{true};
-    const std::chrono::microseconds kPollingTimeWindow;
+    BurstPollingPolicy mPollingPolicy;
+    // Reused across calls to getBlocking to avoid reallocating the packet for every result.
+    std::vector<FmqResultDatum> mPacket;
 };
 
 }  // namespace android::hardware::neuralnetworks::V1_2::utils
@@ -344,12 +344,20 @@ nn::ExecutionResult<std::pair<std::vector<nn::OutputShape>, nn::Timing>> Burst::
         holds.push_back(std::move(hold));
     }
 
+    // Ensure that at most one execution is in flight at any given time. This also guards the
+    // packet storage, which is reused across executions.
+    const bool alreadyInFlight = mExecutionInFlight.test_and_set();
+    if (alreadyInFlight) {
+        return NN_ERROR() << "IBurst already has an execution in flight";
+    }
+    const auto guard = base::make_scope_guard([this] { mExecutionInFlight.clear(); });
+
     // send request packet
-    const auto requestPacket = serialize(hidlRequest, hidlMeasure, slots);
+    serialize(hidlRequest, hidlMeasure, slots, &mRequestPacket);
     const auto fallback = [this, &request, measure, &deadline, &loopTimeoutDuration] {
         return kPreparedModel->execute(request, measure, deadline, loopTimeoutDuration, {}, {});
     };
-    return executeInternal(requestPacket, relocation, fallback);
+    return executeLocked(mRequestPacket, relocation, fallback);
 }
 
 // See IBurst::createReusableExecution for information on this method.
@@ -407,7 +415,12 @@ nn::ExecutionResult<std::pair<std::vector<nn::OutputShape>, nn::Timing>> Burst::
         return NN_ERROR() << "IBurst already has an execution in flight";
     }
     const auto guard = base::make_scope_guard([this] { mExecutionInFlight.clear(); });
+    return executeLocked(requestPacket, relocation, std::move(fallback));
+}
 
+nn::ExecutionResult<std::pair<std::vector<nn::OutputShape>, nn::Timing>> Burst::executeLocked(
+        const std::vector<FmqRequestDatum>& requestPacket,
+        const hal::utils::RequestRelocation& relocation, FallbackFunction fallback) const {
     if (relocation.input) {
         relocation.input->flush();
     }
@@ -27,9 +27,11 @@
 #include <nnapi/Types.h>
 #include <nnapi/hal/1.0/ProtectCallback.h>
 
+#include <algorithm>
 #include <atomic>
 #include <chrono>
 #include <memory>
+#include <optional>
 #include <thread>
 #include <tuple>
 #include <utility>
@@ -41,6 +43,22 @@ namespace {
 constexpr V1_2::Timing kNoTiming = {std::numeric_limits<uint64_t>::max(),
                                     std::numeric_limits<uint64_t>::max()};
 
+// Weight of the newest wait time in the moving average of BurstPollingPolicy.
+constexpr double kPollingWaitTimeWeight = 0.125;
+
+// BurstPollingPolicy polls for this multiple of the average wait time, which leaves room for the
+// jitter of the wait time around its average.
+constexpr double kPollingTimeHeadroom = 2.0;
+
+// Wait times are clamped to this multiple of the maximum polling time window before entering the
+// moving average, so that a single long idle period cannot disable polling for many packets.
+constexpr double kMaxWaitTimeSample = 2.0;
+
+// While polling is skipped, BurstPollingPolicy still polls for the maximum polling time window
+// once every this many packets. The futex wakeup latency is part of the wait times measured without
+// polling, so this is how the policy finds out that packets arrive quickly again.
+constexpr uint32_t kPollingReprobeInterval = 64;
+
 std::chrono::microseconds getPollingTimeWindow(const std::string& property) {
     constexpr int32_t kDefaultPollingTimeWindow = 0;
 #ifdef NN_DEBUGGABLE
@@ -64,9 +82,65 @@ std::chrono::microseconds getBurstServerPollingTimeWindow() {
     return getPollingTimeWindow("debug.nn.burst-server-polling-window");
 }
 
+// BurstPollingPolicy methods
+
+BurstPollingPolicy::BurstPollingPolicy(std::chrono::microseconds maxPollingTimeWindow,
+                                       bool adaptive)
+    : kMaxPollingTimeWindow(maxPollingTimeWindow), kAdaptive(adaptive) {}
+
+std::chrono::microseconds BurstPollingPolicy::getPollingTimeWindow() const {
+    if (!kAdaptive || !mAverageWaitTimeUs.has_value()) {
+        return kMaxPollingTimeWindow;
+    }
+
+    // If packets usually arrive after the polling window has closed, polling is wasted power.
+    const double averageWaitTimeUs = mAverageWaitTimeUs.value();
+    if (averageWaitTimeUs > static_cast<double>(kMaxPollingTimeWindow.count())) {
+        return mNumPacketsWithoutPolling >= kPollingReprobeInterval ? kMaxPollingTimeWindow
+                                                                     : std::chrono::microseconds{0};
+    }
+
+    const auto pollingTimeWindow = std::chrono::microseconds(
+            static_cast<std::chrono::microseconds::rep>(averageWaitTimeUs * kPollingTimeHeadroom));
+    return std::min(pollingTimeWindow, kMaxPollingTimeWindow);
+}
+
+void BurstPollingPolicy::update(std::chrono::microseconds waitTime) {
+    if (!kAdaptive) {
+        return;
+    }
+    const double maxPollingTimeWindowUs = static_cast<double>(kMaxPollingTimeWindow.count());
+    const double waitTimeUs = std::min(static_cast<double>(waitTime.count()),
+                                       kMaxWaitTimeSample * maxPollingTimeWindowUs);
+    if (!mAverageWaitTimeUs.has_value()) {
+        mAverageWaitTimeUs = waitTimeUs;
+    } else {
+        mAverageWaitTimeUs = mAverageWaitTimeUs.value() +
+                             kPollingWaitTimeWeight * (waitTimeUs - mAverageWaitTimeUs.value());
+    }
+
+    // Count the packets received without polling. The count restarts after a probe.
+    if (mAverageWaitTimeUs.value() <= maxPollingTimeWindowUs ||
+        mNumPacketsWithoutPolling >= kPollingReprobeInterval) {
+        mNumPacketsWithoutPolling = 0;
+    } else {
+        mNumPacketsWithoutPolling++;
+    }
+}
+
 // serialize a request into a packet
 std::vector<FmqRequestDatum> serialize(const V1_0::Request& request, V1_2::MeasureTiming measure,
                                        const std::vector<int32_t>& slots) {
+    std::vector<FmqRequestDatum> data;
+    serialize(request, measure, slots, &data);
+    return data;
+}
+
+// serialize a request into an existing packet, reusing its storage
+void serialize(const V1_0::Request& request, V1_2::MeasureTiming measure,
+               const std::vector<int32_t>& slots, std::vector<FmqRequestDatum>* packet) {
+    CHECK(packet != nullptr);
+
     // count how many elements need to be sent for a request
     size_t count = 2 + request.inputs.size() + request.outputs.size() + slots.size();
     for (const auto& input : request.inputs) {
@@ -77,8 +151,9 @@ std::vector<FmqRequestDatum> serialize(const V1_0::Request& request, V1_2::Measu
     }
     CHECK_LE(count, std::numeric_limits<uint32_t>::max());
 
-    // create buffer to temporarily store elements
-    std::vector<FmqRequestDatum> data;
+    // reuse the buffer storing the elements
+    std::vector<FmqRequestDatum>& data = *packet;
+    data.clear();
     data.reserve(count);
 
     // package packetInfo
@@ -132,23 +207,31 @@ std::vector<FmqRequestDatum> serialize(const V1_0::Request& request, V1_2::Measu
     data.back().measureTiming(measure);
 
     CHECK_EQ(data.size(), count);
-
-    // return packet
-    return data;
 }
 
 // serialize result
 std::vector<FmqResultDatum> serialize(V1_0::ErrorStatus errorStatus,
                                       const std::vector<V1_2::OutputShape>& outputShapes,
                                       V1_2::Timing timing) {
+    std::vector<FmqResultDatum> data;
+    serialize(errorStatus, outputShapes, timing, &data);
+    return data;
+}
+
+// serialize result into an existing packet, reusing its storage
+void serialize(V1_0::ErrorStatus errorStatus, const std::vector<V1_2::OutputShape>& outputShapes,
+               V1_2::Timing timing, std::vector<FmqResultDatum>* packet) {
+    CHECK(packet != nullptr);
+
     // count how many elements need to be sent for a request
     size_t count = 2 + outputShapes.size();
     for (const auto& outputShape : outputShapes) {
         count += outputShape.dimensions.size();
     }
 
-    // create buffer to temporarily store elements
-    std::vector<FmqResultDatum> data;
+    // reuse the buffer storing the elements
+    std::vector<FmqResultDatum>& data = *packet;
+    data.clear();
     data.reserve(count);
 
     // package packetInfo
@@ -177,9 +260,6 @@ std::vector<FmqResultDatum> serialize(V1_0::ErrorStatus errorStatus,
     data.back().executionTiming(timing);
 
     CHECK_EQ(data.size(), count);
-
-    // return result
-    return data;
 }
 
 // deserialize request
@@ -463,9 +543,9 @@ void RequestChannelSender::notifyAsDeadObject() {
 
 nn::GeneralResult<std::unique_ptr<RequestChannelReceiver>> RequestChannelReceiver::create(
         const MQDescriptorSync<FmqRequestDatum>& requestChannel,
-        std::chrono::microseconds pollingTimeWindow) {
+        std::chrono::microseconds pollingTimeWindow, bool adaptivePolling) {
     auto requestChannelReceiver = std::make_unique<RequestChannelReceiver>(
-            PrivateConstructorTag{}, requestChannel, pollingTimeWindow);
+            PrivateConstructorTag{}, requestChannel, pollingTimeWindow, adaptivePolling);
 
     if (!requestChannelReceiver->mFmqRequestChannel.isValid()) {
         return NN_ERROR() << "Unable to create RequestChannelReceiver";
@@ -480,13 +560,13 @@ nn::GeneralResult<std::unique_ptr<RequestChannelReceiver>> RequestChannelReceive
 
 RequestChannelReceiver::RequestChannelReceiver(
         PrivateConstructorTag /*tag*/, const MQDescriptorSync<FmqRequestDatum>& requestChannel,
-        std::chrono::microseconds pollingTimeWindow)
-    : mFmqRequestChannel(requestChannel), kPollingTimeWindow(pollingTimeWindow) {}
+        std::chrono::microseconds pollingTimeWindow, bool adaptivePolling)
+    : mFmqRequestChannel(requestChannel), mPollingPolicy(pollingTimeWindow, adaptivePolling) {}
 
 nn::Result<std::tuple<V1_0::Request, std::vector<int32_t>, V1_2::MeasureTiming>>
 RequestChannelReceiver::getBlocking() {
-    const auto packet = NN_TRY(getPacketBlocking());
-    return deserialize(packet);
+    NN_TRY(getPacketBlocking(&mPacket));
+    return deserialize(mPacket);
 }
 
 void RequestChannelReceiver::invalidate() {
@@ -500,7 +580,7 @@ void RequestChannelReceiver::invalidate() {
     mFmqRequestChannel.writeBlocking(data.data(), data.size());
 }
 
-nn::Result<std::vector<FmqRequestDatum>> RequestChannelReceiver::getPacketBlocking() {
+nn::Result<void> RequestChannelReceiver::getPacketBlocking(std::vector<FmqRequestDatum>* packet) {
     if (mTeardown) {
         return NN_ERROR() << "FMQ object is being torn down";
     }
@@ -510,7 +590,12 @@ nn::Result<std::vector<FmqRequestDatum>> RequestChannelReceiver::getPacketBlocki
     // poll for a limited period of time.
 
     auto& getCurrentTime = std::chrono::high_resolution_clock::now;
-    const auto timeToStopPolling = getCurrentTime() + kPollingTimeWindow;
+    const auto timeToStartWaiting = getCurrentTime();
+    const auto timeToStopPolling = timeToStartWaiting + mPollingPolicy.getPollingTimeWindow();
+    const auto updatePollingPolicy = [this, timeToStartWaiting, &getCurrentTime] {
+        mPollingPolicy.update(std::chrono::duration_cast<std::chrono::microseconds>(
+                getCurrentTime() - timeToStartWaiting));
+    };
 
     while (getCurrentTime() < timeToStopPolling) {
         // if class is being torn down, immediately return
@@ -521,12 +606,13 @@ nn::Result<std::vector<FmqRequestDatum>> RequestChannelReceiver::getPacketBlocki
         // Check if data is available. If it is, immediately retrieve it and return.
         const size_t available = mFmqRequestChannel.availableToRead();
         if (available > 0) {
-            std::vector<FmqRequestDatum> packet(available);
-            const bool success = mFmqRequestChannel.readBlocking(packet.data(), available);
+            updatePollingPolicy();
+            packet->resize(available);
+            const bool success = mFmqRequestChannel.readBlocking(packet->data(), available);
             if (!success) {
                 return NN_ERROR() << "Error receiving packet";
             }
-            return packet;
+            return {};
         }
 
         std::this_thread::yield();
@@ -538,6 +624,7 @@ nn::Result<std::vector<FmqRequestDatum>> RequestChannelReceiver::getPacketBlocki
     // wait for request packet and read first element of request packet
     FmqRequestDatum datum;
     bool success = mFmqRequestChannel.readBlocking(&datum, 1);
+    updatePollingPolicy();
 
     // retrieve remaining elements
     // NOTE: all of the data is already available at this point, so there's no need to do a blocking
@@ -546,9 +633,9 @@ nn::Result<std::vector<FmqRequestDatum>> RequestChannelReceiver::getPacketBlocki
     // function call, so if the first element of the packet is available, the remaining elements are
     // also available.
     const size_t count = mFmqRequestChannel.availableToRead();
-    std::vector<FmqRequestDatum> packet(count + 1);
-    std::memcpy(&packet.front(), &datum, sizeof(datum));
-    success &= mFmqRequestChannel.read(packet.data() + 1, count);
+    packet->resize(count + 1);
+    std::memcpy(&packet->front(), &datum, sizeof(datum));
+    success &= mFmqRequestChannel.read(packet->data() + 1, count);
 
     // terminate loop
     if (mTeardown) {
@@ -560,7 +647,7 @@ nn::Result<std::vector<FmqRequestDatum>> RequestChannelReceiver::getPacketBlocki
         return NN_ERROR() << "Error receiving packet";
     }
 
-    return packet;
+    return {};
 }
 
 // ResultChannelSender methods
@@ -588,8 +675,8 @@ ResultChannelSender::ResultChannelSender(PrivateConstructorTag /*tag*/,
 void ResultChannelSender::send(V1_0::ErrorStatus errorStatus,
                                const std::vector<V1_2::OutputShape>& outputShapes,
                                V1_2::Timing timing) {
-    const std::vector<FmqResultDatum> serialized = serialize(errorStatus, outputShapes, timing);
-    sendPacket(serialized);
+    serialize(errorStatus, outputShapes, timing, &mPacket);
+    sendPacket(mPacket);
 }
 
 void ResultChannelSender::sendPacket(const std::vector<FmqResultDatum>& packet) {
@@ -613,9 +700,10 @@ void ResultChannelSender::sendPacket(const std::vector<FmqResultDatum>& packet)
 
 nn::GeneralResult<
         std::pair<std::unique_ptr<ResultChannelReceiver>, const MQDescriptorSync<FmqResultDatum>*>>
-ResultChannelReceiver::create(size_t channelLength, std::chrono::microseconds pollingTimeWindow) {
+ResultChannelReceiver::create(size_t channelLength, std::chrono::microseconds pollingTimeWindow,
+                              bool adaptivePolling) {
     auto resultChannelReceiver = std::make_unique<ResultChannelReceiver>(
-            PrivateConstructorTag{}, channelLength, pollingTimeWindow);
+            PrivateConstructorTag{}, channelLength, pollingTimeWindow, adaptivePolling);
     if (!resultChannelReceiver->mFmqResultChannel.isValid()) {
         return NN_ERROR() << "Unable to create ResultChannelReceiver";
     }
@@ -626,14 +714,15 @@ ResultChannelReceiver::create(size_t channelLength, std::chrono::microseconds po
 }
 
 ResultChannelReceiver::ResultChannelReceiver(PrivateConstructorTag /*tag*/, size_t channelLength,
-                                             std::chrono::microseconds pollingTimeWindow)
+                                             std::chrono::microseconds pollingTimeWindow,
+                                             bool adaptivePolling)
     : mFmqResultChannel(channelLength, /*configureEventFlagWord=*/true),
-      kPollingTimeWindow(pollingTimeWindow) {}
+      mPollingPolicy(pollingTimeWindow, adaptivePolling) {}
 
 nn::Result<std::tuple<V1_0::ErrorStatus, std::vector<V1_2::OutputShape>, V1_2::Timing>>
 ResultChannelReceiver::getBlocking() {
-    const auto packet = NN_TRY(getPacketBlocking());
-    return deserialize(packet);
+    NN_TRY(getPacketBlocking(&mPacket));
+    return deserialize(mPacket);
 }
 
 void ResultChannelReceiver::notifyAsDeadObject() {
@@ -648,6 +737,12 @@ void ResultChannelReceiver::notifyAsDeadObject() {
 }
 
 nn::Result<std::vector<FmqResultDatum>> ResultChannelReceiver::getPacketBlocking() {
+    std::vector<FmqResultDatum> packet;
+    NN_TRY(getPacketBlocking(&packet));
+    return packet;
+}
+
+nn::Result<void> ResultChannelReceiver::getPacketBlocking(std::vector<FmqResultDatum>* packet) {
     if (!mValid) {
         return NN_ERROR() << "FMQ object is invalid";
     }
@@ -657,7 +752,12 @@ nn::Result<std::vector<FmqResultDatum>> ResultChannelReceiver::getPacketBlocking
     // poll for a limited period of time.
 
     auto& getCurrentTime = std::chrono::high_resolution_clock::now;
-    const auto timeToStopPolling = getCurrentTime() + kPollingTimeWindow;
+    const auto timeToStartWaiting = getCurrentTime();
+    const auto timeToStopPolling = timeToStartWaiting + mPollingPolicy.getPollingTimeWindow();
+    const auto updatePollingPolicy = [this, timeToStartWaiting, &getCurrentTime] {
+        mPollingPolicy.update(std::chrono::duration_cast<std::chrono::microseconds>(
+                getCurrentTime() - timeToStartWaiting));
+    };
 
     while (getCurrentTime() < timeToStopPolling) {
         // if class is being torn down, immediately return
@@ -668,12 +768,13 @@ nn::Result<std::vector<FmqResultDatum>> ResultChannelReceiver::getPacketBlocking
         // Check if data is available. If it is, immediately retrieve it and return.
         const size_t available = mFmqResultChannel.availableToRead();
         if (available > 0) {
-            std::vector<FmqResultDatum> packet(available);
-            const bool success = mFmqResultChannel.readBlocking(packet.data(), available);
+            updatePollingPolicy();
+            packet->resize(available);
+            const bool success = mFmqResultChannel.readBlocking(packet->data(), available);
             if (!success) {
                 return NN_ERROR() << "Error receiving packet";
             }
-            return packet;
+            return {};
         }
 
         std::this_thread::yield();
@@ -685,6 +786,7 @@ nn::Result<std::vector<FmqResultDatum>> ResultChannelReceiver::getPacketBlocking
     // wait for result packet and read first element of result packet
     FmqResultDatum datum;
     bool success = mFmqResultChannel.readBlocking(&datum, 1);
+    updatePollingPolicy();
 
     // retrieve remaining elements
     // NOTE: all of the data is already available at this point, so there's no need to do a blocking
@@ -693,9 +795,9 @@ nn::Result<std::vector<FmqResultDatum>> ResultChannelReceiver::getPacketBlocking
     // function call, so if the first element of the packet is available, the remaining elements are
     // also available.
     const size_t count = mFmqResultChannel.availableToRead();
-    std::vector<FmqResultDatum> packet(count + 1);
-    std::memcpy(&packet.front(), &datum, sizeof(datum));
-    success &= mFmqResultChannel.read(packet.data() + 1, count);
+    packet->resize(count + 1);
+    std::memcpy(&packet->front(), &datum, sizeof(datum));
+    success &= mFmqResultChannel.read(packet->data() + 1, count);
 
     if (!mValid) {
         return NN_ERROR() << "FMQ object is invalid";
@@ -706,7 +808,7 @@ nn::Result<std::vector<FmqResultDatum>> ResultChannelReceiver::getPacketBlocking
         return NN_ERROR() << "Error receiving packet";
     }
 
-    return packet;
+    return {};
 }
 
 }  // namespace android::hardware::neuralnetworks::V1_2::utils
@@ -34,6 +34,7 @@
 #include <nnapi/hal/1.0/ProtectCallback.h>
 #include <nnapi/hal/1.1/Conversions.h>
 #include <nnapi/hal/CommonUtils.h>
+#include <nnapi/hal/ConvertedModelCache.h>
 
 #include <functional>
 #include <memory>
@@ -223,11 +224,12 @@ nn::GeneralResult<std::vector<bool>> Device::getSupportedOperations(const nn::Mo
     const nn::Model& modelInShared =
             NN_TRY(hal::utils::flushDataFromPointerToShared(&model, &maybeModelInShared));
 
-    const auto hidlModel = NN_TRY(convert(modelInShared));
+    const auto hidlModel = NN_TRY(hal::utils::convertModelCached(
+            modelInShared, [](const nn::Model& m) { return convert(m); }));
 
     auto cb = hal::utils::CallbackValue(V1_0::utils::supportedOperationsCallback);
 
-    const auto ret = kDevice->getSupportedOperations_1_2(hidlModel, cb);
+    const auto ret = kDevice->getSupportedOperations_1_2(*hidlModel, cb);
     HANDLE_TRANSPORT_FAILURE(ret);
 
     return cb.take();
@@ -244,7 +246,8 @@ nn::GeneralResult<nn::SharedPreparedModel> Device::prepareModel(
     const nn::Model& modelInShared =
             NN_TRY(hal::utils::flushDataFromPointerToShared(&model, &maybeModelInShared));
 
-    const auto hidlModel = NN_TRY(convert(modelInShared));
+    const auto hidlModel = NN_TRY(hal::utils::convertModelCached(
+            modelInShared, [](const nn::Model& m) { return convert(m); }));
     const auto hidlPreference = NN_TRY(convert(preference));
     const auto hidlModelCache = NN_TRY(convert(modelCache));
     const auto hidlDataCache = NN_TRY(convert(dataCache));
@@ -253,7 +256,7 @@ nn::GeneralResult<nn::SharedPreparedModel> Device::prepareModel(
     const auto cb = sp<PreparedModelCallback>::make();
     const auto scoped = kDeathHandler.protectCallback(cb.get());
 
-    const auto ret = kDevice->prepareModel_1_2(hidlModel, hidlPreference, hidlModelCache,
+    const auto ret = kDevice->prepareModel_1_2(*hidlModel, hidlPreference, hidlModelCache,
                                                hidlDataCache, hidlToken, cb);
     const auto status = HANDLE_TRANSPORT_FAILURE(ret);
     HANDLE_STATUS_HIDL(status) << "model preparation failed with " << toString(status);
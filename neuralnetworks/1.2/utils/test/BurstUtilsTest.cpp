@@ -0,0 +1,201 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <android/hardware/neuralnetworks/1.0/types.h>
+#include <android/hardware/neuralnetworks/1.2/types.h>
+#include <gtest/gtest.h>
+#include <nnapi/hal/1.2/BurstUtils.h>
+
+#include <chrono>
+#include <vector>
+
+namespace android::hardware::neuralnetworks::V1_2::utils {
+namespace {
+
+using std::chrono_literals::operator""us;
+
+constexpr auto kMaxPollingTimeWindow = 100us;
+constexpr V1_2::Timing kTiming = {.timeOnDevice = 1, .timeInDriver = 2};
+
+const V1_0::Request kRequest = {
+        .inputs = {{.hasNoValue = false,
+                    .location = {.poolIndex = 0, .offset = 0, .length = 4},
+                    .dimensions = {1}}},
+        .outputs = {{.hasNoValue = false,
+                     .location = {.poolIndex = 1, .offset = 0, .length = 4},
+                     .dimensions = {1}}},
+        .pools = {}};
+const std::vector<int32_t> kSlots = {3, 7};
+
+}  // namespace
+
+TEST(BurstUtilsTest, pollingPolicyFixedIgnoresWaitTime) {
+    // setup test
+    BurstPollingPolicy policy(kMaxPollingTimeWindow, /*adaptive=*/false);
+
+    // run test
+    policy.update(1us);
+
+    // verify result
+    EXPECT_EQ(policy.getPollingTimeWindow(), kMaxPollingTimeWindow);
+}
+
+TEST(BurstUtilsTest, pollingPolicyAdaptiveStartsAtMaximum) {
+    // setup test
+    const BurstPollingPolicy policy(kMaxPollingTimeWindow, /*adaptive=*/true);
+
+    // run test
+    const auto pollingTimeWindow = policy.getPollingTimeWindow();
+
+    // verify result
+    EXPECT_EQ(pollingTimeWindow, kMaxPollingTimeWindow);
+}
+
+TEST(BurstUtilsTest, pollingPolicyAdaptiveShrinksForShortWaits) {
+    // setup test
+    BurstPollingPolicy policy(kMaxPollingTimeWindow, /*adaptive=*/true);
+
+    // run test
+    for (int i = 0; i < 16; ++i) {
+        policy.update(10us);
+    }
+
+    // verify result
+    const auto pollingTimeWindow = policy.getPollingTimeWindow();
+    EXPECT_GE(pollingTimeWindow, 10us);
+    EXPECT_LT(pollingTimeWindow, kMaxPollingTimeWindow);
+}
+
+TEST(BurstUtilsTest, pollingPolicyAdaptiveSkipsPollingForLongWaits) {
+    // setup test
+    BurstPollingPolicy policy(kMaxPollingTimeWindow, /*adaptive=*/true);
+
+    // run test
+    for (int i = 0; i < 16; ++i) {
+        policy.update(10 * kMaxPollingTimeWindow);
+    }
+
+    // verify result
+    EXPECT_EQ(policy.getPollingTimeWindow(), 0us);
+}
+
+TEST(BurstUtilsTest, pollingPolicyAdaptiveRecovers) {
+    // setup test
+    BurstPollingPolicy policy(kMaxPollingTimeWindow, /*adaptive=*/true);
+    for (int i = 0; i < 16; ++i) {
+        policy.update(10 * kMaxPollingTimeWindow);
+    }
+    ASSERT_EQ(policy.getPollingTimeWindow(), 0us);
+
+    // run test
+    for (int i = 0; i < 64; ++i) {
+        policy.update(10us);
+    }
+
+    // verify result
+    EXPECT_GT(policy.getPollingTimeWindow(), 0us);
+}
+
+TEST(BurstUtilsTest, pollingPolicyAdaptiveClampsLongWaits) {
+    // setup test
+    BurstPollingPolicy policy(kMaxPollingTimeWindow, /*adaptive=*/true);
+    for (int i = 0; i < 64; ++i) {
+        policy.update(10us);
+    }
+
+    // run test
+    // A single idle period, e.g. the application pausing between frames.
+    policy.update(std::chrono::seconds(10));
+
+    // verify result
+    EXPECT_GT(policy.getPollingTimeWindow(), 0us);
+}
+
+TEST(BurstUtilsTest, pollingPolicyAdaptiveReprobes) {
+    // setup test
+    BurstPollingPolicy policy(kMaxPollingTimeWindow, /*adaptive=*/true);
+    policy.update(10 * kMaxPollingTimeWindow);
+    ASSERT_EQ(policy.getPollingTimeWindow(), 0us);
+
+    // run test
+    int numProbes = 0;
+    for (int i = 0; i < 256; ++i) {
+        if (policy.getPollingTimeWindow() == kMaxPollingTimeWindow) {
+            ++numProbes;
+        }
+        policy.update(10 * kMaxPollingTimeWindow);
+    }
+
+    // verify result
+    EXPECT_GE(numProbes, 3);
+    EXPECT_LE(numProbes, 4);
+}
+
+TEST(BurstUtilsTest, serializeRequestReusesPacket) {
+    // setup test
+    std::vector<FmqRequestDatum> packet;
+    serialize(kRequest, MeasureTiming::YES, kSlots, &packet);
+    const auto* data = packet.data();
+
+    // run test
+    serialize(kRequest, MeasureTiming::NO, kSlots, &packet);
+
+    // verify result
+    EXPECT_EQ(packet.data(), data);
+    const auto result = deserialize(packet);
+    ASSERT_TRUE(result.has_value()) << result.error();
+    const auto& [request, slots, measure] = result.value();
+    EXPECT_EQ(request.inputs, kRequest.inputs);
+    EXPECT_EQ(request.outputs, kRequest.outputs);
+    EXPECT_EQ(slots, kSlots);
+    EXPECT_EQ(measure, MeasureTiming::NO);
+}
+
+TEST(BurstUtilsTest, serializeRequestMatchesAllocatingSerialize) {
+    // setup test
+    std::vector<FmqRequestDatum> packet;
+    serialize(V1_0::Request{}, MeasureTiming::NO, {}, &packet);
+
+    // run test
+    serialize(kRequest, MeasureTiming::YES, kSlots, &packet);
+
+    // verify result
+    EXPECT_EQ(packet, serialize(kRequest, MeasureTiming::YES, kSlots));
+}
+
+TEST(BurstUtilsTest, serializeResultReusesPacket) {
+    // setup test
+    const std::vector<V1_2::OutputShape> outputShapes = {{.dimensions = {2, 3},
+                                                          .isSufficient = true}};
+    std::vector<FmqResultDatum> packet;
+    serialize(V1_0::ErrorStatus::NONE, outputShapes, kTiming, &packet);
+    const auto* data = packet.data();
+
+    // run test
+    serialize(V1_0::ErrorStatus::NONE, outputShapes, kTiming, &packet);
+
+    // verify result
+    EXPECT_EQ(packet.data(), data);
+    EXPECT_EQ(packet, serialize(V1_0::ErrorStatus::NONE, outputShapes, kTiming));
+    const auto result = deserialize(packet);
+    ASSERT_TRUE(result.has_value()) << result.error();
+    const auto& [status, shapes, timing] = result.value();
+    EXPECT_EQ(status, V1_0::ErrorStatus::NONE);
+    EXPECT_EQ(shapes, outputShapes);
+    EXPECT_EQ(timing, kTiming);
+}
+
+}  // namespace android::hardware::neuralnetworks::V1_2::utils
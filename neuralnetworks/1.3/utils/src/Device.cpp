@@ -40,6 +40,7 @@
 #include <nnapi/hal/1.2/Device.h>
 #include <nnapi/hal/1.2/Utils.h>
 #include <nnapi/hal/CommonUtils.h>
+#include <nnapi/hal/ConvertedModelCache.h>
 
 #include <any>
 #include <functional>
@@ -174,11 +175,12 @@ nn::GeneralResult<std::vector<bool>> Device::getSupportedOperations(const nn::Mo
     const nn::Model& modelInShared =
             NN_TRY(hal::utils::flushDataFromPointerToShared(&model, &maybeModelInShared));
 
-    const auto hidlModel = NN_TRY(convert(modelInShared));
+    const auto hidlModel = NN_TRY(hal::utils::convertModelCached(
+            modelInShared, [](const nn::Model& m) { return convert(m); }));
 
     auto cb = hal::utils::CallbackValue(supportedOperationsCallback);
 
-    const auto ret = kDevice->getSupportedOperations_1_3(hidlModel, cb);
+    const auto ret = kDevice->getSupportedOperations_1_3(*hidlModel, cb);
     HANDLE_TRANSPORT_FAILURE(ret);
 
     return cb.take();
@@ -195,7 +197,8 @@ nn::GeneralResult<nn::SharedPreparedModel> Device::prepareModel(
     const nn::Model& modelInShared =
             NN_TRY(hal::utils::flushDataFromPointerToShared(&model, &maybeModelInShared));
 
-    const auto hidlModel = NN_TRY(convert(modelInShared));
+    const auto hidlModel = NN_TRY(hal::utils::convertModelCached(
+            modelInShared, [](const nn::Model& m) { return convert(m); }));
     const auto hidlPreference = NN_TRY(convert(preference));
     const auto hidlPriority = NN_TRY(convert(priority));
     const auto hidlDeadline = NN_TRY(convert(deadline));
@@ -207,7 +210,7 @@ nn::GeneralResult<nn::SharedPreparedModel> Device::prepareModel(
     const auto scoped = kDeathHandler.protectCallback(cb.get());
 
     const auto ret =
-            kDevice->prepareModel_1_3(hidlModel, hidlPreference, hidlPriority, hidlDeadline,
+            kDevice->prepareModel_1_3(*hidlModel, hidlPreference, hidlPriority, hidlDeadline,
                                       hidlModelCache, hidlDataCache, hidlToken, cb);
     const auto status = HANDLE_TRANSPORT_FAILURE(ret);
     HANDLE_STATUS_HIDL(status) << "model preparation failed with " << toString(status);
@@ -0,0 +1,225 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Measures the cost of moving a model with a large constant operand from an NNAPI client to an
+// AIDL driver, as done by prepareModel: canonical -> AIDL conversion, parceling, unparceling and
+// AIDL -> canonical conversion on the driver side. Each mode runs in its own process so that the
+// reported peak RSS is not polluted by the other mode.
+//
+// Usage: neuralnetworks_utils_hal_aidl_model_transfer_benchmark [-s sizeMiB] [-n iterations]
+//                                                                [-m copy|relocate|both]
+
+#include <aidl/android/hardware/neuralnetworks/Model.h>
+#include <android/binder_parcel.h>
+#include <nnapi/SharedMemory.h>
+#include <nnapi/TypeUtils.h>
+#include <nnapi/Types.h>
+#include <nnapi/hal/aidl/Conversions.h>
+#include <nnapi/hal/aidl/Utils.h>
+
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <limits>
+#include <numeric>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace {
+
+namespace aidl_hal = ::aidl::android::hardware::neuralnetworks;
+namespace nn = ::android::nn;
+using Clock = std::chrono::steady_clock;
+
+enum class Mode { COPY, RELOCATE };
+
+const char* toString(Mode mode) {
+    return mode == Mode::COPY ? "copy" : "relocate";
+}
+
+// ADD(input, constant, activation) -> output
+nn::Model createModel(size_t constantLength) {
+    const auto numElements = static_cast<uint32_t>(constantLength / sizeof(float));
+    std::vector<float> constant(numElements);
+    std::iota(constant.begin(), constant.end(), 0.0f);
+    const int32_t activation = 0;
+
+    nn::Model model;
+    const auto constantLocation = model.operandValues.append(
+            reinterpret_cast<const uint8_t*>(constant.data()), numElements * sizeof(float));
+    const auto activationLocation = model.operandValues.append(
+            reinterpret_cast<const uint8_t*>(&activation), sizeof(activation));
+    model.main = {
+            .operands = {{.type = nn::OperandType::TENSOR_FLOAT32,
+                          .dimensions = {numElements},
+                          .lifetime = nn::Operand::LifeTime::SUBGRAPH_INPUT},
+                         {.type = nn::OperandType::TENSOR_FLOAT32,
+                          .dimensions = {numElements},
+                          .lifetime = nn::Operand::LifeTime::CONSTANT_COPY,
+                          .location = constantLocation},
+                         {.type = nn::OperandType::INT32,
+                          .lifetime = nn::Operand::LifeTime::CONSTANT_COPY,
+                          .location = activationLocation},
+                         {.type = nn::OperandType::TENSOR_FLOAT32,
+                          .dimensions = {numElements},
+                          .lifetime = nn::Operand::LifeTime::SUBGRAPH_OUTPUT}},
+            .operations = {{.type = nn::OperationType::ADD, .inputs = {0, 1, 2}, .outputs = {3}}},
+            .inputIndexes = {0},
+            .outputIndexes = {3},
+    };
+    return model;
+}
+
+// One client -> driver model transfer. Returns false on failure.
+bool transferModel(const nn::Model& model, Mode mode) {
+    // Client side.
+    const size_t threshold = mode == Mode::RELOCATE ? aidl_hal::utils::kLargeConstantCopyThreshold
+                                                    : std::numeric_limits<size_t>::max();
+    std::optional<nn::Model> maybeModelInShared;
+    const auto relocated =
+            aidl_hal::utils::relocateLargeConstantsToShared(model, &maybeModelInShared, threshold);
+    if (!relocated.has_value()) {
+        fprintf(stderr, "relocate failed: %s\n", relocated.error().message.c_str());
+        return false;
+    }
+    const auto aidlModel = aidl_hal::utils::convert(relocated.value().get());
+    if (!aidlModel.has_value()) {
+        fprintf(stderr, "convert failed: %s\n", aidlModel.error().message.c_str());
+        return false;
+    }
+
+    // Transport.
+    AParcel* parcel = AParcel_create();
+    aidl_hal::Model received;
+    bool ok = aidlModel.value().writeToParcel(parcel) == STATUS_OK &&
+              AParcel_setDataPosition(parcel, 0) == STATUS_OK &&
+              received.readFromParcel(parcel) == STATUS_OK;
+    AParcel_delete(parcel);
+    if (!ok) {
+        fprintf(stderr, "parceling failed\n");
+        return false;
+    }
+
+    // Driver side.
+    const auto canonical = nn::convert(received);
+    if (!canonical.has_value()) {
+        fprintf(stderr, "driver convert failed: %s\n", canonical.error().message.c_str());
+        return false;
+    }
+    for (const auto& pool : canonical.value().pools) {
+        if (!nn::map(pool).has_value()) {
+            fprintf(stderr, "driver failed to map pool\n");
+            return false;
+        }
+    }
+    return true;
+}
+
+int runMode(Mode mode, size_t constantLength, int iterations) {
+    const nn::Model model = createModel(constantLength);
+
+    std::vector<double> latenciesMs;
+    latenciesMs.reserve(iterations);
+    for (int i = 0; i < iterations; ++i) {
+        const auto start = Clock::now();
+        if (!transferModel(model, mode)) {
+            return 1;
+        }
+        latenciesMs.push_back(
+                std::chrono::duration<double, std::milli>(Clock::now() - start).count());
+    }
+
+    struct rusage usage = {};
+    getrusage(RUSAGE_SELF, &usage);
+    std::sort(latenciesMs.begin(), latenciesMs.end());
+    const double mean =
+            std::accumulate(latenciesMs.begin(), latenciesMs.end(), 0.0) / latenciesMs.size();
+    printf("%-8s iterations %d, latency mean %.2f ms, min %.2f ms, max %.2f ms, peak RSS %.1f MiB\n",
+           toString(mode), iterations, mean, latenciesMs.front(), latenciesMs.back(),
+           usage.ru_maxrss / 1024.0);
+    return 0;
+}
+
+int runModeInChild(Mode mode, size_t constantLength, int iterations) {
+    fflush(stdout);
+    const pid_t pid = fork();
+    if (pid < 0) {
+        perror("fork");
+        return 1;
+    }
+    if (pid == 0) {
+        _exit(runMode(mode, constantLength, iterations));
+    }
+    int status = 0;
+    if (waitpid(pid, &status, 0) < 0 || !WIFEXITED(status)) {
+        return 1;
+    }
+    return WEXITSTATUS(status);
+}
+
+void usage(const char* name) {
+    fprintf(stderr, "Usage: %s [-s sizeMiB] [-n iterations] [-m copy|relocate|both]\n", name);
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    size_t sizeMiB = 50;
+    int iterations = 10;
+    std::string mode = "both";
+
+    int opt;
+    while ((opt = getopt(argc, argv, "s:n:m:h")) != -1) {
+        switch (opt) {
+            case 's':
+                sizeMiB = strtoul(optarg, nullptr, 10);
+                break;
+            case 'n':
+                iterations = atoi(optarg);
+                break;
+            case 'm':
+                mode = optarg;
+                break;
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+    if (sizeMiB == 0 || iterations <= 0 ||
+        (mode != "copy" && mode != "relocate" && mode != "both")) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    const size_t constantLength = sizeMiB << 20;
+    printf("Model transfer with a %zu MiB CONSTANT_COPY operand\n", sizeMiB);
+    int ret = 0;
+    if (mode == "copy" || mode == "both") {
+        ret |= runModeInChild(Mode::COPY, constantLength, iterations);
+    }
+    if (mode == "relocate" || mode == "both") {
+        ret |= runModeInChild(Mode::RELOCATE, constantLength, iterations);
+    }
+    return ret;
+}
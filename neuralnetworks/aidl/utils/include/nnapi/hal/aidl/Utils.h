@@ -26,12 +26,18 @@
 #include <nnapi/Types.h>
 #include <nnapi/Validation.h>
 
+#include <functional>
+#include <optional>
 #include <type_traits>
 
 namespace aidl::android::hardware::neuralnetworks::utils {
 
 constexpr auto kDefaultPriority = Priority::MEDIUM;
 
+// CONSTANT_COPY operand values at least this large are moved to shared memory before a model is
+// sent across IPC, so that they are not copied into and out of the binder transaction.
+constexpr size_t kLargeConstantCopyThreshold = 64 * 1024;
+
 constexpr std::optional<nn::Version> aidlVersionToCanonicalVersion(int aidlVersion) {
     switch (aidlVersion) {
         case 1:
@@ -92,6 +98,18 @@ nn::GeneralResult<Request> clone(const Request& request);
 nn::GeneralResult<RequestMemoryPool> clone(const RequestMemoryPool& requestPool);
 nn::GeneralResult<Model> clone(const Model& model);
 
+/**
+ * Relocate CONSTANT_COPY operand values of at least `threshold` bytes into a single new shared
+ * memory pool, turning the operands into CONSTANT_REFERENCE.
+ *
+ * If the model has no such operands, the model itself is returned. Otherwise, the relocated model
+ * is stored in `maybeModelInShared` and a reference to it is returned. The relocated model only
+ * copies the small operand values, and shares the existing pools with the original model.
+ */
+nn::GeneralResult<std::reference_wrapper<const nn::Model>> relocateLargeConstantsToShared(
+        const nn::Model& model, std::optional<nn::Model>* maybeModelInShared,
+        size_t threshold = kLargeConstantCopyThreshold);
+
 nn::GeneralResult<void> handleTransportError(const ndk::ScopedAStatus& ret);
 
 #define HANDLE_ASTATUS(ret)                                            \
@@ -33,6 +33,7 @@
 #include <nnapi/Result.h>
 #include <nnapi/Types.h>
 #include <nnapi/hal/CommonUtils.h>
+#include <nnapi/hal/ConvertedModelCache.h>
 
 #include <any>
 #include <functional>
@@ -122,6 +123,14 @@ nn::GeneralResult<std::pair<uint32_t, uint32_t>> getNumberOfCacheFilesNeededFrom
     return std::make_pair(numberOfCacheFiles.numModelCache, numberOfCacheFiles.numDataCache);
 }
 
+// Converts a model whose data is already in shared memory to the form sent over the AIDL interface.
+nn::GeneralResult<Model> convertForIpc(const nn::Model& modelInShared) {
+    std::optional<nn::Model> maybeModelRelocated;
+    const nn::Model& modelRelocated =
+            NN_TRY(relocateLargeConstantsToShared(modelInShared, &maybeModelRelocated));
+    return convert(modelRelocated);
+}
+
 }  // namespace
 
 nn::GeneralResult<std::shared_ptr<const Device>> Device::create(
@@ -203,10 +212,10 @@ nn::GeneralResult<std::vector<bool>> Device::getSupportedOperations(const nn::Mo
     const nn::Model& modelInShared =
             NN_TRY(hal::utils::flushDataFromPointerToShared(&model, &maybeModelInShared));
 
-    const auto aidlModel = NN_TRY(convert(modelInShared));
+    const auto aidlModel = NN_TRY(hal::utils::convertModelCached(modelInShared, convertForIpc));
 
     std::vector<bool> supportedOperations;
-    const auto ret = kDevice->getSupportedOperations(aidlModel, &supportedOperations);
+    const auto ret = kDevice->getSupportedOperations(*aidlModel, &supportedOperations);
     HANDLE_ASTATUS(ret) << "getSupportedOperations failed";
 
     return supportedOperations;
@@ -223,7 +232,7 @@ nn::GeneralResult<nn::SharedPreparedModel> Device::prepareModel(
     const nn::Model& modelInShared =
             NN_TRY(hal::utils::flushDataFromPointerToShared(&model, &maybeModelInShared));
 
-    const auto aidlModel = NN_TRY(convert(modelInShared));
+    const auto aidlModel = NN_TRY(hal::utils::convertModelCached(modelInShared, convertForIpc));
     const auto aidlPreference = NN_TRY(convert(preference));
     const auto aidlPriority = NN_TRY(convert(priority));
     const auto aidlDeadline = NN_TRY(convert(deadline));
@@ -237,7 +246,7 @@ nn::GeneralResult<nn::SharedPreparedModel> Device::prepareModel(
         auto aidlHints = NN_TRY(convert(hints));
         auto aidlExtensionPrefix = NN_TRY(convert(extensionNameToPrefix));
         const auto ret = kDevice->prepareModelWithConfig(
-                aidlModel,
+                *aidlModel,
                 {aidlPreference, aidlPriority, aidlDeadline, std::move(aidlModelCache),
                  std::move(aidlDataCache), token, std::move(aidlHints),
                  std::move(aidlExtensionPrefix)},
@@ -246,7 +255,7 @@ nn::GeneralResult<nn::SharedPreparedModel> Device::prepareModel(
         return cb->get();
     }
     const auto aidlToken = NN_TRY(convert(token));
-    const auto ret = kDevice->prepareModel(aidlModel, aidlPreference, aidlPriority, aidlDeadline,
+    const auto ret = kDevice->prepareModel(*aidlModel, aidlPreference, aidlPriority, aidlDeadline,
                                            aidlModelCache, aidlDataCache, aidlToken, cb);
     HANDLE_ASTATUS(ret) << "prepareModel failed";
     return cb->get();
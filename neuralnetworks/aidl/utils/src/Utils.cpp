@@ -23,6 +23,13 @@
 #include <android/binder_status.h>
 #include <nnapi/Result.h>
 #include <nnapi/SharedMemory.h>
+#include <nnapi/TypeUtils.h>
+
+#include <algorithm>
+#include <cstring>
+#include <functional>
+#include <optional>
+#include <variant>
 
 namespace aidl::android::hardware::neuralnetworks::utils {
 namespace {
@@ -50,6 +57,13 @@ nn::GeneralResult<ndk::ScopedFileDescriptor> clone(const ndk::ScopedFileDescript
     return ndk::ScopedFileDescriptor(duplicatedFd.release());
 }
 
+// Alignment of each constant relocated to the shared memory pool.
+constexpr size_t kRelocatedConstantAlignment = 64;
+
+size_t alignUp(size_t value, size_t alignment) {
+    return (value + alignment - 1) / alignment * alignment;
+}
+
 nn::GeneralResult<common::NativeHandle> clone(const common::NativeHandle& handle) {
     auto fds = NN_TRY(cloneVec(handle.fds));
     return common::NativeHandle{
@@ -133,6 +147,78 @@ nn::GeneralResult<Model> clone(const Model& model) {
     };
 }
 
+nn::GeneralResult<std::reference_wrapper<const nn::Model>> relocateLargeConstantsToShared(
+        const nn::Model& model, std::optional<nn::Model>* maybeModelInShared, size_t threshold) {
+    CHECK(maybeModelInShared != nullptr);
+    const auto isLarge = [threshold](const nn::Operand& operand) {
+        return operand.lifetime == nn::Operand::LifeTime::CONSTANT_COPY &&
+               operand.location.length >= threshold;
+    };
+
+    size_t poolSize = 0;
+    const auto addToPoolSize = [&poolSize, &isLarge](const nn::Model::Subgraph& subgraph) {
+        for (const auto& operand : subgraph.operands) {
+            if (isLarge(operand)) {
+                poolSize = alignUp(poolSize, kRelocatedConstantAlignment) + operand.location.length;
+            }
+        }
+    };
+    addToPoolSize(model.main);
+    std::for_each(model.referenced.begin(), model.referenced.end(), addToPoolSize);
+    if (poolSize == 0) {
+        return std::cref(model);
+    }
+
+    auto memory = NN_TRY(nn::createSharedMemory(poolSize));
+    const auto mapping = NN_TRY(nn::map(memory));
+    if (!std::holds_alternative<void*>(mapping.pointer)) {
+        return NN_ERROR() << "relocateLargeConstantsToShared: shared memory is not writable";
+    }
+    auto* const poolData = static_cast<uint8_t*>(std::get<void*>(mapping.pointer));
+    const auto poolIndex = static_cast<uint32_t>(model.pools.size());
+
+    nn::Model::OperandValues operandValues;
+    size_t poolOffset = 0;
+    const auto relocate = [&](const nn::Model::Subgraph& subgraph) {
+        nn::Model::Subgraph relocated = subgraph;
+        for (auto& operand : relocated.operands) {
+            if (operand.lifetime != nn::Operand::LifeTime::CONSTANT_COPY) {
+                continue;
+            }
+            const uint8_t* data = model.operandValues.data() + operand.location.offset;
+            const uint32_t length = operand.location.length;
+            if (isLarge(operand)) {
+                poolOffset = alignUp(poolOffset, kRelocatedConstantAlignment);
+                std::memcpy(poolData + poolOffset, data, length);
+                operand.lifetime = nn::Operand::LifeTime::CONSTANT_REFERENCE;
+                operand.location = {.poolIndex = poolIndex,
+                                    .offset = static_cast<uint32_t>(poolOffset),
+                                    .length = length};
+                poolOffset += length;
+            } else {
+                operand.location = operandValues.append(data, length);
+            }
+        }
+        return relocated;
+    };
+
+    nn::Model relocated = {
+            .main = relocate(model.main),
+            .pools = model.pools,
+            .relaxComputationFloat32toFloat16 = model.relaxComputationFloat32toFloat16,
+            .extensionNameToPrefix = model.extensionNameToPrefix,
+    };
+    relocated.referenced.reserve(model.referenced.size());
+    for (const auto& subgraph : model.referenced) {
+        relocated.referenced.push_back(relocate(subgraph));
+    }
+    relocated.operandValues = std::move(operandValues);
+    relocated.pools.push_back(std::move(memory));
+
+    *maybeModelInShared = std::move(relocated);
+    return std::cref(maybeModelInShared->value());
+}
+
 nn::GeneralResult<void> handleTransportError(const ndk::ScopedAStatus& ret) {
     if (ret.getStatus() == STATUS_DEAD_OBJECT) {
         return nn::error(nn::ErrorStatus::DEAD_OBJECT)
@@ -0,0 +1,153 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+#include <nnapi/SharedMemory.h>
+#include <nnapi/TypeUtils.h>
+#include <nnapi/Types.h>
+#include <nnapi/Validation.h>
+#include <nnapi/hal/aidl/Conversions.h>
+#include <nnapi/hal/aidl/Utils.h>
+
+#include <cstring>
+#include <numeric>
+#include <optional>
+#include <variant>
+#include <vector>
+
+namespace aidl::android::hardware::neuralnetworks::utils {
+namespace {
+
+namespace nn = ::android::nn;
+
+constexpr size_t kLargeConstantLength = 4 * kLargeConstantCopyThreshold;
+constexpr int32_t kActivation = 0;
+
+// ADD(input, constant, activation) -> output
+nn::Model createAddModel(const std::vector<float>& constant) {
+    const auto numElements = static_cast<uint32_t>(constant.size());
+    nn::Model model;
+    const auto constantLocation = model.operandValues.append(
+            reinterpret_cast<const uint8_t*>(constant.data()), constant.size() * sizeof(float));
+    const auto activationLocation = model.operandValues.append(
+            reinterpret_cast<const uint8_t*>(&kActivation), sizeof(kActivation));
+    model.main = {
+            .operands = {{.type = nn::OperandType::TENSOR_FLOAT32,
+                          .dimensions = {numElements},
+                          .lifetime = nn::Operand::LifeTime::SUBGRAPH_INPUT},
+                         {.type = nn::OperandType::TENSOR_FLOAT32,
+                          .dimensions = {numElements},
+                          .lifetime = nn::Operand::LifeTime::CONSTANT_COPY,
+                          .location = constantLocation},
+                         {.type = nn::OperandType::INT32,
+                          .lifetime = nn::Operand::LifeTime::CONSTANT_COPY,
+                          .location = activationLocation},
+                         {.type = nn::OperandType::TENSOR_FLOAT32,
+                          .dimensions = {numElements},
+                          .lifetime = nn::Operand::LifeTime::SUBGRAPH_OUTPUT}},
+            .operations = {{.type = nn::OperationType::ADD, .inputs = {0, 1, 2}, .outputs = {3}}},
+            .inputIndexes = {0},
+            .outputIndexes = {3},
+    };
+    return model;
+}
+
+std::vector<float> createConstant(size_t length) {
+    std::vector<float> constant(length / sizeof(float));
+    std::iota(constant.begin(), constant.end(), 0.0f);
+    return constant;
+}
+
+}  // namespace
+
+TEST(UtilsTest, relocateLargeConstantsToSharedKeepsSmallConstants) {
+    // setup test
+    const auto constant = createConstant(kLargeConstantCopyThreshold / 2);
+    const auto model = createAddModel(constant);
+
+    // run test
+    std::optional<nn::Model> maybeModelInShared;
+    const auto result = relocateLargeConstantsToShared(model, &maybeModelInShared);
+
+    // verify result
+    ASSERT_TRUE(result.has_value())
+            << "Failed with " << result.error().code << ": " << result.error().message;
+    EXPECT_EQ(&result.value().get(), &model);
+    EXPECT_FALSE(maybeModelInShared.has_value());
+}
+
+TEST(UtilsTest, relocateLargeConstantsToShared) {
+    // setup test
+    const auto constant = createConstant(kLargeConstantLength);
+    const auto model = createAddModel(constant);
+
+    // run test
+    std::optional<nn::Model> maybeModelInShared;
+    const auto result = relocateLargeConstantsToShared(model, &maybeModelInShared);
+
+    // verify result
+    ASSERT_TRUE(result.has_value())
+            << "Failed with " << result.error().code << ": " << result.error().message;
+    const nn::Model& relocated = result.value();
+    ASSERT_TRUE(maybeModelInShared.has_value());
+    EXPECT_EQ(&relocated, &maybeModelInShared.value());
+    EXPECT_TRUE(nn::validate(relocated).has_value());
+
+    ASSERT_EQ(relocated.pools.size(), 1u);
+    const auto& relocatedConstant = relocated.main.operands[1];
+    EXPECT_EQ(relocatedConstant.lifetime, nn::Operand::LifeTime::CONSTANT_REFERENCE);
+    EXPECT_EQ(relocatedConstant.location.poolIndex, 0u);
+    EXPECT_EQ(relocatedConstant.location.length, kLargeConstantLength);
+
+    const auto mapping = nn::map(relocated.pools[0]);
+    ASSERT_TRUE(mapping.has_value());
+    const auto* poolData = std::visit(
+            [](auto* pointer) { return static_cast<const uint8_t*>(pointer); },
+            mapping.value().pointer);
+    EXPECT_EQ(std::memcmp(poolData + relocatedConstant.location.offset, constant.data(),
+                          kLargeConstantLength),
+              0);
+
+    // The small activation operand stays in the operand values.
+    const auto& activation = relocated.main.operands[2];
+    EXPECT_EQ(activation.lifetime, nn::Operand::LifeTime::CONSTANT_COPY);
+    ASSERT_EQ(activation.location.length, sizeof(kActivation));
+    int32_t activationValue = -1;
+    std::memcpy(&activationValue, relocated.operandValues.data() + activation.location.offset,
+                sizeof(activationValue));
+    EXPECT_EQ(activationValue, kActivation);
+    EXPECT_LT(relocated.operandValues.size(), kLargeConstantCopyThreshold);
+}
+
+TEST(UtilsTest, relocatedModelConvertsWithoutLargeOperandValues) {
+    // setup test
+    const auto constant = createConstant(kLargeConstantLength);
+    const auto model = createAddModel(constant);
+    std::optional<nn::Model> maybeModelInShared;
+    const auto relocated = relocateLargeConstantsToShared(model, &maybeModelInShared);
+    ASSERT_TRUE(relocated.has_value());
+
+    // run test
+    const auto result = convert(relocated.value().get());
+
+    // verify result
+    ASSERT_TRUE(result.has_value())
+            << "Failed with " << result.error().code << ": " << result.error().message;
+    EXPECT_LT(result.value().operandValues.size(), kLargeConstantCopyThreshold);
+    EXPECT_EQ(result.value().pools.size(), 1u);
+}
+
+}  // namespace aidl::android::hardware::neuralnetworks::utils
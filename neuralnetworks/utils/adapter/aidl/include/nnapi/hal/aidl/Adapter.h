@@ -29,6 +29,8 @@
 
 namespace aidl::android::hardware::neuralnetworks::adapter {
 
+class DeadlineExecutor;
+
 /**
  * A self-contained unit of work to be executed.
  */
@@ -43,6 +45,16 @@ using Task = std::function<void()>;
  */
 using Executor = std::function<void(Task, ::android::nn::OptionalTimePoint)>;
 
+/**
+ * A type-erased executor which executes a task asynchronously, and which is additionally provided
+ * the priority of the task.
+ *
+ * Tasks which are not associated with a priority (e.g., prepareModelFromCache) are given
+ * Priority::MEDIUM.
+ */
+using PriorityExecutor =
+        std::function<void(Task, ::android::nn::Priority, ::android::nn::OptionalTimePoint)>;
+
 /**
  * Adapt an NNAPI canonical interface object to a AIDL NN HAL interface object.
  *
@@ -55,7 +67,31 @@ std::shared_ptr<BnDevice> adapt(::android::nn::SharedDevice device, Executor exe
 /**
  * Adapt an NNAPI canonical interface object to a AIDL NN HAL interface object.
  *
- * This function uses a default executor, which will execute tasks from a detached thread.
+ * @param device NNAPI canonical IDevice interface object to be adapted.
+ * @param executor Type-erased priority-aware executor to handle executing tasks asynchronously.
+ * @return AIDL NN HAL IDevice interface object.
+ */
+std::shared_ptr<BnDevice> adapt(::android::nn::SharedDevice device, PriorityExecutor executor);
+
+/**
+ * Adapt an NNAPI canonical interface object to a AIDL NN HAL interface object.
+ *
+ * The stats of the executor are written by the dump() of the returned object, and can be read with
+ * DeadlineExecutor::getStats() by the caller.
+ *
+ * @param device NNAPI canonical IDevice interface object to be adapted.
+ * @param executor Executor to handle executing tasks asynchronously.
+ * @return AIDL NN HAL IDevice interface object.
+ */
+std::shared_ptr<BnDevice> adapt(::android::nn::SharedDevice device,
+                                std::shared_ptr<DeadlineExecutor> executor);
+
+/**
+ * Adapt an NNAPI canonical interface object to a AIDL NN HAL interface object.
+ *
+ * This function uses a default executor, which will execute tasks on a fixed pool of worker
+ * threads, earliest deadline first. See DeadlineExecutor. Its stats are written by the dump() of
+ * the returned object.
  *
  * @param device NNAPI canonical IDevice interface object to be adapted.
  * @return AIDL NN HAL IDevice interface object.
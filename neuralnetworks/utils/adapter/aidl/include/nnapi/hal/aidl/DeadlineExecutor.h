@@ -0,0 +1,110 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_HARDWARE_INTERFACES_NEURALNETWORKS_UTILS_ADAPTER_AIDL_DEADLINE_EXECUTOR_H
+#define ANDROID_HARDWARE_INTERFACES_NEURALNETWORKS_UTILS_ADAPTER_AIDL_DEADLINE_EXECUTOR_H
+
+#include "nnapi/hal/aidl/Adapter.h"
+
+#include <android-base/thread_annotations.h>
+#include <nnapi/Types.h>
+
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// See hardware/interfaces/neuralnetworks/utils/README.md for more information on AIDL interface
+// lifetimes across processes and for protecting asynchronous calls across AIDL.
+
+namespace aidl::android::hardware::neuralnetworks::adapter {
+
+/**
+ * An executor with a fixed pool of worker threads.
+ *
+ * Queued tasks are run earliest deadline first. Tasks without a deadline run after all tasks with
+ * a deadline. Ties are broken by priority, then by submission order.
+ */
+class DeadlineExecutor {
+  public:
+    struct Stats {
+        uint64_t numScheduled = 0;
+        uint64_t numExecuted = 0;
+        // Tasks which started running after their deadline had already passed.
+        uint64_t numStartedLate = 0;
+        size_t queueDepth = 0;
+        size_t maxQueueDepth = 0;
+        // Time between schedule() and the start of the task.
+        ::android::nn::Duration totalQueueLatency{};
+        ::android::nn::Duration maxQueueLatency{};
+    };
+
+    /**
+     * Create an executor with numThreads worker threads. A value of 0 selects the number of CPUs.
+     */
+    explicit DeadlineExecutor(size_t numThreads = 0);
+
+    /**
+     * Stops accepting tasks, runs the tasks which are still queued and joins the worker threads.
+     * Must not be called from one of the executor's own tasks.
+     */
+    ~DeadlineExecutor();
+
+    void schedule(Task task, ::android::nn::Priority priority,
+                  ::android::nn::OptionalTimePoint deadline);
+
+    Stats getStats() const;
+
+    /**
+     * Write the stats to fd in a human readable form.
+     */
+    void dump(int fd) const;
+
+    size_t getNumThreads() const { return mThreads.size(); }
+
+  private:
+    struct Entry {
+        Task task;
+        ::android::nn::Priority priority;
+        ::android::nn::OptionalTimePoint deadline;
+        ::android::nn::TimePoint scheduledTime;
+        uint64_t sequence;
+    };
+    // Orders a max-heap so that the front is the next task to run.
+    static bool runsAfter(const Entry& a, const Entry& b);
+
+    void workerLoop();
+
+    mutable std::mutex mMutex;
+    std::condition_variable mCondition;
+    std::vector<Entry> mQueue GUARDED_BY(mMutex);
+    bool mStopping GUARDED_BY(mMutex) = false;
+    uint64_t mNextSequence GUARDED_BY(mMutex) = 0;
+    Stats mStats GUARDED_BY(mMutex);
+    std::vector<std::thread> mThreads;
+};
+
+/**
+ * Create a PriorityExecutor which schedules tasks on the given DeadlineExecutor. The returned
+ * executor shares ownership of the DeadlineExecutor.
+ */
+PriorityExecutor makePriorityExecutor(std::shared_ptr<DeadlineExecutor> executor);
+
+}  // namespace aidl::android::hardware::neuralnetworks::adapter
+
+#endif  // ANDROID_HARDWARE_INTERFACES_NEURALNETWORKS_UTILS_ADAPTER_AIDL_DEADLINE_EXECUTOR_H
@@ -49,6 +49,8 @@ namespace aidl::android::hardware::neuralnetworks::adapter {
 class Device : public BnDevice {
   public:
     Device(::android::nn::SharedDevice device, Executor executor);
+    Device(::android::nn::SharedDevice device, PriorityExecutor executor);
+    Device(::android::nn::SharedDevice device, std::shared_ptr<DeadlineExecutor> executor);
 
     ndk::ScopedAStatus allocate(const BufferDesc& desc,
                                 const std::vector<IPreparedModelParcel>& preparedModels,
@@ -77,9 +79,13 @@ class Device : public BnDevice {
             const Model& model, const PrepareModelConfig& config,
             const std::shared_ptr<IPreparedModelCallback>& callback) override;
 
+    binder_status_t dump(int fd, const char** args, uint32_t numArgs) override;
+
   protected:
     const ::android::nn::SharedDevice kDevice;
-    const Executor kExecutor;
+    const PriorityExecutor kExecutor;
+    // Only set when kExecutor schedules on a DeadlineExecutor, whose stats are dumped.
+    const std::shared_ptr<DeadlineExecutor> kDeadlineExecutor;
 };
 
 }  // namespace aidl::android::hardware::neuralnetworks::adapter
@@ -16,6 +16,7 @@
 
 #include "Adapter.h"
 
+#include "DeadlineExecutor.h"
 #include "Device.h"
 
 #include <aidl/android/hardware/neuralnetworks/BnDevice.h>
@@ -25,7 +26,6 @@
 
 #include <functional>
 #include <memory>
-#include <thread>
 
 // See hardware/interfaces/neuralnetworks/utils/README.md for more information on AIDL interface
 // lifetimes across processes and for protecting asynchronous calls across AIDL.
@@ -36,11 +36,17 @@ std::shared_ptr<BnDevice> adapt(::android::nn::SharedDevice device, Executor exe
     return ndk::SharedRefBase::make<Device>(std::move(device), std::move(executor));
 }
 
+std::shared_ptr<BnDevice> adapt(::android::nn::SharedDevice device, PriorityExecutor executor) {
+    return ndk::SharedRefBase::make<Device>(std::move(device), std::move(executor));
+}
+
+std::shared_ptr<BnDevice> adapt(::android::nn::SharedDevice device,
+                                std::shared_ptr<DeadlineExecutor> executor) {
+    return ndk::SharedRefBase::make<Device>(std::move(device), std::move(executor));
+}
+
 std::shared_ptr<BnDevice> adapt(::android::nn::SharedDevice device) {
-    Executor defaultExecutor = [](Task task, ::android::nn::OptionalTimePoint /*deadline*/) {
-        std::thread(std::move(task)).detach();
-    };
-    return adapt(std::move(device), std::move(defaultExecutor));
+    return adapt(std::move(device), std::make_shared<DeadlineExecutor>());
 }
 
 }  // namespace aidl::android::hardware::neuralnetworks::adapter
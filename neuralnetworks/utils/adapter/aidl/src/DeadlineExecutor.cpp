@@ -0,0 +1,152 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "DeadlineExecutor.h"
+
+#include <android-base/logging.h>
+#include <nnapi/Types.h>
+#include <stdio.h>
+
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace aidl::android::hardware::neuralnetworks::adapter {
+
+DeadlineExecutor::DeadlineExecutor(size_t numThreads) {
+    if (numThreads == 0) {
+        numThreads = std::max(std::thread::hardware_concurrency(), 1u);
+    }
+    mThreads.reserve(numThreads);
+    for (size_t i = 0; i < numThreads; ++i) {
+        mThreads.emplace_back(&DeadlineExecutor::workerLoop, this);
+    }
+}
+
+DeadlineExecutor::~DeadlineExecutor() {
+    {
+        std::lock_guard guard(mMutex);
+        mStopping = true;
+    }
+    mCondition.notify_all();
+    for (auto& thread : mThreads) {
+        CHECK(thread.get_id() != std::this_thread::get_id())
+                << "DeadlineExecutor destroyed from one of its own tasks";
+        thread.join();
+    }
+}
+
+bool DeadlineExecutor::runsAfter(const Entry& a, const Entry& b) {
+    if (a.deadline != b.deadline) {
+        if (!a.deadline.has_value()) return true;
+        if (!b.deadline.has_value()) return false;
+        return *a.deadline > *b.deadline;
+    }
+    if (a.priority != b.priority) {
+        return a.priority < b.priority;
+    }
+    return a.sequence > b.sequence;
+}
+
+void DeadlineExecutor::schedule(Task task, ::android::nn::Priority priority,
+                                ::android::nn::OptionalTimePoint deadline) {
+    {
+        std::lock_guard guard(mMutex);
+        CHECK(!mStopping) << "DeadlineExecutor::schedule called after destruction started";
+        mQueue.push_back({.task = std::move(task),
+                          .priority = priority,
+                          .deadline = deadline,
+                          .scheduledTime = ::android::nn::Clock::now(),
+                          .sequence = mNextSequence++});
+        std::push_heap(mQueue.begin(), mQueue.end(), runsAfter);
+        mStats.numScheduled++;
+        mStats.maxQueueDepth = std::max(mStats.maxQueueDepth, mQueue.size());
+    }
+    mCondition.notify_one();
+}
+
+DeadlineExecutor::Stats DeadlineExecutor::getStats() const {
+    std::lock_guard guard(mMutex);
+    Stats stats = mStats;
+    stats.queueDepth = mQueue.size();
+    return stats;
+}
+
+void DeadlineExecutor::dump(int fd) const {
+    const Stats stats = getStats();
+    using std::chrono::microseconds;
+    const auto meanLatency = stats.numExecuted == 0
+                                     ? microseconds{}
+                                     : std::chrono::duration_cast<microseconds>(
+                                               stats.totalQueueLatency / stats.numExecuted);
+    const auto maxLatency = std::chrono::duration_cast<microseconds>(stats.maxQueueLatency);
+    dprintf(fd, "DeadlineExecutor: %zu threads\n", mThreads.size());
+    dprintf(fd, "  scheduled %llu, executed %llu, started late %llu\n",
+            static_cast<unsigned long long>(stats.numScheduled),
+            static_cast<unsigned long long>(stats.numExecuted),
+            static_cast<unsigned long long>(stats.numStartedLate));
+    dprintf(fd, "  queue depth %zu, max queue depth %zu\n", stats.queueDepth,
+            stats.maxQueueDepth);
+    dprintf(fd, "  queue latency mean %lld us, max %lld us\n",
+            static_cast<long long>(meanLatency.count()),
+            static_cast<long long>(maxLatency.count()));
+}
+
+void DeadlineExecutor::workerLoop() {
+    std::unique_lock lock(mMutex);
+    while (true) {
+        mCondition.wait(lock, [this]() REQUIRES(mMutex) { return mStopping || !mQueue.empty(); });
+        if (mQueue.empty()) {
+            // mStopping is set and all queued tasks have run.
+            return;
+        }
+
+        std::pop_heap(mQueue.begin(), mQueue.end(), runsAfter);
+        Entry entry = std::move(mQueue.back());
+        mQueue.pop_back();
+
+        const auto now = ::android::nn::Clock::now();
+        const auto queueLatency =
+                std::chrono::duration_cast<::android::nn::Duration>(now - entry.scheduledTime);
+        mStats.totalQueueLatency += queueLatency;
+        mStats.maxQueueLatency = std::max(mStats.maxQueueLatency, queueLatency);
+        if (entry.deadline.has_value() && now >= *entry.deadline) {
+            mStats.numStartedLate++;
+        }
+
+        lock.unlock();
+        entry.task();
+        // Release whatever the task captured before picking up the next one.
+        entry.task = nullptr;
+        lock.lock();
+
+        mStats.numExecuted++;
+    }
+}
+
+PriorityExecutor makePriorityExecutor(std::shared_ptr<DeadlineExecutor> executor) {
+    CHECK(executor != nullptr);
+    return [executor = std::move(executor)](Task task, ::android::nn::Priority priority,
+                                            ::android::nn::OptionalTimePoint deadline) {
+        executor->schedule(std::move(task), priority, deadline);
+    };
+}
+
+}  // namespace aidl::android::hardware::neuralnetworks::adapter
@@ -18,6 +18,7 @@
 
 #include "Adapter.h"
 #include "Buffer.h"
+#include "DeadlineExecutor.h"
 #include "PreparedModel.h"
 
 #include <aidl/android/hardware/neuralnetworks/BnDevice.h>
@@ -70,6 +71,18 @@ nn::GeneralResult<nn::OptionalTimePoint> makeOptionalTimePoint(int64_t durationN
     return durationNs < 0 ? nn::OptionalTimePoint{} : nn::TimePoint(makeDuration(durationNs));
 }
 
+bool hasDeadlinePassed(const nn::OptionalTimePoint& deadline) {
+    return deadline.has_value() && nn::Clock::now() >= *deadline;
+}
+
+PriorityExecutor ignorePriority(Executor executor) {
+    CHECK(executor != nullptr);
+    return [executor = std::move(executor)](Task task, nn::Priority /*priority*/,
+                                            nn::OptionalTimePoint deadline) {
+        executor(std::move(task), deadline);
+    };
+}
+
 nn::GeneralResult<nn::CacheToken> convertCacheToken(const std::vector<uint8_t>& token) {
     nn::CacheToken nnToken;
     if (token.size() != nnToken.size()) {
@@ -159,7 +172,7 @@ void notify(IPreparedModelCallback* callback, PrepareModelResult result) {
 }
 
 nn::GeneralResult<void> prepareModel(
-        const nn::SharedDevice& device, const Executor& executor, const Model& model,
+        const nn::SharedDevice& device, const PriorityExecutor& executor, const Model& model,
         ExecutionPreference preference, Priority priority, int64_t deadlineNs,
         const std::vector<ndk::ScopedFileDescriptor>& modelCache,
         const std::vector<ndk::ScopedFileDescriptor>& dataCache, const std::vector<uint8_t>& token,
@@ -174,6 +187,9 @@ nn::GeneralResult<void> prepareModel(
     const auto nnPreference = NN_TRY(convertInput(preference));
     const auto nnPriority = NN_TRY(convertInput(priority));
     const auto nnDeadline = NN_TRY(makeOptionalTimePoint(deadlineNs));
+    if (hasDeadlinePassed(nnDeadline)) {
+        return NN_ERROR(nn::ErrorStatus::MISSED_DEADLINE_TRANSIENT) << "Deadline has passed";
+    }
     auto nnModelCache = NN_TRY(convertInput(modelCache));
     auto nnDataCache = NN_TRY(convertInput(dataCache));
     const auto nnToken = NN_TRY(convertCacheToken(token));
@@ -184,18 +200,23 @@ nn::GeneralResult<void> prepareModel(
                  nnModelCache = std::move(nnModelCache), nnDataCache = std::move(nnDataCache),
                  nnToken, nnHints = std::move(nnHints),
                  nnExtensionNameToPrefix = std::move(nnExtensionNameToPrefix), callback] {
+        // The deadline may have passed while the task was queued.
+        if (hasDeadlinePassed(nnDeadline)) {
+            notify(callback.get(), ErrorStatus::MISSED_DEADLINE_TRANSIENT, nullptr);
+            return;
+        }
         auto result =
                 device->prepareModel(nnModel, nnPreference, nnPriority, nnDeadline, nnModelCache,
                                      nnDataCache, nnToken, nnHints, nnExtensionNameToPrefix);
         notify(callback.get(), std::move(result));
     };
-    executor(std::move(task), nnDeadline);
+    executor(std::move(task), nnPriority, nnDeadline);
 
     return {};
 }
 
 nn::GeneralResult<void> prepareModelFromCache(
-        const nn::SharedDevice& device, const Executor& executor, int64_t deadlineNs,
+        const nn::SharedDevice& device, const PriorityExecutor& executor, int64_t deadlineNs,
         const std::vector<ndk::ScopedFileDescriptor>& modelCache,
         const std::vector<ndk::ScopedFileDescriptor>& dataCache, const std::vector<uint8_t>& token,
         const std::shared_ptr<IPreparedModelCallback>& callback) {
@@ -204,16 +225,24 @@ nn::GeneralResult<void> prepareModelFromCache(
     }
 
     const auto nnDeadline = NN_TRY(makeOptionalTimePoint(deadlineNs));
+    if (hasDeadlinePassed(nnDeadline)) {
+        return NN_ERROR(nn::ErrorStatus::MISSED_DEADLINE_TRANSIENT) << "Deadline has passed";
+    }
     auto nnModelCache = NN_TRY(convertInput(modelCache));
     auto nnDataCache = NN_TRY(convertInput(dataCache));
     const auto nnToken = NN_TRY(convertCacheToken(token));
 
     auto task = [device, nnDeadline, nnModelCache = std::move(nnModelCache),
                  nnDataCache = std::move(nnDataCache), nnToken, callback] {
+        // The deadline may have passed while the task was queued.
+        if (hasDeadlinePassed(nnDeadline)) {
+            notify(callback.get(), ErrorStatus::MISSED_DEADLINE_TRANSIENT, nullptr);
+            return;
+        }
         auto result = device->prepareModelFromCache(nnDeadline, nnModelCache, nnDataCache, nnToken);
         notify(callback.get(), std::move(result));
     };
-    executor(std::move(task), nnDeadline);
+    executor(std::move(task), nn::Priority::MEDIUM, nnDeadline);
 
     return {};
 }
@@ -221,11 +250,21 @@ nn::GeneralResult<void> prepareModelFromCache(
 }  // namespace
 
 Device::Device(::android::nn::SharedDevice device, Executor executor)
+    : Device(std::move(device), ignorePriority(std::move(executor))) {}
+
+Device::Device(::android::nn::SharedDevice device, PriorityExecutor executor)
     : kDevice(std::move(device)), kExecutor(std::move(executor)) {
     CHECK(kDevice != nullptr);
     CHECK(kExecutor != nullptr);
 }
 
+Device::Device(::android::nn::SharedDevice device, std::shared_ptr<DeadlineExecutor> executor)
+    : kDevice(std::move(device)),
+      kExecutor(makePriorityExecutor(executor)),
+      kDeadlineExecutor(std::move(executor)) {
+    CHECK(kDevice != nullptr);
+}
+
 ndk::ScopedAStatus Device::allocate(const BufferDesc& desc,
                                     const std::vector<IPreparedModelParcel>& preparedModels,
                                     const std::vector<BufferRole>& inputRoles,
@@ -334,4 +373,11 @@ ndk::ScopedAStatus Device::prepareModelWithConfig(
     return ndk::ScopedAStatus::ok();
 }
 
+binder_status_t Device::dump(int fd, const char** /*args*/, uint32_t /*numArgs*/) {
+    if (kDeadlineExecutor != nullptr) {
+        kDeadlineExecutor->dump(fd);
+    }
+    return STATUS_OK;
+}
+
 }  // namespace aidl::android::hardware::neuralnetworks::adapter
@@ -0,0 +1,173 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+#include <nnapi/Types.h>
+#include <nnapi/hal/aidl/DeadlineExecutor.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace aidl::android::hardware::neuralnetworks::adapter {
+namespace {
+
+namespace nn = ::android::nn;
+using ::testing::ElementsAre;
+
+constexpr auto kTimeout = std::chrono::seconds(5);
+
+// Records the order in which tasks ran.
+class Recorder {
+  public:
+    Task record(int id) {
+        return [this, id] {
+            std::lock_guard guard(mMutex);
+            mOrder.push_back(id);
+            mCondition.notify_all();
+        };
+    }
+
+    std::vector<int> waitFor(size_t count) {
+        std::unique_lock lock(mMutex);
+        mCondition.wait_for(lock, kTimeout, [this, count] { return mOrder.size() >= count; });
+        return mOrder;
+    }
+
+  private:
+    std::mutex mMutex;
+    std::condition_variable mCondition;
+    std::vector<int> mOrder;
+};
+
+class DeadlineExecutorTest : public ::testing::Test {
+  protected:
+    void SetUp() override {
+        mExecutor = std::make_unique<DeadlineExecutor>(/*numThreads=*/1);
+        // Occupy the only worker so that the tasks scheduled by the test queue up.
+        std::promise<void> started;
+        auto startedFuture = started.get_future();
+        mExecutor->schedule(
+                [&started, gate = mGate.get_future().share()] {
+                    started.set_value();
+                    gate.wait();
+                },
+                nn::Priority::MEDIUM, {});
+        ASSERT_EQ(startedFuture.wait_for(kTimeout), std::future_status::ready);
+    }
+
+    void TearDown() override {
+        releaseWorker();
+        mExecutor.reset();
+    }
+
+    void releaseWorker() {
+        if (!mReleased) {
+            mGate.set_value();
+            mReleased = true;
+        }
+    }
+
+    // A task is counted as executed once it returns, which is after it recorded itself.
+    DeadlineExecutor::Stats waitForExecuted(uint64_t count) const {
+        const auto start = std::chrono::steady_clock::now();
+        auto stats = mExecutor->getStats();
+        while (stats.numExecuted < count && std::chrono::steady_clock::now() - start < kTimeout) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            stats = mExecutor->getStats();
+        }
+        return stats;
+    }
+
+    nn::TimePoint deadlineIn(std::chrono::milliseconds delay) const {
+        return mNow + std::chrono::duration_cast<nn::Duration>(delay);
+    }
+
+    const nn::TimePoint mNow = nn::Clock::now();
+    std::unique_ptr<DeadlineExecutor> mExecutor;
+    std::promise<void> mGate;
+    bool mReleased = false;
+    Recorder mRecorder;
+};
+
+TEST_F(DeadlineExecutorTest, earliestDeadlineFirst) {
+    mExecutor->schedule(mRecorder.record(3), nn::Priority::MEDIUM,
+                        deadlineIn(std::chrono::hours(3)));
+    mExecutor->schedule(mRecorder.record(0), nn::Priority::MEDIUM, {});
+    mExecutor->schedule(mRecorder.record(1), nn::Priority::MEDIUM,
+                        deadlineIn(std::chrono::hours(1)));
+    mExecutor->schedule(mRecorder.record(2), nn::Priority::LOW, deadlineIn(std::chrono::hours(2)));
+    releaseWorker();
+
+    // Tasks without a deadline run after all tasks with one.
+    EXPECT_THAT(mRecorder.waitFor(4), ElementsAre(1, 2, 3, 0));
+}
+
+TEST_F(DeadlineExecutorTest, priorityBreaksDeadlineTies) {
+    const auto deadline = deadlineIn(std::chrono::hours(1));
+    mExecutor->schedule(mRecorder.record(2), nn::Priority::LOW, deadline);
+    mExecutor->schedule(mRecorder.record(0), nn::Priority::HIGH, deadline);
+    mExecutor->schedule(mRecorder.record(1), nn::Priority::MEDIUM, deadline);
+    mExecutor->schedule(mRecorder.record(4), nn::Priority::LOW, {});
+    mExecutor->schedule(mRecorder.record(3), nn::Priority::HIGH, {});
+    releaseWorker();
+
+    EXPECT_THAT(mRecorder.waitFor(5), ElementsAre(0, 1, 2, 3, 4));
+}
+
+TEST_F(DeadlineExecutorTest, fifoAmongEqualTasks) {
+    const auto deadline = deadlineIn(std::chrono::hours(1));
+    for (int i = 0; i < 4; ++i) {
+        mExecutor->schedule(mRecorder.record(i), nn::Priority::MEDIUM, deadline);
+    }
+    for (int i = 4; i < 8; ++i) {
+        mExecutor->schedule(mRecorder.record(i), nn::Priority::MEDIUM, {});
+    }
+    releaseWorker();
+
+    EXPECT_THAT(mRecorder.waitFor(8), ElementsAre(0, 1, 2, 3, 4, 5, 6, 7));
+}
+
+TEST_F(DeadlineExecutorTest, countsLateTasks) {
+    mExecutor->schedule(mRecorder.record(0), nn::Priority::MEDIUM,
+                        deadlineIn(-std::chrono::milliseconds(2)));
+    mExecutor->schedule(mRecorder.record(1), nn::Priority::MEDIUM,
+                        deadlineIn(-std::chrono::milliseconds(1)));
+    mExecutor->schedule(mRecorder.record(2), nn::Priority::MEDIUM,
+                        deadlineIn(std::chrono::hours(1)));
+    mExecutor->schedule(mRecorder.record(3), nn::Priority::MEDIUM, {});
+
+    auto stats = mExecutor->getStats();
+    EXPECT_EQ(stats.numScheduled, 5u);
+    EXPECT_EQ(stats.queueDepth, 4u);
+    EXPECT_EQ(stats.maxQueueDepth, 4u);
+    EXPECT_EQ(stats.numStartedLate, 0u);
+
+    releaseWorker();
+    EXPECT_THAT(mRecorder.waitFor(4), ElementsAre(0, 1, 2, 3));
+    stats = waitForExecuted(5);
+    EXPECT_EQ(stats.numExecuted, 5u);
+    EXPECT_EQ(stats.numStartedLate, 2u);
+    EXPECT_EQ(stats.queueDepth, 0u);
+}
+
+}  // namespace
+}  // namespace aidl::android::hardware::neuralnetworks::adapter
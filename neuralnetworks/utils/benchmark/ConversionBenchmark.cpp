@@ -0,0 +1,361 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Benchmarks of the per-model and per-execution costs of the NNAPI HAL utils: canonical <-> HIDL
+// and AIDL conversion of models and requests, canonical validation, and 1.2 burst packet
+// serialization. Models are chains of 10 to 10,000 ADD operations, requests reference 1 to 256
+// memory pools. Besides time, each benchmark reports the number of heap allocations per iteration.
+
+#include <benchmark/benchmark.h>
+
+#include <nnapi/SharedMemory.h>
+#include <nnapi/TypeUtils.h>
+#include <nnapi/Types.h>
+#include <nnapi/Validation.h>
+#include <nnapi/hal/1.0/Conversions.h>
+#include <nnapi/hal/1.1/Conversions.h>
+#include <nnapi/hal/1.2/BurstUtils.h>
+#include <nnapi/hal/1.2/Conversions.h>
+#include <nnapi/hal/1.3/Conversions.h>
+#include <nnapi/hal/aidl/Conversions.h>
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#include <vector>
+
+namespace {
+
+std::atomic<size_t> gNumAllocations = 0;
+
+}  // namespace
+
+void* operator new(size_t size) {
+    gNumAllocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* pointer = std::malloc(size == 0 ? 1 : size)) {
+        return pointer;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* pointer) noexcept {
+    std::free(pointer);
+}
+
+void operator delete(void* pointer, size_t /*size*/) noexcept {
+    std::free(pointer);
+}
+
+namespace android::hardware::neuralnetworks::utils {
+namespace {
+
+namespace aidl_hal = ::aidl::android::hardware::neuralnetworks;
+
+constexpr uint32_t kTensorLength = 16;
+constexpr size_t kPoolSize = kTensorLength * sizeof(float);
+
+// input -> ADD -> ADD -> ... -> output, where every ADD adds the same constant.
+nn::Model createChainModel(size_t numOperations) {
+    const std::vector<float> constant(kTensorLength, 1.0f);
+    const int32_t activation = 0;
+
+    nn::Model model;
+    const auto constantLocation = model.operandValues.append(
+            reinterpret_cast<const uint8_t*>(constant.data()), kPoolSize);
+    const auto activationLocation = model.operandValues.append(
+            reinterpret_cast<const uint8_t*>(&activation), sizeof(activation));
+
+    auto& operands = model.main.operands;
+    operands.reserve(numOperations + 3);
+    operands.push_back({.type = nn::OperandType::TENSOR_FLOAT32,
+                        .dimensions = {kTensorLength},
+                        .lifetime = nn::Operand::LifeTime::SUBGRAPH_INPUT});
+    operands.push_back({.type = nn::OperandType::TENSOR_FLOAT32,
+                        .dimensions = {kTensorLength},
+                        .lifetime = nn::Operand::LifeTime::CONSTANT_COPY,
+                        .location = constantLocation});
+    operands.push_back({.type = nn::OperandType::INT32,
+                        .lifetime = nn::Operand::LifeTime::CONSTANT_COPY,
+                        .location = activationLocation});
+
+    model.main.operations.reserve(numOperations);
+    uint32_t previous = 0;
+    for (size_t i = 0; i < numOperations; ++i) {
+        const bool last = i + 1 == numOperations;
+        const auto output = static_cast<uint32_t>(operands.size());
+        operands.push_back({.type = nn::OperandType::TENSOR_FLOAT32,
+                            .dimensions = {kTensorLength},
+                            .lifetime = last ? nn::Operand::LifeTime::SUBGRAPH_OUTPUT
+                                             : nn::Operand::LifeTime::TEMPORARY_VARIABLE});
+        model.main.operations.push_back(
+                {.type = nn::OperationType::ADD, .inputs = {previous, 1, 2}, .outputs = {output}});
+        previous = output;
+    }
+    model.main.inputIndexes = {0};
+    model.main.outputIndexes = {previous};
+    return model;
+}
+
+// A request for a chain model whose input is in the first pool and output in the last pool.
+nn::Request createRequest(size_t numPools) {
+    nn::Request request;
+    request.pools.reserve(numPools);
+    for (size_t i = 0; i < numPools; ++i) {
+        request.pools.push_back(nn::createSharedMemory(kPoolSize).value());
+    }
+    request.inputs = {{.lifetime = nn::Request::Argument::LifeTime::POOL,
+                       .location = {.poolIndex = 0, .length = kPoolSize}}};
+    request.outputs = {{.lifetime = nn::Request::Argument::LifeTime::POOL,
+                        .location = {.poolIndex = static_cast<uint32_t>(numPools - 1),
+                                     .length = kPoolSize}}};
+    return request;
+}
+
+// Runs fn once per iteration and reports items/s and heap allocations per iteration.
+template <typename Function>
+void run(benchmark::State& state, size_t itemsPerIteration, const Function& fn) {
+    const size_t numAllocationsBefore = gNumAllocations.load(std::memory_order_relaxed);
+    for (auto _ : state) {
+        auto result = fn();
+        if (!result.has_value()) {
+            state.SkipWithError("operation failed");
+            return;
+        }
+        benchmark::DoNotOptimize(result);
+    }
+    const size_t numAllocations = gNumAllocations.load(std::memory_order_relaxed) -
+                                  numAllocationsBefore;
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * itemsPerIteration));
+    state.counters["allocations"] = benchmark::Counter(static_cast<double>(numAllocations),
+                                                       benchmark::Counter::kAvgIterations);
+}
+
+// Model conversion and validation
+
+template <typename ConvertFunction>
+void benchmarkModelToHal(benchmark::State& state, const ConvertFunction& convert) {
+    const size_t numOperations = state.range(0);
+    const auto model = createChainModel(numOperations);
+    run(state, numOperations, [&model, &convert] { return convert(model); });
+}
+
+template <typename ConvertFunction>
+void benchmarkModelFromHal(benchmark::State& state, const ConvertFunction& convert) {
+    const size_t numOperations = state.range(0);
+    const auto halModel = convert(createChainModel(numOperations)).value();
+    run(state, numOperations, [&halModel] { return nn::convert(halModel); });
+}
+
+void BM_ConvertModelToV1_0(benchmark::State& state) {
+    benchmarkModelToHal(state, [](const nn::Model& m) { return V1_0::utils::convert(m); });
+}
+void BM_ConvertModelToV1_1(benchmark::State& state) {
+    benchmarkModelToHal(state, [](const nn::Model& m) { return V1_1::utils::convert(m); });
+}
+void BM_ConvertModelToV1_2(benchmark::State& state) {
+    benchmarkModelToHal(state, [](const nn::Model& m) { return V1_2::utils::convert(m); });
+}
+void BM_ConvertModelToV1_3(benchmark::State& state) {
+    benchmarkModelToHal(state, [](const nn::Model& m) { return V1_3::utils::convert(m); });
+}
+void BM_ConvertModelToAidl(benchmark::State& state) {
+    benchmarkModelToHal(state, [](const nn::Model& m) { return aidl_hal::utils::convert(m); });
+}
+
+void BM_ConvertModelFromV1_0(benchmark::State& state) {
+    benchmarkModelFromHal(state, [](const nn::Model& m) { return V1_0::utils::convert(m); });
+}
+void BM_ConvertModelFromV1_1(benchmark::State& state) {
+    benchmarkModelFromHal(state, [](const nn::Model& m) { return V1_1::utils::convert(m); });
+}
+void BM_ConvertModelFromV1_2(benchmark::State& state) {
+    benchmarkModelFromHal(state, [](const nn::Model& m) { return V1_2::utils::convert(m); });
+}
+void BM_ConvertModelFromV1_3(benchmark::State& state) {
+    benchmarkModelFromHal(state, [](const nn::Model& m) { return V1_3::utils::convert(m); });
+}
+void BM_ConvertModelFromAidl(benchmark::State& state) {
+    benchmarkModelFromHal(state, [](const nn::Model& m) { return aidl_hal::utils::convert(m); });
+}
+
+void BM_ValidateModel(benchmark::State& state) {
+    const size_t numOperations = state.range(0);
+    const auto model = createChainModel(numOperations);
+    run(state, numOperations, [&model] { return nn::validate(model); });
+}
+
+// Request conversion and validation
+
+template <typename ConvertFunction>
+void benchmarkRequestToHal(benchmark::State& state, const ConvertFunction& convert) {
+    const size_t numPools = state.range(0);
+    const auto request = createRequest(numPools);
+    run(state, numPools, [&request, &convert] { return convert(request); });
+}
+
+template <typename ConvertFunction>
+void benchmarkRequestFromHal(benchmark::State& state, const ConvertFunction& convert) {
+    const size_t numPools = state.range(0);
+    const auto halRequest = convert(createRequest(numPools)).value();
+    run(state, numPools, [&halRequest] { return nn::convert(halRequest); });
+}
+
+void BM_ConvertRequestToV1_0(benchmark::State& state) {
+    benchmarkRequestToHal(state, [](const nn::Request& r) { return V1_0::utils::convert(r); });
+}
+void BM_ConvertRequestToV1_3(benchmark::State& state) {
+    benchmarkRequestToHal(state, [](const nn::Request& r) { return V1_3::utils::convert(r); });
+}
+void BM_ConvertRequestToAidl(benchmark::State& state) {
+    benchmarkRequestToHal(state, [](const nn::Request& r) { return aidl_hal::utils::convert(r); });
+}
+
+void BM_ConvertRequestFromV1_0(benchmark::State& state) {
+    benchmarkRequestFromHal(state, [](const nn::Request& r) { return V1_0::utils::convert(r); });
+}
+void BM_ConvertRequestFromV1_3(benchmark::State& state) {
+    benchmarkRequestFromHal(state, [](const nn::Request& r) { return V1_3::utils::convert(r); });
+}
+void BM_ConvertRequestFromAidl(benchmark::State& state) {
+    benchmarkRequestFromHal(state,
+                            [](const nn::Request& r) { return aidl_hal::utils::convert(r); });
+}
+
+void BM_ValidateRequestForModel(benchmark::State& state) {
+    const size_t numPools = state.range(0);
+    const auto model = createChainModel(/*numOperations=*/1);
+    const auto request = createRequest(numPools);
+    run(state, numPools,
+        [&request, &model] { return nn::validateRequestForModel(request, model); });
+}
+
+// Burst serialization
+
+// A burst request with one input and one output per memory pool, as in a typical model whose
+// inputs and outputs each live in their own memory.
+V1_0::Request createBurstRequest(size_t numPools) {
+    std::vector<V1_0::RequestArgument> arguments(numPools);
+    for (size_t i = 0; i < numPools; ++i) {
+        arguments[i] = {.hasNoValue = false,
+                        .location = {.poolIndex = static_cast<uint32_t>(i),
+                                     .offset = 0,
+                                     .length = kPoolSize},
+                        .dimensions = {kTensorLength}};
+    }
+    return {.inputs = arguments, .outputs = arguments, .pools = {}};
+}
+
+std::vector<int32_t> createSlots(size_t numPools) {
+    std::vector<int32_t> slots(numPools);
+    for (size_t i = 0; i < numPools; ++i) {
+        slots[i] = static_cast<int32_t>(i);
+    }
+    return slots;
+}
+
+// serialize returns a packet rather than a Result, so wrap it for run.
+template <typename Packet>
+struct SerializedPacket {
+    bool has_value() const { return true; }
+    Packet packet;
+};
+
+void BM_BurstSerializeRequest(benchmark::State& state) {
+    const size_t numPools = state.range(0);
+    const auto request = createBurstRequest(numPools);
+    const auto slots = createSlots(numPools);
+    run(state, numPools, [&request, &slots] {
+        return SerializedPacket<std::vector<V1_2::FmqRequestDatum>>{
+                V1_2::utils::serialize(request, V1_2::MeasureTiming::NO, slots)};
+    });
+}
+
+void BM_BurstSerializeRequestReusingPacket(benchmark::State& state) {
+    const size_t numPools = state.range(0);
+    const auto request = createBurstRequest(numPools);
+    const auto slots = createSlots(numPools);
+    std::vector<V1_2::FmqRequestDatum> packet;
+    run(state, numPools, [&request, &slots, &packet] {
+        V1_2::utils::serialize(request, V1_2::MeasureTiming::NO, slots, &packet);
+        return SerializedPacket<size_t>{packet.size()};
+    });
+}
+
+void BM_BurstDeserializeRequest(benchmark::State& state) {
+    const size_t numPools = state.range(0);
+    const auto packet = V1_2::utils::serialize(createBurstRequest(numPools),
+                                               V1_2::MeasureTiming::NO, createSlots(numPools));
+    run(state, numPools, [&packet] { return V1_2::utils::deserialize(packet); });
+}
+
+void BM_BurstSerializeResult(benchmark::State& state) {
+    const size_t numOutputs = state.range(0);
+    const std::vector<V1_2::OutputShape> outputShapes(
+            numOutputs, {.dimensions = {kTensorLength}, .isSufficient = true});
+    const V1_2::Timing timing = {.timeOnDevice = 1, .timeInDriver = 2};
+    run(state, numOutputs, [&outputShapes, &timing] {
+        return SerializedPacket<std::vector<V1_2::FmqResultDatum>>{
+                V1_2::utils::serialize(V1_0::ErrorStatus::NONE, outputShapes, timing)};
+    });
+}
+
+void BM_BurstDeserializeResult(benchmark::State& state) {
+    const size_t numOutputs = state.range(0);
+    const std::vector<V1_2::OutputShape> outputShapes(
+            numOutputs, {.dimensions = {kTensorLength}, .isSufficient = true});
+    const auto packet = V1_2::utils::serialize(V1_0::ErrorStatus::NONE, outputShapes,
+                                               {.timeOnDevice = 1, .timeInDriver = 2});
+    run(state, numOutputs, [&packet] { return V1_2::utils::deserialize(packet); });
+}
+
+void ModelSizes(benchmark::internal::Benchmark* b) {
+    b->RangeMultiplier(10)->Range(10, 10000);
+}
+
+void PoolCounts(benchmark::internal::Benchmark* b) {
+    b->RangeMultiplier(4)->Range(1, 256);
+}
+
+BENCHMARK(BM_ConvertModelToV1_0)->Apply(ModelSizes);
+BENCHMARK(BM_ConvertModelToV1_1)->Apply(ModelSizes);
+BENCHMARK(BM_ConvertModelToV1_2)->Apply(ModelSizes);
+BENCHMARK(BM_ConvertModelToV1_3)->Apply(ModelSizes);
+BENCHMARK(BM_ConvertModelToAidl)->Apply(ModelSizes);
+BENCHMARK(BM_ConvertModelFromV1_0)->Apply(ModelSizes);
+BENCHMARK(BM_ConvertModelFromV1_1)->Apply(ModelSizes);
+BENCHMARK(BM_ConvertModelFromV1_2)->Apply(ModelSizes);
+BENCHMARK(BM_ConvertModelFromV1_3)->Apply(ModelSizes);
+BENCHMARK(BM_ConvertModelFromAidl)->Apply(ModelSizes);
+BENCHMARK(BM_ValidateModel)->Apply(ModelSizes);
+
+BENCHMARK(BM_ConvertRequestToV1_0)->Apply(PoolCounts);
+BENCHMARK(BM_ConvertRequestToV1_3)->Apply(PoolCounts);
+BENCHMARK(BM_ConvertRequestToAidl)->Apply(PoolCounts);
+BENCHMARK(BM_ConvertRequestFromV1_0)->Apply(PoolCounts);
+BENCHMARK(BM_ConvertRequestFromV1_3)->Apply(PoolCounts);
+BENCHMARK(BM_ConvertRequestFromAidl)->Apply(PoolCounts);
+BENCHMARK(BM_ValidateRequestForModel)->Apply(PoolCounts);
+
+BENCHMARK(BM_BurstSerializeRequest)->Apply(PoolCounts);
+BENCHMARK(BM_BurstSerializeRequestReusingPacket)->Apply(PoolCounts);
+BENCHMARK(BM_BurstDeserializeRequest)->Apply(PoolCounts);
+BENCHMARK(BM_BurstSerializeResult)->Apply(PoolCounts);
+BENCHMARK(BM_BurstDeserializeResult)->Apply(PoolCounts);
+
+}  // namespace
+}  // namespace android::hardware::neuralnetworks::utils
+
+BENCHMARK_MAIN();
@@ -0,0 +1,170 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Measures the overhead ResilientPreparedModel adds to executions when many threads execute the
+// same model. The underlying prepared model returns immediately, so the reported throughput is
+// dominated by the cost of getting the current prepared model handle.
+//
+// Usage: neuralnetworks_utils_hal_common_resilient_benchmark [-t threads] [-n iterations]
+
+#include <nnapi/IPreparedModel.h>
+#include <nnapi/Result.h>
+#include <nnapi/Types.h>
+#include <nnapi/hal/ResilientPreparedModel.h>
+
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <any>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace {
+
+namespace nn = ::android::nn;
+namespace utils = ::android::hardware::neuralnetworks::utils;
+using Clock = std::chrono::steady_clock;
+
+class NoopPreparedModel final : public nn::IPreparedModel {
+  public:
+    nn::ExecutionResult<std::pair<std::vector<nn::OutputShape>, nn::Timing>> execute(
+            const nn::Request& /*request*/, nn::MeasureTiming /*measure*/,
+            const nn::OptionalTimePoint& /*deadline*/,
+            const nn::OptionalDuration& /*loopTimeoutDuration*/,
+            const std::vector<nn::TokenValuePair>& /*hints*/,
+            const std::vector<nn::ExtensionNameAndPrefix>& /*extensionNameToPrefix*/)
+            const override {
+        return {};
+    }
+
+    nn::GeneralResult<std::pair<nn::SyncFence, nn::ExecuteFencedInfoCallback>> executeFenced(
+            const nn::Request& /*request*/, const std::vector<nn::SyncFence>& /*waitFor*/,
+            nn::MeasureTiming /*measure*/, const nn::OptionalTimePoint& /*deadline*/,
+            const nn::OptionalDuration& /*loopTimeoutDuration*/,
+            const nn::OptionalDuration& /*timeoutDurationAfterFence*/,
+            const std::vector<nn::TokenValuePair>& /*hints*/,
+            const std::vector<nn::ExtensionNameAndPrefix>& /*extensionNameToPrefix*/)
+            const override {
+        return NN_ERROR() << "unsupported";
+    }
+
+    nn::GeneralResult<nn::SharedExecution> createReusableExecution(
+            const nn::Request& /*request*/, nn::MeasureTiming /*measure*/,
+            const nn::OptionalDuration& /*loopTimeoutDuration*/,
+            const std::vector<nn::TokenValuePair>& /*hints*/,
+            const std::vector<nn::ExtensionNameAndPrefix>& /*extensionNameToPrefix*/)
+            const override {
+        return NN_ERROR() << "unsupported";
+    }
+
+    nn::GeneralResult<nn::SharedBurst> configureExecutionBurst() const override {
+        return NN_ERROR() << "unsupported";
+    }
+
+    std::any getUnderlyingResource() const override { return {}; }
+};
+
+int run(const utils::ResilientPreparedModel& preparedModel, int numThreads, int iterations) {
+    const nn::Request request;
+    std::atomic<bool> failed = false;
+    std::atomic<int> ready = 0;
+    std::atomic<bool> start = false;
+
+    std::vector<std::thread> threads;
+    threads.reserve(numThreads);
+    for (int i = 0; i < numThreads; ++i) {
+        threads.emplace_back([&] {
+            ready++;
+            while (!start.load(std::memory_order_acquire)) {
+                std::this_thread::yield();
+            }
+            for (int j = 0; j < iterations; ++j) {
+                if (!preparedModel.execute(request, nn::MeasureTiming::NO, {}, {}, {}, {})
+                             .has_value()) {
+                    failed = true;
+                    return;
+                }
+            }
+        });
+    }
+
+    while (ready.load() < numThreads) {
+        std::this_thread::yield();
+    }
+    const auto begin = Clock::now();
+    start.store(true, std::memory_order_release);
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    const double elapsedS = std::chrono::duration<double>(Clock::now() - begin).count();
+
+    if (failed) {
+        fprintf(stderr, "execution failed\n");
+        return 1;
+    }
+    const double totalExecutions = static_cast<double>(numThreads) * iterations;
+    printf("threads %d, executions %.0f, %.1f ns/execution per thread, %.2f M executions/s\n",
+           numThreads, totalExecutions, elapsedS * 1e9 / iterations,
+           totalExecutions / elapsedS / 1e6);
+    return 0;
+}
+
+void usage(const char* name) {
+    fprintf(stderr, "Usage: %s [-t threads] [-n iterations]\n", name);
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    int numThreads = 8;
+    int iterations = 1000000;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "t:n:h")) != -1) {
+        switch (opt) {
+            case 't':
+                numThreads = atoi(optarg);
+                break;
+            case 'n':
+                iterations = atoi(optarg);
+                break;
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+    if (numThreads <= 0 || iterations <= 0) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    const auto preparedModel = utils::ResilientPreparedModel::create([] {
+                                   return nn::GeneralResult<nn::SharedPreparedModel>(
+                                           std::make_shared<const NoopPreparedModel>());
+                               }).value();
+
+    // Uncontended baseline first, then the contended case.
+    int ret = run(*preparedModel, 1, iterations);
+    if (numThreads > 1) {
+        ret |= run(*preparedModel, numThreads, iterations);
+    }
+    return ret;
+}
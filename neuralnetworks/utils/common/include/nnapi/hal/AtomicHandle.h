@@ -0,0 +1,127 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_HARDWARE_INTERFACES_NEURALNETWORKS_UTILS_COMMON_ATOMIC_HANDLE_H
+#define ANDROID_HARDWARE_INTERFACES_NEURALNETWORKS_UTILS_COMMON_ATOMIC_HANDLE_H
+
+#include <android-base/logging.h>
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <thread>
+#include <utility>
+
+namespace android::hardware::neuralnetworks::utils {
+
+/**
+ * Holds a std::shared_ptr that is read far more often than it is replaced, such as the current
+ * handle of a Resilient* object, which only changes when recovering from a dead object.
+ *
+ * AtomicHandle::load does not take a lock: it counts itself as an active reader, copies the
+ * currently published std::shared_ptr, and leaves. Readers are counted in one of several
+ * cache-line sized stripes chosen per thread, so that concurrent loads from different threads do
+ * not write to the same cache line.
+ *
+ * AtomicHandle::store publishes a new std::shared_ptr and waits for the readers that may still be
+ * copying the previous one before releasing it, so no replaced handle outlives the store. Readers
+ * are counted in two sets of stripes which alternate with each store. Readers that start after a
+ * store has switched sets are counted in the other set, so the wait only covers the copies that
+ * were already in progress and is bounded even under a constant stream of loads.
+ *
+ * Calls to AtomicHandle::store must be serialized by the caller, e.g., by the mutex that already
+ * serializes recovery. AtomicHandle::load may be called concurrently with anything.
+ */
+template <typename Type>
+class AtomicHandle final {
+  public:
+    explicit AtomicHandle(std::shared_ptr<Type> handle)
+        : mCurrent(new std::shared_ptr<Type>(std::move(handle))) {}
+
+    ~AtomicHandle() {
+        for (const auto& readers : mReaders) {
+            for (const auto& stripe : readers) {
+                CHECK_EQ(stripe.count.load(), 0u);
+            }
+        }
+        delete mCurrent.load();
+    }
+
+    AtomicHandle(const AtomicHandle&) = delete;
+    AtomicHandle(AtomicHandle&&) = delete;
+    AtomicHandle& operator=(const AtomicHandle&) = delete;
+    AtomicHandle& operator=(AtomicHandle&&) = delete;
+
+    std::shared_ptr<Type> load() const {
+        const size_t stripe = getStripe();
+        while (true) {
+            // The increment must be ordered before checking the set again and loading mCurrent,
+            // and store must observe it after switching sets, hence the sequentially consistent
+            // operations.
+            const size_t set = mSet.load();
+            std::atomic<size_t>& count = mReaders[set][stripe].count;
+            count.fetch_add(1);
+            // A store that switched sets in the meantime may not wait for this reader, so retry
+            // in the current set.
+            if (mSet.load() == set) {
+                std::shared_ptr<Type> handle = *mCurrent.load();
+                count.fetch_sub(1, std::memory_order_release);
+                return handle;
+            }
+            count.fetch_sub(1, std::memory_order_release);
+        }
+    }
+
+    void store(std::shared_ptr<Type> handle) {
+        auto next = std::make_unique<std::shared_ptr<Type>>(std::move(handle));
+        std::unique_ptr<std::shared_ptr<Type>> previous(mCurrent.exchange(next.release()));
+
+        // A reader that is counted in the previous set after it is drained started after the
+        // exchange, so it can only see the new handle.
+        const size_t set = mSet.load(std::memory_order_relaxed);
+        mSet.store(set ^ 1);
+        for (const auto& stripe : mReaders[set]) {
+            while (stripe.count.load() != 0) {
+                std::this_thread::yield();
+            }
+        }
+    }
+
+  private:
+    static constexpr size_t kNumStripes = 8;
+    static constexpr size_t kCacheLineSize = 64;
+
+    struct alignas(kCacheLineSize) Stripe {
+        std::atomic<size_t> count = 0;
+    };
+
+    // Spreads threads over the stripes in the order they first load any AtomicHandle.
+    static size_t getStripe() {
+        static std::atomic<size_t> sNextStripe = 0;
+        thread_local const size_t stripe =
+                sNextStripe.fetch_add(1, std::memory_order_relaxed) % kNumStripes;
+        return stripe;
+    }
+
+    std::atomic<std::shared_ptr<Type>*> mCurrent;
+    // The set of mReaders that new readers are counted in. Only changed by store.
+    mutable std::atomic<size_t> mSet = 0;
+    mutable Stripe mReaders[2][kNumStripes];
+};
+
+}  // namespace android::hardware::neuralnetworks::utils
+
+#endif  // ANDROID_HARDWARE_INTERFACES_NEURALNETWORKS_UTILS_COMMON_ATOMIC_HANDLE_H
@@ -0,0 +1,212 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_HARDWARE_INTERFACES_NEURALNETWORKS_UTILS_COMMON_CONVERTED_MODEL_CACHE_H
+#define ANDROID_HARDWARE_INTERFACES_NEURALNETWORKS_UTILS_COMMON_CONVERTED_MODEL_CACHE_H
+
+#include <android-base/thread_annotations.h>
+#include <nnapi/Result.h>
+#include <nnapi/Types.h>
+
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace android::hardware::neuralnetworks::utils {
+
+/**
+ * Structural fingerprint of a canonical model, used as the key of the ConvertedModelCache.
+ *
+ * Two models have equal fingerprints if they have the same subgraphs, operand values and extension
+ * prefixes, and reference the very same memory pool objects. Operand values larger than
+ * kMaxInlineOperandValuesSize are kept out of the structure encoding and only compared byte by
+ * byte when the hashes match.
+ */
+class ModelFingerprint {
+  public:
+    static constexpr size_t kMaxInlineOperandValuesSize = 64 * 1024;
+
+    /**
+     * Returns std::nullopt if the model cannot be fingerprinted, i.e., when it has pointer-based
+     * data whose contents may change between calls.
+     */
+    static std::optional<ModelFingerprint> create(const nn::Model& model);
+
+    /**
+     * Copies large operand values which are still referenced from the model, so the fingerprint
+     * can outlive it. Must be called before the fingerprint is stored.
+     */
+    void retainOperandValues();
+
+    size_t hash() const { return mHash; }
+    bool operator==(const ModelFingerprint& other) const;
+
+  private:
+    ModelFingerprint() = default;
+
+    std::vector<uint8_t> mStructure;
+    // Operand values larger than kMaxInlineOperandValuesSize. Points into the model until
+    // retainOperandValues() copies them into mRetainedOperandValues.
+    const uint8_t* mOperandValues = nullptr;
+    size_t mOperandValuesSize = 0;
+    std::shared_ptr<const std::vector<uint8_t>> mRetainedOperandValues;
+    // Held to keep the pool identities unique for the lifetime of the fingerprint.
+    std::vector<nn::SharedMemory> mPools;
+    size_t mHash = 0;
+};
+
+struct ConvertedModelCacheStats {
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    // Models that could not be cached, see ModelFingerprint::create.
+    uint64_t bypassed = 0;
+    uint64_t evictions = 0;
+    size_t size = 0;
+};
+
+/**
+ * Set the number of converted models each ConvertedModelCache holds. The default of 0 disables
+ * caching. The caches are process wide, so they are shared by all devices and survive
+ * ResilientDevice reconnects.
+ */
+void setConvertedModelCacheCapacity(size_t capacity);
+size_t getConvertedModelCacheCapacity();
+
+/**
+ * LRU cache of canonical models converted (and validated) to HalModel.
+ */
+template <typename HalModel>
+class ConvertedModelCache {
+  public:
+    static ConvertedModelCache& getInstance() {
+        static ConvertedModelCache sInstance;
+        return sInstance;
+    }
+
+    /**
+     * Returns the converted model from the cache, or converts model with convert and inserts the
+     * result. Conversion errors are not cached.
+     */
+    template <typename Convert>
+    nn::GeneralResult<std::shared_ptr<const HalModel>> getOrConvert(const nn::Model& model,
+                                                                    const Convert& convert);
+
+    ConvertedModelCacheStats getStats() const;
+    void clear();
+
+  private:
+    using Entry = std::pair<ModelFingerprint, std::shared_ptr<const HalModel>>;
+    struct FingerprintHash {
+        size_t operator()(const ModelFingerprint* fingerprint) const { return fingerprint->hash(); }
+    };
+    struct FingerprintEqual {
+        bool operator()(const ModelFingerprint* a, const ModelFingerprint* b) const {
+            return *a == *b;
+        }
+    };
+
+    ConvertedModelCache() = default;
+
+    void trimLocked(size_t capacity) REQUIRES(mMutex);
+
+    mutable std::mutex mMutex;
+    // Most recently used first.
+    std::list<Entry> mEntries GUARDED_BY(mMutex);
+    // Keys point into mEntries.
+    std::unordered_map<const ModelFingerprint*, typename std::list<Entry>::iterator,
+                       FingerprintHash, FingerprintEqual>
+            mIndex GUARDED_BY(mMutex);
+    ConvertedModelCacheStats mStats GUARDED_BY(mMutex);
+};
+
+template <typename HalModel>
+template <typename Convert>
+nn::GeneralResult<std::shared_ptr<const HalModel>> ConvertedModelCache<HalModel>::getOrConvert(
+        const nn::Model& model, const Convert& convert) {
+    const size_t capacity = getConvertedModelCacheCapacity();
+    std::optional<ModelFingerprint> fingerprint;
+    if (capacity > 0) {
+        fingerprint = ModelFingerprint::create(model);
+    }
+
+    if (fingerprint.has_value()) {
+        std::lock_guard guard(mMutex);
+        if (const auto it = mIndex.find(&fingerprint.value()); it != mIndex.end()) {
+            mEntries.splice(mEntries.begin(), mEntries, it->second);
+            mStats.hits++;
+            return it->second->second;
+        }
+        mStats.misses++;
+    } else if (capacity > 0) {
+        std::lock_guard guard(mMutex);
+        mStats.bypassed++;
+    }
+
+    // Convert without holding the lock.
+    auto halModel = std::make_shared<const HalModel>(NN_TRY(convert(model)));
+
+    std::lock_guard guard(mMutex);
+    if (fingerprint.has_value() && mIndex.count(&fingerprint.value()) == 0) {
+        fingerprint->retainOperandValues();
+        mEntries.emplace_front(std::move(fingerprint).value(), halModel);
+        mIndex.emplace(&mEntries.front().first, mEntries.begin());
+    }
+    trimLocked(capacity);
+    return halModel;
+}
+
+template <typename HalModel>
+void ConvertedModelCache<HalModel>::trimLocked(size_t capacity) {
+    while (mEntries.size() > capacity) {
+        mIndex.erase(&mEntries.back().first);
+        mEntries.pop_back();
+        mStats.evictions++;
+    }
+}
+
+template <typename HalModel>
+ConvertedModelCacheStats ConvertedModelCache<HalModel>::getStats() const {
+    std::lock_guard guard(mMutex);
+    ConvertedModelCacheStats stats = mStats;
+    stats.size = mEntries.size();
+    return stats;
+}
+
+template <typename HalModel>
+void ConvertedModelCache<HalModel>::clear() {
+    std::lock_guard guard(mMutex);
+    mIndex.clear();
+    mEntries.clear();
+}
+
+/**
+ * Convert model with convert through the ConvertedModelCache of the resulting HAL model type.
+ */
+template <typename Convert>
+auto convertModelCached(const nn::Model& model, const Convert& convert) {
+    using HalModel = typename std::invoke_result_t<const Convert&, const nn::Model&>::value_type;
+    return ConvertedModelCache<HalModel>::getInstance().getOrConvert(model, convert);
+}
+
+}  // namespace android::hardware::neuralnetworks::utils
+
+#endif  // ANDROID_HARDWARE_INTERFACES_NEURALNETWORKS_UTILS_COMMON_CONVERTED_MODEL_CACHE_H
@@ -21,6 +21,7 @@
 #include <nnapi/IBuffer.h>
 #include <nnapi/Result.h>
 #include <nnapi/Types.h>
+#include <nnapi/hal/AtomicHandle.h>
 
 #include <functional>
 #include <memory>
@@ -53,8 +54,9 @@ class ResilientBuffer final : public nn::IBuffer {
 
   private:
     const Factory kMakeBuffer;
+    // Serializes recovery. Reading the current handle does not take it.
     mutable std::mutex mMutex;
-    mutable nn::SharedBuffer mBuffer GUARDED_BY(mMutex);
+    mutable AtomicHandle<const nn::IBuffer> mBuffer;
 };
 
 }  // namespace android::hardware::neuralnetworks::utils
@@ -21,6 +21,7 @@
 #include <nnapi/IBurst.h>
 #include <nnapi/Result.h>
 #include <nnapi/Types.h>
+#include <nnapi/hal/AtomicHandle.h>
 
 #include <functional>
 #include <memory>
@@ -67,8 +68,9 @@ class ResilientBurst final : public nn::IBurst,
             const std::vector<nn::ExtensionNameAndPrefix>& extensionNameToPrefix) const;
 
     const Factory kMakeBurst;
+    // Serializes recovery. Reading the current handle does not take it.
     mutable std::mutex mMutex;
-    mutable nn::SharedBurst mBurst GUARDED_BY(mMutex);
+    mutable AtomicHandle<const nn::IBurst> mBurst;
 };
 
 }  // namespace android::hardware::neuralnetworks::utils
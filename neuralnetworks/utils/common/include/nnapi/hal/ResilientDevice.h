@@ -23,7 +23,9 @@
 #include <nnapi/IPreparedModel.h>
 #include <nnapi/Result.h>
 #include <nnapi/Types.h>
+#include <nnapi/hal/AtomicHandle.h>
 
+#include <atomic>
 #include <functional>
 #include <memory>
 #include <mutex>
@@ -45,7 +47,7 @@ class ResilientDevice final : public nn::IDevice,
                              std::string versionString, std::vector<nn::Extension> extensions,
                              nn::Capabilities capabilities, nn::SharedDevice device);
 
-    nn::SharedDevice getDevice() const EXCLUDES(mMutex);
+    nn::SharedDevice getDevice() const;
     nn::GeneralResult<nn::SharedDevice> recover(const nn::IDevice* failingDevice,
                                                 bool blocking) const EXCLUDES(mMutex);
 
@@ -80,7 +82,7 @@ class ResilientDevice final : public nn::IDevice,
             const std::vector<nn::BufferRole>& outputRoles) const override;
 
   private:
-    bool isValidInternal() const EXCLUDES(mMutex);
+    bool isValidInternal() const;
     nn::GeneralResult<nn::SharedPreparedModel> prepareModelInternal(
             const nn::Model& model, nn::ExecutionPreference preference, nn::Priority priority,
             nn::OptionalTimePoint deadline, const std::vector<nn::SharedHandle>& modelCache,
@@ -100,9 +102,10 @@ class ResilientDevice final : public nn::IDevice,
     const std::string kVersionString;
     const std::vector<nn::Extension> kExtensions;
     const nn::Capabilities kCapabilities;
+    // Serializes recovery. Reading the current device or its validity does not take it.
     mutable std::mutex mMutex;
-    mutable nn::SharedDevice mDevice GUARDED_BY(mMutex);
-    mutable bool mIsValid GUARDED_BY(mMutex) = true;
+    mutable AtomicHandle<const nn::IDevice> mDevice;
+    mutable std::atomic<bool> mIsValid = true;
 };
 
 }  // namespace android::hardware::neuralnetworks::utils
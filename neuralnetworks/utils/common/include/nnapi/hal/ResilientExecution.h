@@ -21,6 +21,7 @@
 #include <nnapi/IExecution.h>
 #include <nnapi/Result.h>
 #include <nnapi/Types.h>
+#include <nnapi/hal/AtomicHandle.h>
 
 #include <functional>
 #include <memory>
@@ -57,8 +58,9 @@ class ResilientExecution final : public nn::IExecution,
     bool isValidInternal() const EXCLUDES(mMutex);
 
     const Factory kMakeExecution;
+    // Serializes recovery. Reading the current handle does not take it.
     mutable std::mutex mMutex;
-    mutable nn::SharedExecution mExecution GUARDED_BY(mMutex);
+    mutable AtomicHandle<const nn::IExecution> mExecution;
 };
 
 }  // namespace android::hardware::neuralnetworks::utils
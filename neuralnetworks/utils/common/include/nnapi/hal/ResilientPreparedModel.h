@@ -21,6 +21,7 @@
 #include <nnapi/IPreparedModel.h>
 #include <nnapi/Result.h>
 #include <nnapi/Types.h>
+#include <nnapi/hal/AtomicHandle.h>
 
 #include <functional>
 #include <memory>
@@ -81,8 +82,9 @@ class ResilientPreparedModel final : public nn::IPreparedModel,
     nn::GeneralResult<nn::SharedBurst> configureExecutionBurstInternal() const;
 
     const Factory kMakePreparedModel;
+    // Serializes recovery. Reading the current handle does not take it.
     mutable std::mutex mMutex;
-    mutable nn::SharedPreparedModel mPreparedModel GUARDED_BY(mMutex);
+    mutable AtomicHandle<const nn::IPreparedModel> mPreparedModel;
 };
 
 }  // namespace android::hardware::neuralnetworks::utils
@@ -0,0 +1,187 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "ConvertedModelCache.h"
+
+#include "CommonUtils.h"
+
+#include <nnapi/Types.h>
+
+#include <atomic>
+#include <cstring>
+#include <functional>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <variant>
+#include <vector>
+
+namespace android::hardware::neuralnetworks::utils {
+namespace {
+
+std::atomic<size_t> gConvertedModelCacheCapacity = 0;
+
+// Appends a flat, unambiguous encoding of the structure of a model.
+class StructureWriter {
+  public:
+    explicit StructureWriter(std::vector<uint8_t>* out) : mOut(*out) {}
+
+    template <typename Type>
+    std::enable_if_t<std::is_arithmetic_v<Type> || std::is_enum_v<Type>> write(Type value) {
+        const auto* bytes = reinterpret_cast<const uint8_t*>(&value);
+        mOut.insert(mOut.end(), bytes, bytes + sizeof(value));
+    }
+
+    template <typename Type>
+    void write(const std::vector<Type>& values) {
+        write(values.size());
+        for (const auto& value : values) {
+            write(value);
+        }
+    }
+
+    void write(const std::string& value) {
+        write(value.size());
+        mOut.insert(mOut.end(), value.begin(), value.end());
+    }
+
+    void write(const nn::DataLocation& location) {
+        write(location.poolIndex);
+        write(location.offset);
+        write(location.length);
+        write(location.padding);
+    }
+
+    void write(const nn::Operand::SymmPerChannelQuantParams& params) {
+        write(params.scales);
+        write(params.channelDim);
+    }
+
+    void write(const nn::Operand::ExtraParams& extraParams) {
+        write(extraParams.index());
+        if (const auto* params =
+                    std::get_if<nn::Operand::SymmPerChannelQuantParams>(&extraParams)) {
+            write(*params);
+        } else if (const auto* params = std::get_if<nn::Operand::ExtensionParams>(&extraParams)) {
+            write(*params);
+        }
+    }
+
+    void write(const nn::Operand& operand) {
+        write(operand.type);
+        write(operand.dimensions);
+        write(operand.scale);
+        write(operand.zeroPoint);
+        write(operand.lifetime);
+        write(operand.location);
+        write(operand.extraParams);
+    }
+
+    void write(const nn::Operation& operation) {
+        write(operation.type);
+        write(operation.inputs);
+        write(operation.outputs);
+    }
+
+    void write(const nn::Model::Subgraph& subgraph) {
+        write(subgraph.operands);
+        write(subgraph.operations);
+        write(subgraph.inputIndexes);
+        write(subgraph.outputIndexes);
+    }
+
+    void write(const nn::ExtensionNameAndPrefix& extensionNameAndPrefix) {
+        write(extensionNameAndPrefix.name);
+        write(extensionNameAndPrefix.prefix);
+    }
+
+    void writeBytes(const uint8_t* data, size_t size) {
+        write(size);
+        mOut.insert(mOut.end(), data, data + size);
+    }
+
+  private:
+    std::vector<uint8_t>& mOut;
+};
+
+size_t hashBytes(const uint8_t* data, size_t size) {
+    return std::hash<std::string_view>{}(
+            std::string_view(reinterpret_cast<const char*>(data), size));
+}
+
+}  // namespace
+
+void setConvertedModelCacheCapacity(size_t capacity) {
+    gConvertedModelCacheCapacity.store(capacity, std::memory_order_relaxed);
+}
+
+size_t getConvertedModelCacheCapacity() {
+    return gConvertedModelCacheCapacity.load(std::memory_order_relaxed);
+}
+
+std::optional<ModelFingerprint> ModelFingerprint::create(const nn::Model& model) {
+    if (!hasNoPointerData(model)) {
+        return std::nullopt;
+    }
+
+    ModelFingerprint fingerprint;
+    StructureWriter writer(&fingerprint.mStructure);
+    writer.write(model.main);
+    writer.write(model.referenced);
+    writer.write(model.relaxComputationFloat32toFloat16);
+    writer.write(model.extensionNameToPrefix);
+
+    const uint8_t* operandValues = model.operandValues.data();
+    const size_t operandValuesSize = model.operandValues.size();
+    const size_t operandValuesHash = hashBytes(operandValues, operandValuesSize);
+    if (operandValuesSize <= kMaxInlineOperandValuesSize) {
+        writer.writeBytes(operandValues, operandValuesSize);
+    } else {
+        writer.write(operandValuesSize);
+        writer.write(operandValuesHash);
+        fingerprint.mOperandValues = operandValues;
+        fingerprint.mOperandValuesSize = operandValuesSize;
+    }
+
+    fingerprint.mPools = model.pools;
+    size_t hash = hashBytes(fingerprint.mStructure.data(), fingerprint.mStructure.size());
+    for (const auto& pool : fingerprint.mPools) {
+        hash = hash * 31 + std::hash<const nn::Memory*>{}(pool.get());
+    }
+    fingerprint.mHash = hash;
+    return fingerprint;
+}
+
+void ModelFingerprint::retainOperandValues() {
+    if (mOperandValues == nullptr || mRetainedOperandValues != nullptr) {
+        return;
+    }
+    mRetainedOperandValues = std::make_shared<const std::vector<uint8_t>>(
+            mOperandValues, mOperandValues + mOperandValuesSize);
+    mOperandValues = mRetainedOperandValues->data();
+}
+
+bool ModelFingerprint::operator==(const ModelFingerprint& other) const {
+    // The structure encodes the size and hash of large operand values, so only a hash collision
+    // gets to the byte comparison.
+    return mHash == other.mHash && mStructure == other.mStructure && mPools == other.mPools &&
+           mOperandValuesSize == other.mOperandValuesSize &&
+           (mOperandValues == other.mOperandValues ||
+            std::memcmp(mOperandValues, other.mOperandValues, mOperandValuesSize) == 0);
+}
+
+}  // namespace android::hardware::neuralnetworks::utils
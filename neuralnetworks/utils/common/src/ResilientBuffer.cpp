@@ -75,24 +75,25 @@ ResilientBuffer::ResilientBuffer(PrivateConstructorTag /*tag*/, Factory makeBuff
                                  nn::SharedBuffer buffer)
     : kMakeBuffer(std::move(makeBuffer)), mBuffer(std::move(buffer)) {
     CHECK(kMakeBuffer != nullptr);
-    CHECK(mBuffer != nullptr);
+    CHECK(mBuffer.load() != nullptr);
 }
 
 nn::SharedBuffer ResilientBuffer::getBuffer() const {
-    std::lock_guard guard(mMutex);
-    return mBuffer;
+    return mBuffer.load();
 }
 nn::GeneralResult<nn::SharedBuffer> ResilientBuffer::recover(
         const nn::IBuffer* failingBuffer) const {
     std::lock_guard guard(mMutex);
+    auto current = mBuffer.load();
 
     // Another caller updated the failing prepared model.
-    if (mBuffer.get() != failingBuffer) {
-        return mBuffer;
+    if (current.get() != failingBuffer) {
+        return current;
     }
 
-    mBuffer = NN_TRY(kMakeBuffer());
-    return mBuffer;
+    auto buffer = NN_TRY(kMakeBuffer());
+    mBuffer.store(buffer);
+    return buffer;
 }
 
 nn::Request::MemoryDomainToken ResilientBuffer::getToken() const {
@@ -78,24 +78,25 @@ ResilientBurst::ResilientBurst(PrivateConstructorTag /*tag*/, Factory makeBurst,
                                nn::SharedBurst burst)
     : kMakeBurst(std::move(makeBurst)), mBurst(std::move(burst)) {
     CHECK(kMakeBurst != nullptr);
-    CHECK(mBurst != nullptr);
+    CHECK(mBurst.load() != nullptr);
 }
 
 nn::SharedBurst ResilientBurst::getBurst() const {
-    std::lock_guard guard(mMutex);
-    return mBurst;
+    return mBurst.load();
 }
 
 nn::GeneralResult<nn::SharedBurst> ResilientBurst::recover(const nn::IBurst* failingBurst) const {
     std::lock_guard guard(mMutex);
+    auto current = mBurst.load();
 
     // Another caller updated the failing burst.
-    if (mBurst.get() != failingBurst) {
-        return mBurst;
+    if (current.get() != failingBurst) {
+        return current;
     }
 
-    mBurst = NN_TRY(kMakeBurst());
-    return mBurst;
+    auto burst = NN_TRY(kMakeBurst());
+    mBurst.store(burst);
+    return burst;
 }
 
 ResilientBurst::OptionalCacheHold ResilientBurst::cacheMemory(
@@ -96,29 +96,29 @@ ResilientDevice::ResilientDevice(PrivateConstructorTag /*tag*/, Factory makeDevi
       kCapabilities(std::move(capabilities)),
       mDevice(std::move(device)) {
     CHECK(kMakeDevice != nullptr);
-    CHECK(mDevice != nullptr);
+    CHECK(mDevice.load() != nullptr);
 }
 
 nn::SharedDevice ResilientDevice::getDevice() const {
-    std::lock_guard guard(mMutex);
-    return mDevice;
+    return mDevice.load();
 }
 
 nn::GeneralResult<nn::SharedDevice> ResilientDevice::recover(const nn::IDevice* failingDevice,
                                                              bool blocking) const {
     std::lock_guard guard(mMutex);
+    const auto current = mDevice.load();
 
     // Another caller updated the failing device.
-    if (mDevice.get() != failingDevice) {
-        return mDevice;
+    if (current.get() != failingDevice) {
+        return current;
     }
 
     auto device = NN_TRY(kMakeDevice(blocking));
 
     // If recovered device has different metadata than what is cached (i.e., because it was
     // updated), mark the device as invalid and preserve the cached data.
-    auto compare = [this, &device](auto fn) REQUIRES(mMutex) {
-        return std::invoke(fn, mDevice) != std::invoke(fn, device);
+    auto compare = [&current, &device](auto fn) {
+        return std::invoke(fn, current) != std::invoke(fn, device);
     };
     if (compare(&IDevice::getName) || compare(&IDevice::getVersionString) ||
         compare(&IDevice::getFeatureLevel) || compare(&IDevice::getType) ||
@@ -126,13 +126,13 @@ nn::GeneralResult<nn::SharedDevice> ResilientDevice::recover(const nn::IDevice*
         LOG(ERROR) << "Recovered device has different metadata than what is cached. Marking "
                       "IDevice object as invalid.";
         device = std::make_shared<const InvalidDevice>(
-                kName, kVersionString, mDevice->getFeatureLevel(), mDevice->getType(), kExtensions,
-                kCapabilities, mDevice->getNumberOfCacheFilesNeeded());
+                kName, kVersionString, current->getFeatureLevel(), current->getType(), kExtensions,
+                kCapabilities, current->getNumberOfCacheFilesNeeded());
         mIsValid = false;
     }
 
-    mDevice = std::move(device);
-    return mDevice;
+    mDevice.store(device);
+    return device;
 }
 
 const std::string& ResilientDevice::getName() const {
@@ -229,7 +229,6 @@ nn::GeneralResult<nn::SharedBuffer> ResilientDevice::allocate(
 }
 
 bool ResilientDevice::isValidInternal() const {
-    std::lock_guard hold(mMutex);
     return mIsValid;
 }
 
@@ -79,25 +79,26 @@ ResilientExecution::ResilientExecution(PrivateConstructorTag /*tag*/, Factory ma
                                        nn::SharedExecution execution)
     : kMakeExecution(std::move(makeExecution)), mExecution(std::move(execution)) {
     CHECK(kMakeExecution != nullptr);
-    CHECK(mExecution != nullptr);
+    CHECK(mExecution.load() != nullptr);
 }
 
 nn::SharedExecution ResilientExecution::getExecution() const {
-    std::lock_guard guard(mMutex);
-    return mExecution;
+    return mExecution.load();
 }
 
 nn::GeneralResult<nn::SharedExecution> ResilientExecution::recover(
         const nn::IExecution* failingExecution) const {
     std::lock_guard guard(mMutex);
+    auto current = mExecution.load();
 
     // Another caller updated the failing prepared model.
-    if (mExecution.get() != failingExecution) {
-        return mExecution;
+    if (current.get() != failingExecution) {
+        return current;
     }
 
-    mExecution = NN_TRY(kMakeExecution());
-    return mExecution;
+    auto execution = NN_TRY(kMakeExecution());
+    mExecution.store(execution);
+    return execution;
 }
 
 nn::ExecutionResult<std::pair<std::vector<nn::OutputShape>, nn::Timing>>
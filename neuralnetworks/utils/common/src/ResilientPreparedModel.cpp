@@ -82,25 +82,26 @@ ResilientPreparedModel::ResilientPreparedModel(PrivateConstructorTag /*tag*/,
                                                nn::SharedPreparedModel preparedModel)
     : kMakePreparedModel(std::move(makePreparedModel)), mPreparedModel(std::move(preparedModel)) {
     CHECK(kMakePreparedModel != nullptr);
-    CHECK(mPreparedModel != nullptr);
+    CHECK(mPreparedModel.load() != nullptr);
 }
 
 nn::SharedPreparedModel ResilientPreparedModel::getPreparedModel() const {
-    std::lock_guard guard(mMutex);
-    return mPreparedModel;
+    return mPreparedModel.load();
 }
 
 nn::GeneralResult<nn::SharedPreparedModel> ResilientPreparedModel::recover(
         const nn::IPreparedModel* failingPreparedModel) const {
     std::lock_guard guard(mMutex);
+    auto current = mPreparedModel.load();
 
     // Another caller updated the failing prepared model.
-    if (mPreparedModel.get() != failingPreparedModel) {
-        return mPreparedModel;
+    if (current.get() != failingPreparedModel) {
+        return current;
     }
 
-    mPreparedModel = NN_TRY(kMakePreparedModel());
-    return mPreparedModel;
+    auto preparedModel = NN_TRY(kMakePreparedModel());
+    mPreparedModel.store(preparedModel);
+    return preparedModel;
 }
 
 nn::ExecutionResult<std::pair<std::vector<nn::OutputShape>, nn::Timing>>
@@ -0,0 +1,133 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+#include <nnapi/hal/AtomicHandle.h>
+
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+
+namespace android::hardware::neuralnetworks::utils {
+namespace {
+
+constexpr size_t kNumReaders = 4;
+constexpr int kNumStores = 1000;
+
+}  // namespace
+
+TEST(AtomicHandleTest, load) {
+    // setup test
+    const auto value = std::make_shared<const int>(1);
+    const AtomicHandle<const int> handle(value);
+
+    // run test
+    const auto result = handle.load();
+
+    // verify result
+    EXPECT_EQ(result, value);
+}
+
+TEST(AtomicHandleTest, store) {
+    // setup test
+    AtomicHandle<const int> handle(std::make_shared<const int>(1));
+    const auto value = std::make_shared<const int>(2);
+
+    // run test
+    handle.store(value);
+
+    // verify result
+    EXPECT_EQ(handle.load(), value);
+}
+
+TEST(AtomicHandleTest, storeReleasesPreviousHandle) {
+    // setup test
+    auto value = std::make_shared<const int>(1);
+    const std::weak_ptr<const int> weakValue = value;
+    AtomicHandle<const int> handle(std::move(value));
+
+    // run test
+    handle.store(std::make_shared<const int>(2));
+
+    // verify result
+    EXPECT_TRUE(weakValue.expired());
+}
+
+TEST(AtomicHandleTest, concurrentLoadAndStore) {
+    // setup test
+    AtomicHandle<const int> handle(std::make_shared<const int>(0));
+    std::atomic<bool> done = false;
+    std::vector<std::thread> readers;
+    for (size_t i = 0; i < kNumReaders; ++i) {
+        readers.emplace_back([&handle, &done] {
+            int last = 0;
+            while (!done.load(std::memory_order_relaxed)) {
+                const auto value = handle.load();
+                ASSERT_NE(value, nullptr);
+                // Values are stored in increasing order.
+                EXPECT_GE(*value, last);
+                last = *value;
+            }
+        });
+    }
+
+    // run test
+    for (int i = 1; i <= kNumStores; ++i) {
+        handle.store(std::make_shared<const int>(i));
+    }
+    done = true;
+    for (auto& reader : readers) {
+        reader.join();
+    }
+
+    // verify result
+    EXPECT_EQ(*handle.load(), kNumStores);
+}
+
+TEST(AtomicHandleTest, storeReleasesPreviousHandlesWhileLoading) {
+    // setup test
+    AtomicHandle<const int> handle(std::make_shared<const int>(0));
+    std::atomic<bool> done = false;
+    std::vector<std::thread> readers;
+    for (size_t i = 0; i < kNumReaders; ++i) {
+        readers.emplace_back([&handle, &done] {
+            while (!done.load(std::memory_order_relaxed)) {
+                handle.load();
+            }
+        });
+    }
+
+    // run test
+    std::vector<std::weak_ptr<const int>> stored;
+    for (int i = 1; i <= kNumStores; ++i) {
+        auto value = std::make_shared<const int>(i);
+        stored.push_back(value);
+        handle.store(std::move(value));
+    }
+    done = true;
+    for (auto& reader : readers) {
+        reader.join();
+    }
+
+    // verify result
+    for (int i = 0; i + 1 < kNumStores; ++i) {
+        EXPECT_TRUE(stored[i].expired());
+    }
+    EXPECT_FALSE(stored.back().expired());
+}
+
+}  // namespace android::hardware::neuralnetworks::utils
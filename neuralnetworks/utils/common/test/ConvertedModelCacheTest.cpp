@@ -0,0 +1,273 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+#include <nnapi/TypeUtils.h>
+#include <nnapi/Types.h>
+#include <nnapi/hal/ConvertedModelCache.h>
+
+#include <memory>
+#include <vector>
+
+namespace android::hardware::neuralnetworks::utils {
+namespace {
+
+constexpr size_t kCapacity = 2;
+
+struct FakeHalModel {
+    int32_t value;
+};
+
+using Cache = ConvertedModelCache<FakeHalModel>;
+
+// ADD(input, constant, activation) -> output, with the constant stored inline.
+nn::Model createModel(float constant) {
+    const int32_t activation = 0;
+    nn::Model model;
+    const auto constantLocation = model.operandValues.append(
+            reinterpret_cast<const uint8_t*>(&constant), sizeof(constant));
+    const auto activationLocation = model.operandValues.append(
+            reinterpret_cast<const uint8_t*>(&activation), sizeof(activation));
+    model.main = {
+            .operands = {{.type = nn::OperandType::TENSOR_FLOAT32,
+                          .dimensions = {1},
+                          .lifetime = nn::Operand::LifeTime::SUBGRAPH_INPUT},
+                         {.type = nn::OperandType::TENSOR_FLOAT32,
+                          .dimensions = {1},
+                          .lifetime = nn::Operand::LifeTime::CONSTANT_COPY,
+                          .location = constantLocation},
+                         {.type = nn::OperandType::INT32,
+                          .lifetime = nn::Operand::LifeTime::CONSTANT_COPY,
+                          .location = activationLocation},
+                         {.type = nn::OperandType::TENSOR_FLOAT32,
+                          .dimensions = {1},
+                          .lifetime = nn::Operand::LifeTime::SUBGRAPH_OUTPUT}},
+            .operations = {{.type = nn::OperationType::ADD, .inputs = {0, 1, 2}, .outputs = {3}}},
+            .inputIndexes = {0},
+            .outputIndexes = {3},
+    };
+    return model;
+}
+
+// createModel(constant) with an extra constant tensor that pushes the operand values past
+// ModelFingerprint::kMaxInlineOperandValuesSize.
+nn::Model createLargeModel(float constant, uint8_t fill) {
+    auto model = createModel(constant);
+    const std::vector<uint8_t> values(ModelFingerprint::kMaxInlineOperandValuesSize, fill);
+    const auto location = model.operandValues.append(values.data(), values.size());
+    model.main.operands.push_back(
+            {.type = nn::OperandType::TENSOR_QUANT8_ASYMM,
+             .dimensions = {static_cast<uint32_t>(values.size())},
+             .scale = 1.0f,
+             .lifetime = nn::Operand::LifeTime::CONSTANT_COPY,
+             .location = location});
+    return model;
+}
+
+class ConvertedModelCacheTest : public ::testing::Test {
+  protected:
+    void SetUp() override {
+        Cache::getInstance().clear();
+        setConvertedModelCacheCapacity(kCapacity);
+        mInitialStats = Cache::getInstance().getStats();
+    }
+
+    void TearDown() override {
+        setConvertedModelCacheCapacity(0);
+        Cache::getInstance().clear();
+    }
+
+    nn::GeneralResult<std::shared_ptr<const FakeHalModel>> convert(const nn::Model& model) {
+        return convertModelCached(model, [this](const nn::Model& /*model*/) {
+            return nn::GeneralResult<FakeHalModel>(FakeHalModel{++mNumConversions});
+        });
+    }
+
+    ConvertedModelCacheStats statsDelta() const {
+        const auto stats = Cache::getInstance().getStats();
+        return {.hits = stats.hits - mInitialStats.hits,
+                .misses = stats.misses - mInitialStats.misses,
+                .bypassed = stats.bypassed - mInitialStats.bypassed,
+                .evictions = stats.evictions - mInitialStats.evictions,
+                .size = stats.size};
+    }
+
+    int32_t mNumConversions = 0;
+    ConvertedModelCacheStats mInitialStats;
+};
+
+}  // namespace
+
+TEST_F(ConvertedModelCacheTest, disabledWithZeroCapacity) {
+    // setup test
+    setConvertedModelCacheCapacity(0);
+    const auto model = createModel(1.0f);
+
+    // run test
+    const auto first = convert(model);
+    const auto second = convert(model);
+
+    // verify result
+    ASSERT_TRUE(first.has_value());
+    ASSERT_TRUE(second.has_value());
+    EXPECT_EQ(mNumConversions, 2);
+    EXPECT_NE(first.value(), second.value());
+    EXPECT_EQ(statsDelta().size, 0u);
+}
+
+TEST_F(ConvertedModelCacheTest, hit) {
+    // setup test
+    const auto model = createModel(1.0f);
+    const auto sameModel = createModel(1.0f);
+
+    // run test
+    const auto first = convert(model);
+    const auto second = convert(sameModel);
+
+    // verify result
+    ASSERT_TRUE(first.has_value());
+    ASSERT_TRUE(second.has_value());
+    EXPECT_EQ(mNumConversions, 1);
+    EXPECT_EQ(first.value(), second.value());
+    const auto stats = statsDelta();
+    EXPECT_EQ(stats.hits, 1u);
+    EXPECT_EQ(stats.misses, 1u);
+    EXPECT_EQ(stats.size, 1u);
+}
+
+TEST_F(ConvertedModelCacheTest, missOnDifferentOperandValues) {
+    // setup test
+    const auto model = createModel(1.0f);
+    const auto otherModel = createModel(2.0f);
+
+    // run test
+    const auto first = convert(model);
+    const auto second = convert(otherModel);
+
+    // verify result
+    ASSERT_TRUE(first.has_value());
+    ASSERT_TRUE(second.has_value());
+    EXPECT_EQ(mNumConversions, 2);
+    EXPECT_NE(first.value()->value, second.value()->value);
+    EXPECT_EQ(statsDelta().misses, 2u);
+}
+
+TEST_F(ConvertedModelCacheTest, evictsLeastRecentlyUsed) {
+    // setup test
+    const auto model1 = createModel(1.0f);
+    const auto model2 = createModel(2.0f);
+    const auto model3 = createModel(3.0f);
+    ASSERT_TRUE(convert(model1).has_value());
+    ASSERT_TRUE(convert(model2).has_value());
+    // Touch model1 so that model2 becomes the least recently used entry.
+    ASSERT_TRUE(convert(model1).has_value());
+
+    // run test
+    ASSERT_TRUE(convert(model3).has_value());
+    ASSERT_TRUE(convert(model1).has_value());
+    ASSERT_TRUE(convert(model2).has_value());
+
+    // verify result
+    EXPECT_EQ(mNumConversions, 4);
+    const auto stats = statsDelta();
+    EXPECT_EQ(stats.hits, 2u);
+    EXPECT_EQ(stats.misses, 4u);
+    EXPECT_EQ(stats.evictions, 2u);
+    EXPECT_EQ(stats.size, kCapacity);
+}
+
+TEST_F(ConvertedModelCacheTest, bypassPointerData) {
+    // setup test
+    auto model = createModel(1.0f);
+    const float constant = 1.0f;
+    model.main.operands[1].lifetime = nn::Operand::LifeTime::POINTER;
+    model.main.operands[1].location = {.pointer = &constant, .length = sizeof(constant)};
+
+    // run test
+    ASSERT_TRUE(convert(model).has_value());
+    ASSERT_TRUE(convert(model).has_value());
+
+    // verify result
+    EXPECT_EQ(mNumConversions, 2);
+    const auto stats = statsDelta();
+    EXPECT_EQ(stats.bypassed, 2u);
+    EXPECT_EQ(stats.size, 0u);
+}
+
+TEST_F(ConvertedModelCacheTest, errorsAreNotCached) {
+    // setup test
+    const auto model = createModel(1.0f);
+    const auto failingConvert =
+            [this](const nn::Model& /*model*/) -> nn::GeneralResult<FakeHalModel> {
+        ++mNumConversions;
+        return NN_ERROR(nn::ErrorStatus::INVALID_ARGUMENT) << "conversion failed";
+    };
+
+    // run test
+    const auto failed = convertModelCached(model, failingConvert);
+    const auto converted = convert(model);
+
+    // verify result
+    ASSERT_FALSE(failed.has_value());
+    EXPECT_EQ(failed.error().code, nn::ErrorStatus::INVALID_ARGUMENT);
+    ASSERT_TRUE(converted.has_value());
+    EXPECT_EQ(mNumConversions, 2);
+    EXPECT_EQ(statsDelta().size, 1u);
+}
+
+TEST_F(ConvertedModelCacheTest, hitOnLargeOperandValues) {
+    // setup test
+    auto model = std::make_unique<nn::Model>(createLargeModel(1.0f, 0x5a));
+    const auto sameModel = createLargeModel(1.0f, 0x5a);
+    ASSERT_GT(sameModel.operandValues.size(), ModelFingerprint::kMaxInlineOperandValuesSize);
+
+    // run test
+    const auto first = convert(*model);
+    // The cache entry must not reference the operand values of the model it was created from.
+    model.reset();
+    const auto second = convert(sameModel);
+
+    // verify result
+    ASSERT_TRUE(first.has_value());
+    ASSERT_TRUE(second.has_value());
+    EXPECT_EQ(mNumConversions, 1);
+    EXPECT_EQ(first.value(), second.value());
+    EXPECT_EQ(statsDelta().hits, 1u);
+}
+
+TEST_F(ConvertedModelCacheTest, largeOperandValuesAreComparedByteByByte) {
+    // setup test
+    const auto model = createLargeModel(1.0f, 0x5a);
+    auto otherModel = createLargeModel(1.0f, 0x5a);
+    const auto fingerprint = ModelFingerprint::create(model);
+    auto otherFingerprint = ModelFingerprint::create(otherModel);
+    ASSERT_TRUE(fingerprint.has_value());
+    ASSERT_TRUE(otherFingerprint.has_value());
+    EXPECT_TRUE(*fingerprint == *otherFingerprint);
+
+    // run test
+    // Change the last byte of otherModel's values behind the fingerprint's back, which is what a
+    // hash collision looks like to operator==.
+    const_cast<uint8_t*>(otherModel.operandValues.data())[otherModel.operandValues.size() - 1]++;
+
+    // verify result
+    EXPECT_EQ(fingerprint->hash(), otherFingerprint->hash());
+    EXPECT_FALSE(*fingerprint == *otherFingerprint);
+    otherFingerprint->retainOperandValues();
+    EXPECT_FALSE(*fingerprint == *otherFingerprint);
+}
+
+}  // namespace android::hardware::neuralnetworks::utils
@@ -0,0 +1,132 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "sensors-impl/DirectChannel.h"
+
+#include <log/log.h>
+#include <sys/mman.h>
+
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+
+namespace aidl {
+namespace android {
+namespace hardware {
+namespace sensors {
+
+using EventPayload = Event::EventPayload;
+
+static constexpr size_t kRecordSize = ISensors::DIRECT_REPORT_SENSOR_EVENT_TOTAL_LENGTH;
+static constexpr size_t kDataSize = ISensors::DIRECT_REPORT_SENSOR_EVENT_OFFSET_SIZE_RESERVED -
+                                    ISensors::DIRECT_REPORT_SENSOR_EVENT_OFFSET_SIZE_DATA;
+
+// Fills the data field of a record like the union of sensors_event_t.
+static void writeEventData(const EventPayload& payload, float* data) {
+    switch (payload.getTag()) {
+        case EventPayload::Tag::vec3: {
+            const EventPayload::Vec3& vec3 = payload.get<EventPayload::Tag::vec3>();
+            data[0] = vec3.x;
+            data[1] = vec3.y;
+            data[2] = vec3.z;
+            // The status follows the vector, as in sensors_vec_t.
+            int8_t status = static_cast<int8_t>(vec3.status);
+            memcpy(&data[3], &status, sizeof(status));
+            break;
+        }
+        case EventPayload::Tag::vec4: {
+            const EventPayload::Vec4& vec4 = payload.get<EventPayload::Tag::vec4>();
+            data[0] = vec4.x;
+            data[1] = vec4.y;
+            data[2] = vec4.z;
+            data[3] = vec4.w;
+            break;
+        }
+        case EventPayload::Tag::uncal: {
+            const EventPayload::Uncal& uncal = payload.get<EventPayload::Tag::uncal>();
+            data[0] = uncal.x;
+            data[1] = uncal.y;
+            data[2] = uncal.z;
+            data[3] = uncal.xBias;
+            data[4] = uncal.yBias;
+            data[5] = uncal.zBias;
+            break;
+        }
+        case EventPayload::Tag::scalar:
+            data[0] = payload.get<EventPayload::Tag::scalar>();
+            break;
+        default:
+            break;
+    }
+}
+
+std::unique_ptr<DirectChannel> DirectChannel::create(const SharedMemInfo& mem) {
+    if (mem.type != SharedMemInfo::SharedMemType::ASHMEM ||
+        mem.format != SharedMemInfo::SharedMemFormat::SENSORS_EVENT || mem.size < 0 ||
+        static_cast<size_t>(mem.size) < kRecordSize || mem.memoryHandle.fds.size() != 1) {
+        return nullptr;
+    }
+
+    // The mapping stays valid once the file descriptor is closed along with the parcel.
+    size_t size = static_cast<size_t>(mem.size);
+    void* base = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED,
+                      mem.memoryHandle.fds[0].get(), 0 /* offset */);
+    if (base == MAP_FAILED) {
+        ALOGE("Failed to map direct channel memory: %s", strerror(errno));
+        return nullptr;
+    }
+    memset(base, 0, size);
+    return std::unique_ptr<DirectChannel>(new DirectChannel(static_cast<uint8_t*>(base), size));
+}
+
+DirectChannel::DirectChannel(uint8_t* base, size_t size)
+    : mBase(base), mSize(size), mNumRecords(size / kRecordSize), mNextRecord(0), mCounter(0) {}
+
+DirectChannel::~DirectChannel() {
+    munmap(mBase, mSize);
+}
+
+void DirectChannel::write(const Event& event, int32_t reportToken) {
+    std::lock_guard<std::mutex> lock(mWriteLock);
+    uint8_t* record = mBase + mNextRecord * kRecordSize;
+    mNextRecord = (mNextRecord + 1) % mNumRecords;
+    if (++mCounter == 0) {
+        mCounter = 1;
+    }
+
+    int32_t size = kRecordSize;
+    int32_t type = static_cast<int32_t>(event.sensorType);
+    float data[kDataSize / sizeof(float)] = {};
+    writeEventData(event.payload, data);
+    memcpy(record + ISensors::DIRECT_REPORT_SENSOR_EVENT_OFFSET_SIZE_FIELD, &size, sizeof(size));
+    memcpy(record + ISensors::DIRECT_REPORT_SENSOR_EVENT_OFFSET_SIZE_REPORT_TOKEN, &reportToken,
+           sizeof(reportToken));
+    memcpy(record + ISensors::DIRECT_REPORT_SENSOR_EVENT_OFFSET_SIZE_SENSOR_TYPE, &type,
+           sizeof(type));
+    memcpy(record + ISensors::DIRECT_REPORT_SENSOR_EVENT_OFFSET_SIZE_TIMESTAMP, &event.timestamp,
+           sizeof(event.timestamp));
+    memcpy(record + ISensors::DIRECT_REPORT_SENSOR_EVENT_OFFSET_SIZE_DATA, data, sizeof(data));
+
+    // Publishes the record to readers polling the counter.
+    reinterpret_cast<std::atomic<uint32_t>*>(
+            record + ISensors::DIRECT_REPORT_SENSOR_EVENT_OFFSET_SIZE_ATOMIC_COUNTER)
+            ->store(mCounter, std::memory_order_release);
+}
+
+}  // namespace sensors
+}  // namespace hardware
+}  // namespace android
+}  // namespace aidl
@@ -18,6 +18,7 @@
 
 #include "utils/SystemClock.h"
 
+#include <algorithm>
 #include <cmath>
 
 using ::ndk::ScopedAStatus;
@@ -28,48 +29,98 @@ namespace hardware {
 namespace sensors {
 
 static constexpr int32_t kDefaultMaxDelayUs = 10 * 1000 * 1000;
+// Size of the software FIFO of the continuous sensors, e.g. 3 s of accelerometer data at the
+// fastest rate.
+static constexpr int32_t kDefaultFifoEventCount = 300;
+static constexpr int64_t kNanosecondsInSeconds = 1000 * 1000 * 1000;
+
+// The rate a direct channel is written at for each RateLevel, which is the nominal rate of the
+// level.
+static int64_t directReportSamplingPeriodNs(Sensor::RateLevel rate) {
+    switch (rate) {
+        case Sensor::RateLevel::NORMAL:
+            return kNanosecondsInSeconds / 50;
+        case Sensor::RateLevel::FAST:
+            return kNanosecondsInSeconds / 200;
+        case Sensor::RateLevel::VERY_FAST:
+            return kNanosecondsInSeconds / 800;
+        default:
+            return 0;
+    }
+}
+
+// Returns the last multiple of the period at or before 'now'. Sampling on multiples of the period
+// keeps the rate steady, and makes the sensors at the same or harmonic rates due at the same time,
+// so that the SensorScheduler processes them together.
+static int64_t alignToPeriod(int64_t now, int64_t periodNs) {
+    return periodNs > 0 ? now - now % periodNs : now;
+}
+
+// The flags of a sensor supporting ASHMEM direct channels up to the given rate.
+static uint32_t directReportFlags(Sensor::RateLevel maxRate) {
+    return static_cast<uint32_t>(SensorInfo::SENSOR_FLAG_BITS_DIRECT_CHANNEL_ASHMEM) |
+           (static_cast<uint32_t>(maxRate)
+            << static_cast<uint32_t>(SensorInfo::SENSOR_FLAG_SHIFT_DIRECT_REPORT));
+}
 
 Sensor::Sensor(ISensorsEventCallback* callback)
     : mIsEnabled(false),
       mSamplingPeriodNs(0),
+      mMaxReportLatencyNs(0),
       mLastSampleTimeNs(0),
+      mFifoDeadlineNs(0),
+      mScheduler(SensorScheduler::getInstance()),
       mCallback(callback),
-      mMode(OperationMode::NORMAL) {
-    mRunThread = std::thread(startThread, this);
-}
+      mMode(OperationMode::NORMAL) {}
 
 Sensor::~Sensor() {
-    std::unique_lock<std::mutex> lock(mRunMutex);
-    mStopThread = true;
-    mIsEnabled = false;
-    mWaitCV.notify_all();
-    lock.release();
-    mRunThread.join();
+    std::unique_lock<std::mutex> lock(mScheduler->getLock());
+    mScheduler->schedule(this, INT64_MAX);
+    // The scheduler may still be posting events of the sensor to its callback.
+    mScheduler->waitForPosts();
 }
 
 const SensorInfo& Sensor::getSensorInfo() const {
     return mSensorInfo;
 }
 
-void Sensor::batch(int64_t samplingPeriodNs) {
+void Sensor::batch(int64_t samplingPeriodNs, int64_t maxReportLatencyNs) {
     if (samplingPeriodNs < mSensorInfo.minDelayUs * 1000LL) {
         samplingPeriodNs = mSensorInfo.minDelayUs * 1000LL;
     } else if (samplingPeriodNs > mSensorInfo.maxDelayUs * 1000LL) {
         samplingPeriodNs = mSensorInfo.maxDelayUs * 1000LL;
     }
+    // Sensors without a FIFO report events as soon as they are generated.
+    if (mSensorInfo.fifoMaxEventCount <= 0 || maxReportLatencyNs < 0) {
+        maxReportLatencyNs = 0;
+    }
 
-    if (mSamplingPeriodNs != samplingPeriodNs) {
+    if (mSamplingPeriodNs != samplingPeriodNs || mMaxReportLatencyNs != maxReportLatencyNs) {
+        std::unique_lock<std::mutex> lock(mScheduler->getLock());
         mSamplingPeriodNs = samplingPeriodNs;
-        // Wake up the 'run' thread to check if a new event should be generated now
-        mWaitCV.notify_all();
+        std::vector<Event> events;
+        if (mMaxReportLatencyNs != maxReportLatencyNs) {
+            // Events batched so far are reported with the previous latency.
+            drainFifo(&events);
+            mMaxReportLatencyNs = maxReportLatencyNs;
+            if (mMaxReportLatencyNs > 0) {
+                mFifo.reserve(mSensorInfo.fifoMaxEventCount);
+            }
+        }
+        // Check if a new event should be generated now
+        reschedule();
+        mScheduler->post(&lock, mCallback, events, isWakeUpSensor());
     }
 }
 
 void Sensor::activate(bool enable) {
     if (mIsEnabled != enable) {
-        std::unique_lock<std::mutex> lock(mRunMutex);
+        std::unique_lock<std::mutex> lock(mScheduler->getLock());
         mIsEnabled = enable;
-        mWaitCV.notify_all();
+        reschedule();
+        if (!enable) {
+            postFifo(&lock);
+        }
     }
 }
 
@@ -82,8 +133,8 @@ ScopedAStatus Sensor::flush() {
                 static_cast<int32_t>(BnSensors::ERROR_BAD_VALUE));
     }
 
-    // Note: If a sensor supports batching, write all of the currently batched events for the sensor
-    // to the Event FMQ prior to writing the flush complete event.
+    // Write all of the currently batched events for the sensor to the Event FMQ along with, and
+    // prior to, the flush complete event.
     Event ev;
     ev.sensorHandle = mSensorInfo.sensorHandle;
     ev.sensorType = SensorType::META_DATA;
@@ -91,42 +142,92 @@ ScopedAStatus Sensor::flush() {
             .what = MetaDataEventType::META_DATA_FLUSH_COMPLETE,
     };
     ev.payload.set<EventPayload::Tag::meta>(meta);
-    std::vector<Event> evs{ev};
-    mCallback->postEvents(evs, isWakeUpSensor());
+    std::unique_lock<std::mutex> lock(mScheduler->getLock());
+    mFifo.push_back(ev);
+    postFifo(&lock);
 
     return ScopedAStatus::ok();
 }
 
-void Sensor::startThread(Sensor* sensor) {
-    sensor->run();
+int64_t Sensor::process(int64_t now, std::vector<Event>* events) {
+    writeDirectReports(now);
+    if (mIsEnabled) {
+        if (now >= mLastSampleTimeNs + mSamplingPeriodNs) {
+            mLastSampleTimeNs = alignToPeriod(now, mSamplingPeriodNs);
+            batchEvents(readEvents(), now, events);
+        }
+        if (!mFifo.empty() && now >= mFifoDeadlineNs) {
+            drainFifo(events);
+        }
+    }
+    return getNextDeadline();
 }
 
-void Sensor::run() {
-    std::unique_lock<std::mutex> runLock(mRunMutex);
-    constexpr int64_t kNanosecondsInSeconds = 1000 * 1000 * 1000;
+int64_t Sensor::getNextDeadline() const {
+    if (mMode == OperationMode::DATA_INJECTION) {
+        return INT64_MAX;
+    }
+    int64_t deadline = INT64_MAX;
+    if (mIsEnabled) {
+        deadline = mLastSampleTimeNs + mSamplingPeriodNs;
+        if (!mFifo.empty()) {
+            deadline = std::min(deadline, mFifoDeadlineNs);
+        }
+    }
+    for (const auto& [channelHandle, report] : mDirectReports) {
+        deadline = std::min(deadline, report.nextSampleTimeNs);
+    }
+    return deadline;
+}
 
-    while (!mStopThread) {
-        if (!mIsEnabled || mMode == OperationMode::DATA_INJECTION) {
-            mWaitCV.wait(runLock, [&] {
-                return ((mIsEnabled && mMode == OperationMode::NORMAL) || mStopThread);
-            });
-        } else {
-            timespec curTime;
-            clock_gettime(CLOCK_BOOTTIME, &curTime);
-            int64_t now = (curTime.tv_sec * kNanosecondsInSeconds) + curTime.tv_nsec;
-            int64_t nextSampleTime = mLastSampleTimeNs + mSamplingPeriodNs;
+void Sensor::reschedule() {
+    mScheduler->schedule(this, getNextDeadline());
+}
 
-            if (now >= nextSampleTime) {
-                mLastSampleTimeNs = now;
-                nextSampleTime = mLastSampleTimeNs + mSamplingPeriodNs;
-                mCallback->postEvents(readEvents(), isWakeUpSensor());
+void Sensor::writeDirectReports(int64_t now) {
+    for (auto& [channelHandle, report] : mDirectReports) {
+        if (now >= report.nextSampleTimeNs) {
+            for (const Event& event : readEvents()) {
+                report.channel->write(event, mSensorInfo.sensorHandle /* reportToken */);
             }
-
-            mWaitCV.wait_for(runLock, std::chrono::nanoseconds(nextSampleTime - now));
+            report.nextSampleTimeNs =
+                    alignToPeriod(now, report.samplingPeriodNs) + report.samplingPeriodNs;
         }
     }
 }
 
+void Sensor::batchEvents(const std::vector<Event>& events, int64_t now,
+                         std::vector<Event>* outEvents) {
+    if (events.empty()) {
+        return;
+    }
+    if (mMaxReportLatencyNs == 0) {
+        drainFifo(outEvents);
+        outEvents->insert(outEvents->end(), events.begin(), events.end());
+        return;
+    }
+    if (mFifo.empty()) {
+        mFifoDeadlineNs = now + mMaxReportLatencyNs;
+    }
+    mFifo.insert(mFifo.end(), events.begin(), events.end());
+    if (mFifo.size() >= static_cast<size_t>(mSensorInfo.fifoMaxEventCount)) {
+        drainFifo(outEvents);
+    }
+}
+
+void Sensor::drainFifo(std::vector<Event>* outEvents) {
+    outEvents->insert(outEvents->end(), mFifo.begin(), mFifo.end());
+    // Keeps the capacity, so that batching does not allocate.
+    mFifo.clear();
+}
+
+void Sensor::postFifo(std::unique_lock<std::mutex>* lock) {
+    // Copied out, as the FIFO may change once the lock is released.
+    std::vector<Event> events;
+    drainFifo(&events);
+    mScheduler->post(lock, mCallback, events, isWakeUpSensor());
+}
+
 bool Sensor::isWakeUpSensor() {
     return mSensorInfo.flags & static_cast<uint32_t>(SensorInfo::SENSOR_FLAG_BITS_WAKE_UP);
 }
@@ -145,9 +246,13 @@ std::vector<Event> Sensor::readEvents() {
 
 void Sensor::setOperationMode(OperationMode mode) {
     if (mMode != mode) {
-        std::unique_lock<std::mutex> lock(mRunMutex);
+        std::unique_lock<std::mutex> lock(mScheduler->getLock());
         mMode = mode;
-        mWaitCV.notify_all();
+        reschedule();
+        if (mMode == OperationMode::DATA_INJECTION) {
+            // The sensor stops sampling, so the batched events are not held until it resumes.
+            postFifo(&lock);
+        }
     }
 }
 
@@ -175,6 +280,50 @@ ScopedAStatus Sensor::injectEvent(const Event& event) {
             static_cast<int32_t>(BnSensors::ERROR_BAD_VALUE));
 }
 
+bool Sensor::supportsDirectChannel() const {
+    return mSensorInfo.flags &
+           static_cast<uint32_t>(SensorInfo::SENSOR_FLAG_BITS_DIRECT_CHANNEL_ASHMEM);
+}
+
+ScopedAStatus Sensor::configDirectReport(const std::shared_ptr<DirectChannel>& channel,
+                                         int32_t channelHandle, RateLevel rate,
+                                         int32_t* reportToken) {
+    uint32_t maxRate = (mSensorInfo.flags &
+                        static_cast<uint32_t>(SensorInfo::SENSOR_FLAG_BITS_MASK_DIRECT_REPORT)) >>
+                       static_cast<uint32_t>(SensorInfo::SENSOR_FLAG_SHIFT_DIRECT_REPORT);
+    if (!supportsDirectChannel() || static_cast<uint32_t>(rate) > maxRate) {
+        return ScopedAStatus::fromExceptionCode(EX_ILLEGAL_ARGUMENT);
+    }
+
+    if (rate == RateLevel::STOP) {
+        stopDirectReport(channelHandle);
+        *reportToken = 0;
+        return ScopedAStatus::ok();
+    }
+
+    int64_t samplingPeriodNs = directReportSamplingPeriodNs(rate);
+    std::unique_lock<std::mutex> lock(mScheduler->getLock());
+    auto report = mDirectReports.find(channelHandle);
+    if (report == mDirectReports.end() || report->second.samplingPeriodNs != samplingPeriodNs) {
+        // Reports the first event right away.
+        mDirectReports[channelHandle] = {
+                .channel = channel,
+                .samplingPeriodNs = samplingPeriodNs,
+                .nextSampleTimeNs = 0,
+        };
+        reschedule();
+    }
+    *reportToken = mSensorInfo.sensorHandle;
+    return ScopedAStatus::ok();
+}
+
+void Sensor::stopDirectReport(int32_t channelHandle) {
+    std::unique_lock<std::mutex> lock(mScheduler->getLock());
+    if (mDirectReports.erase(channelHandle) > 0) {
+        reschedule();
+    }
+}
+
 OnChangeSensor::OnChangeSensor(ISensorsEventCallback* callback)
     : Sensor(callback), mPreviousEventSet(false) {}
 
@@ -213,10 +362,11 @@ AccelSensor::AccelSensor(int32_t sensorHandle, ISensorsEventCallback* callback)
     mSensorInfo.power = 0.001f;          // mA
     mSensorInfo.minDelayUs = 10 * 1000;  // microseconds
     mSensorInfo.maxDelayUs = kDefaultMaxDelayUs;
-    mSensorInfo.fifoReservedEventCount = 0;
-    mSensorInfo.fifoMaxEventCount = 0;
+    mSensorInfo.fifoReservedEventCount = kDefaultFifoEventCount;
+    mSensorInfo.fifoMaxEventCount = kDefaultFifoEventCount;
     mSensorInfo.requiredPermission = "";
-    mSensorInfo.flags = static_cast<uint32_t>(SensorInfo::SENSOR_FLAG_BITS_DATA_INJECTION);
+    mSensorInfo.flags = static_cast<uint32_t>(SensorInfo::SENSOR_FLAG_BITS_DATA_INJECTION) |
+                        directReportFlags(RateLevel::NORMAL);
 };
 
 void AccelSensor::readEventPayload(EventPayload& payload) {
@@ -242,8 +392,8 @@ PressureSensor::PressureSensor(int32_t sensorHandle, ISensorsEventCallback* call
     mSensorInfo.power = 0.001f;           // mA
     mSensorInfo.minDelayUs = 100 * 1000;  // microseconds
     mSensorInfo.maxDelayUs = kDefaultMaxDelayUs;
-    mSensorInfo.fifoReservedEventCount = 0;
-    mSensorInfo.fifoMaxEventCount = 0;
+    mSensorInfo.fifoReservedEventCount = kDefaultFifoEventCount;
+    mSensorInfo.fifoMaxEventCount = kDefaultFifoEventCount;
     mSensorInfo.requiredPermission = "";
     mSensorInfo.flags = 0;
 };
@@ -265,10 +415,11 @@ MagnetometerSensor::MagnetometerSensor(int32_t sensorHandle, ISensorsEventCallba
     mSensorInfo.power = 0.001f;          // mA
     mSensorInfo.minDelayUs = 20 * 1000;  // microseconds
     mSensorInfo.maxDelayUs = kDefaultMaxDelayUs;
-    mSensorInfo.fifoReservedEventCount = 0;
-    mSensorInfo.fifoMaxEventCount = 0;
+    mSensorInfo.fifoReservedEventCount = kDefaultFifoEventCount;
+    mSensorInfo.fifoMaxEventCount = kDefaultFifoEventCount;
     mSensorInfo.requiredPermission = "";
-    mSensorInfo.flags = static_cast<uint32_t>(SensorInfo::SENSOR_FLAG_BITS_DATA_INJECTION);
+    mSensorInfo.flags = static_cast<uint32_t>(SensorInfo::SENSOR_FLAG_BITS_DATA_INJECTION) |
+                        directReportFlags(RateLevel::NORMAL);
 };
 
 void MagnetometerSensor::readEventPayload(EventPayload& payload) {
@@ -340,10 +491,11 @@ GyroSensor::GyroSensor(int32_t sensorHandle, ISensorsEventCallback* callback) :
     mSensorInfo.power = 0.001f;
     mSensorInfo.minDelayUs = 10 * 1000;  // microseconds
     mSensorInfo.maxDelayUs = kDefaultMaxDelayUs;
-    mSensorInfo.fifoReservedEventCount = 0;
-    mSensorInfo.fifoMaxEventCount = 0;
+    mSensorInfo.fifoReservedEventCount = kDefaultFifoEventCount;
+    mSensorInfo.fifoMaxEventCount = kDefaultFifoEventCount;
     mSensorInfo.requiredPermission = "";
-    mSensorInfo.flags = static_cast<uint32_t>(SensorInfo::SENSOR_FLAG_BITS_DATA_INJECTION);
+    mSensorInfo.flags = static_cast<uint32_t>(SensorInfo::SENSOR_FLAG_BITS_DATA_INJECTION) |
+                        directReportFlags(RateLevel::NORMAL);
 };
 
 void GyroSensor::readEventPayload(EventPayload& payload) {
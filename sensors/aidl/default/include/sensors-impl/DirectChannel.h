@@ -0,0 +1,83 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <aidl/android/hardware/sensors/BnSensors.h>
+
+#include <memory>
+#include <mutex>
+
+namespace aidl {
+namespace android {
+namespace hardware {
+namespace sensors {
+
+/**
+ * A direct report channel, i.e. a shared memory region the HAL writes sensor events to in the
+ * ISensors::DIRECT_REPORT_SENSOR_EVENT_* format, without going through the event FMQ.
+ *
+ * The region is used as a ring of records. The atomic counter of each record is written last, so
+ * that a reader polling the counter never sees a partially written record.
+ */
+class DirectChannel {
+  public:
+    using Event = ::aidl::android::hardware::sensors::Event;
+    using SharedMemInfo = ::aidl::android::hardware::sensors::ISensors::SharedMemInfo;
+
+    /**
+     * Maps the shared memory of a direct channel and zeroes it.
+     *
+     * @param mem The shared memory registered by the framework.
+     *
+     * @return The channel, or nullptr if the memory is not supported or cannot be mapped.
+     */
+    static std::unique_ptr<DirectChannel> create(const SharedMemInfo& mem);
+
+    ~DirectChannel();
+
+    DirectChannel(const DirectChannel&) = delete;
+    DirectChannel& operator=(const DirectChannel&) = delete;
+
+    /**
+     * Writes an event as the next record of the ring. Safe to call from several sensor threads.
+     *
+     * @param event The event to write.
+     * @param reportToken The token returned by ISensors::configDirectReport for the sensor.
+     */
+    void write(const Event& event, int32_t reportToken);
+
+  private:
+    DirectChannel(uint8_t* base, size_t size);
+
+    // The mapped shared memory
+    uint8_t* const mBase;
+    // The size of the mapping, and the number of records which fit in it
+    const size_t mSize;
+    const size_t mNumRecords;
+
+    // Protects the fields below
+    std::mutex mWriteLock;
+    // The index of the next record written
+    size_t mNextRecord;
+    // The atomic counter of the last record written. Starts at 1 and skips 0 when wrapping.
+    uint32_t mCounter;
+};
+
+}  // namespace sensors
+}  // namespace hardware
+}  // namespace android
+}  // namespace aidl
@@ -14,10 +14,16 @@
  * limitations under the License.
  */
 
-#include <thread>
+#include <map>
+#include <mutex>
+#include <vector>
 
 #include <aidl/android/hardware/sensors/BnSensors.h>
 
+#include <SensorScheduler.h>
+
+#include "DirectChannel.h"
+
 namespace aidl {
 namespace android {
 namespace hardware {
@@ -31,9 +37,15 @@ class ISensorsEventCallback {
     virtual void postEvents(const std::vector<Event>& events, bool wakeup) = 0;
 };
 
+class Sensor;
+
+using SensorScheduler =
+        ::android::hardware::sensors::common::SensorScheduler<Sensor, ISensorsEventCallback, Event>;
+
 class Sensor {
   public:
     using OperationMode = ::aidl::android::hardware::sensors::ISensors::OperationMode;
+    using RateLevel = ::aidl::android::hardware::sensors::ISensors::RateLevel;
     using Event = ::aidl::android::hardware::sensors::Event;
     using EventPayload = ::aidl::android::hardware::sensors::Event::EventPayload;
     using SensorInfo = ::aidl::android::hardware::sensors::SensorInfo;
@@ -45,7 +57,7 @@ class Sensor {
     virtual ~Sensor();
 
     const SensorInfo& getSensorInfo() const;
-    void batch(int64_t samplingPeriodNs);
+    void batch(int64_t samplingPeriodNs, int64_t maxReportLatencyNs);
     virtual void activate(bool enable);
     ndk::ScopedAStatus flush();
 
@@ -53,23 +65,61 @@ class Sensor {
     bool supportsDataInjection() const;
     ndk::ScopedAStatus injectEvent(const Event& event);
 
+    bool supportsDirectChannel() const;
+    // Starts, changes or stops (with RateLevel::STOP) reporting the sensor to a direct channel.
+    ndk::ScopedAStatus configDirectReport(const std::shared_ptr<DirectChannel>& channel,
+                                          int32_t channelHandle, RateLevel rate,
+                                          int32_t* reportToken);
+    void stopDirectReport(int32_t channelHandle);
+
   protected:
-    void run();
+    // A direct channel the sensor reports to, and when it writes the next event to it.
+    struct DirectReport {
+        std::shared_ptr<DirectChannel> channel;
+        int64_t samplingPeriodNs;
+        int64_t nextSampleTimeNs;
+    };
+
+    friend SensorScheduler;
+
+    // Generates the events due at 'now', adds the ones to post to 'events', and returns when the
+    // sensor is due next. Called by the SensorScheduler.
+    int64_t process(int64_t now, std::vector<Event>* events);
+    // Returns when the sensor is due next, or INT64_MAX if it is idle.
+    int64_t getNextDeadline() const;
+    // Updates the deadline of the sensor after a configuration change. Requires the scheduler lock.
+    void reschedule();
+
     virtual std::vector<Event> readEvents();
     virtual void readEventPayload(EventPayload&) = 0;
-    static void startThread(Sensor* sensor);
 
     bool isWakeUpSensor();
 
+    // Adds the events to 'outEvents' right away, or batches them in the FIFO if a report latency
+    // is set.
+    void batchEvents(const std::vector<Event>& events, int64_t now,
+                     std::vector<Event>* outEvents);
+    // Moves the events batched in the FIFO to 'outEvents'.
+    void drainFifo(std::vector<Event>* outEvents);
+    // Posts the events batched in the FIFO, if any, and releases the scheduler lock held by 'lock'.
+    void postFifo(std::unique_lock<std::mutex>* lock);
+    // Writes events to the direct channels which are due. Requires the scheduler lock.
+    void writeDirectReports(int64_t now);
+
     bool mIsEnabled;
     int64_t mSamplingPeriodNs;
+    int64_t mMaxReportLatencyNs;
     int64_t mLastSampleTimeNs;
+
+    // Software FIFO holding up to fifoMaxEventCount events until mFifoDeadlineNs
+    std::vector<Event> mFifo;
+    int64_t mFifoDeadlineNs;
+    // The direct channels the sensor reports to, by channel handle
+    std::map<int32_t, DirectReport> mDirectReports;
     SensorInfo mSensorInfo;
 
-    std::atomic_bool mStopThread;
-    std::condition_variable mWaitCV;
-    std::mutex mRunMutex;
-    std::thread mRunThread;
+    // Generates the events of the sensor. Its lock protects the fields above and mMode.
+    SensorScheduler* mScheduler;
 
     ISensorsEventCallback* mCallback;
 
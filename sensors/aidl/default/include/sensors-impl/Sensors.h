@@ -41,6 +41,7 @@ class Sensors : public BnSensors, public ISensorsEventCallback {
     Sensors()
         : mEventQueueFlag(nullptr),
           mNextHandle(1),
+          mNextChannelHandle(1),
           mOutstandingWakeUpEvents(0),
           mReadWakeLockQueueRun(false),
           mAutoReleaseWakeLockTime(0),
@@ -59,7 +60,9 @@ class Sensors : public BnSensors, public ISensorsEventCallback {
     virtual ~Sensors() {
         deleteEventFlag();
         mReadWakeLockQueueRun = false;
-        mWakeLockThread.join();
+        if (mWakeLockThread.joinable()) {
+            mWakeLockThread.join();
+        }
     }
 
     ::ndk::ScopedAStatus activate(int32_t in_sensorHandle, bool in_enabled) override;
@@ -194,6 +197,12 @@ class Sensors : public BnSensors, public ISensorsEventCallback {
     std::map<int32_t, std::shared_ptr<Sensor>> mSensors;
     // The next available sensor handle.
     int32_t mNextHandle;
+    // A map of the registered direct channels.
+    std::map<int32_t, std::shared_ptr<DirectChannel>> mDirectChannels;
+    // The next available direct channel handle.
+    int32_t mNextChannelHandle;
+    // Lock to protect the direct channels.
+    std::mutex mDirectChannelLock;
     // Lock to protect writes to the FMQs.
     std::mutex mWriteLock;
     // Lock to protect acquiring and releasing the wake lock
@@ -0,0 +1,240 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Reads the direct channels of the default HAL like a client of SensorDirectChannel would, i.e.
+// only through the shared memory once the channel is configured.
+
+#include <gtest/gtest.h>
+
+#include <cutils/ashmem.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "sensors-impl/Sensors.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <map>
+#include <thread>
+#include <vector>
+
+using ::aidl::android::hardware::sensors::ISensors;
+using ::aidl::android::hardware::sensors::SensorInfo;
+using ::aidl::android::hardware::sensors::Sensors;
+using ::aidl::android::hardware::sensors::SensorType;
+
+namespace {
+
+constexpr size_t kRecordSize = ISensors::DIRECT_REPORT_SENSOR_EVENT_TOTAL_LENGTH;
+constexpr size_t kNumRecords = 1000;
+constexpr size_t kMemSize = kNumRecords * kRecordSize;
+constexpr auto kMeasureTime = std::chrono::seconds(1);
+
+struct Record {
+    int32_t size;
+    int32_t reportToken;
+    int32_t type;
+    uint32_t counter;
+    int64_t timestamp;
+};
+
+class DirectChannelTest : public ::testing::Test {
+  protected:
+    void SetUp() override {
+        mSensors = ndk::SharedRefBase::make<Sensors>();
+        mFd = ashmem_create_region("DirectChannelTest", kMemSize);
+        ASSERT_GE(mFd, 0);
+        void* buffer = mmap(nullptr, kMemSize, PROT_READ | PROT_WRITE, MAP_SHARED, mFd, 0);
+        ASSERT_NE(buffer, MAP_FAILED);
+        mBuffer = static_cast<uint8_t*>(buffer);
+    }
+
+    void TearDown() override {
+        if (mBuffer != nullptr) {
+            munmap(mBuffer, kMemSize);
+        }
+        if (mFd >= 0) {
+            close(mFd);
+        }
+    }
+
+    ISensors::SharedMemInfo makeSharedMemInfo(ISensors::SharedMemInfo::SharedMemType type) {
+        ISensors::SharedMemInfo mem;
+        mem.type = type;
+        mem.format = ISensors::SharedMemInfo::SharedMemFormat::SENSORS_EVENT;
+        mem.size = kMemSize;
+        mem.memoryHandle.fds.emplace_back(dup(mFd));
+        return mem;
+    }
+
+    int32_t registerChannel() {
+        int32_t channelHandle = 0;
+        EXPECT_TRUE(mSensors
+                            ->registerDirectChannel(makeSharedMemInfo(
+                                                            ISensors::SharedMemInfo::
+                                                                    SharedMemType::ASHMEM),
+                                                    &channelHandle)
+                            .isOk());
+        return channelHandle;
+    }
+
+    int32_t getSensorHandle(SensorType type) {
+        std::vector<SensorInfo> sensors;
+        mSensors->getSensorsList(&sensors);
+        for (const SensorInfo& sensor : sensors) {
+            if (sensor.type == type) {
+                return sensor.sensorHandle;
+            }
+        }
+        return -1;
+    }
+
+    // Waits for the record following the last one read, like a client polling the ring.
+    bool readNextRecord(Record* record, std::chrono::milliseconds timeout) {
+        const uint8_t* base = mBuffer + (mNumRead % kNumRecords) * kRecordSize;
+        uint32_t expectedCounter = static_cast<uint32_t>(mNumRead + 1);
+        auto deadline = std::chrono::steady_clock::now() + timeout;
+        while (reinterpret_cast<const std::atomic<uint32_t>*>(
+                       base + ISensors::DIRECT_REPORT_SENSOR_EVENT_OFFSET_SIZE_ATOMIC_COUNTER)
+                       ->load(std::memory_order_acquire) != expectedCounter) {
+            if (std::chrono::steady_clock::now() > deadline) {
+                return false;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        memcpy(&record->size, base + ISensors::DIRECT_REPORT_SENSOR_EVENT_OFFSET_SIZE_FIELD,
+               sizeof(record->size));
+        memcpy(&record->reportToken,
+               base + ISensors::DIRECT_REPORT_SENSOR_EVENT_OFFSET_SIZE_REPORT_TOKEN,
+               sizeof(record->reportToken));
+        memcpy(&record->type, base + ISensors::DIRECT_REPORT_SENSOR_EVENT_OFFSET_SIZE_SENSOR_TYPE,
+               sizeof(record->type));
+        record->counter = expectedCounter;
+        memcpy(&record->timestamp,
+               base + ISensors::DIRECT_REPORT_SENSOR_EVENT_OFFSET_SIZE_TIMESTAMP,
+               sizeof(record->timestamp));
+        mNumRead++;
+        return true;
+    }
+
+    std::shared_ptr<Sensors> mSensors;
+    int mFd = -1;
+    uint8_t* mBuffer = nullptr;
+    // The # of records read from the ring so far
+    size_t mNumRead = 0;
+};
+
+TEST_F(DirectChannelTest, RegisterZeroesMemory) {
+    memset(mBuffer, 0xff, kMemSize);
+    EXPECT_GT(registerChannel(), 0);
+    for (size_t i = 0; i < kMemSize; i++) {
+        ASSERT_EQ(mBuffer[i], 0x00);
+    }
+}
+
+TEST_F(DirectChannelTest, ReportsInOrderAtRateLevel) {
+    int32_t channelHandle = registerChannel();
+    int32_t accelToken = 0;
+    int32_t gyroToken = 0;
+    ASSERT_TRUE(mSensors->configDirectReport(getSensorHandle(SensorType::ACCELEROMETER),
+                                             channelHandle, ISensors::RateLevel::NORMAL,
+                                             &accelToken)
+                        .isOk());
+    ASSERT_TRUE(mSensors->configDirectReport(getSensorHandle(SensorType::GYROSCOPE), channelHandle,
+                                             ISensors::RateLevel::NORMAL, &gyroToken)
+                        .isOk());
+    ASSERT_GT(accelToken, 0);
+    ASSERT_GT(gyroToken, 0);
+    ASSERT_NE(accelToken, gyroToken);
+
+    // The timestamps of the records of each sensor
+    std::map<int32_t, std::vector<int64_t>> timestamps;
+    auto end = std::chrono::steady_clock::now() + kMeasureTime;
+    while (std::chrono::steady_clock::now() < end) {
+        Record record;
+        ASSERT_TRUE(readNextRecord(&record, std::chrono::milliseconds(100)));
+        ASSERT_EQ(record.size, static_cast<int32_t>(kRecordSize));
+        if (record.reportToken == accelToken) {
+            ASSERT_EQ(record.type, static_cast<int32_t>(SensorType::ACCELEROMETER));
+        } else {
+            ASSERT_EQ(record.reportToken, gyroToken);
+            ASSERT_EQ(record.type, static_cast<int32_t>(SensorType::GYROSCOPE));
+        }
+        std::vector<int64_t>& sensorTimestamps = timestamps[record.reportToken];
+        if (!sensorTimestamps.empty()) {
+            ASSERT_GT(record.timestamp, sensorTimestamps.back());
+        }
+        sensorTimestamps.push_back(record.timestamp);
+    }
+
+    ASSERT_TRUE(mSensors->configDirectReport(-1 /* sensorHandle */, channelHandle,
+                                             ISensors::RateLevel::STOP, &accelToken)
+                        .isOk());
+
+    // RateLevel::NORMAL allows (55%, 220%] of 50 Hz.
+    for (const auto& [token, sensorTimestamps] : timestamps) {
+        ASSERT_GT(sensorTimestamps.size(), 1u);
+        double rateHz = (sensorTimestamps.size() - 1) * 1e9 /
+                        (sensorTimestamps.back() - sensorTimestamps.front());
+        RecordProperty("rate_hz_token_" + std::to_string(token), std::to_string(rateHz));
+        EXPECT_GT(rateHz, 27.5);
+        EXPECT_LE(rateHz, 110.0);
+    }
+
+    // Nothing is written once stopped, but for a record which may have been in flight.
+    Record record;
+    readNextRecord(&record, std::chrono::milliseconds(50));
+    EXPECT_FALSE(readNextRecord(&record, std::chrono::milliseconds(100)));
+
+    EXPECT_TRUE(mSensors->unregisterDirectChannel(channelHandle).isOk());
+}
+
+TEST_F(DirectChannelTest, RejectsUnsupportedConfigs) {
+    int32_t channelHandle = registerChannel();
+    int32_t reportToken = 0;
+
+    EXPECT_EQ(mSensors->configDirectReport(getSensorHandle(SensorType::ACCELEROMETER),
+                                           channelHandle, ISensors::RateLevel::FAST,
+                                           &reportToken)
+                      .getExceptionCode(),
+              EX_ILLEGAL_ARGUMENT);
+    EXPECT_EQ(mSensors->configDirectReport(getSensorHandle(SensorType::LIGHT), channelHandle,
+                                           ISensors::RateLevel::NORMAL, &reportToken)
+                      .getExceptionCode(),
+              EX_ILLEGAL_ARGUMENT);
+    EXPECT_EQ(mSensors->configDirectReport(-1 /* sensorHandle */, channelHandle,
+                                           ISensors::RateLevel::NORMAL, &reportToken)
+                      .getExceptionCode(),
+              EX_ILLEGAL_ARGUMENT);
+    EXPECT_EQ(mSensors->configDirectReport(getSensorHandle(SensorType::ACCELEROMETER),
+                                           channelHandle + 1, ISensors::RateLevel::NORMAL,
+                                           &reportToken)
+                      .getExceptionCode(),
+              EX_ILLEGAL_ARGUMENT);
+
+    int32_t grallocHandle = 0;
+    EXPECT_EQ(mSensors
+                      ->registerDirectChannel(
+                              makeSharedMemInfo(ISensors::SharedMemInfo::SharedMemType::GRALLOC),
+                              &grallocHandle)
+                      .getExceptionCode(),
+              EX_ILLEGAL_ARGUMENT);
+
+    EXPECT_TRUE(mSensors->unregisterDirectChannel(channelHandle).isOk());
+}
+
+}  // namespace
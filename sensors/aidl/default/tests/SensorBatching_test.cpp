@@ -0,0 +1,216 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+
+#include "sensors-impl/Sensor.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <vector>
+
+using ::aidl::android::hardware::sensors::AccelSensor;
+using ::aidl::android::hardware::sensors::Event;
+using ::aidl::android::hardware::sensors::ISensors;
+using ::aidl::android::hardware::sensors::ISensorsEventCallback;
+using ::aidl::android::hardware::sensors::SensorScheduler;
+using ::aidl::android::hardware::sensors::SensorType;
+
+namespace {
+
+constexpr int64_t kSamplingPeriodNs = 10 * 1000 * 1000;  // 100 Hz, the fastest rate
+constexpr int64_t kLongReportLatencyNs = INT64_C(10) * 1000 * 1000 * 1000;
+// How long to wait for the sensor, far longer than the expected waits so as not to be flaky.
+constexpr auto kTimeout = std::chrono::seconds(5);
+
+// Counts the writes to the event FMQ, which each wake up the framework.
+class CountingCallback : public ISensorsEventCallback {
+  public:
+    void postEvents(const std::vector<Event>& events, bool /* wakeup */) override {
+        std::lock_guard<std::mutex> lock(mLock);
+        mNumWrites++;
+        mNumEvents += events.size();
+        mLastWrite = events;
+        mCondition.notify_all();
+    }
+
+    // Returns false if fewer than numEvents events were written before kTimeout.
+    bool waitForEvents(size_t numEvents) {
+        std::unique_lock<std::mutex> lock(mLock);
+        return mCondition.wait_for(lock, kTimeout, [&] { return mNumEvents >= numEvents; });
+    }
+
+    size_t numWrites() {
+        std::lock_guard<std::mutex> lock(mLock);
+        return mNumWrites;
+    }
+
+    size_t numEvents() {
+        std::lock_guard<std::mutex> lock(mLock);
+        return mNumEvents;
+    }
+
+    std::vector<Event> lastWrite() {
+        std::lock_guard<std::mutex> lock(mLock);
+        return mLastWrite;
+    }
+
+  private:
+    std::mutex mLock;
+    std::condition_variable mCondition;
+    size_t mNumWrites = 0;
+    size_t mNumEvents = 0;
+    std::vector<Event> mLastWrite;
+};
+
+// An accelerometer which signals each sample it reads.
+class SampleCountingAccelSensor : public AccelSensor {
+  public:
+    SampleCountingAccelSensor(CountingCallback* callback, int32_t fifoEventCount)
+        : AccelSensor(1 /* sensorHandle */, callback) {
+        mSensorInfo.fifoMaxEventCount = fifoEventCount;
+    }
+
+    // Returns false if fewer than numSamples samples were read before kTimeout. The scheduler
+    // batches a sample under the same lock it reads it with, so the samples are in the FIFO by
+    // the time another call into the sensor takes that lock.
+    bool waitForSamples(size_t numSamples) {
+        std::unique_lock<std::mutex> lock(mSamplesLock);
+        return mSamplesCondition.wait_for(lock, kTimeout,
+                                          [&] { return mNumSamples >= numSamples; });
+    }
+
+  protected:
+    std::vector<Event> readEvents() override {
+        std::vector<Event> events = AccelSensor::readEvents();
+        std::lock_guard<std::mutex> lock(mSamplesLock);
+        mNumSamples++;
+        mSamplesCondition.notify_all();
+        return events;
+    }
+
+  private:
+    std::mutex mSamplesLock;
+    std::condition_variable mSamplesCondition;
+    size_t mNumSamples = 0;
+};
+
+// Counts the writes made while the scheduler lock is held by another thread.
+class LockCheckingCallback : public CountingCallback {
+  public:
+    void postEvents(const std::vector<Event>& events, bool wakeup) override {
+        {
+            std::unique_lock<std::mutex> lock(SensorScheduler::getInstance()->getLock(),
+                                              std::try_to_lock);
+            if (!lock.owns_lock()) {
+                mNumWritesUnderLock++;
+            }
+        }
+        CountingCallback::postEvents(events, wakeup);
+    }
+
+    std::atomic<size_t> mNumWritesUnderLock = 0;
+};
+
+// Streams accelerometer events until numEvents were written, and returns the # of writes.
+size_t countWrites(int64_t maxReportLatencyNs, size_t numEvents) {
+    CountingCallback callback;
+    AccelSensor sensor(1 /* sensorHandle */, &callback);
+    sensor.batch(kSamplingPeriodNs, maxReportLatencyNs);
+    sensor.activate(true);
+    EXPECT_TRUE(callback.waitForEvents(numEvents));
+    sensor.activate(false);
+    EXPECT_GE(callback.numEvents(), numEvents);
+    return callback.numWrites();
+}
+
+TEST(SensorBatchingTest, ReportLatencyReducesWrites) {
+    constexpr size_t kNumEvents = 100;  // 1 s of events
+    size_t unbatchedWrites = countWrites(0 /* maxReportLatencyNs */, kNumEvents);
+    size_t batchedWrites = countWrites(200 * 1000 * 1000 /* maxReportLatencyNs */, kNumEvents);
+    RecordProperty("unbatched_writes", unbatchedWrites);
+    RecordProperty("batched_writes", batchedWrites);
+
+    // A write per event, vs. a write of ~20 events every 200 ms and one more on deactivation
+    EXPECT_GE(unbatchedWrites, kNumEvents);
+    EXPECT_LE(batchedWrites * 10, kNumEvents);
+}
+
+TEST(SensorBatchingTest, FullFifoIsWrittenBeforeReportLatency) {
+    constexpr int32_t kFifoEventCount = 5;
+    CountingCallback callback;
+    SampleCountingAccelSensor sensor(&callback, kFifoEventCount);
+    sensor.batch(kSamplingPeriodNs, kLongReportLatencyNs);
+    sensor.activate(true);
+
+    // The FIFO is written long before kLongReportLatencyNs
+    ASSERT_TRUE(callback.waitForEvents(kFifoEventCount));
+    EXPECT_EQ(callback.lastWrite().size(), kFifoEventCount);
+    sensor.activate(false);
+}
+
+TEST(SensorBatchingTest, FlushWritesBatchedEventsFirst) {
+    CountingCallback callback;
+    SampleCountingAccelSensor sensor(&callback, 300 /* fifoEventCount */);
+    sensor.batch(kSamplingPeriodNs, kLongReportLatencyNs);
+    sensor.activate(true);
+    ASSERT_TRUE(sensor.waitForSamples(3));
+    EXPECT_EQ(callback.numWrites(), 0);
+
+    ASSERT_TRUE(sensor.flush().isOk());
+    EXPECT_EQ(callback.numWrites(), 1);
+    std::vector<Event> events = callback.lastWrite();
+    ASSERT_GT(events.size(), 3);
+    for (size_t i = 0; i + 1 < events.size(); i++) {
+        EXPECT_EQ(events[i].sensorType, SensorType::ACCELEROMETER);
+    }
+    EXPECT_EQ(events.back().sensorType, SensorType::META_DATA);
+    sensor.activate(false);
+}
+
+TEST(SensorBatchingTest, DataInjectionWritesBatchedEvents) {
+    CountingCallback callback;
+    SampleCountingAccelSensor sensor(&callback, 300 /* fifoEventCount */);
+    sensor.batch(kSamplingPeriodNs, kLongReportLatencyNs);
+    sensor.activate(true);
+    ASSERT_TRUE(sensor.waitForSamples(3));
+    EXPECT_EQ(callback.numWrites(), 0);
+
+    // The sensor stops sampling while injecting, so the batched events would be held until the
+    // mode switches back.
+    sensor.setOperationMode(ISensors::OperationMode::DATA_INJECTION);
+    EXPECT_EQ(callback.numWrites(), 1);
+    EXPECT_GE(callback.lastWrite().size(), 3);
+
+    sensor.setOperationMode(ISensors::OperationMode::NORMAL);
+    sensor.activate(false);
+}
+
+TEST(SensorBatchingTest, PostsWithoutSchedulerLock) {
+    LockCheckingCallback callback;
+    AccelSensor sensor(1 /* sensorHandle */, &callback);
+    sensor.batch(kSamplingPeriodNs, 0 /* maxReportLatencyNs */);
+    sensor.activate(true);
+    ASSERT_TRUE(callback.waitForEvents(10));
+
+    // Only the scheduler thread posts until the sensor is deactivated.
+    EXPECT_EQ(callback.mNumWritesUnderLock.load(), 0);
+    sensor.activate(false);
+}
+
+}  // namespace
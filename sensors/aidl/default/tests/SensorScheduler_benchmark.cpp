@@ -0,0 +1,113 @@
+//
+// Copyright (C) 2022 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Streams a number of sensors at the same rate, like a device exposing many virtual sensors, and
+// reports the threads generating their events, how often they wake up, and the writes to the
+// event FMQ.
+
+#include <benchmark/benchmark.h>
+
+#include "sensors-impl/Sensor.h"
+
+#include <dirent.h>
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <thread>
+#include <vector>
+
+namespace {
+
+using ::aidl::android::hardware::sensors::AccelSensor;
+using ::aidl::android::hardware::sensors::Event;
+using ::aidl::android::hardware::sensors::ISensorsEventCallback;
+using ::aidl::android::hardware::sensors::SensorScheduler;
+
+constexpr int64_t kSamplingPeriodNs = 10 * 1000 * 1000;  // 100 Hz
+constexpr auto kMeasureTime = std::chrono::seconds(1);
+
+// Stands in for the event FMQ.
+class CountingCallback : public ISensorsEventCallback {
+  public:
+    void postEvents(const std::vector<Event>& events, bool /* wakeup */) override {
+        mNumWrites.fetch_add(1);
+        mNumEvents.fetch_add(events.size());
+    }
+
+    std::atomic<uint64_t> mNumWrites = 0;
+    std::atomic<uint64_t> mNumEvents = 0;
+};
+
+size_t countThreads() {
+    size_t count = 0;
+    DIR* dir = opendir("/proc/self/task");
+    if (dir == nullptr) {
+        return 0;
+    }
+    while (dirent* entry = readdir(dir)) {
+        if (entry->d_name[0] != '.') {
+            count++;
+        }
+    }
+    closedir(dir);
+    return count;
+}
+
+// Arg: the # of sensors
+void BM_StreamSensors(benchmark::State& state) {
+    const size_t numSensors = state.range(0);
+    CountingCallback callback;
+    std::vector<std::unique_ptr<AccelSensor>> sensors;
+    for (size_t i = 0; i < numSensors; i++) {
+        sensors.push_back(std::make_unique<AccelSensor>(i + 1 /* sensorHandle */, &callback));
+        sensors.back()->batch(kSamplingPeriodNs, 0 /* maxReportLatencyNs */);
+    }
+
+    size_t threads = 0;
+    uint64_t wakeups = 0;
+    uint64_t writes = 0;
+    uint64_t events = 0;
+    for (auto _ : state) {
+        for (auto& sensor : sensors) {
+            sensor->activate(true);
+        }
+        uint64_t wakeupsBefore = SensorScheduler::getInstance()->getNumWakeups();
+        uint64_t writesBefore = callback.mNumWrites.load();
+        uint64_t eventsBefore = callback.mNumEvents.load();
+        std::this_thread::sleep_for(kMeasureTime);
+        threads = countThreads();
+        wakeups += SensorScheduler::getInstance()->getNumWakeups() - wakeupsBefore;
+        writes += callback.mNumWrites.load() - writesBefore;
+        events += callback.mNumEvents.load() - eventsBefore;
+        for (auto& sensor : sensors) {
+            sensor->activate(false);
+        }
+        state.SetIterationTime(std::chrono::duration<double>(kMeasureTime).count());
+    }
+
+    double seconds = state.iterations() * std::chrono::duration<double>(kMeasureTime).count();
+    // The threads generating the events, i.e. all but the main thread
+    state.counters["threads"] = threads - 1;
+    state.counters["wakeups_per_sec"] = wakeups / seconds;
+    state.counters["writes_per_sec"] = writes / seconds;
+    state.counters["events_per_sec"] = events / seconds;
+}
+
+BENCHMARK(BM_StreamSensors)->Arg(1)->Arg(10)->Arg(40)->Iterations(3)->UseManualTime();
+
+}  // namespace
+
+BENCHMARK_MAIN();
@@ -40,19 +40,15 @@ Sensor::Sensor(ISensorsEventCallback* callback)
     : mIsEnabled(false),
       mSamplingPeriodNs(0),
       mLastSampleTimeNs(0),
-      mStopThread(false),
+      mScheduler(SensorScheduler::getInstance()),
       mCallback(callback),
-      mMode(OperationMode::NORMAL) {
-    mRunThread = std::thread(startThread, this);
-}
+      mMode(OperationMode::NORMAL) {}
 
 Sensor::~Sensor() {
-    std::unique_lock<std::mutex> lock(mRunMutex);
-    mStopThread = true;
-    mIsEnabled = false;
-    mWaitCV.notify_all();
-    lock.release();
-    mRunThread.join();
+    std::unique_lock<std::mutex> lock(mScheduler->getLock());
+    mScheduler->schedule(this, INT64_MAX);
+    // The scheduler may still be posting events of the sensor to its callback.
+    mScheduler->waitForPosts();
 }
 
 const SensorInfo& Sensor::getSensorInfo() const {
@@ -67,17 +63,18 @@ void Sensor::batch(int64_t samplingPeriodNs) {
     }
 
     if (mSamplingPeriodNs != samplingPeriodNs) {
+        std::unique_lock<std::mutex> lock(mScheduler->getLock());
         mSamplingPeriodNs = samplingPeriodNs;
-        // Wake up the 'run' thread to check if a new event should be generated now
-        mWaitCV.notify_all();
+        // Check if a new event should be generated now
+        reschedule();
     }
 }
 
 void Sensor::activate(bool enable) {
     if (mIsEnabled != enable) {
-        std::unique_lock<std::mutex> lock(mRunMutex);
+        std::unique_lock<std::mutex> lock(mScheduler->getLock());
         mIsEnabled = enable;
-        mWaitCV.notify_all();
+        reschedule();
     }
 }
 
@@ -95,39 +92,33 @@ Result Sensor::flush() {
     ev.sensorType = SensorType::META_DATA;
     ev.u.meta.what = MetaDataEventType::META_DATA_FLUSH_COMPLETE;
     std::vector<Event> evs{ev};
-    mCallback->postEvents(evs, isWakeUpSensor());
+    // Written after the events the scheduler is generating for the sensor, if any.
+    std::unique_lock<std::mutex> lock(mScheduler->getLock());
+    mScheduler->post(&lock, mCallback, evs, isWakeUpSensor());
 
     return Result::OK;
 }
 
-void Sensor::startThread(Sensor* sensor) {
-    sensor->run();
+int64_t Sensor::process(int64_t now, std::vector<Event>* events) {
+    if (mIsEnabled && now >= mLastSampleTimeNs + mSamplingPeriodNs) {
+        // Sampling on multiples of the period keeps the rate steady, and makes the sensors at the
+        // same or harmonic rates due at the same time, so that they are processed together.
+        mLastSampleTimeNs = mSamplingPeriodNs > 0 ? now - now % mSamplingPeriodNs : now;
+        std::vector<Event> sensorEvents = readEvents();
+        events->insert(events->end(), sensorEvents.begin(), sensorEvents.end());
+    }
+    return getNextDeadline();
 }
 
-void Sensor::run() {
-    std::unique_lock<std::mutex> runLock(mRunMutex);
-    constexpr int64_t kNanosecondsInSeconds = 1000 * 1000 * 1000;
-
-    while (!mStopThread) {
-        if (!mIsEnabled || mMode == OperationMode::DATA_INJECTION) {
-            mWaitCV.wait(runLock, [&] {
-                return ((mIsEnabled && mMode == OperationMode::NORMAL) || mStopThread);
-            });
-        } else {
-            timespec curTime;
-            clock_gettime(CLOCK_BOOTTIME, &curTime);
-            int64_t now = (curTime.tv_sec * kNanosecondsInSeconds) + curTime.tv_nsec;
-            int64_t nextSampleTime = mLastSampleTimeNs + mSamplingPeriodNs;
-
-            if (now >= nextSampleTime) {
-                mLastSampleTimeNs = now;
-                nextSampleTime = mLastSampleTimeNs + mSamplingPeriodNs;
-                mCallback->postEvents(readEvents(), isWakeUpSensor());
-            }
-
-            mWaitCV.wait_for(runLock, std::chrono::nanoseconds(nextSampleTime - now));
-        }
+int64_t Sensor::getNextDeadline() const {
+    if (!mIsEnabled || mMode == OperationMode::DATA_INJECTION) {
+        return INT64_MAX;
     }
+    return mLastSampleTimeNs + mSamplingPeriodNs;
+}
+
+void Sensor::reschedule() {
+    mScheduler->schedule(this, getNextDeadline());
 }
 
 bool Sensor::isWakeUpSensor() {
@@ -148,9 +139,9 @@ std::vector<Event> Sensor::readEvents() {
 
 void Sensor::setOperationMode(OperationMode mode) {
     if (mMode != mode) {
-        std::unique_lock<std::mutex> lock(mRunMutex);
+        std::unique_lock<std::mutex> lock(mScheduler->getLock());
         mMode = mode;
-        mWaitCV.notify_all();
+        reschedule();
     }
 }
 
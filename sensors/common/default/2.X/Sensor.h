@@ -20,10 +20,10 @@
 #include <android/hardware/sensors/1.0/types.h>
 #include <android/hardware/sensors/2.1/types.h>
 
-#include <condition_variable>
+#include <SensorScheduler.h>
+
 #include <memory>
 #include <mutex>
-#include <thread>
 #include <vector>
 
 namespace android {
@@ -42,6 +42,11 @@ class ISensorsEventCallback {
     virtual void postEvents(const std::vector<Event>& events, bool wakeup) = 0;
 };
 
+class Sensor;
+
+using SensorScheduler = ::android::hardware::sensors::common::SensorScheduler<
+        Sensor, ISensorsEventCallback, ::android::hardware::sensors::V2_1::Event>;
+
 class Sensor {
   public:
     using OperationMode = ::android::hardware::sensors::V1_0::OperationMode;
@@ -64,10 +69,27 @@ class Sensor {
     Result injectEvent(const Event& event);
 
   protected:
-    void run();
+    friend SensorScheduler;
+
+    /**
+     * Generates the events due at 'now', adds them to 'events', and returns when the sensor is due
+     * next. Called by the SensorScheduler.
+     */
+    int64_t process(int64_t now, std::vector<Event>* events);
+
+    /**
+     * Returns when the sensor is due next, or INT64_MAX if it is idle.
+     */
+    int64_t getNextDeadline() const;
+
+    /**
+     * Updates the deadline of the sensor after a configuration change. Requires the scheduler
+     * lock.
+     */
+    void reschedule();
+
     virtual std::vector<Event> readEvents();
     virtual void readEventPayload(EventPayload&) {}
-    static void startThread(Sensor* sensor);
 
     bool isWakeUpSensor();
 
@@ -76,10 +98,10 @@ class Sensor {
     int64_t mLastSampleTimeNs;
     SensorInfo mSensorInfo;
 
-    std::atomic_bool mStopThread;
-    std::condition_variable mWaitCV;
-    std::mutex mRunMutex;
-    std::thread mRunThread;
+    /**
+     * Generates the events of the sensor. Its lock protects the fields above and mMode.
+     */
+    SensorScheduler* mScheduler;
 
     ISensorsEventCallback* mCallback;
 
@@ -23,6 +23,7 @@
 
 #include <dlfcn.h>
 
+#include <algorithm>
 #include <cinttypes>
 #include <cmath>
 #include <fstream>
@@ -223,9 +224,9 @@ Return<Result> HalProxy::initializeCommon(
     // again we do not get new events until after initialize resets the subhals.
     disableAllSensors();
 
-    // Clears the queue if any events were pending write before.
-    mPendingWriteEventsQueue = std::queue<std::pair<std::vector<V2_1::Event>, size_t>>();
-    mSizePendingWriteEventsQueue = 0;
+    // Clears the staging queues if any events were pending write before.
+    dropStagedEvents();
+    mPendingWrites.store(false);
 
     // Clears previously connected dynamic sensors
     mDynamicSensors.clear();
@@ -370,19 +371,20 @@ Return<void> HalProxy::debug(const hidl_handle& fd, const hidl_vec<hidl_string>&
            << " ms ago" << std::endl;
     // TODO(b/142969448): Add logging for history of wakelock acquisition per subhal.
     stream << "  Wakelock ref count: " << mWakelockRefCount << std::endl;
-    stream << "  # of events on pending write writes queue: " << mSizePendingWriteEventsQueue
-           << std::endl;
-    stream << " Most events seen on pending write events queue: "
-           << mMostEventsObservedPendingWriteEventsQueue << std::endl;
-    if (!mPendingWriteEventsQueue.empty()) {
-        stream << "  Size of events list on front of pending writes queue: "
-               << mPendingWriteEventsQueue.front().first.size() << std::endl;
-    }
+    stream << "  Pending writes: " << (mPendingWrites.load() ? "true" : "false") << std::endl;
+    stream << "  # of events on staging queues: " << mNumStagedEvents.load() << " of "
+           << kMaxSizePendingWriteEventsQueue << std::endl;
     stream << "  # of non-dynamic sensors across all subhals: " << mSensors.size() << std::endl;
     stream << "  # of dynamic sensors across all subhals: " << mDynamicSensors.size() << std::endl;
     stream << "SubHals (" << mSubHalList.size() << "):" << std::endl;
-    for (auto& subHal : mSubHalList) {
+    for (size_t i = 0; i < mSubHalList.size(); i++) {
+        auto& subHal = mSubHalList[i];
+        const EventStagingQueue<Event>& stagingQueue = *mStagingQueues[i];
         stream << "  Name: " << subHal->getName() << std::endl;
+        stream << "  # of events on staging queue: " << stagingQueue.size() << std::endl;
+        stream << "  Most events seen on staging queue: " << stagingQueue.getHighWaterMark()
+               << std::endl;
+        stream << "  # of events dropped: " << stagingQueue.getNumDropped() << std::endl;
         stream << "  Debug dump: " << std::endl;
         android::base::WriteStringToFd(stream.str(), writeFd);
         subHal->debug(fd, {});
@@ -528,6 +530,11 @@ void* HalProxy::getHandleForSubHalSharedObject(const std::string& filename) {
 
 void HalProxy::init() {
     initializeSensorList();
+    for (size_t i = 0; i < mSubHalList.size(); i++) {
+        mStagingQueues.push_back(
+                std::make_unique<EventStagingQueue<Event>>(&mNumStagedEvents,
+                                                           kMaxSizePendingWriteEventsQueue));
+    }
 }
 
 void HalProxy::stopThreads() {
@@ -544,7 +551,10 @@ void HalProxy::stopThreads() {
         mWakelockQueueFlag->wake(static_cast<uint32_t>(WakeLockQueueFlagBits::DATA_WRITTEN));
     }
     mWakelockCV.notify_one();
-    mEventQueueWriteCV.notify_one();
+    {
+        std::lock_guard<std::mutex> lock(mPendingWritesMutex);
+        mPendingWritesCV.notify_one();
+    }
     if (mPendingWritesThread.joinable()) {
         mPendingWritesThread.join();
     }
@@ -570,47 +580,108 @@ void HalProxy::startPendingWritesThread(HalProxy* halProxy) {
 }
 
 void HalProxy::handlePendingWrites() {
-    // TODO(b/143302327): Find a way to optimize locking strategy maybe using two mutexes instead of
-    // one.
-    std::unique_lock<std::mutex> lock(mEventQueueWriteMutex);
     while (mThreadsRun.load()) {
-        mEventQueueWriteCV.wait(
-                lock, [&] { return !mPendingWriteEventsQueue.empty() || !mThreadsRun.load(); });
-        if (mThreadsRun.load()) {
-            std::vector<Event>& pendingWriteEvents = mPendingWriteEventsQueue.front().first;
-            size_t numWakeupEvents = mPendingWriteEventsQueue.front().second;
-            size_t eventQueueSize = mEventQueue->getQuantumCount();
-            size_t numToWrite = std::min(pendingWriteEvents.size(), eventQueueSize);
-            lock.unlock();
-            if (!mEventQueue->writeBlocking(
-                        pendingWriteEvents.data(), numToWrite,
-                        static_cast<uint32_t>(EventQueueFlagBits::EVENTS_READ),
-                        static_cast<uint32_t>(EventQueueFlagBits::READ_AND_PROCESS),
-                        kPendingWriteTimeoutNs, mEventQueueFlag)) {
-                ALOGE("Dropping %zu events after blockingWrite failed.", numToWrite);
-                if (numWakeupEvents > 0) {
-                    if (pendingWriteEvents.size() > eventQueueSize) {
-                        decrementRefCountAndMaybeReleaseWakelock(
-                                countNumWakeupEvents(pendingWriteEvents, eventQueueSize));
-                    } else {
-                        decrementRefCountAndMaybeReleaseWakelock(numWakeupEvents);
-                    }
-                }
-            }
-            lock.lock();
-            mSizePendingWriteEventsQueue -= numToWrite;
-            if (pendingWriteEvents.size() > eventQueueSize) {
-                // TODO(b/143302327): Check if this erase operation is too inefficient. It will copy
-                // all the events ahead of it down to fill gap off array at front after the erase.
-                pendingWriteEvents.erase(pendingWriteEvents.begin(),
-                                         pendingWriteEvents.begin() + eventQueueSize);
+        {
+            std::unique_lock<std::mutex> lock(mPendingWritesMutex);
+            mPendingWritesCV.wait(lock,
+                                  [&] { return mPendingWrites.load() || !mThreadsRun.load(); });
+        }
+        mPendingWrites.store(false);
+        int64_t timeLeft = kPendingWriteTimeoutNs;
+        while (mThreadsRun.load() && !writeStagedEvents()) {
+            // Wait for the framework to make room in the fmq, giving up once it has not read
+            // anything for kPendingWriteTimeoutNs.
+            uint32_t efState = 0;
+            int64_t waitStart = getTimeNow();
+            mEventQueueFlag->wait(static_cast<uint32_t>(EventQueueFlagBits::EVENTS_READ), &efState,
+                                  timeLeft);
+            if ((efState & static_cast<uint32_t>(EventQueueFlagBits::EVENTS_READ)) != 0) {
+                timeLeft = kPendingWriteTimeoutNs;
             } else {
-                mPendingWriteEventsQueue.pop();
+                timeLeft -= getTimeNow() - waitStart;
+                if (timeLeft <= 0) {
+                    // Only the subhal flooding the fmq loses its events, the others keep theirs
+                    // and are written once the framework reads again.
+                    size_t subHalIndex;
+                    size_t numDropped = dropLargestStagingQueue(&subHalIndex);
+                    ALOGE("Dropping %zu events from subhal %s after blockingWrite failed.",
+                          numDropped, mSubHalList[subHalIndex]->getName().c_str());
+                    timeLeft = kPendingWriteTimeoutNs;
+                }
             }
         }
     }
 }
 
+bool HalProxy::writeStagedEvents() {
+    bool allWritten;
+    do {
+        std::unique_lock<std::mutex> lock(mEventQueueWriteMutex, std::try_to_lock);
+        if (!lock.owns_lock()) {
+            // The thread holding the lock checks the staging queues again after unlocking.
+            return true;
+        }
+        size_t numToWrite = mEventQueue->availableToWrite();
+        size_t numWritten = 0;
+        for (size_t i = 0; i < mStagingQueues.size() && numWritten < numToWrite; i++) {
+            EventStagingQueue<Event>& queue =
+                    *mStagingQueues[(mNextStagingQueue + i) % mStagingQueues.size()];
+            numWritten += queue.consume(numToWrite - numWritten,
+                                        [&](const Event* events, size_t count) {
+                                            return mEventQueue->write(events, count);
+                                        });
+        }
+        if (!mStagingQueues.empty()) {
+            mNextStagingQueue = (mNextStagingQueue + 1) % mStagingQueues.size();
+        }
+        if (numWritten > 0) {
+            mEventQueueFlag->wake(static_cast<uint32_t>(EventQueueFlagBits::READ_AND_PROCESS));
+        }
+        allWritten = std::all_of(mStagingQueues.begin(), mStagingQueues.end(),
+                                 [](const auto& queue) { return queue->empty(); });
+        lock.unlock();
+        // Pairs with the fence in postEventsToMessageQueue, so that either the poster took the
+        // lock or the events it staged are seen here.
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+    } while (allWritten && std::any_of(mStagingQueues.begin(), mStagingQueues.end(),
+                                       [](const auto& queue) { return !queue->empty(); }));
+    return allWritten;
+}
+
+size_t HalProxy::dropStagedEvents() {
+    std::lock_guard<std::mutex> lock(mEventQueueWriteMutex);
+    size_t numDropped = 0;
+    for (auto& queue : mStagingQueues) {
+        numDropped += dropStagedEventsLocked(*queue);
+    }
+    return numDropped;
+}
+
+size_t HalProxy::dropLargestStagingQueue(size_t* outSubHalIndex) {
+    std::lock_guard<std::mutex> lock(mEventQueueWriteMutex);
+    size_t largest = 0;
+    for (size_t i = 1; i < mStagingQueues.size(); i++) {
+        if (mStagingQueues[i]->size() > mStagingQueues[largest]->size()) {
+            largest = i;
+        }
+    }
+    *outSubHalIndex = largest;
+    return dropStagedEventsLocked(*mStagingQueues[largest]);
+}
+
+size_t HalProxy::dropStagedEventsLocked(EventStagingQueue<Event>& queue) {
+    size_t numWakeupEvents = 0;
+    size_t numDropped = queue.consume(SIZE_MAX, [&](const Event* events, size_t count) {
+        numWakeupEvents += countNumWakeupEvents(events, count);
+        return true;
+    });
+    queue.addDropped(numDropped);
+    if (numWakeupEvents > 0) {
+        decrementRefCountAndMaybeReleaseWakelock(numWakeupEvents);
+    }
+    return numDropped;
+}
+
 void HalProxy::startWakelockThread(HalProxy* halProxy) {
     halProxy->handleWakelocks();
 }
@@ -659,33 +730,25 @@ void HalProxy::resetSharedWakelock() {
 }
 
 void HalProxy::postEventsToMessageQueue(const std::vector<Event>& events, size_t numWakeupEvents,
-                                        V2_0::implementation::ScopedWakelock wakelock) {
-    size_t numToWrite = 0;
-    std::lock_guard<std::mutex> lock(mEventQueueWriteMutex);
+                                        V2_0::implementation::ScopedWakelock wakelock,
+                                        int32_t subHalIndex) {
     if (wakelock.isLocked()) {
         incrementRefCountAndMaybeAcquireWakelock(numWakeupEvents);
     }
-    if (mPendingWriteEventsQueue.empty()) {
-        numToWrite = std::min(events.size(), mEventQueue->availableToWrite());
-        if (numToWrite > 0) {
-            if (mEventQueue->write(events.data(), numToWrite)) {
-                // TODO(b/143302327): While loop if mEventQueue->avaiableToWrite > 0 to possibly fit
-                // in more writes immediately
-                mEventQueueFlag->wake(static_cast<uint32_t>(EventQueueFlagBits::READ_AND_PROCESS));
-            } else {
-                numToWrite = 0;
-            }
+    // Staging first keeps the events of each subhal in order with those still pending write.
+    if (!mStagingQueues[subHalIndex]->push(events.data(), events.size())) {
+        ALOGW("Dropping %zu events from subhal w/ index %" PRId32 ", the staging queues are full.",
+              events.size(), subHalIndex);
+        if (wakelock.isLocked()) {
+            decrementRefCountAndMaybeReleaseWakelock(numWakeupEvents);
         }
+        return;
     }
-    size_t numLeft = events.size() - numToWrite;
-    if (numToWrite < events.size() &&
-        mSizePendingWriteEventsQueue + numLeft <= kMaxSizePendingWriteEventsQueue) {
-        std::vector<Event> eventsLeft(events.begin() + numToWrite, events.end());
-        mPendingWriteEventsQueue.push({eventsLeft, numWakeupEvents});
-        mSizePendingWriteEventsQueue += numLeft;
-        mMostEventsObservedPendingWriteEventsQueue =
-                std::max(mMostEventsObservedPendingWriteEventsQueue, mSizePendingWriteEventsQueue);
-        mEventQueueWriteCV.notify_one();
+    // Pairs with the fence in writeStagedEvents.
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (!writeStagedEvents() && !mPendingWrites.exchange(true)) {
+        std::lock_guard<std::mutex> lock(mPendingWritesMutex);
+        mPendingWritesCV.notify_one();
     }
 }
 
@@ -744,11 +807,12 @@ bool HalProxy::isSubHalIndexValid(int32_t sensorHandle) {
     return extractSubHalIndex(sensorHandle) < mSubHalList.size();
 }
 
-size_t HalProxy::countNumWakeupEvents(const std::vector<Event>& events, size_t n) {
+size_t HalProxy::countNumWakeupEvents(const Event* events, size_t n) {
     size_t numWakeupEvents = 0;
     for (size_t i = 0; i < n; i++) {
-        int32_t sensorHandle = events[i].sensorHandle;
-        if (mSensors[sensorHandle].flags & static_cast<uint32_t>(V1_0::SensorFlagBits::WAKE_UP)) {
+        auto it = mSensors.find(events[i].sensorHandle);
+        if (it != mSensors.end() &&
+            (it->second.flags & static_cast<uint32_t>(V1_0::SensorFlagBits::WAKE_UP))) {
             numWakeupEvents++;
         }
     }
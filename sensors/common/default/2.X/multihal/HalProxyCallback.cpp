@@ -54,7 +54,8 @@ void HalProxyCallbackBase::postEvents(const std::vector<V2_1::Event>& events,
                     " w/ index %" PRId32 ".",
                     mSubHalIndex);
     }
-    mCallback->postEventsToMessageQueue(processedEvents, numWakeupEvents, std::move(wakelock));
+    mCallback->postEventsToMessageQueue(processedEvents, numWakeupEvents, std::move(wakelock),
+                                        mSubHalIndex);
 }
 
 ScopedWakelock HalProxyCallbackBase::createScopedWakelock(bool lock) {
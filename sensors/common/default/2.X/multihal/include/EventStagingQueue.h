@@ -0,0 +1,219 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+
+namespace android {
+namespace hardware {
+namespace sensors {
+namespace V2_1 {
+namespace implementation {
+
+/**
+ * A FIFO queue of events staged by one producer (a subhal, possibly posting from several threads)
+ * for one consumer (whoever currently writes to the event FMQ).
+ *
+ * Events are stored in fixed size blocks which are linked as the queue grows and recycled once
+ * consumed, so that staging events only allocates when the queue grows past its previous peak.
+ * The consumer side never takes a lock, and the producer side only takes a lock shared with other
+ * producers of the same queue.
+ */
+template <typename T>
+class EventStagingQueue {
+  public:
+    //! The number of events in each block.
+    static constexpr size_t kBlockSize = 256;
+
+    /**
+     * @param sharedSize The number of events staged across all the queues sharing the capacity.
+     * @param capacity The max number of events those queues hold together before rejecting pushes.
+     */
+    EventStagingQueue(std::atomic<size_t>* sharedSize, size_t capacity)
+        : mSharedSize(sharedSize), mCapacity(capacity), mHead(new Block()), mTail(mHead) {}
+
+    ~EventStagingQueue() {
+        for (Block* block = mHead; block != nullptr;) {
+            Block* next = block->next;
+            delete block;
+            block = next;
+        }
+        for (Block* block = mSpareBlocks.load(); block != nullptr;) {
+            Block* next = block->next;
+            delete block;
+            block = next;
+        }
+    }
+
+    EventStagingQueue(const EventStagingQueue&) = delete;
+    EventStagingQueue& operator=(const EventStagingQueue&) = delete;
+
+    /**
+     * Append events to the queue if they all fit in the shared capacity. Otherwise they are all
+     * dropped and counted in getNumDropped().
+     *
+     * @param events The events to push.
+     * @param n The number of events.
+     *
+     * @return true if the events were pushed.
+     */
+    bool push(const T* events, size_t n) {
+        if (mSharedSize->fetch_add(n, std::memory_order_relaxed) + n > mCapacity) {
+            mSharedSize->fetch_sub(n, std::memory_order_relaxed);
+            mNumDropped.fetch_add(n, std::memory_order_relaxed);
+            return false;
+        }
+        std::lock_guard<std::mutex> lock(mProducerMutex);
+        uint64_t pushed = mNumPushed.load(std::memory_order_relaxed);
+        size_t size = static_cast<size_t>(pushed - mNumPopped.load(std::memory_order_acquire));
+        for (size_t i = 0; i < n;) {
+            size_t offset = pushed % kBlockSize;
+            if (offset == 0 && pushed != 0) {
+                Block* block = takeSpareBlock();
+                mTail->next = block;
+                mTail = block;
+            }
+            size_t count = std::min(n - i, kBlockSize - offset);
+            std::copy(events + i, events + i + count, mTail->events + offset);
+            i += count;
+            pushed += count;
+        }
+        // Publishes the events and any newly linked blocks to the consumer.
+        mNumPushed.store(pushed, std::memory_order_seq_cst);
+        size += n;
+        if (size > mHighWaterMark.load(std::memory_order_relaxed)) {
+            mHighWaterMark.store(size, std::memory_order_relaxed);
+        }
+        return true;
+    }
+
+    /**
+     * Remove up to maxCount events from the front of the queue, handing them to the given sink in
+     * contiguous runs. Only one thread may consume at a time.
+     *
+     * @param maxCount The max number of events to consume.
+     * @param sink Called with (const T* events, size_t count) for each run. Returning false leaves
+     *     the run and all the events after it in the queue.
+     *
+     * @return The number of events consumed.
+     */
+    template <typename Sink>
+    size_t consume(size_t maxCount, Sink sink) {
+        uint64_t popped = mNumPopped.load(std::memory_order_relaxed);
+        uint64_t pushed = mNumPushed.load(std::memory_order_acquire);
+        size_t total = 0;
+        while (total < maxCount && popped < pushed) {
+            if (mHeadConsumed) {
+                advanceHead();
+            }
+            size_t offset = popped % kBlockSize;
+            size_t count = std::min({static_cast<size_t>(pushed - popped), kBlockSize - offset,
+                                     maxCount - total});
+            if (!sink(static_cast<const T*>(mHead->events + offset), count)) {
+                break;
+            }
+            popped += count;
+            total += count;
+            mHeadConsumed = popped % kBlockSize == 0;
+            mNumPopped.store(popped, std::memory_order_release);
+        }
+        mSharedSize->fetch_sub(total, std::memory_order_relaxed);
+        return total;
+    }
+
+    //! @return The number of events in the queue.
+    size_t size() const {
+        return static_cast<size_t>(mNumPushed.load(std::memory_order_seq_cst) -
+                                   mNumPopped.load(std::memory_order_acquire));
+    }
+
+    bool empty() const { return size() == 0; }
+
+    //! @return The most events ever observed in the queue.
+    size_t getHighWaterMark() const { return mHighWaterMark.load(std::memory_order_relaxed); }
+
+    //! @return The number of events rejected by push() or reported through addDropped().
+    uint64_t getNumDropped() const { return mNumDropped.load(std::memory_order_relaxed); }
+
+    //! Count events the consumer dropped after they were staged.
+    void addDropped(size_t n) { mNumDropped.fetch_add(n, std::memory_order_relaxed); }
+
+  private:
+    struct Block {
+        T events[kBlockSize];
+        Block* next = nullptr;
+    };
+
+    // Pops a block off the spare block stack, or allocates one. Only the producer pops, so the
+    // stack does not suffer from ABA.
+    Block* takeSpareBlock() {
+        Block* block = mSpareBlocks.load(std::memory_order_acquire);
+        while (block != nullptr && !mSpareBlocks.compare_exchange_weak(
+                                           block, block->next, std::memory_order_acquire)) {
+        }
+        if (block == nullptr) {
+            return new Block();
+        }
+        block->next = nullptr;
+        return block;
+    }
+
+    // Moves the consumer past the fully consumed head block, and pushes it onto the spare block
+    // stack. Only called once the producer pushed events past the head block, so that the next
+    // block is linked.
+    void advanceHead() {
+        Block* block = mHead;
+        mHead = block->next;
+        mHeadConsumed = false;
+        block->next = mSpareBlocks.load(std::memory_order_relaxed);
+        while (!mSpareBlocks.compare_exchange_weak(block->next, block, std::memory_order_release)) {
+        }
+    }
+
+    std::atomic<size_t>* const mSharedSize;
+    const size_t mCapacity;
+
+    //! Protects the producer side against subhals posting from several threads.
+    std::mutex mProducerMutex;
+
+    //! The block being consumed. Only accessed by the consumer.
+    Block* mHead;
+
+    //! Whether the consumer reached the end of mHead. Only accessed by the consumer.
+    bool mHeadConsumed = false;
+
+    //! The block being filled. Only accessed by the producer.
+    Block* mTail;
+
+    std::atomic<Block*> mSpareBlocks = nullptr;
+
+    //! Total number of events pushed and popped.
+    std::atomic<uint64_t> mNumPushed = 0;
+    std::atomic<uint64_t> mNumPopped = 0;
+
+    std::atomic<size_t> mHighWaterMark = 0;
+    std::atomic<uint64_t> mNumDropped = 0;
+};
+
+}  // namespace implementation
+}  // namespace V2_1
+}  // namespace sensors
+}  // namespace hardware
+}  // namespace android
@@ -17,6 +17,7 @@
 #pragma once
 
 #include "EventMessageQueueWrapper.h"
+#include "EventStagingQueue.h"
 #include "HalProxyCallback.h"
 #include "ISensorsCallbackWrapper.h"
 #include "SubHalWrapper.h"
@@ -37,7 +38,6 @@
 #include <condition_variable>
 #include <map>
 #include <mutex>
-#include <queue>
 #include <thread>
 #include <utility>
 
@@ -127,7 +127,8 @@ class HalProxy : public V2_0::implementation::IScopedWakelockRefCounter,
                                               int32_t subHalIndex) override;
 
     void postEventsToMessageQueue(const std::vector<Event>& events, size_t numWakeupEvents,
-                                  V2_0::implementation::ScopedWakelock wakelock) override;
+                                  V2_0::implementation::ScopedWakelock wakelock,
+                                  int32_t subHalIndex) override;
 
     const SensorInfo& getSensorInfo(int32_t sensorHandle) override {
         return mSensors[sensorHandle];
@@ -202,25 +203,29 @@ class HalProxy : public V2_0::implementation::IScopedWakelockRefCounter,
     static constexpr int32_t kSensorHandleSubHalIndexMask = 0xFF000000;
 
     /**
-     * A FIFO queue of pairs of vector of events and the number of wakeup events in that vector
-     * which are waiting to be written to the events fmq in the background thread.
+     * One queue per subhal of events which are waiting to be written to the events fmq, either by
+     * the next poster that finds the fmq free or by the background thread.
      */
-    std::queue<std::pair<std::vector<Event>, size_t>> mPendingWriteEventsQueue;
+    std::vector<std::unique_ptr<EventStagingQueue<Event>>> mStagingQueues;
 
-    //! The most events observed on the pending write events queue for debug purposes.
-    size_t mMostEventsObservedPendingWriteEventsQueue = 0;
-
-    //! The max number of events allowed in the pending write events queue
+    //! The max number of events allowed in the staging queues of all subhals together
     static constexpr size_t kMaxSizePendingWriteEventsQueue = 100000;
 
-    //! The number of events in the pending write events queue
-    size_t mSizePendingWriteEventsQueue = 0;
+    //! The number of events in the staging queues of all subhals
+    std::atomic<size_t> mNumStagedEvents = 0;
+
+    //! The staging queue the next write to the fmq starts from, so that subhals take turns.
+    size_t mNextStagingQueue = 0;
 
-    //! The mutex protecting writing to the fmq and the pending events queue
+    //! The mutex protecting writing to the fmq and consuming the staging queues
     std::mutex mEventQueueWriteMutex;
 
-    //! The condition variable waiting on pending write events to stack up
-    std::condition_variable mEventQueueWriteCV;
+    //! Set when the staging queues have events the posters could not write to the fmq
+    std::atomic_bool mPendingWrites = false;
+
+    //! The mutex and condition variable the background thread waits for pending writes on
+    std::mutex mPendingWritesMutex;
+    std::condition_variable mPendingWritesCV;
 
     //! The thread object ptr that handles pending writes
     std::thread mPendingWritesThread;
@@ -303,6 +308,39 @@ class HalProxy : public V2_0::implementation::IScopedWakelockRefCounter,
     //! Handles the pending writes on events to eventqueue.
     void handlePendingWrites();
 
+    /**
+     * Write as many staged events as fit to the event fmq, taking turns between the subhals, and
+     * wake the framework once. Does nothing if another thread is writing, as that thread will
+     * write the staged events before it returns.
+     *
+     * @return false if events are left staged because the fmq is full.
+     */
+    bool writeStagedEvents();
+
+    /**
+     * Drop all staged events and release the wakelock ref counts of the wakeup events among them.
+     *
+     * @return The number of events dropped.
+     */
+    size_t dropStagedEvents();
+
+    /**
+     * Drop the staged events of the subhal with the most events staged, and release the wakelock
+     * ref counts of the wakeup events among them.
+     *
+     * @param outSubHalIndex The index of the subhal whose events were dropped.
+     *
+     * @return The number of events dropped.
+     */
+    size_t dropLargestStagingQueue(size_t* outSubHalIndex);
+
+    /**
+     * Drop the events of one staging queue. mEventQueueWriteMutex must be held.
+     *
+     * @return The number of events dropped.
+     */
+    size_t dropStagedEventsLocked(EventStagingQueue<Event>& queue);
+
     /**
      * Starts the thread that handles decrementing the ref count on wakeup events processed by the
      * framework and timing out wakelocks.
@@ -357,14 +395,14 @@ class HalProxy : public V2_0::implementation::IScopedWakelockRefCounter,
     bool isSubHalIndexValid(int32_t sensorHandle);
 
     /**
-     * Count the number of wakeup events in the first n events of the vector.
+     * Count the number of wakeup events in the first n events of the array.
      *
-     * @param events The vector of Event objects.
+     * @param events The array of Event objects.
      * @param n The end index not inclusive of events to consider.
      *
      * @return The number of wakeup events of the considered events.
      */
-    size_t countNumWakeupEvents(const std::vector<Event>& events, size_t n);
+    size_t countNumWakeupEvents(const Event* events, size_t n);
 
     /*
      * Clear out the subhal index bytes from a sensorHandle.
@@ -50,17 +50,19 @@ class ISubHalCallback {
             const hidl_vec<int32_t>& dynamicSensorHandlesRemoved, int32_t subHalIndex) = 0;
 
     /**
-     * Post events to the event message queue if there is room to write them. Otherwise post the
-     * remaining events to a background thread for a blocking write with a kPendingWriteTimeoutNs
-     * timeout.
+     * Stage events on the sub-HAL's queue and write them to the event message queue if there is
+     * room. Otherwise leave the remaining events to a background thread which waits up to
+     * kPendingWriteTimeoutNs for room to write them.
      *
      * @param events The list of events to post to the message queue.
      * @param numWakeupEvents The number of wakeup events in events.
      * @param wakelock The wakelock associated with this post of events.
+     * @param subHalIndex The index of the sub-HAL posting the events.
      */
     virtual void postEventsToMessageQueue(const std::vector<V2_1::Event>& events,
                                           size_t numWakeupEvents,
-                                          V2_0::implementation::ScopedWakelock wakelock) = 0;
+                                          V2_0::implementation::ScopedWakelock wakelock,
+                                          int32_t subHalIndex) = 0;
 
     /**
      * Get the sensor info associated with that sensorHandle.
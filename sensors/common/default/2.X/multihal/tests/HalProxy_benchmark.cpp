@@ -0,0 +1,213 @@
+//
+// Copyright (C) 2022 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Measures posting events through the HalProxy from 6 subhals, each streaming accelerometer and
+// gyroscope samples like an IMU, while a reader drains the event FMQ like the sensors framework.
+// Once at a realistic 400 Hz per subhal, and once as fast as the subhals can post.
+
+#include <benchmark/benchmark.h>
+
+#include <android/hardware/sensors/1.0/types.h>
+#include <android/hardware/sensors/2.0/types.h>
+#include <fmq/MessageQueue.h>
+
+#include "HalProxy.h"
+#include "SensorsSubHal.h"
+#include "convertV2_1.h"
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <thread>
+#include <vector>
+
+namespace {
+
+using ::android::hardware::EventFlag;
+using ::android::hardware::hidl_vec;
+using ::android::hardware::MessageQueue;
+using ::android::hardware::Return;
+using ::android::hardware::sensors::V1_0::EventPayload;
+using ::android::hardware::sensors::V1_0::SensorInfo;
+using ::android::hardware::sensors::V1_0::SensorType;
+using ::android::hardware::sensors::V2_0::EventQueueFlagBits;
+using ::android::hardware::sensors::V2_1::implementation::convertToNewEvents;
+using ::android::hardware::sensors::V2_1::implementation::HalProxy;
+using ::android::hardware::sensors::V2_1::subhal::implementation::AllSensorsSubHal;
+using ::android::hardware::sensors::V2_1::subhal::implementation::SensorsSubHalV2_0;
+
+using ISensorsCallbackV2_0 = ::android::hardware::sensors::V2_0::ISensorsCallback;
+using EventV1_0 = ::android::hardware::sensors::V1_0::Event;
+using EventV2_1 = ::android::hardware::sensors::V2_1::Event;
+using EventMessageQueueV2_0 = MessageQueue<EventV1_0, ::android::hardware::kSynchronizedReadWrite>;
+using WakeupMessageQueue = MessageQueue<uint32_t, ::android::hardware::kSynchronizedReadWrite>;
+
+constexpr int kNumSubHals = 6;
+constexpr int kImuRateHz = 400;
+// Events the sensors framework reads from the FMQ at once
+constexpr size_t kEventQueueSize = 256;
+// Handles of AccelSensor and GyroSensor in AllSensorsSubHal
+constexpr int32_t kAccelHandle = 1;
+constexpr int32_t kGyroHandle = 2;
+
+class SensorsCallback : public ISensorsCallbackV2_0 {
+  public:
+    Return<void> onDynamicSensorsConnected(
+            const hidl_vec<SensorInfo>& /*dynamicSensorsAdded*/) override {
+        return Return<void>();
+    }
+
+    Return<void> onDynamicSensorsDisconnected(
+            const hidl_vec<int32_t>& /*dynamicSensorHandlesRemoved*/) override {
+        return Return<void>();
+    }
+};
+
+// One IMU sample, i.e. an accelerometer and a gyroscope event.
+std::vector<EventV2_1> makeImuSample() {
+    std::vector<EventV1_0> events(2);
+    events[0].sensorHandle = kAccelHandle;
+    events[0].sensorType = SensorType::ACCELEROMETER;
+    events[1].sensorHandle = kGyroHandle;
+    events[1].sensorType = SensorType::GYROSCOPE;
+    for (EventV1_0& event : events) {
+        event.timestamp = 0xFF00FF00;
+        event.u = EventPayload();
+    }
+    return convertToNewEvents(events);
+}
+
+// The subhals behind a HalProxy, and a reader draining its event FMQ.
+class Fixture {
+  public:
+    Fixture() : mProxy(makeSubHalList()) {
+        mEventQueue = std::make_unique<EventMessageQueueV2_0>(kEventQueueSize, true);
+        mWakeLockQueue = std::make_unique<WakeupMessageQueue>(kEventQueueSize, true);
+        mProxy.initialize(*mEventQueue->getDesc(), *mWakeLockQueue->getDesc(),
+                          new SensorsCallback());
+        EventFlag::createEventFlag(mEventQueue->getEventFlagWord(), &mEventQueueFlag);
+        mReader = std::thread([this] { readEvents(); });
+    }
+
+    ~Fixture() {
+        mReaderRun.store(false);
+        mEventQueueFlag->wake(static_cast<uint32_t>(EventQueueFlagBits::READ_AND_PROCESS));
+        mReader.join();
+        EventFlag::deleteEventFlag(&mEventQueueFlag);
+    }
+
+    AllSensorsSubHal<SensorsSubHalV2_0>& subHal(int index) { return mSubHals[index]; }
+
+    // Waits a bit for the reader to catch up, then returns the # of events it read.
+    uint64_t drain(uint64_t numPosted) {
+        for (int i = 0; i < 100 && mNumRead.load() < numPosted; i++) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        return mNumRead.load();
+    }
+
+  private:
+    std::vector<ISensorsSubHal*>& makeSubHalList() {
+        for (auto& subHal : mSubHals) {
+            mSubHalList.push_back(&subHal);
+        }
+        return mSubHalList;
+    }
+
+    void readEvents() {
+        constexpr int64_t kReadTimeoutNs = INT64_C(10000000);
+        std::vector<EventV1_0> events(kEventQueueSize);
+        while (mReaderRun.load()) {
+            uint32_t efState = 0;
+            mEventQueueFlag->wait(static_cast<uint32_t>(EventQueueFlagBits::READ_AND_PROCESS),
+                                  &efState, kReadTimeoutNs);
+            size_t numToRead = mEventQueue->availableToRead();
+            if (numToRead > 0 && mEventQueue->read(events.data(), numToRead)) {
+                mNumRead.fetch_add(numToRead);
+                mEventQueueFlag->wake(static_cast<uint32_t>(EventQueueFlagBits::EVENTS_READ));
+            }
+        }
+    }
+
+    AllSensorsSubHal<SensorsSubHalV2_0> mSubHals[kNumSubHals];
+    std::vector<ISensorsSubHal*> mSubHalList;
+    HalProxy mProxy;
+    std::unique_ptr<EventMessageQueueV2_0> mEventQueue;
+    std::unique_ptr<WakeupMessageQueue> mWakeLockQueue;
+    EventFlag* mEventQueueFlag = nullptr;
+    std::thread mReader;
+    std::atomic_bool mReaderRun = true;
+    std::atomic<uint64_t> mNumRead = 0;
+};
+
+std::unique_ptr<Fixture> sFixture;
+std::atomic<uint64_t> sNumPosted;
+
+void setUp(const benchmark::State& state) {
+    if (state.thread_index() == 0) {
+        sFixture = std::make_unique<Fixture>();
+        sNumPosted = 0;
+    }
+}
+
+void tearDown(benchmark::State& state) {
+    if (state.thread_index() == 0) {
+        uint64_t numPosted = sNumPosted.load();
+        uint64_t numRead = sFixture->drain(numPosted);
+        state.counters["dropped"] = numPosted - std::min(numPosted, numRead);
+        sFixture.reset();
+    }
+}
+
+// Each subhal posts one sample every 1 / kImuRateHz seconds. Reports the time a post takes.
+void BM_PostImuAt400Hz(benchmark::State& state) {
+    const std::vector<EventV2_1> sample = makeImuSample();
+    setUp(state);
+    auto nextPost = std::chrono::steady_clock::now();
+    for (auto _ : state) {
+        std::this_thread::sleep_until(nextPost);
+        nextPost += std::chrono::microseconds(1000000 / kImuRateHz);
+        auto start = std::chrono::steady_clock::now();
+        sFixture->subHal(state.thread_index()).postEvents(sample, false /* wakeup */);
+        state.SetIterationTime(
+                std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+        sNumPosted.fetch_add(sample.size());
+    }
+    state.SetItemsProcessed(state.iterations() * sample.size());
+    tearDown(state);
+}
+
+// Each subhal posts samples back to back, to find how much the HalProxy can take.
+void BM_PostImuSaturated(benchmark::State& state) {
+    const std::vector<EventV2_1> sample = makeImuSample();
+    setUp(state);
+    for (auto _ : state) {
+        sFixture->subHal(state.thread_index()).postEvents(sample, false /* wakeup */);
+        sNumPosted.fetch_add(sample.size());
+    }
+    state.SetItemsProcessed(state.iterations() * sample.size());
+    tearDown(state);
+}
+
+// 2 seconds of samples
+BENCHMARK(BM_PostImuAt400Hz)
+        ->Threads(kNumSubHals)
+        ->Iterations(2 * kImuRateHz)
+        ->UseManualTime();
+BENCHMARK(BM_PostImuSaturated)->Threads(kNumSubHals)->UseRealTime();
+
+}  // namespace
+
+BENCHMARK_MAIN();
@@ -25,6 +25,7 @@
 #include "V2_0/ScopedWakelock.h"
 #include "convertV2_1.h"
 
+#include <atomic>
 #include <chrono>
 #include <set>
 #include <thread>
@@ -46,6 +47,7 @@ using ::android::hardware::sensors::V2_0::implementation::HalProxyCallbackBase;
 using ::android::hardware::sensors::V2_0::implementation::ScopedWakelock;
 using ::android::hardware::sensors::V2_1::implementation::convertToNewEvents;
 using ::android::hardware::sensors::V2_1::implementation::convertToNewSensorInfos;
+using ::android::hardware::sensors::V2_1::implementation::EventStagingQueue;
 using ::android::hardware::sensors::V2_1::implementation::HalProxy;
 using ::android::hardware::sensors::V2_1::subhal::implementation::AddAndRemoveDynamicSensorsSubHal;
 using ::android::hardware::sensors::V2_1::subhal::implementation::AllSensorsSubHal;
@@ -827,6 +829,83 @@ TEST(HalProxyTest, PostEventsMultipleSubhalsThreadedV2_1) {
     EXPECT_EQ(eventQueue->availableToRead(), kNumEvents * 2);
 }
 
+TEST(EventStagingQueueTest, KeepsOrderAcrossBlocks) {
+    constexpr size_t kBlockSize = EventStagingQueue<int>::kBlockSize;
+    std::atomic<size_t> sharedSize = 0;
+    EventStagingQueue<int> queue(&sharedSize, 4 * kBlockSize);
+    std::vector<int> in(3 * kBlockSize + 7);
+    for (size_t i = 0; i < in.size(); i++) {
+        in[i] = static_cast<int>(i);
+    }
+
+    // Consume in runs not aligned to blocks, while more events are pushed, so that blocks are
+    // recycled.
+    std::vector<int> out;
+    auto sink = [&](const int* events, size_t count) {
+        out.insert(out.end(), events, events + count);
+        return true;
+    };
+    for (int round = 0; round < 3; round++) {
+        ASSERT_TRUE(queue.push(in.data(), in.size()));
+        EXPECT_EQ(queue.consume(kBlockSize + 3, sink), kBlockSize + 3);
+        EXPECT_EQ(queue.consume(SIZE_MAX, sink), in.size() - kBlockSize - 3);
+        EXPECT_TRUE(queue.empty());
+    }
+
+    ASSERT_EQ(out.size(), 3 * in.size());
+    for (size_t i = 0; i < out.size(); i++) {
+        EXPECT_EQ(out[i], in[i % in.size()]);
+    }
+    EXPECT_EQ(queue.getHighWaterMark(), in.size());
+    EXPECT_EQ(queue.getNumDropped(), 0);
+    EXPECT_EQ(sharedSize.load(), 0);
+}
+
+TEST(EventStagingQueueTest, DropsPushesPastCapacity) {
+    constexpr size_t kCapacity = 10;
+    std::atomic<size_t> sharedSize = 0;
+    EventStagingQueue<int> queue(&sharedSize, kCapacity);
+    std::vector<int> events(6);
+
+    EXPECT_TRUE(queue.push(events.data(), events.size()));
+    // All or nothing
+    EXPECT_FALSE(queue.push(events.data(), events.size()));
+    EXPECT_EQ(queue.size(), events.size());
+    EXPECT_EQ(queue.getNumDropped(), events.size());
+
+    // A sink refusing events leaves them queued
+    EXPECT_EQ(queue.consume(SIZE_MAX, [](const int*, size_t) { return false; }), 0);
+    EXPECT_EQ(queue.size(), events.size());
+
+    EXPECT_EQ(queue.consume(2, [](const int*, size_t) { return true; }), 2);
+    EXPECT_TRUE(queue.push(events.data(), events.size()));
+    EXPECT_EQ(queue.size(), kCapacity);
+    EXPECT_EQ(queue.getHighWaterMark(), kCapacity);
+    EXPECT_EQ(sharedSize.load(), kCapacity);
+}
+
+TEST(EventStagingQueueTest, SharesCapacityWithOtherQueues) {
+    constexpr size_t kCapacity = 10;
+    std::atomic<size_t> sharedSize = 0;
+    EventStagingQueue<int> queue1(&sharedSize, kCapacity);
+    EventStagingQueue<int> queue2(&sharedSize, kCapacity);
+    std::vector<int> events(6);
+
+    EXPECT_TRUE(queue1.push(events.data(), events.size()));
+    // The other queue is empty, but the shared capacity is not
+    EXPECT_FALSE(queue2.push(events.data(), events.size()));
+    EXPECT_EQ(queue2.getNumDropped(), events.size());
+    EXPECT_EQ(queue1.getNumDropped(), 0);
+    EXPECT_TRUE(queue2.push(events.data(), kCapacity - events.size()));
+    EXPECT_EQ(sharedSize.load(), kCapacity);
+
+    // Consuming from one queue makes room for the other
+    EXPECT_EQ(queue1.consume(SIZE_MAX, [](const int*, size_t) { return true; }), events.size());
+    EXPECT_EQ(sharedSize.load(), kCapacity - events.size());
+    EXPECT_TRUE(queue2.push(events.data(), events.size()));
+    EXPECT_EQ(queue2.size(), kCapacity);
+}
+
 // Helper implementations follow
 void testSensorsListFromProxyAndSubHal(const std::vector<SensorInfo>& proxySensorsList,
                                        const std::vector<SensorInfo>& subHalSensorsList) {
@@ -0,0 +1,258 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_HARDWARE_SENSORS_COMMON_SENSORSCHEDULER_H
+#define ANDROID_HARDWARE_SENSORS_COMMON_SENSORSCHEDULER_H
+
+#include <time.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace android {
+namespace hardware {
+namespace sensors {
+namespace common {
+
+/**
+ * Generates the events of all the sensors of the process from a single thread.
+ *
+ * Active sensors are kept in one queue ordered by the time they are next due. Each time the
+ * thread wakes up, it processes all the sensors which are due together, and posts their events
+ * with one write per callback, instead of one write per sensor.
+ *
+ * Shared by the default HIDL and AIDL implementations, which befriend the scheduler. A SensorT
+ * has:
+ *   int64_t process(int64_t now, std::vector<EventT>* events), which adds the events due at 'now'
+ *       to 'events' and returns when the sensor is due next,
+ *   bool isWakeUpSensor(), and
+ *   CallbackT* mCallback, whose postEvents(const std::vector<EventT>&, bool wakeup) writes events
+ *       to the event FMQ.
+ */
+template <typename SensorT, typename CallbackT, typename EventT>
+class SensorScheduler {
+  public:
+    static SensorScheduler* getInstance() {
+        // Never destroyed, as sensors may outlive static destructors.
+        static SensorScheduler* sInstance = new SensorScheduler();
+        return sInstance;
+    }
+
+    /**
+     * The lock protecting the state of all the sensors. It is held while the scheduler processes
+     * sensors, so that sensors are never processed while their configuration changes. It is not
+     * held while events are posted.
+     */
+    std::mutex& getLock() { return mLock; }
+
+    /**
+     * Sets when the sensor is processed next. Requires getLock().
+     *
+     * @param sensor The sensor.
+     * @param deadlineNs The CLOCK_BOOTTIME time to process the sensor at, or INT64_MAX to stop
+     *     processing it.
+     */
+    void schedule(SensorT* sensor, int64_t deadlineNs) {
+        auto entry = mEntries.find(sensor);
+        if (entry != mEntries.end()) {
+            mDeadlines.erase(entry->second);
+            mEntries.erase(entry);
+        }
+        if (deadlineNs == INT64_MAX) {
+            // The callback of the sensor may go away with it.
+            mPruneBatches = true;
+            return;
+        }
+        auto deadline = mDeadlines.emplace(deadlineNs, sensor);
+        mEntries.emplace(sensor, deadline);
+        if (deadline == mDeadlines.begin()) {
+            // Wake up the thread to wait for the new earliest deadline
+            mWaitCV.notify_all();
+        }
+    }
+
+    /**
+     * Releases getLock() and posts events to a callback, in order with the events the scheduler
+     * and the other sensors post.
+     *
+     * @param lock The lock holding getLock(). It is unlocked on return.
+     * @param callback The callback to post to.
+     * @param events The events to post, which must not be guarded by getLock().
+     * @param wakeup Whether the events are from a wake up sensor.
+     */
+    void post(std::unique_lock<std::mutex>* lock, CallbackT* callback,
+              const std::vector<EventT>& events, bool wakeup) {
+        if (events.empty()) {
+            lock->unlock();
+            return;
+        }
+        // Taken before releasing getLock(), so that events are posted in the order they were
+        // generated.
+        std::lock_guard<std::mutex> postLock(mPostLock);
+        lock->unlock();
+        callback->postEvents(events, wakeup);
+    }
+
+    /**
+     * Waits until the events the scheduler is posting are written. Once a sensor is unscheduled,
+     * this ensures the scheduler no longer uses its callback. Requires getLock().
+     */
+    void waitForPosts() { std::lock_guard<std::mutex> postLock(mPostLock); }
+
+    /**
+     * @return The number of times the thread woke up to process sensors.
+     */
+    uint64_t getNumWakeups() const { return mNumWakeups.load(std::memory_order_relaxed); }
+
+  private:
+    /**
+     * The events posted to a callback at once
+     */
+    struct Batch {
+        CallbackT* callback;
+        bool wakeup;
+        std::vector<EventT> events;
+    };
+
+    SensorScheduler() : mNumWakeups(0) {
+        mThread = std::thread([this] { run(); });
+    }
+
+    void run() {
+        constexpr int64_t kNanosecondsInSeconds = 1000 * 1000 * 1000;
+        std::unique_lock<std::mutex> lock(mLock);
+
+        while (true) {
+            if (mPruneBatches) {
+                pruneBatches();
+            }
+            if (mDeadlines.empty()) {
+                mWaitCV.wait(lock);
+                continue;
+            }
+
+            timespec curTime;
+            clock_gettime(CLOCK_BOOTTIME, &curTime);
+            int64_t now = (curTime.tv_sec * kNanosecondsInSeconds) + curTime.tv_nsec;
+            int64_t deadline = mDeadlines.begin()->first;
+            if (now < deadline) {
+                mWaitCV.wait_for(lock, std::chrono::nanoseconds(deadline - now));
+                continue;
+            }
+            mNumWakeups.fetch_add(1, std::memory_order_relaxed);
+
+            // Take all the due sensors out of the queue first, so that a sensor rescheduled at
+            // 'now' is processed on the next wake up.
+            for (auto due = mDeadlines.begin(); due != mDeadlines.end() && due->first <= now;) {
+                mDueSensors.push_back(due->second);
+                mEntries.erase(due->second);
+                due = mDeadlines.erase(due);
+            }
+            for (SensorT* sensor : mDueSensors) {
+                schedule(sensor, sensor->process(now, getBatch(sensor)));
+            }
+            mDueSensors.clear();
+
+            // The batches are only used by this thread, so they are posted without getLock(),
+            // but holding mPostLock, like post().
+            {
+                std::lock_guard<std::mutex> postLock(mPostLock);
+                lock.unlock();
+                for (Batch& batch : mBatches) {
+                    if (!batch.events.empty()) {
+                        batch.callback->postEvents(batch.events, batch.wakeup);
+                        batch.events.clear();
+                    }
+                }
+            }
+            lock.lock();
+        }
+    }
+
+    std::vector<EventT>* getBatch(SensorT* sensor) {
+        bool wakeup = sensor->isWakeUpSensor();
+        for (Batch& batch : mBatches) {
+            if (batch.callback == sensor->mCallback && batch.wakeup == wakeup) {
+                return &batch.events;
+            }
+        }
+        mBatches.push_back({.callback = sensor->mCallback, .wakeup = wakeup, .events = {}});
+        return &mBatches.back().events;
+    }
+
+    /**
+     * Removes the batches of the callbacks no scheduled sensor posts to. Requires getLock().
+     */
+    void pruneBatches() {
+        mPruneBatches = false;
+        mBatches.erase(std::remove_if(mBatches.begin(), mBatches.end(),
+                                      [this](const Batch& batch) {
+                                          return std::none_of(
+                                                  mEntries.begin(), mEntries.end(),
+                                                  [&batch](const auto& entry) {
+                                                      SensorT* sensor = entry.first;
+                                                      return sensor->mCallback == batch.callback &&
+                                                             sensor->isWakeUpSensor() ==
+                                                                     batch.wakeup;
+                                                  });
+                                      }),
+                       mBatches.end());
+    }
+
+    std::mutex mLock;
+    std::condition_variable mWaitCV;
+
+    /**
+     * Held while posting events, so that they are posted in order without holding mLock. Taken
+     * after mLock.
+     */
+    std::mutex mPostLock;
+
+    /**
+     * The active sensors by deadline, and the position of each sensor in it
+     */
+    std::multimap<int64_t, SensorT*> mDeadlines;
+    std::unordered_map<SensorT*, typename std::multimap<int64_t, SensorT*>::iterator> mEntries;
+
+    /**
+     * The sensors being processed, and their events. Kept to reuse their allocations. Only used
+     * by the scheduler thread.
+     */
+    std::vector<SensorT*> mDueSensors;
+    std::vector<Batch> mBatches;
+
+    /**
+     * Set when a sensor was unscheduled, so that the scheduler thread prunes mBatches.
+     */
+    bool mPruneBatches = false;
+
+    std::atomic<uint64_t> mNumWakeups;
+    std::thread mThread;
+};
+
+}  // namespace common
+}  // namespace sensors
+}  // namespace hardware
+}  // namespace android
+
+#endif  // ANDROID_HARDWARE_SENSORS_COMMON_SENSORSCHEDULER_H
@@ -0,0 +1,633 @@
+/*
+ * Copyright 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * Standalone benchmark of the default tuner HAL demux data path.
+ *
+ * Tuner/Demux/Dvr/Filter are instantiated in-process, a TS file is streamed through a DVR
+ * playback into the requested filters, and the packet rate, per-stage latency histograms of the
+ * DataPathProfiler and the number of heap allocations are reported.
+ *
+ * Usage:
+ *   android.hardware.tv.tuner-service.example-benchmark --input <ts file>
+ *       [--filters section:<pid>,pes:<pid>,video:<pid>,audio:<pid>,record]
+ *       [--loops <count>] [--dvr-size <bytes>] [--filter-size <bytes>]
+ */
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "android.hardware.tv.tuner-service.example-benchmark"
+
+#include <aidl/android/hardware/tv/tuner/BnDvrCallback.h>
+#include <aidl/android/hardware/tv/tuner/BnFilterCallback.h>
+#include <aidl/android/hardware/tv/tuner/DemuxQueueNotifyBits.h>
+#include <android/binder_process.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <string.h>
+#include <unistd.h>
+#include <utils/Log.h>
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "DataPathProfiler.h"
+#include "Tuner.h"
+
+using ::aidl::android::hardware::tv::tuner::BnDvrCallback;
+using ::aidl::android::hardware::tv::tuner::BnFilterCallback;
+using ::aidl::android::hardware::tv::tuner::DataFormat;
+using ::aidl::android::hardware::tv::tuner::DataPathProfiler;
+using ::aidl::android::hardware::tv::tuner::DemuxFilterAvSettings;
+using ::aidl::android::hardware::tv::tuner::DemuxFilterEvent;
+using ::aidl::android::hardware::tv::tuner::DemuxFilterMainType;
+using ::aidl::android::hardware::tv::tuner::DemuxFilterPesDataSettings;
+using ::aidl::android::hardware::tv::tuner::DemuxFilterRecordSettings;
+using ::aidl::android::hardware::tv::tuner::DemuxFilterSectionSettings;
+using ::aidl::android::hardware::tv::tuner::DemuxFilterSettings;
+using ::aidl::android::hardware::tv::tuner::DemuxFilterStatus;
+using ::aidl::android::hardware::tv::tuner::DemuxFilterSubType;
+using ::aidl::android::hardware::tv::tuner::DemuxFilterType;
+using ::aidl::android::hardware::tv::tuner::DemuxQueueNotifyBits;
+using ::aidl::android::hardware::tv::tuner::DemuxTsFilterSettingsFilterSettings;
+using ::aidl::android::hardware::tv::tuner::DemuxTsFilterType;
+using ::aidl::android::hardware::tv::tuner::DvrSettings;
+using ::aidl::android::hardware::tv::tuner::DvrType;
+using ::aidl::android::hardware::tv::tuner::IDemux;
+using ::aidl::android::hardware::tv::tuner::IDvr;
+using ::aidl::android::hardware::tv::tuner::IFilter;
+using ::aidl::android::hardware::tv::tuner::PlaybackSettings;
+using ::aidl::android::hardware::tv::tuner::PlaybackStatus;
+using ::aidl::android::hardware::tv::tuner::RecordSettings;
+using ::aidl::android::hardware::tv::tuner::RecordStatus;
+using ::aidl::android::hardware::tv::tuner::Tuner;
+
+using ::aidl::android::hardware::common::fmq::SynchronizedReadWrite;
+using ::android::AidlMessageQueue;
+using ::android::hardware::EventFlag;
+
+using BenchMQ = AidlMessageQueue<int8_t, SynchronizedReadWrite>;
+
+namespace {
+
+const int64_t kTsPacketSize = 188;
+const int32_t kDefaultDvrSize = 4 * 1024 * 1024;
+const int32_t kDefaultFilterSize = 16 * 1024 * 1024;
+const int kDrainPollUs = 100;
+const int64_t kFilterTimeoutNs = 10000000000;
+
+std::atomic<int64_t> sAllocationCount = 0;
+std::atomic<int64_t> sAllocationBytes = 0;
+
+}  // namespace
+
+// Global allocation counters, so allocations made by the HAL threads are accounted as well.
+void* operator new(size_t size) {
+    sAllocationCount.fetch_add(1, std::memory_order_relaxed);
+    sAllocationBytes.fetch_add(size, std::memory_order_relaxed);
+    void* ptr = malloc(size == 0 ? 1 : size);
+    if (ptr == nullptr) {
+        throw std::bad_alloc();
+    }
+    return ptr;
+}
+
+void* operator new[](size_t size) {
+    return operator new(size);
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept {
+    sAllocationCount.fetch_add(1, std::memory_order_relaxed);
+    sAllocationBytes.fetch_add(size, std::memory_order_relaxed);
+    return malloc(size == 0 ? 1 : size);
+}
+
+void* operator new[](size_t size, const std::nothrow_t& tag) noexcept {
+    return operator new(size, tag);
+}
+
+void operator delete(void* ptr) noexcept {
+    free(ptr);
+}
+
+void operator delete[](void* ptr) noexcept {
+    free(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept {
+    free(ptr);
+}
+
+void operator delete[](void* ptr, size_t) noexcept {
+    free(ptr);
+}
+
+namespace {
+
+/**
+ * Drains a filter or record FMQ on its own thread the same way a client would, so the HAL
+ * never blocks on a full output queue during the run.
+ */
+class QueueDrainer {
+  public:
+    explicit QueueDrainer(std::unique_ptr<BenchMQ> queue) : mQueue(std::move(queue)) {
+        EventFlag::createEventFlag(mQueue->getEventFlagWord(), &mEventFlag);
+    }
+
+    ~QueueDrainer() {
+        stop();
+        if (mEventFlag != nullptr) {
+            EventFlag::deleteEventFlag(&mEventFlag);
+        }
+    }
+
+    void start() {
+        mRunning = true;
+        mThread = std::thread(&QueueDrainer::threadLoop, this);
+    }
+
+    void stop() {
+        mRunning = false;
+        if (mThread.joinable()) {
+            mThread.join();
+        }
+    }
+
+    int64_t getDrainedBytes() const { return mDrainedBytes; }
+
+  private:
+    void threadLoop() {
+        std::vector<int8_t> buffer;
+        while (mRunning) {
+            size_t size = mQueue->availableToRead();
+            if (size == 0) {
+                usleep(kDrainPollUs);
+                continue;
+            }
+            buffer.resize(size);
+            if (!mQueue->read(buffer.data(), size)) {
+                continue;
+            }
+            mDrainedBytes += size;
+            if (mEventFlag != nullptr) {
+                mEventFlag->wake(static_cast<uint32_t>(DemuxQueueNotifyBits::DATA_CONSUMED));
+            }
+        }
+    }
+
+    std::unique_ptr<BenchMQ> mQueue;
+    EventFlag* mEventFlag = nullptr;
+    std::thread mThread;
+    std::atomic<bool> mRunning = false;
+    std::atomic<int64_t> mDrainedBytes = 0;
+};
+
+class BenchFilterCallback : public BnFilterCallback {
+  public:
+    ::ndk::ScopedAStatus onFilterEvent(const std::vector<DemuxFilterEvent>& events) override {
+        mEventCount += events.size();
+        for (const auto& event : events) {
+            // Return the A/V buffers right away so the run does not leak dmabufs.
+            if (event.getTag() == DemuxFilterEvent::Tag::media && mFilter != nullptr) {
+                const auto& mediaEvent = event.get<DemuxFilterEvent::Tag::media>();
+                mFilter->releaseAvHandle(mediaEvent.avMemory, mediaEvent.avDataId);
+            }
+        }
+        return ::ndk::ScopedAStatus::ok();
+    }
+
+    ::ndk::ScopedAStatus onFilterStatus(DemuxFilterStatus status) override {
+        if (status == DemuxFilterStatus::OVERFLOW) {
+            mOverflowCount++;
+        }
+        return ::ndk::ScopedAStatus::ok();
+    }
+
+    void setFilter(std::shared_ptr<IFilter> filter) { mFilter = filter; }
+    int64_t getEventCount() const { return mEventCount; }
+    int64_t getOverflowCount() const { return mOverflowCount; }
+
+  private:
+    std::shared_ptr<IFilter> mFilter;
+    std::atomic<int64_t> mEventCount = 0;
+    std::atomic<int64_t> mOverflowCount = 0;
+};
+
+class BenchDvrCallback : public BnDvrCallback {
+  public:
+    ::ndk::ScopedAStatus onRecordStatus(RecordStatus status) override {
+        if (status == RecordStatus::OVERFLOW && mDvr != nullptr) {
+            mRecordOverflowCount++;
+            mDvr->flush();
+        }
+        return ::ndk::ScopedAStatus::ok();
+    }
+
+    ::ndk::ScopedAStatus onPlaybackStatus(PlaybackStatus /* status */) override {
+        return ::ndk::ScopedAStatus::ok();
+    }
+
+    void setDvr(std::shared_ptr<IDvr> dvr) { mDvr = dvr; }
+    int64_t getRecordOverflowCount() const { return mRecordOverflowCount; }
+
+  private:
+    std::shared_ptr<IDvr> mDvr;
+    std::atomic<int64_t> mRecordOverflowCount = 0;
+};
+
+struct FilterSpec {
+    std::string name;
+    DemuxTsFilterType type;
+    int32_t pid;
+};
+
+struct BenchFilter {
+    FilterSpec spec;
+    std::shared_ptr<IFilter> filter;
+    std::shared_ptr<BenchFilterCallback> callback;
+    std::unique_ptr<QueueDrainer> drainer;
+};
+
+struct BenchConfig {
+    std::string inputFile;
+    std::vector<FilterSpec> filters;
+    int loops = 1;
+    int32_t dvrSize = kDefaultDvrSize;
+    int32_t filterSize = kDefaultFilterSize;
+};
+
+bool parseFilterSpecs(const std::string& arg, std::vector<FilterSpec>* specs) {
+    std::stringstream stream(arg);
+    std::string token;
+    while (std::getline(stream, token, ',')) {
+        std::string name = token.substr(0, token.find(':'));
+        int32_t pid = 0;
+        if (token.find(':') != std::string::npos) {
+            pid = static_cast<int32_t>(strtol(token.substr(token.find(':') + 1).c_str(), nullptr, 0));
+        }
+        if (name == "section") {
+            specs->push_back({name, DemuxTsFilterType::SECTION, pid});
+        } else if (name == "pes") {
+            specs->push_back({name, DemuxTsFilterType::PES, pid});
+        } else if (name == "video") {
+            specs->push_back({name, DemuxTsFilterType::VIDEO, pid});
+        } else if (name == "audio") {
+            specs->push_back({name, DemuxTsFilterType::AUDIO, pid});
+        } else if (name == "record") {
+            specs->push_back({name, DemuxTsFilterType::RECORD, pid});
+        } else {
+            fprintf(stderr, "Unknown filter type %s\n", name.c_str());
+            return false;
+        }
+    }
+    return true;
+}
+
+bool parseArgs(int argc, char** argv, BenchConfig* config) {
+    static const struct option options[] = {
+            {"input", required_argument, nullptr, 'i'},
+            {"filters", required_argument, nullptr, 'f'},
+            {"loops", required_argument, nullptr, 'l'},
+            {"dvr-size", required_argument, nullptr, 'd'},
+            {"filter-size", required_argument, nullptr, 's'},
+            {nullptr, 0, nullptr, 0},
+    };
+    int opt;
+    while ((opt = getopt_long(argc, argv, "i:f:l:d:s:", options, nullptr)) != -1) {
+        switch (opt) {
+            case 'i':
+                config->inputFile = optarg;
+                break;
+            case 'f':
+                if (!parseFilterSpecs(optarg, &config->filters)) {
+                    return false;
+                }
+                break;
+            case 'l':
+                config->loops = atoi(optarg);
+                break;
+            case 'd':
+                config->dvrSize = atoi(optarg);
+                break;
+            case 's':
+                config->filterSize = atoi(optarg);
+                break;
+            default:
+                return false;
+        }
+    }
+    if (config->inputFile.empty() || config->loops <= 0) {
+        return false;
+    }
+    if (config->filters.empty()) {
+        config->filters.push_back({"section", DemuxTsFilterType::SECTION, 0});
+    }
+    return true;
+}
+
+DemuxFilterSettings getFilterSettings(const FilterSpec& spec) {
+    DemuxFilterSettings settings = DemuxFilterSettings::make<DemuxFilterSettings::Tag::ts>();
+    auto& ts = settings.get<DemuxFilterSettings::Tag::ts>();
+    ts.tpid = spec.pid;
+    switch (spec.type) {
+        case DemuxTsFilterType::SECTION:
+            ts.filterSettings.set<DemuxTsFilterSettingsFilterSettings::Tag::section>(
+                    DemuxFilterSectionSettings{.isRepeat = true});
+            break;
+        case DemuxTsFilterType::PES:
+            ts.filterSettings.set<DemuxTsFilterSettingsFilterSettings::Tag::pesData>(
+                    DemuxFilterPesDataSettings{});
+            break;
+        case DemuxTsFilterType::AUDIO:
+        case DemuxTsFilterType::VIDEO:
+            ts.filterSettings.set<DemuxTsFilterSettingsFilterSettings::Tag::av>(
+                    DemuxFilterAvSettings{});
+            break;
+        case DemuxTsFilterType::RECORD:
+            ts.filterSettings.set<DemuxTsFilterSettingsFilterSettings::Tag::record>(
+                    DemuxFilterRecordSettings{});
+            break;
+        default:
+            break;
+    }
+    return settings;
+}
+
+std::unique_ptr<QueueDrainer> createDrainer(
+        const ::aidl::android::hardware::common::fmq::MQDescriptor<int8_t, SynchronizedReadWrite>&
+                desc) {
+    std::unique_ptr<BenchMQ> queue = std::make_unique<BenchMQ>(desc);
+    if (!queue->isValid()) {
+        return nullptr;
+    }
+    return std::make_unique<QueueDrainer>(std::move(queue));
+}
+
+/**
+ * Writes the input file into the playback FMQ |loops| times. Returns the number of bytes written.
+ */
+int64_t feedPlayback(const BenchConfig& config, BenchMQ* playbackMQ, EventFlag* playbackFlag) {
+    int fd = open(config.inputFile.c_str(), O_RDONLY | O_LARGEFILE);
+    if (fd < 0) {
+        fprintf(stderr, "Failed to open %s: %s\n", config.inputFile.c_str(), strerror(errno));
+        return -1;
+    }
+
+    // Only write whole TS packets, so the HAL never sees a split packet.
+    std::vector<int8_t> chunk((config.dvrSize / 4 / kTsPacketSize) * kTsPacketSize);
+    int64_t totalBytes = 0;
+    for (int loop = 0; loop < config.loops; loop++) {
+        lseek(fd, 0, SEEK_SET);
+        while (true) {
+            ssize_t readBytes = read(fd, chunk.data(), chunk.size());
+            if (readBytes <= 0) {
+                break;
+            }
+            readBytes -= readBytes % kTsPacketSize;
+            while (playbackMQ->availableToWrite() < static_cast<size_t>(readBytes)) {
+                usleep(kDrainPollUs);
+            }
+            if (!playbackMQ->write(chunk.data(), readBytes)) {
+                fprintf(stderr, "Failed to write into the playback FMQ\n");
+                close(fd);
+                return -1;
+            }
+            playbackFlag->wake(static_cast<uint32_t>(DemuxQueueNotifyBits::DATA_READY));
+            totalBytes += readBytes;
+        }
+    }
+    close(fd);
+
+    // Wait for the HAL to consume everything we wrote.
+    while (playbackMQ->availableToRead() > 0) {
+        usleep(kDrainPollUs);
+    }
+    return totalBytes;
+}
+
+/**
+ * Waits for the filters to handle the last packets read out of the playback FMQ, so that the
+ * elapsed time covers the whole data path.
+ */
+bool waitForFilters(int64_t packets) {
+    int64_t deadlineNs = DataPathProfiler::nowNs() + kFilterTimeoutNs;
+    while (DataPathProfiler::getInstance().getPacketCount() < packets) {
+        if (DataPathProfiler::nowNs() > deadlineNs) {
+            return false;
+        }
+        usleep(kDrainPollUs);
+    }
+    return true;
+}
+
+void printReport(const BenchConfig& config, const std::vector<BenchFilter>& filters,
+                 int64_t totalBytes, int64_t elapsedNs, int64_t allocations,
+                 int64_t allocatedBytes) {
+    DataPathProfiler& profiler = DataPathProfiler::getInstance();
+    int64_t packets = profiler.getPacketCount();
+    double seconds = elapsedNs / 1e9;
+
+    printf("Input: %s x%d\n", config.inputFile.c_str(), config.loops);
+    printf("Bytes: %" PRId64 ", packets: %" PRId64 ", elapsed: %.3f s\n", totalBytes, packets,
+           seconds);
+    printf("Throughput: %.0f packets/s, %.2f MB/s\n", packets / seconds,
+           totalBytes / seconds / (1024 * 1024));
+    printf("Allocations: %" PRId64 " (%" PRId64 " bytes), %.2f per packet\n", allocations,
+           allocatedBytes, packets == 0 ? 0.0 : static_cast<double>(allocations) / packets);
+    printf("Filters:\n");
+    for (const auto& filter : filters) {
+        printf("  %s pid=0x%x: events=%" PRId64 " overflows=%" PRId64 " drained=%" PRId64
+               " bytes\n",
+               filter.spec.name.c_str(), filter.spec.pid, filter.callback->getEventCount(),
+               filter.callback->getOverflowCount(),
+               filter.drainer != nullptr ? filter.drainer->getDrainedBytes() : 0);
+    }
+    fflush(stdout);
+    profiler.dump(STDOUT_FILENO);
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    BenchConfig config;
+    if (!parseArgs(argc, argv, &config)) {
+        fprintf(stderr,
+                "Usage: %s --input <ts file> [--filters type:pid,...] [--loops n] "
+                "[--dvr-size bytes] [--filter-size bytes]\n"
+                "  filter types: section, pes, video, audio, record\n",
+                argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    ABinderProcess_startThreadPool();
+    std::shared_ptr<Tuner> tuner = ndk::SharedRefBase::make<Tuner>();
+    tuner->init();
+
+    std::vector<int32_t> demuxId;
+    std::shared_ptr<IDemux> demux;
+    if (!tuner->openDemux(&demuxId, &demux).isOk()) {
+        fprintf(stderr, "Failed to open demux\n");
+        return EXIT_FAILURE;
+    }
+
+    // The playback DVR has to exist before the filters are opened, so they get attached to it.
+    std::shared_ptr<BenchDvrCallback> playbackCallback =
+            ndk::SharedRefBase::make<BenchDvrCallback>();
+    std::shared_ptr<IDvr> playbackDvr;
+    if (!demux->openDvr(DvrType::PLAYBACK, config.dvrSize, playbackCallback, &playbackDvr).isOk()) {
+        fprintf(stderr, "Failed to open the playback DVR\n");
+        return EXIT_FAILURE;
+    }
+    playbackCallback->setDvr(playbackDvr);
+    PlaybackSettings playbackSettings{
+            .statusMask = 0xf,
+            .lowThreshold = config.dvrSize / 4,
+            .highThreshold = config.dvrSize * 3 / 4,
+            .dataFormat = DataFormat::TS,
+            .packetSize = kTsPacketSize,
+    };
+    playbackDvr->configure(DvrSettings::make<DvrSettings::Tag::playback>(playbackSettings));
+
+    ::aidl::android::hardware::common::fmq::MQDescriptor<int8_t, SynchronizedReadWrite> desc;
+    playbackDvr->getQueueDesc(&desc);
+    std::unique_ptr<BenchMQ> playbackMQ = std::make_unique<BenchMQ>(desc);
+    EventFlag* playbackFlag = nullptr;
+    if (!playbackMQ->isValid() ||
+        EventFlag::createEventFlag(playbackMQ->getEventFlagWord(), &playbackFlag) != ::android::OK) {
+        fprintf(stderr, "Failed to map the playback FMQ\n");
+        return EXIT_FAILURE;
+    }
+
+    bool hasRecordFilter = false;
+    for (const auto& spec : config.filters) {
+        hasRecordFilter |= spec.type == DemuxTsFilterType::RECORD;
+    }
+
+    std::shared_ptr<BenchDvrCallback> recordCallback = ndk::SharedRefBase::make<BenchDvrCallback>();
+    std::shared_ptr<IDvr> recordDvr;
+    std::unique_ptr<QueueDrainer> recordDrainer;
+    if (hasRecordFilter) {
+        if (!demux->openDvr(DvrType::RECORD, config.dvrSize, recordCallback, &recordDvr).isOk()) {
+            fprintf(stderr, "Failed to open the record DVR\n");
+            return EXIT_FAILURE;
+        }
+        recordCallback->setDvr(recordDvr);
+        RecordSettings recordSettings{
+                .statusMask = 0xf,
+                .lowThreshold = config.dvrSize / 4,
+                .highThreshold = config.dvrSize * 3 / 4,
+                .dataFormat = DataFormat::TS,
+                .packetSize = kTsPacketSize,
+        };
+        recordDvr->configure(DvrSettings::make<DvrSettings::Tag::record>(recordSettings));
+        recordDvr->getQueueDesc(&desc);
+        recordDrainer = createDrainer(desc);
+    }
+
+    std::vector<BenchFilter> filters;
+    for (const auto& spec : config.filters) {
+        BenchFilter benchFilter;
+        benchFilter.spec = spec;
+        benchFilter.callback = ndk::SharedRefBase::make<BenchFilterCallback>();
+
+        DemuxFilterType type;
+        type.mainType = DemuxFilterMainType::TS;
+        type.subType.set<DemuxFilterSubType::Tag::tsFilterType>(spec.type);
+        if (!demux->openFilter(type, config.filterSize, benchFilter.callback, &benchFilter.filter)
+                     .isOk()) {
+            fprintf(stderr, "Failed to open %s filter\n", spec.name.c_str());
+            return EXIT_FAILURE;
+        }
+        benchFilter.callback->setFilter(benchFilter.filter);
+        benchFilter.filter->configure(getFilterSettings(spec));
+        if (spec.type == DemuxTsFilterType::RECORD) {
+            recordDvr->attachFilter(benchFilter.filter);
+        } else {
+            benchFilter.filter->getQueueDesc(&desc);
+            benchFilter.drainer = createDrainer(desc);
+        }
+        filters.push_back(std::move(benchFilter));
+    }
+
+    // Start the consumers first, then the HAL side, then measure only the streaming itself.
+    for (auto& filter : filters) {
+        if (filter.drainer != nullptr) {
+            filter.drainer->start();
+        }
+        filter.filter->start();
+    }
+    if (recordDrainer != nullptr) {
+        recordDrainer->start();
+        recordDvr->start();
+    }
+
+    DataPathProfiler& profiler = DataPathProfiler::getInstance();
+    profiler.reset();
+    profiler.setEnabled(true);
+    int64_t allocationsBefore = sAllocationCount;
+    int64_t allocatedBytesBefore = sAllocationBytes;
+    int64_t startNs = DataPathProfiler::nowNs();
+
+    playbackDvr->start();
+    int64_t totalBytes = feedPlayback(config, playbackMQ.get(), playbackFlag);
+    if (totalBytes > 0 && !waitForFilters(totalBytes / kTsPacketSize)) {
+        fprintf(stderr, "Timed out waiting for the filters to handle the playback data\n");
+    }
+
+    int64_t elapsedNs = DataPathProfiler::nowNs() - startNs;
+    int64_t allocations = sAllocationCount - allocationsBefore;
+    int64_t allocatedBytes = sAllocationBytes - allocatedBytesBefore;
+    profiler.setEnabled(false);
+
+    playbackDvr->stop();
+    if (recordDvr != nullptr) {
+        recordDvr->stop();
+    }
+    for (auto& filter : filters) {
+        filter.filter->stop();
+        if (filter.drainer != nullptr) {
+            filter.drainer->stop();
+        }
+    }
+    if (recordDrainer != nullptr) {
+        recordDrainer->stop();
+    }
+
+    if (totalBytes < 0) {
+        return EXIT_FAILURE;
+    }
+    printReport(config, filters, totalBytes, elapsedNs, allocations, allocatedBytes);
+    if (recordDrainer != nullptr) {
+        printf("Record drained: %" PRId64 " bytes, overflows: %" PRId64 "\n",
+               recordDrainer->getDrainedBytes(), recordCallback->getRecordOverflowCount());
+    }
+
+    for (auto& filter : filters) {
+        filter.callback->setFilter(nullptr);
+        filter.filter->close();
+    }
+    playbackCallback->setDvr(nullptr);
+    recordCallback->setDvr(nullptr);
+    EventFlag::deleteEventFlag(&playbackFlag);
+    demux->close();
+
+    return EXIT_SUCCESS;
+}
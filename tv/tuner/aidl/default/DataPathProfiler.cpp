@@ -0,0 +1,174 @@
+/*
+ * Copyright 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "android.hardware.tv.tuner-service.example-DataPathProfiler"
+
+#include <inttypes.h>
+#include <stdio.h>
+
+#include "DataPathProfiler.h"
+
+namespace aidl {
+namespace android {
+namespace hardware {
+namespace tv {
+namespace tuner {
+
+LatencyHistogram::LatencyHistogram() {
+    reset();
+}
+
+void LatencyHistogram::record(int64_t latencyNs) {
+    if (latencyNs < 0) {
+        latencyNs = 0;
+    }
+    int bucket = 0;
+    while (bucket < kNumBuckets - 1 && (latencyNs >> (bucket + 1)) != 0) {
+        bucket++;
+    }
+    mBuckets[bucket].fetch_add(1, std::memory_order_relaxed);
+    mCount.fetch_add(1, std::memory_order_relaxed);
+    mTotalNs.fetch_add(latencyNs, std::memory_order_relaxed);
+
+    int64_t max = mMaxNs.load(std::memory_order_relaxed);
+    while (latencyNs > max &&
+           !mMaxNs.compare_exchange_weak(max, latencyNs, std::memory_order_relaxed)) {
+    }
+}
+
+void LatencyHistogram::reset() {
+    for (auto& bucket : mBuckets) {
+        bucket.store(0, std::memory_order_relaxed);
+    }
+    mCount.store(0, std::memory_order_relaxed);
+    mTotalNs.store(0, std::memory_order_relaxed);
+    mMaxNs.store(0, std::memory_order_relaxed);
+}
+
+int64_t LatencyHistogram::getCount() const {
+    return mCount.load(std::memory_order_relaxed);
+}
+
+int64_t LatencyHistogram::getMeanNs() const {
+    int64_t count = getCount();
+    return count == 0 ? 0 : mTotalNs.load(std::memory_order_relaxed) / count;
+}
+
+int64_t LatencyHistogram::getMaxNs() const {
+    return mMaxNs.load(std::memory_order_relaxed);
+}
+
+int64_t LatencyHistogram::getPercentileNs(double percentile) const {
+    int64_t count = getCount();
+    if (count == 0) {
+        return 0;
+    }
+    int64_t target = static_cast<int64_t>(count * percentile / 100.0);
+    int64_t seen = 0;
+    for (int i = 0; i < kNumBuckets; i++) {
+        seen += mBuckets[i].load(std::memory_order_relaxed);
+        if (seen > target) {
+            return (int64_t)1 << (i + 1);
+        }
+    }
+    return getMaxNs();
+}
+
+void LatencyHistogram::dump(int fd, const char* name) const {
+    dprintf(fd, "      %s: count=%" PRId64 " mean=%" PRId64 "ns p50<%" PRId64 "ns p90<%" PRId64
+                "ns p99<%" PRId64 "ns max=%" PRId64 "ns\n",
+            name, getCount(), getMeanNs(), getPercentileNs(50), getPercentileNs(90),
+            getPercentileNs(99), getMaxNs());
+    for (int i = 0; i < kNumBuckets; i++) {
+        int64_t bucket = mBuckets[i].load(std::memory_order_relaxed);
+        if (bucket != 0) {
+            dprintf(fd, "        [%" PRId64 ", %" PRId64 ")ns: %" PRId64 "\n",
+                    i == 0 ? 0 : (int64_t)1 << i, (int64_t)1 << (i + 1), bucket);
+        }
+    }
+}
+
+DataPathProfiler& DataPathProfiler::getInstance() {
+    static DataPathProfiler sInstance;
+    return sInstance;
+}
+
+void DataPathProfiler::setEnabled(bool enabled) {
+    mEnabled.store(enabled, std::memory_order_relaxed);
+}
+
+void DataPathProfiler::record(DataPathStage stage, int64_t latencyNs) {
+    mHistograms[static_cast<int>(stage)].record(latencyNs);
+}
+
+void DataPathProfiler::addPackets(int64_t count) {
+    if (isEnabled()) {
+        mPacketCount.fetch_add(count, std::memory_order_relaxed);
+    }
+}
+
+void DataPathProfiler::reset() {
+    for (auto& histogram : mHistograms) {
+        histogram.reset();
+    }
+    mPacketCount.store(0, std::memory_order_relaxed);
+}
+
+const LatencyHistogram& DataPathProfiler::getHistogram(DataPathStage stage) const {
+    return mHistograms[static_cast<int>(stage)];
+}
+
+int64_t DataPathProfiler::getPacketCount() const {
+    return mPacketCount.load(std::memory_order_relaxed);
+}
+
+void DataPathProfiler::dump(int fd) const {
+    dprintf(fd, "    DataPathProfiler:\n");
+    dprintf(fd, "      enabled: %d\n", isEnabled());
+    dprintf(fd, "      packets: %" PRId64 "\n", getPacketCount());
+    for (int i = 0; i < static_cast<int>(DataPathStage::COUNT); i++) {
+        mHistograms[i].dump(fd, getStageName(static_cast<DataPathStage>(i)));
+    }
+}
+
+const char* DataPathProfiler::getStageName(DataPathStage stage) {
+    switch (stage) {
+        case DataPathStage::FMQ_READ:
+            return "fmq_read";
+        case DataPathStage::DISPATCH:
+            return "dispatch";
+        case DataPathStage::FILTER_HANDLER:
+            return "filter_handler";
+        case DataPathStage::CALLBACK:
+            return "callback";
+        case DataPathStage::COUNT:
+            break;
+    }
+    return "unknown";
+}
+
+int64_t DataPathProfiler::nowNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                   std::chrono::steady_clock::now().time_since_epoch())
+            .count();
+}
+
+}  // namespace tuner
+}  // namespace tv
+}  // namespace hardware
+}  // namespace android
+}  // namespace aidl
@@ -0,0 +1,133 @@
+/*
+ * Copyright 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+namespace aidl {
+namespace android {
+namespace hardware {
+namespace tv {
+namespace tuner {
+
+/**
+ * Stages of the demux data path that can be timed by the DataPathProfiler.
+ */
+enum class DataPathStage : int {
+    // Reading one packet out of the DVR playback FMQ
+    FMQ_READ = 0,
+    // Routing one packet to the PID matching (or record) filters
+    DISPATCH,
+    // Running a filter handler over the accumulated filter output
+    FILTER_HANDLER,
+    // Delivering a batch of filter events to the IFilterCallback
+    CALLBACK,
+    COUNT,
+};
+
+/**
+ * A lock-free latency histogram with power-of-two nanosecond buckets.
+ * Bucket i counts samples in [2^i, 2^(i+1)) ns.
+ */
+class LatencyHistogram {
+  public:
+    static constexpr int kNumBuckets = 40;
+
+    LatencyHistogram();
+
+    void record(int64_t latencyNs);
+    void reset();
+
+    int64_t getCount() const;
+    int64_t getMeanNs() const;
+    int64_t getMaxNs() const;
+    /**
+     * Returns the upper bound of the bucket containing the given percentile, in ns.
+     */
+    int64_t getPercentileNs(double percentile) const;
+    void dump(int fd, const char* name) const;
+
+  private:
+    std::array<std::atomic<int64_t>, kNumBuckets> mBuckets;
+    std::atomic<int64_t> mCount;
+    std::atomic<int64_t> mTotalNs;
+    std::atomic<int64_t> mMaxNs;
+};
+
+/**
+ * Process wide profiler of the default demux data path. It is disabled by default, in which
+ * case the instrumentation in Dvr/Demux/Filter costs a single relaxed atomic load per stage.
+ * Tuner::dump enables, disables and resets it with the "--profiler" argument.
+ */
+class DataPathProfiler {
+  public:
+    static DataPathProfiler& getInstance();
+
+    void setEnabled(bool enabled);
+    bool isEnabled() const { return mEnabled.load(std::memory_order_relaxed); }
+
+    void record(DataPathStage stage, int64_t latencyNs);
+    void addPackets(int64_t count);
+    void reset();
+
+    const LatencyHistogram& getHistogram(DataPathStage stage) const;
+    int64_t getPacketCount() const;
+
+    void dump(int fd) const;
+
+    static const char* getStageName(DataPathStage stage);
+    static int64_t nowNs();
+
+  private:
+    DataPathProfiler() = default;
+
+    std::atomic<bool> mEnabled = false;
+    std::atomic<int64_t> mPacketCount = 0;
+    std::array<LatencyHistogram, static_cast<int>(DataPathStage::COUNT)> mHistograms;
+};
+
+/**
+ * Records the lifetime of the object into the given stage of the DataPathProfiler when it
+ * is enabled.
+ */
+class ScopedDataPathTimer {
+  public:
+    explicit ScopedDataPathTimer(DataPathStage stage)
+        : mStage(stage),
+          mStartNs(DataPathProfiler::getInstance().isEnabled() ? DataPathProfiler::nowNs() : 0) {}
+    ~ScopedDataPathTimer() {
+        if (mStartNs != 0) {
+            DataPathProfiler::getInstance().record(mStage, DataPathProfiler::nowNs() - mStartNs);
+        }
+    }
+
+  private:
+    ScopedDataPathTimer(const ScopedDataPathTimer&) = delete;
+    ScopedDataPathTimer& operator=(const ScopedDataPathTimer&) = delete;
+
+    DataPathStage mStage;
+    int64_t mStartNs;
+};
+
+}  // namespace tuner
+}  // namespace tv
+}  // namespace hardware
+}  // namespace android
+}  // namespace aidl
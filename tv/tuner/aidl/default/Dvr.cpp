@@ -21,6 +21,7 @@
 #include <aidl/android/hardware/tv/tuner/Result.h>
 
 #include <utils/Log.h>
+#include "DataPathProfiler.h"
 #include "Dvr.h"
 
 namespace aidl {
@@ -265,9 +266,13 @@ bool Dvr::readPlaybackFMQ(bool isVirtualFrontend, bool isRecording) {
     dataOutputBuffer.resize(playbackPacketSize);
     // Dispatch the packet to the PID matching filter output buffer
     for (int i = 0; i < size / playbackPacketSize; i++) {
-        if (!mDvrMQ->read(dataOutputBuffer.data(), playbackPacketSize)) {
-            return false;
+        {
+            ScopedDataPathTimer timer(DataPathStage::FMQ_READ);
+            if (!mDvrMQ->read(dataOutputBuffer.data(), playbackPacketSize)) {
+                return false;
+            }
         }
+        ScopedDataPathTimer timer(DataPathStage::DISPATCH);
         if (isVirtualFrontend) {
             if (isRecording) {
                 mDemux->sendFrontendInputToRecord(dataOutputBuffer);
@@ -278,6 +283,7 @@ bool Dvr::readPlaybackFMQ(bool isVirtualFrontend, bool isRecording) {
             startTpidFilter(dataOutputBuffer);
         }
     }
+    mDispatchedPackets += size / playbackPacketSize;
 
     return true;
 }
@@ -416,23 +422,28 @@ void Dvr::startTpidFilter(vector<int8_t> data) {
 }
 
 bool Dvr::startFilterDispatcher(bool isVirtualFrontend, bool isRecording) {
+    bool success = true;
     if (isVirtualFrontend) {
         if (isRecording) {
-            return mDemux->startRecordFilterDispatcher();
+            success = mDemux->startRecordFilterDispatcher();
         } else {
-            return mDemux->startBroadcastFilterDispatcher();
+            success = mDemux->startBroadcastFilterDispatcher();
         }
-    }
-
-    map<int64_t, std::shared_ptr<IFilter>>::iterator it;
-    // Handle the output data per filter type
-    for (it = mFilters.begin(); it != mFilters.end(); it++) {
-        if (mDemux->startFilterHandler(it->first).isOk()) {
-            return false;
+    } else {
+        map<int64_t, std::shared_ptr<IFilter>>::iterator it;
+        // Handle the output data per filter type
+        for (it = mFilters.begin(); it != mFilters.end(); it++) {
+            if (!mDemux->startFilterHandler(it->first).isOk()) {
+                success = false;
+                break;
+            }
         }
     }
 
-    return true;
+    // Packets only count as processed once the filters handled them.
+    DataPathProfiler::getInstance().addPackets(mDispatchedPackets);
+    mDispatchedPackets = 0;
+    return success;
 }
 
 bool Dvr::writeRecordFMQ(const vector<int8_t>& data) {
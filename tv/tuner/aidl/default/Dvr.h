@@ -131,6 +131,10 @@ class Dvr : public BnDvr {
      * If a specific filter's writing loop is still running
      */
     std::atomic<bool> mDvrThreadRunning;
+    /**
+     * Packets read from the playback FMQ and not yet handled by the filters
+     */
+    int64_t mDispatchedPackets = 0;
 
     /**
      * Lock to protect writes to the FMQs
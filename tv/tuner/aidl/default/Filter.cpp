@@ -25,6 +25,7 @@
 #include <inttypes.h>
 #include <utils/Log.h>
 
+#include "DataPathProfiler.h"
 #include "Filter.h"
 
 namespace aidl {
@@ -136,6 +137,7 @@ void FilterCallbackScheduler::threadLoopOnce() {
     // events.
     if (mIsRunning && !mCallbackBuffer.empty()) {
         if (mCallback) {
+            ScopedDataPathTimer timer(DataPathStage::CALLBACK);
             mCallback->onFilterEvent(mCallbackBuffer);
         }
         mCallbackBuffer.clear();
@@ -717,6 +719,7 @@ void Filter::updateRecordOutput(vector<int8_t>& data) {
 }
 
 ::ndk::ScopedAStatus Filter::startFilterHandler() {
+    ScopedDataPathTimer timer(DataPathStage::FILTER_HANDLER);
     std::lock_guard<std::mutex> lock(mFilterOutputLock);
     switch (mType.mainType) {
         case DemuxFilterMainType::TS:
@@ -923,6 +926,7 @@ void Filter::updateRecordOutput(vector<int8_t>& data) {
 }
 
 ::ndk::ScopedAStatus Filter::startRecordFilterHandler() {
+    ScopedDataPathTimer timer(DataPathStage::FILTER_HANDLER);
     std::lock_guard<std::mutex> lock(mRecordFilterOutputLock);
     if (mRecordFilterOutput.empty()) {
         return ::ndk::ScopedAStatus::ok();
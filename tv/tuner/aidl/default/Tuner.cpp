@@ -18,8 +18,10 @@
 #define LOG_TAG "android.hardware.tv.tuner-service.example-Tuner"
 
 #include <aidl/android/hardware/tv/tuner/Result.h>
+#include <string.h>
 #include <utils/Log.h>
 
+#include "DataPathProfiler.h"
 #include "Demux.h"
 #include "Descrambler.h"
 #include "Frontend.h"
@@ -224,6 +226,31 @@ binder_status_t Tuner::dump(int fd, const char** args, uint32_t numArgs) {
             mLnbs[i]->dump(fd, args, numArgs);
         }
     }
+    {
+        // The profiler is controlled with
+        // "dumpsys android.hardware.tv.tuner.ITuner/default --profiler <enable|disable|reset>".
+        DataPathProfiler& profiler = DataPathProfiler::getInstance();
+        bool dumpProfiler = profiler.isEnabled();
+        for (uint32_t i = 0; i + 1 < numArgs; i++) {
+            if (strcmp(args[i], "--profiler") != 0) {
+                continue;
+            }
+            if (strcmp(args[i + 1], "enable") == 0) {
+                profiler.reset();
+                profiler.setEnabled(true);
+            } else if (strcmp(args[i + 1], "disable") == 0) {
+                profiler.setEnabled(false);
+            } else if (strcmp(args[i + 1], "reset") == 0) {
+                profiler.reset();
+            } else {
+                dprintf(fd, "Unknown profiler command: %s\n", args[i + 1]);
+            }
+            dumpProfiler = true;
+        }
+        if (dumpProfiler) {
+            profiler.dump(fd);
+        }
+    }
     return STATUS_OK;
 }
 
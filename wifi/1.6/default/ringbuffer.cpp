@@ -14,8 +14,13 @@
  * limitations under the License.
  */
 
+#include <android-base/file.h>
 #include <android-base/logging.h>
 
+#include <algorithm>
+#include <cstring>
+#include <thread>
+
 #include "ringbuffer.h"
 
 namespace android {
@@ -24,37 +29,180 @@ namespace wifi {
 namespace V1_6 {
 namespace implementation {
 
-Ringbuffer::Ringbuffer(size_t maxSize) : size_(0), maxSize_(maxSize) {}
+namespace {
+// Each record is prefixed with its size, and with the amount of data
+// appended before it, which tells how much data follows the oldest record.
+struct RecordHeader {
+    uint32_t size;
+    uint32_t appended;
+};
+constexpr size_t kHeaderSize = sizeof(RecordHeader);
+// The ring has room for the headers of records of this size on average, and
+// drops the oldest records early when they are smaller.
+constexpr size_t kMinAverageRecordSize = 64;
+constexpr size_t kMinRecords = 16;
+constexpr uint64_t kPinned = 1;
+
+size_t ringCapacity(size_t maxSize) {
+    return maxSize + kHeaderSize * std::max(kMinRecords, maxSize / kMinAverageRecordSize);
+}
+}  // namespace
+
+// The ring is left uninitialized, and only takes up memory as it fills.
+Ringbuffer::Ringbuffer(size_t maxSize)
+    : ring_(new uint8_t[ringCapacity(maxSize)]),
+      capacity_(ringCapacity(maxSize)),
+      maxSize_(maxSize),
+      appended_(0),
+      head_(0),
+      tail_(0) {}
 
 enum Ringbuffer::AppendStatus Ringbuffer::append(const std::vector<uint8_t>& input) {
-    if (input.size() == 0) {
+    return append(input.data(), input.size());
+}
+
+enum Ringbuffer::AppendStatus Ringbuffer::append(const uint8_t* data, size_t size) {
+    if (size == 0) {
         return AppendStatus::FAIL_IP_BUFFER_ZERO;
     }
-    if (input.size() > maxSize_) {
-        LOG(INFO) << "Oversized message of " << input.size() << " bytes is dropped";
+    if (size > maxSize_) {
+        LOG(INFO) << "Oversized message of " << size << " bytes is dropped";
         return AppendStatus::FAIL_IP_BUFFER_EXCEEDED_MAXSIZE;
     }
-    data_.push_back(input);
-    size_ += input.size() * sizeof(input[0]);
-    while (size_ > maxSize_) {
-        if (data_.front().size() <= 0 || data_.front().size() > maxSize_) {
-            LOG(ERROR) << "First buffer in the ring buffer is Invalid. Size: "
-                       << data_.front().size();
+    const uint64_t tail = tail_.load(std::memory_order_relaxed);
+    const uint64_t end = tail + kHeaderSize + size;
+    uint64_t head_word = head_.load(std::memory_order_acquire);
+    // Deletes from the front until the record fits, in the ring and within
+    // |maxSize_|.
+    while (true) {
+        const uint64_t head = head_word >> 1;
+        if (head == tail) {
+            break;
+        }
+        RecordHeader front;
+        copyOut(head, &front, kHeaderSize);
+        // Truncated to the width of the header, like |front.appended|.
+        const uint32_t kept = static_cast<uint32_t>(appended_) - front.appended;
+        if (end - head <= capacity_ && kept + size <= maxSize_) {
+            break;
+        }
+        // The records being read are never overwritten. Readers only pin
+        // them to copy them out, so waiting for the pin is short.
+        if (head_word & kPinned) {
+            std::this_thread::yield();
+            head_word = head_.load(std::memory_order_acquire);
+            continue;
+        }
+        if (front.size == 0 || front.size > maxSize_) {
+            LOG(ERROR) << "First buffer in the ring buffer is Invalid";
             return AppendStatus::FAIL_RING_BUFFER_CORRUPTED;
         }
-        size_ -= data_.front().size() * sizeof(data_.front()[0]);
-        data_.pop_front();
+        // Fails, and reloads |head_word|, if the records were pinned or
+        // removed meanwhile.
+        const uint64_t next_word = (head + kHeaderSize + front.size) << 1;
+        if (head_.compare_exchange_weak(head_word, next_word, std::memory_order_acq_rel,
+                                        std::memory_order_acquire)) {
+            head_word = next_word;
+        }
     }
+    const RecordHeader header = {static_cast<uint32_t>(size), static_cast<uint32_t>(appended_)};
+    copyIn(tail, &header, kHeaderSize);
+    copyIn(tail + kHeaderSize, data, size);
+    appended_ += size;
+    // Publishes the record to the readers.
+    tail_.store(end, std::memory_order_release);
     return AppendStatus::SUCCESS;
 }
 
-const std::list<std::vector<uint8_t>>& Ringbuffer::getData() const {
-    return data_;
+bool Ringbuffer::empty() const {
+    return (head_.load(std::memory_order_acquire) >> 1) == tail_.load(std::memory_order_acquire);
+}
+
+std::list<std::vector<uint8_t>> Ringbuffer::getData() {
+    std::vector<uint8_t> data;
+    std::vector<size_t> sizes;
+    const uint64_t head = pin();
+    copyRecords(head, tail_.load(std::memory_order_acquire), &data, &sizes);
+    unpin(head);
+
+    std::list<std::vector<uint8_t>> records;
+    auto pos = data.begin();
+    for (size_t size : sizes) {
+        records.emplace_back(pos, pos + size);
+        pos += size;
+    }
+    return records;
+}
+
+bool Ringbuffer::writeToFd(int fd) {
+    std::vector<uint8_t> data;
+    std::vector<size_t> sizes;
+    const uint64_t head = pin();
+    const uint64_t tail = tail_.load(std::memory_order_acquire);
+    bool success = copyRecords(head, tail, &data, &sizes);
+    // Removes the records, written or not, before writing, so that append()
+    // does not wait on the file.
+    unpin(tail);
+    if (!data.empty() && !android::base::WriteFully(fd, data.data(), data.size())) {
+        PLOG(ERROR) << "Error writing to file";
+        success = false;
+    }
+    return success;
 }
 
 void Ringbuffer::clear() {
-    data_.clear();
-    size_ = 0;
+    pin();
+    unpin(tail_.load(std::memory_order_acquire));
+}
+
+uint64_t Ringbuffer::pin() {
+    uint64_t head_word = head_.load(std::memory_order_acquire);
+    while (!head_.compare_exchange_weak(head_word, head_word | kPinned, std::memory_order_acq_rel,
+                                        std::memory_order_acquire)) {
+    }
+    return head_word >> 1;
+}
+
+void Ringbuffer::unpin(uint64_t head) {
+    head_.store(head << 1, std::memory_order_release);
+}
+
+bool Ringbuffer::copyRecords(uint64_t head, uint64_t tail, std::vector<uint8_t>* data,
+                             std::vector<size_t>* sizes) const {
+    data->reserve(tail - head);
+    for (uint64_t pos = head; pos < tail;) {
+        const size_t size = readRecordSize(pos);
+        if (size == 0) {
+            LOG(ERROR) << "Ring buffer is corrupted. Invalid block at " << pos - head;
+            return false;
+        }
+        const size_t offset = data->size();
+        data->resize(offset + size);
+        copyOut(pos + kHeaderSize, data->data() + offset, size);
+        sizes->push_back(size);
+        pos += kHeaderSize + size;
+    }
+    return true;
+}
+
+size_t Ringbuffer::readRecordSize(uint64_t pos) const {
+    RecordHeader header;
+    copyOut(pos, &header, kHeaderSize);
+    return (header.size == 0 || header.size > maxSize_) ? 0 : header.size;
+}
+
+void Ringbuffer::copyIn(uint64_t pos, const void* src, size_t size) {
+    const size_t offset = pos % capacity_;
+    const size_t first = std::min(size, capacity_ - offset);
+    memcpy(ring_.get() + offset, src, first);
+    memcpy(ring_.get(), static_cast<const uint8_t*>(src) + first, size - first);
+}
+
+void Ringbuffer::copyOut(uint64_t pos, void* dst, size_t size) const {
+    const size_t offset = pos % capacity_;
+    const size_t first = std::min(size, capacity_ - offset);
+    memcpy(dst, ring_.get() + offset, first);
+    memcpy(static_cast<uint8_t*>(dst) + first, ring_.get(), size - first);
 }
 
 }  // namespace implementation
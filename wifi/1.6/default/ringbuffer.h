@@ -17,7 +17,9 @@
 #ifndef RINGBUFFER_H_
 #define RINGBUFFER_H_
 
+#include <atomic>
 #include <list>
+#include <memory>
 #include <vector>
 
 namespace android {
@@ -28,6 +30,13 @@ namespace implementation {
 
 /**
  * Ringbuffer object used to store debug data.
+ *
+ * Records are stored back to back in a fixed size byte ring, each prefixed
+ * with a small header, and the oldest records are overwritten once they add
+ * up to more than |maxSize| bytes. A single thread appends (the legacy HAL
+ * event loop), while the other methods read or remove the records and must
+ * not run concurrently with each other. Readers only hold off append() while
+ * they copy the records out.
  */
 class Ringbuffer {
   public:
@@ -44,13 +53,41 @@ class Ringbuffer {
     // Appends the data buffer and deletes from the front until buffer is
     // within |maxSize_|.
     enum AppendStatus append(const std::vector<uint8_t>& input);
-    const std::list<std::vector<uint8_t>>& getData() const;
+    enum AppendStatus append(const uint8_t* data, size_t size);
+    bool empty() const;
+    // Copies the records out, oldest first.
+    std::list<std::vector<uint8_t>> getData();
+    // Writes the records to |fd|, oldest first, and removes them.
+    bool writeToFd(int fd);
     void clear();
 
   private:
-    std::list<std::vector<uint8_t>> data_;
-    size_t size_;
+    // Pins the oldest record so that append() does not overwrite it, and
+    // returns its position.
+    uint64_t pin();
+    // Releases the pin and removes the records before |head|.
+    void unpin(uint64_t head);
+    // Copies the data of the records in [|head|, |tail|) to |data|, oldest
+    // first, and their sizes to |sizes|. Returns false if the ring is
+    // corrupted.
+    bool copyRecords(uint64_t head, uint64_t tail, std::vector<uint8_t>* data,
+                     std::vector<size_t>* sizes) const;
+    // Reads the size of the record at |pos|, or returns 0 if invalid.
+    size_t readRecordSize(uint64_t pos) const;
+    void copyIn(uint64_t pos, const void* src, size_t size);
+    void copyOut(uint64_t pos, void* dst, size_t size) const;
+
+    // Positions are byte offsets which only grow, and wrap in |ring_|.
+    std::unique_ptr<uint8_t[]> ring_;
+    size_t capacity_;
     size_t maxSize_;
+    // The amount of data appended so far. Only used by append().
+    uint64_t appended_;
+    // The position of the oldest record, shifted left by one to hold the
+    // pin bit.
+    std::atomic<uint64_t> head_;
+    // The position past the newest record. Only written by append().
+    std::atomic<uint64_t> tail_;
 };
 
 }  // namespace implementation
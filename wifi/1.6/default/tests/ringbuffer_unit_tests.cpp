@@ -14,8 +14,11 @@
  * limitations under the License.
  */
 
+#include <android-base/file.h>
 #include <gmock/gmock.h>
 
+#include <thread>
+
 #include "ringbuffer.h"
 
 using testing::Return;
@@ -70,6 +73,20 @@ TEST_F(RingbufferTest, MultipleOldDataIsRemovedOnOverflow) {
     EXPECT_EQ(input3, buffer_.getData().front());
 }
 
+TEST_F(RingbufferTest, SmallRecordsAreKeptUpToMaxSize) {
+    for (uint8_t i = 0; i < maxBufferSize_; i++) {
+        ASSERT_EQ(Ringbuffer::AppendStatus::SUCCESS, buffer_.append({i}));
+    }
+    ASSERT_EQ(maxBufferSize_, buffer_.getData().size());
+    EXPECT_EQ(std::vector<uint8_t>({0}), buffer_.getData().front());
+
+    const std::vector<uint8_t> input = {'G'};
+    buffer_.append(input);
+    ASSERT_EQ(maxBufferSize_, buffer_.getData().size());
+    EXPECT_EQ(std::vector<uint8_t>({1}), buffer_.getData().front());
+    EXPECT_EQ(input, buffer_.getData().back());
+}
+
 TEST_F(RingbufferTest, AppendingEmptyBufferDoesNotAddGarbage) {
     const std::vector<uint8_t> input = {};
     buffer_.append(input);
@@ -90,6 +107,59 @@ TEST_F(RingbufferTest, OversizedAppendDoesNotDropExistingData) {
     ASSERT_EQ(1u, buffer_.getData().size());
     EXPECT_EQ(input, buffer_.getData().front());
 }
+
+TEST_F(RingbufferTest, RecordsWrapAroundTheRing) {
+    for (uint8_t i = 0; i < 100; i++) {
+        const std::vector<uint8_t> input(1 + i % 7, i);
+        ASSERT_EQ(Ringbuffer::AppendStatus::SUCCESS, buffer_.append(input));
+        ASSERT_EQ(input, buffer_.getData().back());
+    }
+}
+
+TEST_F(RingbufferTest, WriteToFdWritesDataAndClears) {
+    const std::vector<uint8_t> input(maxBufferSize_ / 2, '0');
+    const std::vector<uint8_t> input2(maxBufferSize_ / 2, '1');
+    const std::vector<uint8_t> input3 = {'G'};
+    buffer_.append(input);
+    buffer_.append(input2);
+    buffer_.append(input3);
+    TemporaryFile file;
+    ASSERT_TRUE(buffer_.writeToFd(file.fd));
+    EXPECT_TRUE(buffer_.empty());
+    std::string content;
+    ASSERT_TRUE(android::base::ReadFileToString(file.path, &content));
+    EXPECT_EQ("11111G", content);
+}
+
+TEST_F(RingbufferTest, AppendDuringWriteToFdKeepsRecordsIntact) {
+    // Each record is its size followed by that many copies of its index.
+    Ringbuffer buffer(4096);
+    std::thread appender([&buffer]() {
+        for (uint32_t i = 0; i < 100000; i++) {
+            std::vector<uint8_t> input(1 + i % 64, static_cast<uint8_t>(i));
+            input[0] = static_cast<uint8_t>(input.size());
+            ASSERT_EQ(Ringbuffer::AppendStatus::SUCCESS, buffer.append(input));
+        }
+    });
+    TemporaryFile file;
+    for (int i = 0; i < 100; i++) {
+        ASSERT_TRUE(buffer.writeToFd(file.fd));
+    }
+    appender.join();
+    ASSERT_TRUE(buffer.writeToFd(file.fd));
+
+    std::string content;
+    ASSERT_TRUE(android::base::ReadFileToString(file.path, &content));
+    for (size_t pos = 0; pos < content.size();) {
+        const size_t size = static_cast<uint8_t>(content[pos]);
+        ASSERT_GT(size, 0u);
+        ASSERT_LE(pos + size, content.size());
+        for (size_t i = 2; i < size; i++) {
+            ASSERT_EQ(content[pos + 1], content[pos + i]);
+        }
+        pos += size;
+    }
+}
 }  // namespace implementation
 }  // namespace V1_6
 }  // namespace wifi
@@ -1286,8 +1286,12 @@ WifiStatus WifiChip::startLoggingToDebugRingBufferInternal(
             getFirstActiveWlanIfaceName(), ring_name,
             static_cast<std::underlying_type<WifiDebugRingBufferVerboseLevel>::type>(verbose_level),
             max_interval_in_sec, min_data_size_in_bytes);
-    ringbuffer_map_.insert(
-            std::pair<std::string, Ringbuffer>(ring_name, Ringbuffer(kMaxBufferSizeBytes)));
+    {
+        std::unique_lock<std::mutex> lk(lock_t);
+        ringbuffer_map_.emplace(std::piecewise_construct, std::forward_as_tuple(ring_name),
+                                std::forward_as_tuple(kMaxBufferSizeBytes));
+        // unique_lock unlocked here
+    }
     // if verbose logging enabled, turn up HAL daemon logging as well.
     if (verbose_level < WifiDebugRingBufferVerboseLevel::VERBOSE) {
         android::base::SetMinimumLogSeverity(android::base::DEBUG);
@@ -1605,7 +1609,7 @@ WifiStatus WifiChip::registerDebugRingBufferCallback() {
 
     android::wp<WifiChip> weak_ptr_this(this);
     const auto& on_ring_buffer_data_callback =
-            [weak_ptr_this](const std::string& name, const std::vector<uint8_t>& data,
+            [weak_ptr_this](const std::string& name, const uint8_t* data, size_t size,
                             const legacy_hal::wifi_ring_buffer_status& status) {
                 const auto shared_ptr_this = weak_ptr_this.promote();
                 if (!shared_ptr_this.get() || !shared_ptr_this->isValid()) {
@@ -1619,17 +1623,17 @@ WifiStatus WifiChip::registerDebugRingBufferCallback() {
                     LOG(ERROR) << "Error converting ring buffer status";
                     return;
                 }
-                {
-                    std::unique_lock<std::mutex> lk(shared_ptr_this->lock_t);
-                    const auto& target = shared_ptr_this->ringbuffer_map_.find(name);
-                    if (target != shared_ptr_this->ringbuffer_map_.end()) {
-                        Ringbuffer& cur_buffer = target->second;
-                        appendstatus = cur_buffer.append(data);
-                    } else {
-                        LOG(ERROR) << "Ringname " << name << " not found";
-                        return;
-                    }
-                    // unique_lock unlocked here
+                // Appended without |lock_t|, which is held while the rings are dumped
+                // to files, as a dump only holds off appends while it copies the ring
+                // out. The global lock, held while legacy HAL callbacks run, still
+                // serializes appends with changes to |ringbuffer_map_|.
+                const auto& target = shared_ptr_this->ringbuffer_map_.find(name);
+                if (target != shared_ptr_this->ringbuffer_map_.end()) {
+                    Ringbuffer& cur_buffer = target->second;
+                    appendstatus = cur_buffer.append(data, size);
+                } else {
+                    LOG(ERROR) << "Ringname " << name << " not found";
+                    return;
                 }
                 if (appendstatus == Ringbuffer::AppendStatus::FAIL_RING_BUFFER_CORRUPTED) {
                     LOG(ERROR) << "Ringname " << name << " is corrupted. Clear the ring buffer";
@@ -1967,7 +1971,7 @@ bool WifiChip::writeRingbufferFilesInternal() {
         std::unique_lock<std::mutex> lk(lock_t);
         for (auto& item : ringbuffer_map_) {
             Ringbuffer& cur_buffer = item.second;
-            if (cur_buffer.getData().empty()) {
+            if (cur_buffer.empty()) {
                 continue;
             }
             const std::string file_path_raw = kTombstoneFolderPath + item.first + "XXXXXXXXXX";
@@ -1977,18 +1981,9 @@ bool WifiChip::writeRingbufferFilesInternal() {
                 return false;
             }
             unique_fd file_auto_closer(dump_fd);
-            for (const auto& cur_block : cur_buffer.getData()) {
-                if (cur_block.size() <= 0 || cur_block.size() > kMaxBufferSizeBytes) {
-                    PLOG(ERROR) << "Ring buffer: " << item.first
-                                << " is corrupted. Invalid block size: " << cur_block.size();
-                    break;
-                }
-                if (write(dump_fd, cur_block.data(), sizeof(cur_block[0]) * cur_block.size()) ==
-                    -1) {
-                    PLOG(ERROR) << "Error writing to file";
-                }
+            if (!cur_buffer.writeToFd(dump_fd)) {
+                LOG(ERROR) << "Error writing ring buffer: " << item.first;
             }
-            cur_buffer.clear();
         }
         // unique_lock unlocked here
     }
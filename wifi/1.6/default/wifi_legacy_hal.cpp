@@ -949,10 +949,9 @@ wifi_error WifiLegacyHal::registerRingBufferCallbackHandler(
     on_ring_buffer_data_internal_callback = [on_user_data_callback](
                                                     char* ring_name, char* buffer, int buffer_size,
                                                     wifi_ring_buffer_status* status) {
-        if (status && buffer) {
-            std::vector<uint8_t> buffer_vector(reinterpret_cast<uint8_t*>(buffer),
-                                               reinterpret_cast<uint8_t*>(buffer) + buffer_size);
-            on_user_data_callback(ring_name, buffer_vector, *status);
+        if (status && buffer && buffer_size >= 0) {
+            on_user_data_callback(ring_name, reinterpret_cast<uint8_t*>(buffer), buffer_size,
+                                  *status);
         }
     };
     wifi_error status = global_func_table_.wifi_set_log_handler(0, getIfaceHandle(iface_name),
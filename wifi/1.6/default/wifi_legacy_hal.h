@@ -420,8 +420,10 @@ using on_rtt_results_callback =
         std::function<void(wifi_request_id, const std::vector<const wifi_rtt_result*>&)>;
 
 // Callback for ring buffer data.
+// The data is only valid during the callback, and must be copied to be
+// retained.
 using on_ring_buffer_data_callback = std::function<void(
-        const std::string&, const std::vector<uint8_t>&, const wifi_ring_buffer_status&)>;
+        const std::string&, const uint8_t*, size_t, const wifi_ring_buffer_status&)>;
 
 // Callback for alerts.
 using on_error_alert_callback = std::function<void(int32_t, const std::vector<uint8_t>&)>;